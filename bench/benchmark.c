@@ -0,0 +1,1264 @@
+/*********************************************************************/
+/*                                                                   */
+/* Benchmarks for the VISA I/O layer, run against the simulated      */
+/* analyzer in visa-sim.c so results do not depend on the bench      */
+/* hardware. Each scenario goes through the same VisaSession calls   */
+/* the program uses.                                                 */
+/*                                                                   */
+/* Usage: benchmark [--rtt-us N] [--quick] [--output FILE]           */
+/*                                                                   */
+/* Results are written as JSON (to stdout unless --output is given)  */
+/* so runs can be compared to track regressions.                     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "visa.h"
+#include "platform.h"
+#include "journal.h"
+#include "visa-session.h"
+#include "sequence.h"
+#include "scheduler.h"
+#include "health.h"
+#include "logger.h"
+#include "scpi-parse.h"
+#include "scpi-template.h"
+#include "scpi-validate.h"
+#include "capability.h"
+#include "remote-capture.h"
+#include "sync-trigger.h"
+#include "snapshot.h"
+#include "session-pool.h"
+#include "resource-registry.h"
+#include "visa-sim.h"
+
+#define BENCH_RESOURCE "SIM0::INSTR"    // Resource the benchmarks open
+#define BENCH_DEFAULT_RTT 50            // Default simulated round trip time in microseconds
+#define BENCH_QUERIES 2000              // Iterations of the query latency scenario
+#define BENCH_WRITES 5000               // Iterations of the write burst scenario
+#define BENCH_DECODES 200               // Iterations of the block decode scenario
+#define BENCH_DECODE_POINTS 24001       // Trace points per decoded block
+#define BENCH_RESPONSE_BYTES 256        // Buffer for ASCII query responses
+#define BENCH_QUICK_DIVISOR 10          // Iteration divisor for --quick
+#define BENCH_FANOUT_INSTRUMENTS 32     // Simulated analyzers driven by the sequence fan-out scenario
+#define BENCH_FANOUT_QUERIES 50         // Queries per analyzer in the sequence fan-out scenario
+#define BENCH_FLEET_BOARDS 4            // GPIB boards in the scheduler fleet scenario
+#define BENCH_FLEET_PER_BOARD 4         // Analyzers on each GPIB board
+#define BENCH_FLEET_LAN 32              // LAN analyzers in the scheduler fleet scenario
+#define BENCH_FLEET_INSTRUMENTS (BENCH_FLEET_BOARDS * BENCH_FLEET_PER_BOARD + BENCH_FLEET_LAN)
+#define BENCH_FLEET_QUERIES 50          // Queries in the test plan of each analyzer
+#define BENCH_FLEET_WORKERS 8           // Worker threads of the parallel fleet run
+#define BENCH_ARBITRATION_MS 500        // Duration of the bus arbitration scenario
+#define BENCH_ARBITRATION_THREADS 8     // Threads in the bus arbitration scenario, half on GPIB0 and half on the LAN
+#define BENCH_ADAPTIVE_RESOURCE "SIM1::INSTR"   // Analyzer that hangs in the adaptive timeout scenario
+#define BENCH_ADAPTIVE_TIMEOUT 1000     // Session timeout of the adaptive timeout scenario in milliseconds
+#define BENCH_ADAPTIVE_QUERIES 200      // Queries that train the adaptive timeout
+#define BENCH_RECONNECT_DOWN_MS 300     // How long the analyzer is unreachable in the reconnect scenario
+#define BENCH_RECONNECT_PROBE_MS 50     // Probe interval of the health monitor in the reconnect scenario
+#define BENCH_RECONNECT_LIMIT_MS 5000   // Time after which the reconnect scenario gives up
+#define BENCH_CHECKED_WRITES 1000       // Setting commands per variant of the checked write scenario
+#define BENCH_MULTI_MARKER_POINTS 1601  // Trace points of the multi-marker scenario
+#define BENCH_FORMATS 1000000           // Commands rendered per variant of the command format scenario
+#define BENCH_LOG_CALLS 1000000         // Disabled log calls timed by the logging scenario
+#define BENCH_LOG_BURSTS 50             // Bursts of enabled log calls, each half a queue long
+#define BENCH_LOG_PAUSE_MS 10           // Pause between bursts that lets the writer thread catch up
+#define BENCH_SETUP_STEPS 200           // Test steps per variant of the differential setup scenario
+#define BENCH_SWITCHES 200              // Instrument switches per variant of the session switch scenario
+#define BENCH_SWITCH_INSTRUMENTS 4      // Analyzers switched between, SIM0 to SIM<n-1>
+#define BENCH_REGISTRY_RESOURCES 4096   // LAN resources in the resource registry scenario
+#define BENCH_REGISTRY_LOOKUPS 200000   // Lookups per variant of the resource registry scenario
+#define BENCH_TYPO_TIMEOUT 500          // Session timeout of the typo detection scenario in milliseconds
+#define BENCH_TYPO_QUERIES 2000         // Queries per variant of the typo detection scenario
+#define BENCH_TYPO_COMMANDS 2000        // Synthetic header patterns in the command list, besides the real ones
+#define BENCH_CAPABILITY_RESOURCE "SIM2::INSTR" // Analyzer of the capability scenario, left in its own state
+#define BENCH_CAPABILITY_POINTS 1601    // Trace points of the capability scenario
+#define BENCH_CAPABILITY_CAPTURES 20    // Captures per variant of the capability scenario
+#define BENCH_CAPABILITY_LOOKUPS 100000 // Lookups of the probed profile in the capability scenario
+#define BENCH_REMOTE_AGENTS 4           // Agents on localhost in the distributed capture scenario
+#define BENCH_REMOTE_ANALYZERS 2        // Analyzers per agent, SIM16 upwards
+#define BENCH_REMOTE_TRACES 10          // Traces per analyzer in the distributed capture scenario
+#define BENCH_REMOTE_POINTS 1601        // Trace points in the distributed capture scenario
+#define BENCH_SYNC_INSTRUMENTS 8        // Analyzers triggered together, SIM24 upwards
+#define BENCH_SYNC_ROUNDS 50            // Triggers per variant of the synchronized trigger scenario
+
+static const int markerWalkPoints[] = { 101, 401, 1601, 6001, 24001 };
+
+static ViSession defaultRM;
+static VisaSession* session;
+static int quick;
+static FILE* out;
+static int firstResult = 1;
+
+static int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns the value at a percentile of a sorted array.
+ */
+static double percentile(const double* sorted, int count, double pct) {
+    int i = (int)(pct / 100.0 * (count - 1) + 0.5);
+    return sorted[i];
+}
+
+static int iterations(int count) {
+    return quick ? count / BENCH_QUICK_DIVISOR : count;
+}
+
+/**
+ * @brief Starts a result object in the JSON output.
+ */
+static void beginResult(const char* name) {
+    fprintf(out, "%s\n    { \"name\": \"%s\"", firstResult ? "" : ",", name);
+    firstResult = 0;
+}
+
+/**
+ * @brief Round trip latency of a short query (*OPC?), reported as mean, median and 99th percentile.
+ */
+static int benchQueryLatency() {
+    int n = iterations(BENCH_QUERIES);
+    double* samples = malloc(sizeof(double) * n);
+    char response[BENCH_RESPONSE_BYTES];
+    double total = 0;
+
+    for (int i = 0; i < n; i++) {
+        unsigned long long start = monotonicMicros();
+        if (sessionQuery(session, "*OPC?", response, sizeof(response), NULL) < VI_SUCCESS) {
+            free(samples);
+            return 1;
+        }
+        samples[i] = (double)(monotonicMicros() - start);
+        total += samples[i];
+    }
+    qsort(samples, n, sizeof(double), compareDouble);
+
+    beginResult("query_latency");
+    fprintf(out, ", \"iterations\": %d, \"mean_us\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f }",
+        n, total / n, percentile(samples, n, 50), percentile(samples, n, 99), samples[n - 1]);
+    free(samples);
+    return 0;
+}
+
+/**
+ * @brief Throughput of unacknowledged setting commands written back to back.
+ */
+static int benchWriteBurst() {
+    int n = iterations(BENCH_WRITES);
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n; i++) {
+        if (sessionWritef(session, ":CALC:MARK1:X %f", 1e9 + i * 1e3) < VI_SUCCESS)
+            return 1;
+    }
+    double seconds = (monotonicMicros() - start) / 1e6;
+
+    beginResult("write_burst");
+    fprintf(out, ", \"iterations\": %d, \"seconds\": %.4f, \"ops_per_s\": %.1f }", n, seconds, n / seconds);
+    return 0;
+}
+
+/**
+ * @brief Trace capture by walking marker 1 across the span, as visaGetTraceFromMarkers() does.
+ */
+static int benchMarkerWalk(int numPoints) {
+    MarkerSetup setup;
+
+    if (quick && numPoints > 1601)
+        return 0;
+    if (sessionWrite(session, ":FREQ:STAR 1e9;:FREQ:STOP 2e9") < VI_SUCCESS
+        || sessionPrepareMarkerCapture(session, &setup) < VI_SUCCESS)
+        return 1;
+
+    double* freq = malloc(sizeof(double) * numPoints);
+    double* amp = malloc(sizeof(double) * numPoints);
+    unsigned long long start = monotonicMicros();
+    ViStatus status = sessionCaptureMarkers(session, &setup, numPoints, freq, amp);
+    double seconds = (monotonicMicros() - start) / 1e6;
+    sessionFinishMarkerCapture(session);
+    free(freq);
+    free(amp);
+    if (status < VI_SUCCESS)
+        return 1;
+
+    char name[32];
+    sprintf(name, "marker_walk_%d", numPoints);
+    beginResult(name);
+    fprintf(out, ", \"points\": %d, \"markers\": %d, \"seconds\": %.4f, \"points_per_s\": %.1f }", numPoints,
+        setup.numMarkers, seconds, numPoints / seconds);
+    return 0;
+}
+
+/**
+ * @brief Marker capture moving only marker 1 versus all markers of the analyzer per round trip.
+ */
+static int benchMultiMarker() {
+    int numPoints = BENCH_MULTI_MARKER_POINTS;
+    MarkerSetup setup;
+    double seconds[2];
+
+    if (sessionWrite(session, ":FREQ:STAR 1e9;:FREQ:STOP 2e9") < VI_SUCCESS
+        || sessionPrepareMarkerCapture(session, &setup) < VI_SUCCESS)
+        return 1;
+    int numMarkers = setup.numMarkers;
+    double* freq = malloc(sizeof(double) * numPoints);
+    double* amp = malloc(sizeof(double) * numPoints);
+    ViStatus status = VI_SUCCESS;
+    for (int i = 0; i < 2 && status >= VI_SUCCESS; i++) {
+        setup.numMarkers = i == 0 ? 1 : numMarkers;
+        unsigned long long start = monotonicMicros();
+        status = sessionCaptureMarkers(session, &setup, numPoints, freq, amp);
+        seconds[i] = (monotonicMicros() - start) / 1e6;
+    }
+    sessionFinishMarkerCapture(session);
+    free(freq);
+    free(amp);
+    if (status < VI_SUCCESS)
+        return 1;
+
+    beginResult("multi_marker");
+    fprintf(out, ", \"points\": %d, \"markers\": %d, \"single_seconds\": %.4f, \"multi_seconds\": %.4f, \"speedup\": %.2f }",
+        numPoints, numMarkers, seconds[0], seconds[1], seconds[0] / seconds[1]);
+    return 0;
+}
+
+/**
+ * @brief Cost of building a marker command with snprintf() versus a precompiled template, in nanoseconds per command.
+ * Also counts commands where the two differ.
+ */
+static int benchCommandFormat() {
+    int n = iterations(BENCH_FORMATS);
+    char formatted[BENCH_RESPONSE_BYTES], rendered[BENCH_RESPONSE_BYTES];
+    ScpiTemplate tmpl;
+    unsigned long checksum = 0;
+    int mismatches = 0;
+
+    if (templateCompile(&tmpl, ":CALC:MARK%d:X %f") != 0)
+        return 1;
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n; i++)
+        checksum += snprintf(formatted, sizeof(formatted), ":CALC:MARK%d:X %f", i % 12 + 1, 1e9 + i * 1.25e3);
+    double printfNs = (monotonicMicros() - start) * 1e3 / n;
+
+    start = monotonicMicros();
+    for (int i = 0; i < n; i++)
+        checksum += templateRender(&tmpl, rendered, sizeof(rendered), i % 12 + 1, 1e9 + i * 1.25e3);
+    double templateNs = (monotonicMicros() - start) * 1e3 / n;
+
+    for (int i = 0; i < n; i += 97) {
+        snprintf(formatted, sizeof(formatted), ":CALC:MARK%d:X %f", i % 12 + 1, 1e9 + i * 1.25e3);
+        templateRender(&tmpl, rendered, sizeof(rendered), i % 12 + 1, 1e9 + i * 1.25e3);
+        mismatches += strcmp(formatted, rendered) != 0;
+    }
+    if (checksum == 0)
+        return 1;
+
+    beginResult("command_format");
+    fprintf(out, ", \"iterations\": %d, \"snprintf_ns\": %.1f, \"template_ns\": %.1f, \"speedup\": %.2f, \"mismatches\": %d }",
+        n, printfNs, templateNs, printfNs / templateNs, mismatches);
+    return 0;
+}
+
+/**
+ * @brief Cost of a log call on the I/O path: disabled, enabled with the record queued for the writer thread, and an
+ * fprintf() of the same line for comparison.
+ */
+static int benchLogging() {
+    int n = iterations(BENCH_LOG_CALLS);
+    int bursts = iterations(BENCH_LOG_BURSTS);
+    int burst = LOG_QUEUE_SIZE / 2;
+    const char* command = ":CALC:MARK1:X 1000000000.000000";
+    size_t length = strlen(command);
+    FILE* sink = tmpfile();
+    if (sink == NULL)
+        return 1;
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n; i++)
+        LOG_TEXT(LOG_DEBUG, "visa.write", BENCH_RESOURCE, command, length);
+    double disabledNs = (monotonicMicros() - start) * 1e3 / n;
+
+    if (logStart(sink, LOG_DEBUG) != 0) {
+        fclose(sink);
+        return 1;
+    }
+    unsigned long long elapsed = 0;
+    for (int b = 0; b < bursts; b++) {
+        start = monotonicMicros();
+        for (int i = 0; i < burst; i++)
+            LOG_TEXT(LOG_DEBUG, "visa.write", BENCH_RESOURCE, command, length);
+        elapsed += monotonicMicros() - start;
+        sleepMs(BENCH_LOG_PAUSE_MS);
+    }
+    unsigned long dropped = logDropped();
+    logStop();
+    double enabledNs = elapsed * 1e3 / ((double)bursts * burst);
+
+    start = monotonicMicros();
+    for (int i = 0; i < bursts * burst; i++)
+        fprintf(sink, "t=%.6f level=debug event=visa.write subject=%s text=\"%s\"\n", i / 1e6, BENCH_RESOURCE, command);
+    fflush(sink);
+    double fprintfNs = (monotonicMicros() - start) * 1e3 / ((double)bursts * burst);
+    fclose(sink);
+
+    beginResult("logging");
+    fprintf(out, ", \"iterations\": %d, \"disabled_ns\": %.2f, \"enabled_ns\": %.1f, \"fprintf_ns\": %.1f, \"dropped\": %lu }",
+        bursts * burst, disabledNs, enabledNs, fprintfNs, dropped);
+    return 0;
+}
+
+/**
+ * @brief Decode throughput of REAL,32 definite length blocks, in memory and end to end through :TRACe:DATA?.
+ */
+static int benchBlockDecode() {
+    int n = iterations(BENCH_DECODES);
+    size_t blockSize = 16 + (size_t)BENCH_DECODE_POINTS * 4;
+    unsigned char* block = malloc(blockSize);
+    float* values = malloc(sizeof(float) * BENCH_DECODE_POINTS);
+    size_t offset, length;
+    int status = 1;
+
+    for (int i = 0; i < BENCH_DECODE_POINTS; i++)
+        values[i] = -90.0f + (float)(i % 100);
+    size_t encoded = scpiEncodeReal32(values, BENCH_DECODE_POINTS, 1, block, blockSize);
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n; i++) {
+        if (scpiBlockHeader(block, encoded, &offset, &length) != 0)
+            goto done;
+        scpiDecodeReal32(block + offset, length, 1, values, BENCH_DECODE_POINTS);
+    }
+    double seconds = (monotonicMicros() - start) / 1e6;
+    beginResult("block_decode");
+    fprintf(out, ", \"iterations\": %d, \"points\": %d, \"seconds\": %.4f, \"mb_per_s\": %.1f }",
+        n, BENCH_DECODE_POINTS, seconds, n * (double)encoded / seconds / 1e6);
+
+    /* End to end: the simulator formats the block and it is read in chunks through the VISA layer */
+    ViUInt32 count;
+    if (sessionWritef(session, ":SWE:POIN %d;:FORM REAL,32;:FORM:BORD NORM", BENCH_DECODE_POINTS) < VI_SUCCESS)
+        goto done;
+
+    int transfers = iterations(BENCH_DECODES) / 10 + 1;
+    start = monotonicMicros();
+    for (int i = 0; i < transfers; i++) {
+        size_t received = 0;
+        ViStatus readStatus;
+        sessionLock(session);
+        readStatus = sessionWrite(session, ":TRAC:DATA? TRACE1");
+        while (readStatus >= VI_SUCCESS) {
+            readStatus = journalViRead(sessionHandle(session), block + received, (ViUInt32)(blockSize - received), &count);
+            received += readStatus < VI_SUCCESS ? 0 : count;
+            if (readStatus != VI_SUCCESS_MAX_CNT || received == blockSize)
+                break;
+        }
+        sessionUnlock(session);
+        if (readStatus < VI_SUCCESS)
+            goto done;
+        if (scpiBlockHeader(block, received, &offset, &length) != 0)
+            goto done;
+        scpiDecodeReal32(block + offset, length, 1, values, BENCH_DECODE_POINTS);
+    }
+    seconds = (monotonicMicros() - start) / 1e6;
+    beginResult("trace_transfer");
+    fprintf(out, ", \"iterations\": %d, \"points\": %d, \"seconds\": %.4f, \"traces_per_s\": %.1f }",
+        transfers, BENCH_DECODE_POINTS, seconds, transfers / seconds);
+    status = 0;
+
+done:
+    free(block);
+    free(values);
+    return status;
+}
+
+/* Sequence of the fan-out scenario: a setup write, then queries counted in the context */
+static int fanoutSequence(Sequence* seq) {
+    int* remaining = seq->context;
+
+    SEQ_BEGIN(seq);
+    SEQ_WRITE(seq, ":CALC:MARK1:STAT ON");
+    while (*remaining > 0) {
+        SEQ_QUERY(seq, ":CALC:MARK1:Y?");
+        (*remaining)--;
+    }
+    SEQ_END(seq);
+}
+
+/**
+ * @brief Many analyzers each running a short query sequence: one after another with blocking calls, then all at once
+ * on a single thread with the event loop.
+ */
+static int benchSequenceFanout() {
+    VisaSession* sessions[BENCH_FANOUT_INSTRUMENTS];
+    Sequence sequences[BENCH_FANOUT_INSTRUMENTS];
+    int remaining[BENCH_FANOUT_INSTRUMENTS];
+    char resource[VI_FIND_BUFLEN];
+    char response[BENCH_RESPONSE_BYTES];
+    int queries = iterations(BENCH_FANOUT_QUERIES);
+    int numOpen = 0;
+    int status = 1;
+
+    for (; numOpen < BENCH_FANOUT_INSTRUMENTS; numOpen++) {
+        sprintf(resource, "SIM%d::INSTR", numOpen);
+        if ((sessions[numOpen] = sessionOpen(defaultRM, resource, VISA_SIM_DEFAULT_TIMEOUT, NULL)) == NULL)
+            goto done;
+    }
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < numOpen; i++) {
+        if (sessionWrite(sessions[i], ":CALC:MARK1:STAT ON") < VI_SUCCESS)
+            goto done;
+        for (int j = 0; j < queries; j++) {
+            if (sessionQuery(sessions[i], ":CALC:MARK1:Y?", response, sizeof(response), NULL) < VI_SUCCESS)
+                goto done;
+        }
+    }
+    double sequential = (monotonicMicros() - start) / 1e6;
+
+    EventLoop loop;
+    loopInit(&loop);
+    for (int i = 0; i < numOpen; i++) {
+        remaining[i] = queries;
+        loopAdd(&loop, &sequences[i], fanoutSequence, sessions[i], &remaining[i]);
+    }
+    start = monotonicMicros();
+    int failed = loopRun(&loop);
+    double multiplexed = (monotonicMicros() - start) / 1e6;
+    if (failed > 0)
+        goto done;
+
+    beginResult("sequence_fanout");
+    fprintf(out, ", \"instruments\": %d, \"queries\": %d, \"sequential_s\": %.4f, \"event_loop_s\": %.4f, \"speedup\": %.1f }",
+        numOpen, queries, sequential, multiplexed, sequential / multiplexed);
+    status = 0;
+
+done:
+    for (int i = 0; i < numOpen; i++)
+        sessionClose(sessions[i]);
+    return status;
+}
+
+typedef struct {
+    VisaSession* session;
+    int bus;                            // Index of the GPIB board, or -1 for LAN
+    int queries;
+    int failed;
+} FleetStation;
+
+static PlatformMutex fleetMutex;
+static int fleetActive[BENCH_FLEET_BOARDS];     // Jobs currently running on each board
+static int fleetOverlaps;                       // Times two jobs ran on one board at once
+
+static void fleetTestPlan(void* arg) {
+    FleetStation* station = arg;
+    char response[BENCH_RESPONSE_BYTES];
+
+    if (station->bus >= 0) {
+        mutexLock(&fleetMutex);
+        if (++fleetActive[station->bus] > 1)
+            fleetOverlaps++;
+        mutexUnlock(&fleetMutex);
+    }
+    for (int i = 0; i < station->queries && !station->failed; i++)
+        station->failed = sessionQuery(station->session, ":CALC:MARK1:Y?", response, sizeof(response), NULL) < VI_SUCCESS;
+    if (station->bus >= 0) {
+        mutexLock(&fleetMutex);
+        fleetActive[station->bus]--;
+        mutexUnlock(&fleetMutex);
+    }
+}
+
+/* Runs the test plan of every station on a pool of workers. Returns the elapsed seconds, or -1 on error */
+static double runFleet(FleetStation* stations, int workers, unsigned long* stolen) {
+    unsigned long executed;
+    char bus[SCHEDULER_BUS_NAME];
+    Scheduler* scheduler = schedulerCreate(workers);
+    if (scheduler == NULL)
+        return -1;
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < BENCH_FLEET_INSTRUMENTS; i++) {
+        sessionSharedBus(stations[i].session, bus, sizeof(bus));
+        schedulerSubmit(scheduler, bus, fleetTestPlan, &stations[i]);
+    }
+    schedulerWait(scheduler);
+    double seconds = (monotonicMicros() - start) / 1e6;
+    schedulerStats(scheduler, &executed, stolen);
+    schedulerDestroy(scheduler);
+    return executed == BENCH_FLEET_INSTRUMENTS ? seconds : -1;
+}
+
+/* Simulated resource of a fleet station: the first ones share GPIB boards, the rest are on the LAN */
+static void fleetResource(int index, char* resource) {
+    if (index < BENCH_FLEET_BOARDS * BENCH_FLEET_PER_BOARD)
+        sprintf(resource, "GPIB%d::%d::INSTR", index / BENCH_FLEET_PER_BOARD, index % BENCH_FLEET_PER_BOARD + 1);
+    else
+        sprintf(resource, "TCPIP0::10.0.0.%d::INSTR", index + 1);
+}
+
+/**
+ * @brief A fleet of analyzers, some sharing GPIB boards, each running a test plan: on one worker, then on a
+ * work-stealing pool that never runs two jobs on one board at once.
+ */
+static int benchSchedulerFleet() {
+    FleetStation stations[BENCH_FLEET_INSTRUMENTS];
+    char resource[VI_FIND_BUFLEN];
+    unsigned long stolenSerial, stolen;
+    int numOpen = 0;
+    int status = 1;
+
+    mutexInit(&fleetMutex);
+    fleetOverlaps = 0;
+    for (; numOpen < BENCH_FLEET_INSTRUMENTS; numOpen++) {
+        fleetResource(numOpen, resource);
+        stations[numOpen].session = sessionOpen(defaultRM, resource, VISA_SIM_DEFAULT_TIMEOUT, NULL);
+        if (stations[numOpen].session == NULL)
+            goto done;
+        stations[numOpen].bus = numOpen < BENCH_FLEET_BOARDS * BENCH_FLEET_PER_BOARD ? numOpen / BENCH_FLEET_PER_BOARD : -1;
+        stations[numOpen].queries = iterations(BENCH_FLEET_QUERIES);
+        stations[numOpen].failed = 0;
+    }
+
+    double serial = runFleet(stations, 1, &stolenSerial);
+    double parallel = runFleet(stations, BENCH_FLEET_WORKERS, &stolen);
+    for (int i = 0; i < numOpen; i++) {
+        if (stations[i].failed)
+            serial = -1;
+    }
+    if (serial < 0 || parallel < 0)
+        goto done;
+
+    beginResult("scheduler_fleet");
+    fprintf(out, ", \"instruments\": %d, \"gpib_boards\": %d, \"workers\": %d, \"serial_s\": %.4f, \"parallel_s\": %.4f, "
+        "\"speedup\": %.1f, \"stolen\": %lu, \"bus_overlaps\": %d }",
+        numOpen, BENCH_FLEET_BOARDS, BENCH_FLEET_WORKERS, serial, parallel, serial / parallel, stolen, fleetOverlaps);
+    status = fleetOverlaps != 0;
+
+done:
+    for (int i = 0; i < numOpen; i++)
+        sessionClose(stations[i].session);
+    mutexDestroy(&fleetMutex);
+    return status;
+}
+
+typedef struct {
+    VisaSession* session;
+    unsigned long long deadline;
+    int queries;
+    int failed;
+} ArbitrationClient;
+
+static THREAD_FUNC arbitrationThread(void* arg) {
+    ArbitrationClient* client = arg;
+    char response[BENCH_RESPONSE_BYTES];
+    while (!client->failed && monotonicMicros() < client->deadline) {
+        client->failed = sessionQuery(client->session, ":CALC:MARK1:Y?", response, sizeof(response), NULL) < VI_SUCCESS;
+        client->queries++;
+    }
+    return THREAD_RETURN;
+}
+
+/**
+ * @brief One thread per analyzer, half of them sharing GPIB board 0 and half on the LAN, querying for a fixed time.
+ * Reports the throughput of each group, how evenly the board was shared and any transfers that collided on it.
+ */
+static int benchBusArbitration() {
+    ArbitrationClient clients[BENCH_ARBITRATION_THREADS];
+    PlatformThread threads[BENCH_ARBITRATION_THREADS];
+    char resource[VI_FIND_BUFLEN];
+    int half = BENCH_ARBITRATION_THREADS / 2;
+    int numOpen = 0;
+    int status = 1;
+
+    for (; numOpen < BENCH_ARBITRATION_THREADS; numOpen++) {
+        fleetResource(numOpen < half ? numOpen : BENCH_FLEET_BOARDS * BENCH_FLEET_PER_BOARD + numOpen - half, resource);
+        clients[numOpen].session = sessionOpen(defaultRM, resource, VISA_SIM_DEFAULT_TIMEOUT, NULL);
+        if (clients[numOpen].session == NULL)
+            goto done;
+        clients[numOpen].queries = 0;
+        clients[numOpen].failed = 0;
+    }
+
+    unsigned long collisions = visaSimBusCollisions();
+    unsigned long long deadline = monotonicMicros() + (unsigned long long)iterations(BENCH_ARBITRATION_MS) * 1000;
+    for (int i = 0; i < numOpen; i++) {
+        clients[i].deadline = deadline;
+        threadCreate(&threads[i], arbitrationThread, &clients[i]);
+    }
+    for (int i = 0; i < numOpen; i++)
+        threadJoin(threads[i]);
+    collisions = visaSimBusCollisions() - collisions;
+
+    int gpib = 0, lan = 0, fewest = clients[0].queries, most = clients[0].queries;
+    for (int i = 0; i < numOpen; i++) {
+        if (clients[i].failed)
+            goto done;
+        if (i < half) {
+            gpib += clients[i].queries;
+            fewest = clients[i].queries < fewest ? clients[i].queries : fewest;
+            most = clients[i].queries > most ? clients[i].queries : most;
+        }
+        else {
+            lan += clients[i].queries;
+        }
+    }
+    double seconds = iterations(BENCH_ARBITRATION_MS) / 1e3;
+    beginResult("bus_arbitration");
+    fprintf(out, ", \"threads\": %d, \"seconds\": %.3f, \"gpib_queries_per_s\": %.1f, \"lan_queries_per_s\": %.1f, "
+        "\"gpib_fairness\": %.2f, \"bus_collisions\": %lu }",
+        numOpen, seconds, gpib / seconds, lan / seconds, most > 0 ? (double)fewest / most : 0, collisions);
+    status = collisions != 0;
+
+done:
+    for (int i = 0; i < numOpen; i++)
+        sessionClose(clients[i].session);
+    return status;
+}
+
+/* Times one query to a hung analyzer, in milliseconds */
+static double timeHungQuery(VisaSession* hung) {
+    char response[BENCH_RESPONSE_BYTES];
+    unsigned long long start = monotonicMicros();
+    ViStatus status = sessionQuery(hung, ":CALC:MARK1:Y?", response, sizeof(response), NULL);
+    return status == VI_ERROR_TMO ? (monotonicMicros() - start) / 1e3 : -1;
+}
+
+/**
+ * @brief How long a query to an analyzer that stopped responding takes to fail, with the fixed session timeout and with
+ * a timeout adapted to the latencies of earlier queries.
+ */
+static int benchAdaptiveTimeout() {
+    char response[BENCH_RESPONSE_BYTES];
+    int n = iterations(BENCH_ADAPTIVE_QUERIES);
+    double total = 0;
+    VisaSession* hung = sessionOpen(defaultRM, BENCH_ADAPTIVE_RESOURCE, BENCH_ADAPTIVE_TIMEOUT, NULL);
+    if (hung == NULL)
+        return 1;
+
+    sessionSetAdaptiveTimeout(hung, 1);
+    for (int i = 0; i < n; i++) {
+        unsigned long long start = monotonicMicros();
+        if (sessionQuery(hung, ":CALC:MARK1:Y?", response, sizeof(response), NULL) < VI_SUCCESS) {
+            sessionClose(hung);
+            return 1;
+        }
+        total += (monotonicMicros() - start) / 1e3;
+    }
+
+    visaSimSetResponding(BENCH_ADAPTIVE_RESOURCE, 0);
+    double adaptive = timeHungQuery(hung);
+    sessionSetAdaptiveTimeout(hung, 0);
+    double fixed = timeHungQuery(hung);
+    visaSimSetResponding(BENCH_ADAPTIVE_RESOURCE, 1);
+    sessionClose(hung);
+    if (adaptive < 0 || fixed < 0)
+        return 1;
+
+    beginResult("adaptive_timeout");
+    fprintf(out, ", \"training_queries\": %d, \"mean_latency_ms\": %.3f, \"fixed_detect_ms\": %.1f, \"adaptive_detect_ms\": %.1f }",
+        n, total / n, fixed, adaptive);
+    return 0;
+}
+
+/**
+ * @brief A LAN analyzer reboots while it is being queried. Reports how soon queries succeed again once the health
+ * monitor has reopened the session, and how quickly the queries made while it was down failed.
+ */
+static int benchReconnect() {
+    char resource[VI_FIND_BUFLEN];
+    char response[BENCH_RESPONSE_BYTES];
+    int failures = 0;
+    double slowestFailure = 0;
+    unsigned long probes, reconnects;
+
+    fleetResource(BENCH_FLEET_BOARDS * BENCH_FLEET_PER_BOARD + BENCH_ARBITRATION_THREADS / 2, resource);
+    VisaSession* lan = sessionOpen(defaultRM, resource, VISA_SIM_DEFAULT_TIMEOUT, NULL);
+    HealthMonitor* monitor = healthStart(BENCH_RECONNECT_PROBE_MS);
+    if (lan == NULL || monitor == NULL || healthWatch(monitor, lan) != 0) {
+        healthStop(monitor);
+        sessionClose(lan);
+        return 1;
+    }
+
+    unsigned long long restart = monotonicMicros();
+    visaSimRestart(resource, BENCH_RECONNECT_DOWN_MS);
+    ViStatus status;
+    for (;;) {
+        unsigned long long start = monotonicMicros();
+        status = sessionQuery(lan, "*IDN?", response, sizeof(response), NULL);
+        if (status >= VI_SUCCESS || start - restart > (unsigned long long)BENCH_RECONNECT_LIMIT_MS * 1000)
+            break;
+        double elapsed = (monotonicMicros() - start) / 1e3;
+        slowestFailure = elapsed > slowestFailure ? elapsed : slowestFailure;
+        failures++;
+        sleepMs(1);
+    }
+    double recovery = (monotonicMicros() - restart) / 1e3;
+    healthStats(monitor, &probes, &reconnects);
+    healthUnwatch(monitor, lan);
+    healthStop(monitor);
+    sessionClose(lan);
+    if (status < VI_SUCCESS)
+        return 1;
+
+    beginResult("reconnect");
+    fprintf(out, ", \"down_ms\": %d, \"recovery_ms\": %.1f, \"failed_queries\": %d, \"slowest_failure_ms\": %.3f, "
+        "\"reconnects\": %lu }", BENCH_RECONNECT_DOWN_MS, recovery, failures, slowestFailure, reconnects);
+    return 0;
+}
+
+/* Writes n setting commands, each followed by its own :SYST:ERR? query if separate is set. Returns seconds, or -1 */
+static double timeCheckedWrites(int n, int separate) {
+    char response[BENCH_RESPONSE_BYTES];
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n; i++) {
+        if (sessionWritef(session, ":CALC:MARK1:X %f", 1e9 + i * 1e3) < VI_SUCCESS
+            || (separate && sessionQuery(session, ":SYST:ERR?", response, sizeof(response), NULL) < VI_SUCCESS))
+            return -1;
+    }
+    return (monotonicMicros() - start) / 1e6;
+}
+
+/**
+ * @brief Cost of SCPI error checking on setting commands: a separate :SYST:ERR? query after each write, the query
+ * batched into each write by checked mode, and unchecked writes with one bulk drain of the error queue at the end.
+ */
+static int benchCheckedWrites() {
+    int n = iterations(BENCH_CHECKED_WRITES);
+    int numErrors;
+
+    double separate = timeCheckedWrites(n, 1);
+    sessionSetChecked(session, 1);
+    double checked = timeCheckedWrites(n, 0);
+    int detected = sessionWrite(session, ":CALC:MARK1:BOGUS 1") == SESSION_ERROR_SCPI;
+    sessionSetChecked(session, 0);
+    unsigned long long start = monotonicMicros();
+    int clean = timeCheckedWrites(n, 0) >= 0 && sessionDrainErrors(session, NULL, 0, &numErrors) >= VI_SUCCESS
+        && numErrors == 0;
+    double drained = (monotonicMicros() - start) / 1e6;
+    if (separate < 0 || checked < 0 || !clean || !detected)
+        return 1;
+
+    beginResult("checked_writes");
+    fprintf(out, ", \"iterations\": %d, \"separate_ops_per_s\": %.1f, \"checked_ops_per_s\": %.1f, "
+        "\"drained_ops_per_s\": %.1f }", n, n / separate, n / checked, n / drained);
+    return 0;
+}
+
+/* Setup commands of two test steps that differ only in their span */
+static const char* setupSteps[2][8] = {
+    { ":SENSe:FREQuency:STARt 1e9", ":SENSe:FREQuency:STOP 2e9", ":SENSe:BANDwidth:RESolution 1e6",
+        ":SENSe:BANDwidth:VIDeo 1e6", ":SENSe:SWEep:POINts 1001", ":INITiate:CONTinuous OFF",
+        ":CALCulate:MARKer1:FUNCtion BPower", ":CALCulate:MARKer1:MODE POSition" },
+    { ":SENSe:FREQuency:STARt 1.1e9", ":SENSe:FREQuency:STOP 1.9e9", ":SENSe:BANDwidth:RESolution 1e6",
+        ":SENSe:BANDwidth:VIDeo 1e6", ":SENSe:SWEep:POINts 1001", ":INITiate:CONTinuous OFF",
+        ":CALCulate:MARKer1:FUNCtion BPower", ":CALCulate:MARKer1:MODE POSition" }
+};
+
+/**
+ * @brief Repeated test steps that alternate between two setups: every command sent each step versus only the settings
+ * that differ from the session's snapshot, after one capture of the instrument's state.
+ */
+static int benchDifferentialSetup() {
+    static const char* patterns[] = { "[:SENSe]:FREQuency:STARt", "[:SENSe]:FREQuency:STOP",
+        "[:SENSe]:BANDwidth[:RESolution]", "[:SENSe]:BANDwidth:VIDeo", "[:SENSe]:SWEep:POINts", ":INITiate:CONTinuous",
+        ":CALCulate:MARKer#:FUNCtion", ":CALCulate:MARKer#:MODE" };
+    int n = iterations(BENCH_SETUP_STEPS);
+    int numCommands = sizeof(setupSteps[0]) / sizeof(setupSteps[0][0]);
+    ViStatus status = VI_SUCCESS;
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++) {
+        for (int j = 0; j < numCommands && status >= VI_SUCCESS; j++)
+            status = sessionWrite(session, setupSteps[i % 2][j]);
+    }
+    double fullUs = (monotonicMicros() - start) / (double)n;
+
+    StateSnapshot* snapshot = sessionSnapshot(session);
+    if (snapshot == NULL || status < VI_SUCCESS)
+        return 1;
+    for (int j = 0; j < numCommands; j++)
+        snapshotTrack(snapshot, patterns[j], j < 6 ? -1 : 1);
+    unsigned long sentBefore = snapshot->sent;
+    start = monotonicMicros();
+    status = snapshotCapture(session, snapshot);
+    double captureUs = (double)(monotonicMicros() - start);
+    start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++)
+        status = snapshotApply(session, snapshot, setupSteps[i % 2], numCommands, NULL);
+    double diffUs = (monotonicMicros() - start) / (double)n;
+    if (status < VI_SUCCESS)
+        return 1;
+
+    beginResult("differential_setup");
+    fprintf(out, ", \"steps\": %d, \"commands_per_step\": %d, \"full_us_per_step\": %.1f, \"capture_us\": %.1f, "
+        "\"diff_us_per_step\": %.1f, \"diff_commands_per_step\": %.2f, \"speedup\": %.2f }", n, numCommands, fullUs,
+        captureUs, diffUs, (double)(snapshot->sent - sentBefore) / n, fullUs / diffUs);
+    return 0;
+}
+
+/**
+ * @brief Switching between analyzers with one *IDN? query each: a session opened and closed per switch, as the menu
+ * used to, versus sessions kept open in a pool.
+ */
+static int benchSessionSwitch() {
+    int n = iterations(BENCH_SWITCHES);
+    char resource[VI_FIND_BUFLEN], response[BENCH_RESPONSE_BYTES];
+    unsigned long hits, misses, evictions;
+    ViStatus status = VI_SUCCESS;
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++) {
+        sprintf(resource, "SIM%d::INSTR", i % BENCH_SWITCH_INSTRUMENTS);
+        VisaSession* switched = sessionOpen(defaultRM, resource, VISA_SIM_DEFAULT_TIMEOUT, &status);
+        if (switched != NULL)
+            status = sessionQuery(switched, "*IDN?", response, sizeof(response), NULL);
+        sessionClose(switched);
+    }
+    double reopenUs = (monotonicMicros() - start) / (double)n;
+
+    SessionPool* pool = poolCreate(defaultRM, POOL_DEFAULT_CAPACITY, VISA_SIM_DEFAULT_TIMEOUT);
+    if (pool == NULL || status < VI_SUCCESS)
+        return 1;
+    start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++) {
+        sprintf(resource, "SIM%d::INSTR", i % BENCH_SWITCH_INSTRUMENTS);
+        VisaSession* switched = poolAcquire(pool, resource, &status);
+        if (switched != NULL)
+            status = sessionQuery(switched, "*IDN?", response, sizeof(response), NULL);
+        poolRelease(pool, switched);
+    }
+    double pooledUs = (monotonicMicros() - start) / (double)n;
+    poolStats(pool, &hits, &misses, &evictions);
+    poolDestroy(pool);
+    if (status < VI_SUCCESS)
+        return 1;
+
+    beginResult("session_switch");
+    fprintf(out, ", \"switches\": %d, \"instruments\": %d, \"reopen_us\": %.1f, \"pooled_us\": %.1f, \"speedup\": %.2f, "
+        "\"pool_hits\": %lu, \"pool_misses\": %lu }", n, BENCH_SWITCH_INSTRUMENTS, reopenUs, pooledUs, reopenUs / pooledUs,
+        hits, misses);
+    return 0;
+}
+
+/**
+ * @brief Benchmarks finding a resource by name in a registry of thousands of LAN resources, against a linear search
+ * of a fixed table of VI_FIND_BUFLEN descriptors, and compares their memory use.
+ */
+static int benchResourceRegistry() {
+    int n = iterations(BENCH_REGISTRY_LOOKUPS);
+    char (*table)[VI_FIND_BUFLEN] = malloc(sizeof(*table) * BENCH_REGISTRY_RESOURCES);
+    ResourceRegistry* registry = registryCreate();
+    char alias[32];
+    int found = 0;
+
+    if (table == NULL || registry == NULL) {
+        free(table);
+        registryDestroy(registry);
+        return 1;
+    }
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < BENCH_REGISTRY_RESOURCES; i++) {
+        sprintf(table[i], "TCPIP0::10.0.%d.%d::inst0::INSTR", i / 256, i % 256);
+        sprintf(alias, "SA%d", i);
+        int index = registryAdd(registry, table[i]);
+        if (index < 0 || registrySetAlias(registry, index, alias) != 0) {
+            free(table);
+            registryDestroy(registry);
+            return 1;
+        }
+    }
+    double insertNs = (monotonicMicros() - start) * 1000.0 / BENCH_REGISTRY_RESOURCES;
+
+    start = monotonicMicros();
+    for (int i = 0; i < n; i++) {
+        const char* name = table[(i * 7919) % BENCH_REGISTRY_RESOURCES];
+        int j = 0;
+        while (j < BENCH_REGISTRY_RESOURCES && strcmp(table[j], name) != 0)
+            j++;
+        found += j < BENCH_REGISTRY_RESOURCES;
+    }
+    double scanNs = (monotonicMicros() - start) * 1000.0 / n;
+
+    start = monotonicMicros();
+    for (int i = 0; i < n; i++)
+        found += registryFind(registry, table[(i * 7919) % BENCH_REGISTRY_RESOURCES]) >= 0;
+    double lookupNs = (monotonicMicros() - start) * 1000.0 / n;
+
+    start = monotonicMicros();
+    for (int i = 0; i < n; i++) {
+        sprintf(alias, "SA%d", (i * 7919) % BENCH_REGISTRY_RESOURCES);
+        found += registryFind(registry, alias) >= 0;
+    }
+    double aliasNs = (monotonicMicros() - start) * 1000.0 / n;
+
+    size_t registryBytes = registryMemory(registry);
+    free(table);
+    registryDestroy(registry);
+    if (found != 3 * n)
+        return 1;
+
+    beginResult("resource_registry");
+    fprintf(out, ", \"resources\": %d, \"lookups\": %d, \"insert_ns\": %.1f, \"scan_ns\": %.1f, \"lookup_ns\": %.1f, "
+        "\"alias_lookup_ns\": %.1f, \"speedup\": %.1f, \"table_bytes\": %lu, \"registry_bytes\": %lu }",
+        BENCH_REGISTRY_RESOURCES, n, insertNs, scanNs, lookupNs, aliasNs, scanNs / lookupNs,
+        (unsigned long)(BENCH_REGISTRY_RESOURCES * VI_FIND_BUFLEN), (unsigned long)registryBytes);
+    return 0;
+}
+
+/**
+ * @brief Benchmarks a mistyped query, which the analyzer never answers, sent as is and rejected by a strict validator
+ * holding a command list of a few thousand headers, and the cost of validating queries that are valid.
+ */
+static int benchTypoDetection() {
+    int n = iterations(BENCH_TYPO_QUERIES);
+    char response[BENCH_RESPONSE_BYTES], pattern[VALIDATOR_PATTERN_BYTES];
+    ViStatus status;
+
+    ScpiValidator* validator = validatorCreate(1);
+    VisaSession* typoSession = sessionOpen(defaultRM, BENCH_RESOURCE, BENCH_TYPO_TIMEOUT, &status);
+    if (validator == NULL || typoSession == NULL) {
+        validatorDestroy(validator);
+        sessionClose(typoSession);
+        return 1;
+    }
+    for (int i = 0; i < BENCH_TYPO_COMMANDS; i++) {
+        sprintf(pattern, ":SOURce%d:LIST%d:POINts%d?", i % 7, i % 13, i);
+        validatorAdd(validator, pattern);
+    }
+    validatorAdd(validator, "[:SENSe]:FREQuency:STARt?");
+
+    unsigned long long start = monotonicMicros();
+    ViStatus typoStatus = sessionQuery(typoSession, ":SENS:FREQ:STRT?", response, sizeof(response), NULL);
+    double timeoutUs = (double)(monotonicMicros() - start);
+
+    start = monotonicMicros();
+    status = VI_SUCCESS;
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++)
+        status = sessionQuery(typoSession, ":FREQ:STAR?", response, sizeof(response), NULL);
+    double queryUs = (monotonicMicros() - start) / (double)n;
+
+    sessionSetValidator(typoSession, validator);
+    start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++)
+        status = sessionQuery(typoSession, ":FREQ:STAR?", response, sizeof(response), NULL);
+    double validatedUs = (monotonicMicros() - start) / (double)n;
+
+    int rejected = 0;
+    start = monotonicMicros();
+    for (int i = 0; i < n; i++)
+        rejected += sessionQuery(typoSession, ":SENS:FREQ:STRT?", response, sizeof(response), NULL) == SESSION_ERROR_HEADER;
+    double rejectUs = (monotonicMicros() - start) / (double)n;
+
+    int numPatterns = validatorCount(validator);
+    sessionClose(typoSession);
+    validatorDestroy(validator);
+    if (status < VI_SUCCESS || typoStatus != VI_ERROR_TMO || rejected != n)
+        return 1;
+
+    beginResult("typo_detection");
+    fprintf(out, ", \"patterns\": %d, \"queries\": %d, \"timeout_us\": %.0f, \"reject_us\": %.2f, \"query_us\": %.1f, "
+        "\"validated_query_us\": %.1f }", numPatterns, n, timeoutUs, rejectUs, queryUs, validatedUs);
+    return 0;
+}
+
+/**
+ * @brief Trace capture of an unknown model without a capability profile, walking the markers, versus with the profile
+ * probed once, reading the trace as one binary transfer. Also times the probe and finding the cached profile again.
+ */
+static int benchCapabilityCapture() {
+    int n = iterations(BENCH_CAPABILITY_CAPTURES);
+    int lookups = iterations(BENCH_CAPABILITY_LOOKUPS);
+    char idn[BENCH_RESPONSE_BYTES];
+    MarkerSetup setup;
+    ViStatus status;
+    int result = 1;
+
+    CapabilityTable* table = capabilityCreate();
+    VisaSession* analyzer = sessionOpen(defaultRM, BENCH_CAPABILITY_RESOURCE, VISA_SIM_DEFAULT_TIMEOUT, &status);
+    double* freq = malloc(sizeof(double) * BENCH_CAPABILITY_POINTS);
+    double* amp = malloc(sizeof(double) * BENCH_CAPABILITY_POINTS);
+    if (table == NULL || analyzer == NULL || freq == NULL || amp == NULL)
+        goto done;
+    if ((status = sessionWrite(analyzer, ":FREQ:STAR 1e9;:FREQ:STOP 2e9")) < VI_SUCCESS
+        || (status = sessionQuery(analyzer, "*IDN?", idn, sizeof(idn), NULL)) < VI_SUCCESS)
+        goto done;
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++)
+        status = sessionCaptureTrace(analyzer, BENCH_CAPABILITY_POINTS, &setup, freq, amp);
+    double markerSeconds = (monotonicMicros() - start) / 1e6 / n;
+    int numMarkers = setup.numMarkers;
+
+    start = monotonicMicros();
+    const CapabilityProfile* profile = capabilitySelect(table, analyzer, defaultRM, idn, &status);
+    double probeMs = (monotonicMicros() - start) / 1e3;
+    start = monotonicMicros();
+    for (int i = 0; i < lookups; i++)
+        capabilitySelect(table, analyzer, defaultRM, idn, NULL);
+    double lookupNs = (monotonicMicros() - start) * 1e3 / lookups;
+    if (profile == NULL || !profile->binaryTrace)
+        goto done;
+
+    sessionSetProfile(analyzer, profile);
+    start = monotonicMicros();
+    for (int i = 0; i < n && status >= VI_SUCCESS; i++)
+        status = sessionCaptureTrace(analyzer, BENCH_CAPABILITY_POINTS, &setup, freq, amp);
+    double binarySeconds = (monotonicMicros() - start) / 1e6 / n;
+    if (status < VI_SUCCESS || setup.numMarkers != 0)
+        goto done;
+
+    beginResult("capability_capture");
+    fprintf(out, ", \"points\": %d, \"captures\": %d, \"markers\": %d, \"probe_ms\": %.1f, \"lookup_ns\": %.1f, "
+        "\"marker_seconds\": %.4f, \"binary_seconds\": %.4f, \"speedup\": %.1f }", BENCH_CAPABILITY_POINTS, n, numMarkers,
+        probeMs, lookupNs, markerSeconds, binarySeconds, markerSeconds / binarySeconds);
+    result = 0;
+
+done:
+    sessionClose(analyzer);
+    capabilityDestroy(table);
+    free(freq);
+    free(amp);
+    return result;
+}
+
+/**
+ * @brief A capture campaign over agents on localhost, each serving its own analyzers: run agent by agent, as when
+ * each lab PC is driven on its own, versus dispatched to all agents at once by the coordinator.
+ */
+static int benchRemoteCampaign() {
+    CaptureAgent* agents[BENCH_REMOTE_AGENTS] = { NULL };
+    SessionPool* pools[BENCH_REMOTE_AGENTS] = { NULL };
+    ResourceRegistry* registries[BENCH_REMOTE_AGENTS] = { NULL };
+    RemoteAddress addresses[BENCH_REMOTE_AGENTS];
+    int traces = quick ? 2 : BENCH_REMOTE_TRACES;
+    int perAgent = BENCH_REMOTE_ANALYZERS * traces;
+    int numJobs = BENCH_REMOTE_AGENTS * perAgent;
+    RemoteJob* jobs = malloc(sizeof(RemoteJob) * numJobs);
+    RemoteResult* results = malloc(sizeof(RemoteResult) * numJobs);
+    CapabilityTable* table = capabilityCreate();
+    char resource[VI_FIND_BUFLEN];
+    int result = 1, captured[2] = { 0, 0 };
+    double seconds[2];
+
+    if (jobs == NULL || results == NULL || table == NULL)
+        goto done;
+    for (int a = 0; a < BENCH_REMOTE_AGENTS; a++) {
+        pools[a] = poolCreate(defaultRM, BENCH_REMOTE_ANALYZERS, VISA_SIM_DEFAULT_TIMEOUT);
+        registries[a] = registryCreate();
+        if (pools[a] == NULL || registries[a] == NULL)
+            goto done;
+        for (int i = 0; i < BENCH_REMOTE_ANALYZERS; i++) {
+            sprintf(resource, "SIM%d::INSTR", 16 + a * BENCH_REMOTE_ANALYZERS + i);
+            registryAdd(registries[a], resource);
+        }
+        agents[a] = agentStart(defaultRM, pools[a], table, registries[a], REMOTE_DEFAULT_BIND, 0);
+        if (agents[a] == NULL)
+            goto done;
+        strcpy(addresses[a].host, "127.0.0.1");
+        addresses[a].port = agentPort(agents[a]);
+    }
+
+    /* Jobs are grouped by agent, so each agent's share is a contiguous run */
+    for (int j = 0; j < numJobs; j++) {
+        int a = j / perAgent;
+        jobs[j].agent = a;
+        jobs[j].numPoints = BENCH_REMOTE_POINTS;
+        sprintf(jobs[j].resource, "SIM%d::INSTR", 16 + a * BENCH_REMOTE_ANALYZERS + j % BENCH_REMOTE_ANALYZERS);
+    }
+
+    /* Warm up: sessions open and capability probes happen once, outside the timing */
+    if (remoteDispatch(addresses, BENCH_REMOTE_AGENTS, jobs, numJobs, results) != numJobs)
+        goto done;
+    remoteFreeResults(results, numJobs);
+
+    unsigned long long start = monotonicMicros();
+    for (int a = 0; a < BENCH_REMOTE_AGENTS; a++) {
+        captured[0] += remoteDispatch(addresses, BENCH_REMOTE_AGENTS, jobs + a * perAgent, perAgent, results + a * perAgent);
+        remoteFreeResults(results + a * perAgent, perAgent);
+    }
+    seconds[0] = (monotonicMicros() - start) / 1e6;
+
+    start = monotonicMicros();
+    captured[1] = remoteDispatch(addresses, BENCH_REMOTE_AGENTS, jobs, numJobs, results);
+    seconds[1] = (monotonicMicros() - start) / 1e6;
+    remoteFreeResults(results, numJobs);
+    if (captured[0] != numJobs || captured[1] != numJobs)
+        goto done;
+
+    beginResult("remote_campaign");
+    fprintf(out, ", \"agents\": %d, \"analyzers\": %d, \"traces\": %d, \"points\": %d, \"per_agent_traces_per_s\": %.1f, "
+        "\"dispatched_traces_per_s\": %.1f, \"speedup\": %.2f }", BENCH_REMOTE_AGENTS,
+        BENCH_REMOTE_AGENTS * BENCH_REMOTE_ANALYZERS, numJobs, BENCH_REMOTE_POINTS, numJobs / seconds[0],
+        numJobs / seconds[1], seconds[0] / seconds[1]);
+    result = 0;
+
+done:
+    for (int a = 0; a < BENCH_REMOTE_AGENTS; a++) {
+        agentStop(agents[a]);
+        if (pools[a] != NULL)
+            poolDestroy(pools[a]);
+        registryDestroy(registries[a]);
+    }
+    capabilityDestroy(table);
+    free(jobs);
+    free(results);
+    return result;
+}
+
+/**
+ * @brief Trigger skew across several analyzers: triggered one after another from one thread, versus released together
+ * by syncTrigger() once all are armed.
+ */
+static int benchSyncTrigger() {
+    SyncTarget targets[BENCH_SYNC_INSTRUMENTS];
+    SyncSettings settings[BENCH_SYNC_INSTRUMENTS];
+    SyncReading readings[BENCH_SYNC_INSTRUMENTS];
+    SyncReport report;
+    char resource[VI_FIND_BUFLEN];
+    char response[BENCH_RESPONSE_BYTES];
+    int rounds = iterations(BENCH_SYNC_ROUNDS);
+    int numOpen = 0, result = 1;
+    unsigned long long sequentialSkew = 0, syncSkew = 0, maxSyncSkew = 0, maxSpan = 0;
+
+    for (; numOpen < BENCH_SYNC_INSTRUMENTS; numOpen++) {
+        sprintf(resource, "SIM%d::INSTR", 24 + numOpen);
+        targets[numOpen].arm = NULL;
+        targets[numOpen].fetch = NULL;
+        if ((targets[numOpen].session = sessionOpen(defaultRM, resource, VISA_SIM_DEFAULT_TIMEOUT, NULL)) == NULL)
+            goto done;
+        if (syncSaveSettings(targets[numOpen].session, &settings[numOpen]) < VI_SUCCESS) {
+            sessionClose(targets[numOpen].session);
+            goto done;
+        }
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        unsigned long long first = 0, last = 0;
+        for (int i = 0; i < numOpen; i++) {
+            if (sessionWrite(targets[i].session, SYNC_DEFAULT_ARM) < VI_SUCCESS
+                || sessionQuery(targets[i].session, "*STB?", response, sizeof(response), NULL) < VI_SUCCESS)
+                goto done;
+        }
+        for (int i = 0; i < numOpen; i++) {
+            unsigned long long before = monotonicMicros();
+            if (sessionAssertTrigger(targets[i].session, NULL) < VI_SUCCESS)
+                goto done;
+            last = (before + monotonicMicros()) / 2;
+            if (i == 0)
+                first = last;
+        }
+        sequentialSkew += last - first;
+        for (int i = 0; i < numOpen; i++) {
+            if (sessionQuery(targets[i].session, "*OPC?", response, sizeof(response), NULL) < VI_SUCCESS
+                || sessionQuery(targets[i].session, SYNC_DEFAULT_FETCH, response, sizeof(response), NULL) < VI_SUCCESS)
+                goto done;
+        }
+    }
+
+    for (int r = 0; r < rounds; r++) {
+        if (syncTrigger(targets, numOpen, readings, &report) != numOpen)
+            goto done;
+        syncSkew += report.skewMicros;
+        if (report.skewMicros > maxSyncSkew)
+            maxSyncSkew = report.skewMicros;
+        if (report.maxSpanMicros > maxSpan)
+            maxSpan = report.maxSpanMicros;
+    }
+
+    beginResult("sync_trigger");
+    fprintf(out, ", \"instruments\": %d, \"rounds\": %d, \"sequential_skew_us\": %.1f, \"sync_skew_us\": %.1f, "
+        "\"max_sync_skew_us\": %llu, \"trigger_uncertainty_us\": %llu }", numOpen, rounds,
+        (double)sequentialSkew / rounds, (double)syncSkew / rounds, maxSyncSkew, maxSpan / 2);
+    result = 0;
+
+done:
+    for (int i = 0; i < numOpen; i++) {
+        syncRestoreSettings(targets[i].session, &settings[i]);
+        sessionClose(targets[i].session);
+    }
+    return result;
+}
+
+/* Simulated resources of all scenarios: SIM0 (BENCH_RESOURCE) to SIM<n-1> for the fan-out, then the fleet */
+static void configureSimulator(unsigned int rtt) {
+    char resources[(BENCH_FANOUT_INSTRUMENTS + BENCH_FLEET_INSTRUMENTS) * 32];
+    char resource[VI_FIND_BUFLEN];
+
+    resources[0] = '\0';
+    for (int i = 0; i < BENCH_FANOUT_INSTRUMENTS; i++)
+        sprintf(resources + strlen(resources), "%sSIM%d::INSTR", i > 0 ? "," : "", i);
+    for (int i = 0; i < BENCH_FLEET_INSTRUMENTS; i++) {
+        fleetResource(i, resource);
+        sprintf(resources + strlen(resources), ",%s", resource);
+    }
+    visaSimConfigure(resources, rtt);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int rtt = BENCH_DEFAULT_RTT;
+    const char* outputPath = NULL;
+    int failed = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rtt-us") == 0 && i + 1 < argc)
+            rtt = (unsigned int)atoi(argv[++i]);
+        else if (strcmp(argv[i], "--quick") == 0)
+            quick = 1;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            outputPath = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [--rtt-us N] [--quick] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    out = stdout;
+    if (outputPath != NULL && (out = fopen(outputPath, "w")) == NULL) {
+        fprintf(stderr, "Error: could not open %s\n", outputPath);
+        return 1;
+    }
+
+    configureSimulator(rtt);
+    if (viOpenDefaultRM(&defaultRM) < VI_SUCCESS
+        || (session = sessionOpen(defaultRM, BENCH_RESOURCE, VISA_SIM_DEFAULT_TIMEOUT, NULL)) == NULL) {
+        fprintf(stderr, "Error: could not open %s\n", BENCH_RESOURCE);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"rtt_us\": %u,\n  \"quick\": %s,\n  \"timestamp\": %lld,\n  \"results\": [",
+        rtt, quick ? "true" : "false", (long long)time(NULL));
+    failed |= benchQueryLatency();
+    failed |= benchWriteBurst();
+    for (size_t i = 0; i < sizeof(markerWalkPoints) / sizeof(markerWalkPoints[0]); i++)
+        failed |= benchMarkerWalk(markerWalkPoints[i]);
+    failed |= benchMultiMarker();
+    failed |= benchBlockDecode();
+    failed |= benchCommandFormat();
+    failed |= benchLogging();
+    failed |= benchSequenceFanout();
+    failed |= benchSchedulerFleet();
+    failed |= benchBusArbitration();
+    failed |= benchAdaptiveTimeout();
+    failed |= benchReconnect();
+    failed |= benchCheckedWrites();
+    failed |= benchDifferentialSetup();
+    failed |= benchSessionSwitch();
+    failed |= benchResourceRegistry();
+    failed |= benchTypoDetection();
+    failed |= benchCapabilityCapture();
+    failed |= benchRemoteCampaign();
+    failed |= benchSyncTrigger();
+    fprintf(out, "\n  ]\n}\n");
+
+    sessionClose(session);
+    viClose(defaultRM);
+    if (out != stdout)
+        fclose(out);
+    if (failed)
+        fprintf(stderr, "Error: one or more benchmarks failed\n");
+    return failed;
+}
@@ -0,0 +1,39 @@
+// file: capability.h
+#ifndef CAPABILITY_H
+#define CAPABILITY_H
+
+#include <stddef.h>
+#include "visa.h"
+#include "visa-session.h"
+
+#define CAPABILITY_MAX_PROFILES 64          // Built-in and probed models one table holds
+#define CAPABILITY_NAME_BYTES 48            // Longest manufacturer or model, including the terminator
+#define CAPABILITY_PROBE_TIMEOUT_MS 1000    // Longest wait for the answer to a probe
+#define CAPABILITY_DEFAULT_MESSAGE_BYTES SESSION_MESSAGE_BYTES  // Batch length assumed for probed models
+
+/* What a model of analyzer supports, matched on the manufacturer and model fields of *IDN? */
+struct CapabilityProfile {
+    char manufacturer[CAPABILITY_NAME_BYTES];   // Glob on the first *IDN? field, e.g. "Keysight*"
+    char model[CAPABILITY_NAME_BYTES];          // Glob on the second *IDN? field, e.g. "N90[0-4]0[AB]"
+    int binaryTrace;                            // :TRACe:DATA? returns REAL,32 definite length blocks
+    int maxPoints;                              // Most sweep points, i.e. the longest trace one transfer returns
+    int maxMessageBytes;                        // Longest message a batched marker readout may use
+    int hislip;                                 // The LAN interface accepts HiSLIP connections
+    int numMarkers;                             // Markers a capture can read per round trip
+    int probed;                                 // Found by capabilityProbe() rather than built in
+    int failed;                                 // The probe failed, so captures walk the markers; not saved
+};
+
+typedef struct CapabilityTable CapabilityTable;
+
+CapabilityTable* capabilityCreate(void);
+void capabilityDestroy(CapabilityTable* table);
+const CapabilityProfile* capabilityFind(CapabilityTable* table, const char* idn);
+ViStatus capabilityProbe(VisaSession* session, ViSession resourceManager, CapabilityProfile* profile);
+const CapabilityProfile* capabilitySelect(CapabilityTable* table, VisaSession* session, ViSession resourceManager,
+    const char* idn, ViStatus* status);
+int capabilityLoad(CapabilityTable* table, const char* path);
+int capabilitySave(CapabilityTable* table, const char* path);
+int capabilityHislipResource(const char* resource, char* hislip, size_t size);
+
+#endif
@@ -0,0 +1,37 @@
+// file: discovery.h
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <stddef.h>
+#include "visa.h"
+#include "session-pool.h"
+
+#define DISCOVERY_MAX_PATTERNS 16       // Maximum include patterns, exclude patterns or interfaces of a filter
+#define DISCOVERY_INTF_NAME 16          // Longest interface name, including the terminator
+#define DISCOVERY_ALL "?*"              // VISA expression that finds every resource
+
+/* Which resources a search lists. An empty include or interface list accepts every resource */
+typedef struct {
+    const char* include[DISCOVERY_MAX_PATTERNS];    // Globs of which a descriptor must match one
+    int numInclude;
+    const char* exclude[DISCOVERY_MAX_PATTERNS];    // Globs of which a descriptor must match none
+    int numExclude;
+    char interfaces[DISCOVERY_MAX_PATTERNS][DISCOVERY_INTF_NAME];   // Interface names in upper case, e.g. "GPIB"
+    int numInterfaces;
+    int probe;                                      // Open each resource before it is listed
+    SessionPool* pool;                              // Keeps the probed sessions open for reuse; NULL closes them
+} DiscoveryFilter;
+
+/* Called for each resource that passes the filter. status is the result of the probe, VI_SUCCESS if not probed */
+typedef void (*DiscoveryFn)(const char* descriptor, ViStatus status, void* context);
+
+void discoveryInit(DiscoveryFilter* filter);
+int discoveryInclude(DiscoveryFilter* filter, const char* pattern);
+int discoveryExclude(DiscoveryFilter* filter, const char* pattern);
+int discoveryInterfaces(DiscoveryFilter* filter, const char* list);
+int discoveryGlob(const char* pattern, const char* text);
+int discoveryMatches(const DiscoveryFilter* filter, const char* descriptor);
+void discoveryExpression(const DiscoveryFilter* filter, char* expression, size_t size);
+ViStatus discoveryFind(ViSession resourceManager, const DiscoveryFilter* filter, DiscoveryFn found, void* context);
+
+#endif
@@ -0,0 +1,22 @@
+// file: health.h
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include "visa-session.h"
+
+#define HEALTH_MAX_SESSIONS 64          // Maximum sessions one monitor watches
+#define HEALTH_PROBE_INTERVAL_MS 1000   // Default idle time after which a session is probed
+#define HEALTH_PROBE_TIMEOUT_MS 500     // Longest wait for the answer to a probe
+#define HEALTH_BACKOFF_MIN_MS 100       // Wait before the first reconnect attempt
+#define HEALTH_BACKOFF_MAX_MS 5000      // Longest wait between reconnect attempts
+#define HEALTH_TICK_MS 20               // How often the monitor thread checks its sessions
+
+typedef struct HealthMonitor HealthMonitor;
+
+HealthMonitor* healthStart(unsigned int probeIntervalMs);
+void healthStop(HealthMonitor* monitor);
+int healthWatch(HealthMonitor* monitor, VisaSession* session);
+void healthUnwatch(HealthMonitor* monitor, VisaSession* session);
+void healthStats(HealthMonitor* monitor, unsigned long* probes, unsigned long* reconnects);
+
+#endif
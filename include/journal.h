@@ -0,0 +1,27 @@
+// file: journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "visa.h"
+
+#define JOURNAL_MAGIC "VJNL"        // First four bytes of every journal file
+#define JOURNAL_VERSION 2           // Journal format version written after the magic
+#define JOURNAL_OPEN 'O'            // Record direction: session opened to the resource descriptor in the data
+#define JOURNAL_WRITE 'W'           // Record direction: bytes sent to the instrument
+#define JOURNAL_READ 'R'            // Record direction: bytes received from the instrument
+#define JOURNAL_REPLAY_SESSION 1    // Session handle handed out while replaying for the first resource in the journal
+#define JOURNAL_MAX_RESOURCES 64    // Most resources a replayed journal may have opened
+
+int journalStartRecording(const char* path);
+void journalStopRecording();
+int journalIsRecording();
+int journalStartReplay(const char* path, double speed);
+void journalStopReplay();
+int journalIsReplaying();
+const char* journalReplayResource(int index);
+
+ViStatus journalViOpen(ViSession rm, ViConstRsrc descriptor, ViPSession session);
+ViStatus journalViWrite(ViSession session, ViConstBuf buf, ViUInt32 count, ViPUInt32 retCount);
+ViStatus journalViRead(ViSession session, ViPBuf buf, ViUInt32 count, ViPUInt32 retCount);
+
+#endif
@@ -0,0 +1,35 @@
+// file: logger.h
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define LOG_QUEUE_SIZE 4096             // Records the submission queue holds; a power of two
+#define LOG_TEXT_BYTES 128              // Longest text kept per record; longer text is cut
+#define LOG_SUBJECT_BYTES 48            // Longest subject kept per record, e.g. a resource descriptor
+#define LOG_IDLE_MS 2                   // How long the writer thread sleeps when the queue is empty
+
+#define LOG_OFF -1                      // Threshold that disables logging
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3
+
+/* Most verbose level written; LOG_OFF until logStart(). Read without a lock by LOG_ENABLED() */
+extern int logThreshold;
+
+#define LOG_ENABLED(level) ((level) <= logThreshold)
+
+/* Submits a record if its level is enabled; a disabled call costs one comparison */
+#define LOG_TEXT(level, event, subject, text, length) \
+    do { if (LOG_ENABLED(level)) logSubmit((level), (event), (subject), (text), (length)); } while (0)
+
+int logStart(FILE* out, int level);
+void logStop();
+int logParseLevel(const char* name);
+void logSubmit(int level, const char* event, const char* subject, const char* text, size_t length);
+void logPrintf(int level, const char* event, const char* subject, const char* format, ...);
+unsigned long logDropped();
+
+#endif
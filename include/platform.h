@@ -0,0 +1,256 @@
+// file: platform.h
+// Thin wrappers over the Win32 and POSIX threading, atomic and timing APIs so worker code compiles unchanged on both.
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+typedef HANDLE PlatformThread;
+typedef LPTHREAD_START_ROUTINE ThreadFn;
+#define THREAD_FUNC DWORD WINAPI    // Return type and calling convention of a function passed to threadCreate()
+#define THREAD_RETURN 0             // Value a thread function returns on exit
+
+/**
+ * @brief Starts a thread running fn(arg).
+ * @return 0 on success, 1 on error.
+ */
+static inline int threadCreate(PlatformThread* thread, ThreadFn fn, void* arg) {
+    *thread = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *thread == NULL;
+}
+
+/**
+ * @brief Waits for a thread to exit and releases it.
+ */
+static inline void threadJoin(PlatformThread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+/**
+ * @brief Suspends the calling thread for a number of milliseconds.
+ */
+static inline void sleepMs(unsigned int ms) {
+    Sleep(ms);
+}
+
+/**
+ * @brief Gives up the rest of the calling thread's time slice to any other thread ready to run.
+ */
+static inline void threadYield() {
+    SwitchToThread();
+}
+
+typedef CRITICAL_SECTION PlatformMutex;
+
+static inline void mutexInit(PlatformMutex* mutex) {
+    InitializeCriticalSection(mutex);
+}
+
+static inline void mutexLock(PlatformMutex* mutex) {
+    EnterCriticalSection(mutex);
+}
+
+static inline void mutexUnlock(PlatformMutex* mutex) {
+    LeaveCriticalSection(mutex);
+}
+
+static inline void mutexDestroy(PlatformMutex* mutex) {
+    DeleteCriticalSection(mutex);
+}
+
+typedef CONDITION_VARIABLE PlatformCond;
+
+static inline void condInit(PlatformCond* cond) {
+    InitializeConditionVariable(cond);
+}
+
+/**
+ * @brief Releases the mutex, waits until the condition is signalled and takes the mutex again. The mutex must be held
+ * exactly once by the calling thread. Wakeups may be spurious, so wait in a loop that checks the condition.
+ */
+static inline void condWait(PlatformCond* cond, PlatformMutex* mutex) {
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+static inline void condSignal(PlatformCond* cond) {
+    WakeConditionVariable(cond);
+}
+
+static inline void condBroadcast(PlatformCond* cond) {
+    WakeAllConditionVariable(cond);
+}
+
+static inline void condDestroy(PlatformCond* cond) {
+    (void)cond;
+}
+
+typedef volatile LONG PlatformAtomic;
+
+/**
+ * @brief Reads an atomic value. Writes made before the matching atomicStore() are visible afterwards.
+ */
+static inline long atomicLoad(PlatformAtomic* atomic) {
+    return InterlockedCompareExchange(atomic, 0, 0);
+}
+
+/**
+ * @brief Writes an atomic value, publishing the writes made before it.
+ */
+static inline void atomicStore(PlatformAtomic* atomic, long value) {
+    InterlockedExchange(atomic, value);
+}
+
+/**
+ * @brief Replaces an atomic value with desired if it equals expected.
+ * @return 1 if the value was replaced, 0 otherwise.
+ */
+static inline int atomicCompareExchange(PlatformAtomic* atomic, long expected, long desired) {
+    return InterlockedCompareExchange(atomic, desired, expected) == expected;
+}
+
+/**
+ * @brief Adds to an atomic value.
+ * @return The value before the addition.
+ */
+static inline long atomicFetchAdd(PlatformAtomic* atomic, long value) {
+    return InterlockedExchangeAdd(atomic, value);
+}
+
+/**
+ * @brief Returns a monotonic timestamp in microseconds, suitable for measuring intervals.
+ */
+static inline unsigned long long monotonicMicros() {
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (unsigned long long)(counter.QuadPart / frequency.QuadPart) * 1000000ULL
+        + (unsigned long long)(counter.QuadPart % frequency.QuadPart) * 1000000ULL / frequency.QuadPart;
+}
+
+/**
+ * @brief Suspends the calling thread for a number of microseconds.
+ * Sleep() only has millisecond resolution, so short waits spin on the performance counter instead.
+ */
+static inline void sleepMicros(unsigned long long us) {
+    if (us >= 2000) {
+        Sleep((DWORD)(us / 1000));
+        return;
+    }
+    unsigned long long end = monotonicMicros() + us;
+    while (monotonicMicros() < end)
+        ;
+}
+
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+typedef pthread_t PlatformThread;
+typedef void* (*ThreadFn)(void*);
+#define THREAD_FUNC void*
+#define THREAD_RETURN NULL
+
+static inline int threadCreate(PlatformThread* thread, ThreadFn fn, void* arg) {
+    return pthread_create(thread, NULL, fn, arg) != 0;
+}
+
+static inline void threadJoin(PlatformThread thread) {
+    pthread_join(thread, NULL);
+}
+
+static inline void sleepMs(unsigned int ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+static inline void threadYield() {
+    sched_yield();
+}
+
+typedef pthread_mutex_t PlatformMutex;
+
+/* Recursive, like a CRITICAL_SECTION, so a thread holding a lock may call functions that take it again */
+static inline void mutexInit(PlatformMutex* mutex) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static inline void mutexLock(PlatformMutex* mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void mutexUnlock(PlatformMutex* mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+static inline void mutexDestroy(PlatformMutex* mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+typedef pthread_cond_t PlatformCond;
+
+static inline void condInit(PlatformCond* cond) {
+    pthread_cond_init(cond, NULL);
+}
+
+static inline void condWait(PlatformCond* cond, PlatformMutex* mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline void condSignal(PlatformCond* cond) {
+    pthread_cond_signal(cond);
+}
+
+static inline void condBroadcast(PlatformCond* cond) {
+    pthread_cond_broadcast(cond);
+}
+
+static inline void condDestroy(PlatformCond* cond) {
+    pthread_cond_destroy(cond);
+}
+
+typedef long PlatformAtomic;
+
+static inline long atomicLoad(PlatformAtomic* atomic) {
+    return __atomic_load_n(atomic, __ATOMIC_ACQUIRE);
+}
+
+static inline void atomicStore(PlatformAtomic* atomic, long value) {
+    __atomic_store_n(atomic, value, __ATOMIC_RELEASE);
+}
+
+static inline int atomicCompareExchange(PlatformAtomic* atomic, long expected, long desired) {
+    return __atomic_compare_exchange_n(atomic, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline long atomicFetchAdd(PlatformAtomic* atomic, long value) {
+    return __atomic_fetch_add(atomic, value, __ATOMIC_ACQ_REL);
+}
+
+static inline unsigned long long monotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000ULL;
+}
+
+static inline void sleepMicros(unsigned long long us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(us / 1000000ULL);
+    ts.tv_nsec = (long)(us % 1000000ULL) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+// file: remote-capture.h
+#ifndef REMOTE_CAPTURE_H
+#define REMOTE_CAPTURE_H
+
+#include <stddef.h>
+#include "visa.h"
+#include "tcp-socket.h"
+#include "capability.h"
+#include "resource-registry.h"
+#include "session-pool.h"
+
+#define REMOTE_DEFAULT_PORT 5990            // Port an agent listens on unless one is given
+#define REMOTE_DEFAULT_BIND "127.0.0.1"     // Interface an agent listens on unless one is given: this host only
+#define REMOTE_MAX_AGENTS 32                // Most agents one coordinator dispatches to
+#define REMOTE_MAX_WORKERS 64               // Analyzers a dispatch drives at once; also connections an agent serves
+#define REMOTE_MAX_POINTS 100001            // Most points a capture job may ask for
+#define REMOTE_LINE_BYTES 8192              // Longest request or response line, e.g. an agent's resource list
+#define REMOTE_CONNECT_TIMEOUT_MS 2000      // Longest wait for an agent to accept a connection
+#define REMOTE_REPLY_TIMEOUT_MS 60000       // Longest wait for an agent to answer one request
+#define REMOTE_TICK_MS 100                  // How often agent threads check whether the agent is stopping
+
+typedef struct CaptureAgent CaptureAgent;
+
+/* Host and port of an agent */
+typedef struct {
+    char host[TCP_HOST_MAX];
+    int port;
+} RemoteAddress;
+
+/* Capture job: one trace of an analyzer attached to an agent's host */
+typedef struct {
+    int agent;                          // Index of the agent in the address list
+    char resource[VI_FIND_BUFLEN];      // Resource descriptor on the agent's host
+    int numPoints;                      // Trace points, 2 to REMOTE_MAX_POINTS
+} RemoteJob;
+
+/* Trace an agent captured for a job */
+typedef struct {
+    ViStatus status;                    // Status of the capture on the agent, or of the exchange with it
+    double startFreq;
+    double stopFreq;
+    double resBW;
+    double vidBW;
+    int numPoints;                      // Values in amp, 0 if the job failed
+    float* amp;                         // Amplitudes of the uniformly spaced points; freed by remoteFreeResults()
+    unsigned long long captureMicros;   // Time the agent took to capture the trace
+    unsigned long long doneMicros;      // Time from the start of remoteDispatch() until the trace arrived or failed
+} RemoteResult;
+
+int remoteParseAddress(const char* text, RemoteAddress* address);
+
+CaptureAgent* agentStart(ViSession resourceManager, SessionPool* pool, CapabilityTable* capabilities,
+    const ResourceRegistry* registry, const char* bindAddress, int port);
+int agentPort(const CaptureAgent* agent);
+void agentStats(CaptureAgent* agent, unsigned long* captures, unsigned long* failures);
+void agentStop(CaptureAgent* agent);
+
+ViStatus remoteListResources(const RemoteAddress* agent, char* list, size_t size);
+int remoteDispatch(const RemoteAddress* agents, int numAgents, const RemoteJob* jobs, int numJobs, RemoteResult* results);
+void remoteFreeResults(RemoteResult* results, int numResults);
+
+#endif
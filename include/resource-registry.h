@@ -0,0 +1,35 @@
+// file: resource-registry.h
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include <stddef.h>
+#include <time.h>
+#include "visa.h"
+
+#define REGISTRY_INITIAL_CAPACITY 64    // Resources a registry holds before it first grows
+#define REGISTRY_ARENA_BLOCK 16384      // Bytes of each arena block strings are interned in
+
+/* A resource known to the registry. Its strings stay valid until the registry is destroyed */
+typedef struct {
+    const char* descriptor;     // VISA resource descriptor, e.g. "TCPIP0::192.168.1.5::INSTR"
+    const char* alias;          // Alias the VISA library knows the resource by, NULL if none
+    const char* idn;            // Response to *IDN?, NULL until the resource is identified
+    ViUInt16 intfType;          // Interface type, e.g. VI_INTF_TCPIP, 0 if unknown
+    ViUInt16 intfNum;           // Board number of the interface
+    time_t lastSeen;            // When a search last reported the resource
+} RegistryEntry;
+
+typedef struct ResourceRegistry ResourceRegistry;
+
+ResourceRegistry* registryCreate(void);
+void registryDestroy(ResourceRegistry* registry);
+int registryAdd(ResourceRegistry* registry, const char* descriptor);
+int registryFind(const ResourceRegistry* registry, const char* name);
+int registrySetAlias(ResourceRegistry* registry, int index, const char* alias);
+int registrySetIdn(ResourceRegistry* registry, int index, const char* idn);
+void registrySetInterface(ResourceRegistry* registry, int index, ViUInt16 intfType, ViUInt16 intfNum);
+const RegistryEntry* registryEntry(const ResourceRegistry* registry, int index);
+int registryCount(const ResourceRegistry* registry);
+size_t registryMemory(const ResourceRegistry* registry);
+
+#endif
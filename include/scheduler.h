@@ -0,0 +1,20 @@
+// file: scheduler.h
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#define SCHEDULER_MAX_WORKERS 64        // Maximum worker threads in a pool
+#define SCHEDULER_MAX_BUSES 64          // Maximum distinct shared buses jobs can name
+#define SCHEDULER_BUS_NAME 32           // Longest bus name, including the terminator
+
+typedef struct Scheduler Scheduler;
+
+/* A job, typically the command sequence of one instrument */
+typedef void (*SchedulerJobFn)(void* arg);
+
+Scheduler* schedulerCreate(int numWorkers);
+void schedulerDestroy(Scheduler* scheduler);
+int schedulerSubmit(Scheduler* scheduler, const char* bus, SchedulerJobFn fn, void* arg);
+void schedulerWait(Scheduler* scheduler);
+void schedulerStats(Scheduler* scheduler, unsigned long* executed, unsigned long* stolen);
+
+#endif
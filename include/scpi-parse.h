@@ -0,0 +1,24 @@
+// file: scpi-parse.h
+#ifndef SCPI_PARSE_H
+#define SCPI_PARSE_H
+
+#include <stddef.h>
+
+#define SCPI_MAX_NODES 16       // Maximum number of mnemonics in a command header
+#define SCPI_MAX_MNEMONIC 32    // Maximum length of a single mnemonic
+#define SCPI_MAX_ENDINGS (2 * SCPI_MAX_NODES)   // Most mnemonics a header matching a pattern can end with
+
+int scpiMatchHeader(const char* header, size_t length, const char* pattern, int* suffix);
+const char* scpiSkipHeader(const char* command, size_t length);
+unsigned int scpiMnemonicHash(const char* text, size_t length);
+int scpiPatternEndings(const char* pattern, unsigned int* hashes);
+const char* scpiLastMnemonic(const char* command, size_t length, size_t* mnemonicLength, int* query);
+int scpiIsQuery(const char* message, size_t length);
+size_t scpiUnitLength(const char* response, size_t length);
+int scpiParseError(const char* response, size_t length, int* code, char* message, size_t size);
+
+int scpiBlockHeader(const unsigned char* data, size_t length, size_t* payloadOffset, size_t* payloadLength);
+int scpiDecodeReal32(const unsigned char* payload, size_t payloadLength, int bigEndian, float* values, int maxValues);
+size_t scpiEncodeReal32(const float* values, int numValues, int bigEndian, unsigned char* out, size_t outSize);
+
+#endif
@@ -0,0 +1,32 @@
+// file: scpi-template.h
+#ifndef SCPI_TEMPLATE_H
+#define SCPI_TEMPLATE_H
+
+#include <stddef.h>
+
+#define TEMPLATE_MAX_SLOTS 16           // Most parameter slots in a template
+#define TEMPLATE_TEXT_BYTES 256         // Longest template, including the terminator
+#define TEMPLATE_MAX_PRECISION 9        // Most decimals of a %.<n>f slot
+
+#define TEMPLATE_INT 0                  // %d slot: int
+#define TEMPLATE_FIXED 1                // %f or %.<n>f slot: double, 6 decimals unless given
+#define TEMPLATE_STRING 2               // %s slot: null-terminated string
+
+typedef struct {
+    unsigned short offset;              // Position in the literal text where the slot is rendered
+    unsigned char type;                 // TEMPLATE_INT, TEMPLATE_FIXED or TEMPLATE_STRING
+    unsigned char precision;            // Decimals of a TEMPLATE_FIXED slot
+} TemplateSlot;
+
+/* A command with typed parameter slots, parsed once by templateCompile() and rendered many times */
+typedef struct {
+    char text[TEMPLATE_TEXT_BYTES];     // Literal text with the slots taken out
+    size_t length;                      // Length of text
+    TemplateSlot slots[TEMPLATE_MAX_SLOTS];
+    int numSlots;
+} ScpiTemplate;
+
+int templateCompile(ScpiTemplate* tmpl, const char* format);
+size_t templateRender(const ScpiTemplate* tmpl, char* out, size_t size, ...);
+
+#endif
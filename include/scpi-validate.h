@@ -0,0 +1,32 @@
+// file: scpi-validate.h
+#ifndef SCPI_VALIDATE_H
+#define SCPI_VALIDATE_H
+
+#include <stddef.h>
+
+#define VALIDATOR_MAX_COMMANDS 4096     // Header patterns one validator holds
+#define VALIDATOR_PATTERN_BYTES 64      // Longest header pattern, including the terminator
+#define VALIDATOR_BUCKETS 512           // Hash buckets patterns are sorted into by the mnemonics they end with
+#define VALIDATOR_MAX_MODELS 32         // Models one validator table holds
+#define VALIDATOR_MODEL_BYTES 48        // Longest model, including the terminator
+#define VALIDATOR_PATH_BYTES 260        // Longest command list path, including the terminator
+
+typedef struct ScpiValidator ScpiValidator;
+typedef struct ValidatorTable ValidatorTable;
+
+ScpiValidator* validatorCreate(int strict);
+void validatorDestroy(ScpiValidator* validator);
+int validatorStrict(ScpiValidator* validator);
+int validatorAdd(ScpiValidator* validator, const char* pattern);
+int validatorLoad(ScpiValidator* validator, const char* path);
+int validatorSave(ScpiValidator* validator, const char* path);
+int validatorCheck(ScpiValidator* validator, const char* message, size_t length, char* unknown, size_t size);
+int validatorLearn(ScpiValidator* validator, const char* message, size_t length);
+int validatorCount(ScpiValidator* validator);
+
+ValidatorTable* validatorTableCreate(const char* path, int strict);
+void validatorTableDestroy(ValidatorTable* table);
+ScpiValidator* validatorTableSelect(ValidatorTable* table, const char* idn);
+int validatorTableSave(ValidatorTable* table);
+
+#endif
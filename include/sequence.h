@@ -0,0 +1,71 @@
+// file: sequence.h
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "visa.h"
+#include "visa-session.h"
+
+#define SEQUENCE_RESPONSE_BYTES 256     // Response buffer of a sequence query
+#define SEQUENCE_POLL_US 50             // Wait between completion polls while several sequences are suspended
+
+#define SEQ_WAITING 0                   // Sequence suspended on an operation
+#define SEQ_DONE 1                      // Sequence ran to its end
+#define SEQ_FAILED 2                    // Sequence stopped on a failed operation
+
+typedef struct Sequence Sequence;
+
+/* Body of a sequence. Resumed by the event loop after each operation; returns one of SEQ_WAITING, SEQ_DONE, SEQ_FAILED */
+typedef int (*SequenceFn)(Sequence* seq);
+
+/*
+ * A command sequence that runs on an EventLoop. The body is written between SEQ_BEGIN() and SEQ_END() and suspends at
+ * each SEQ_WRITE(), SEQ_QUERY() and SEQ_DELAY(); the loop resumes it when the operation completes, so one thread can
+ * drive many instruments at once. Local variables of the body do not survive a suspension: keep state in context.
+ * Only one SEQ_ macro may appear per source line, and they cannot be used inside a switch statement.
+ */
+struct Sequence {
+    SequenceFn fn;
+    VisaSession* session;
+    void* context;                              // Caller state kept across suspensions
+    ViStatus status;                            // Status of the last operation
+    ViUInt32 count;                             // Bytes in response after a query
+    char response[SEQUENCE_RESPONSE_BYTES];     // Null-terminated response of the last query
+    char command[SESSION_COMMAND_BYTES];        // Command of the pending operation
+    int scpiErrors;                             // Errors drained from a checked session when the sequence finished
+
+    /* Managed by the SEQ_ macros and the event loop */
+    int line;                                   // Resume point in the body
+    int state;
+    int op;
+    int stage;
+    int result;
+    ViJobId job;
+    unsigned long long wakeAt;
+    Sequence* next;
+};
+
+typedef struct {
+    Sequence* head;                     // Sequences added with loopAdd(), in order
+} EventLoop;
+
+void loopInit(EventLoop* loop);
+void loopAdd(EventLoop* loop, Sequence* seq, SequenceFn fn, VisaSession* session, void* context);
+int loopRun(EventLoop* loop);
+
+int sequenceWritef(Sequence* seq, const char* format, ...);
+int sequenceQueryf(Sequence* seq, const char* format, ...);
+void sequenceDelay(Sequence* seq, unsigned int ms);
+
+#define SEQ_BEGIN(seq) switch ((seq)->line) { case 0:
+#define SEQ_END(seq) } (seq)->line = 0; return SEQ_DONE;
+
+/* Suspends until the loop completes the pending operation, then fails the sequence if the operation failed */
+#define SEQ_AWAIT(seq) \
+    do { (seq)->line = __LINE__; return SEQ_WAITING; case __LINE__:; \
+         if ((seq)->status < VI_SUCCESS) return SEQ_FAILED; } while (0)
+
+#define SEQ_WRITE(seq, ...) do { if (!sequenceWritef((seq), __VA_ARGS__)) return SEQ_FAILED; SEQ_AWAIT(seq); } while (0)
+#define SEQ_QUERY(seq, ...) do { if (!sequenceQueryf((seq), __VA_ARGS__)) return SEQ_FAILED; SEQ_AWAIT(seq); } while (0)
+#define SEQ_DELAY(seq, ms) do { sequenceDelay((seq), (ms)); SEQ_AWAIT(seq); } while (0)
+
+#endif
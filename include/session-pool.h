@@ -0,0 +1,18 @@
+// file: session-pool.h
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include "visa-session.h"
+
+#define POOL_MAX_SESSIONS 64            // Most sessions a pool holds, in use or idle
+#define POOL_DEFAULT_CAPACITY 8         // Default number of sessions kept open
+
+typedef struct SessionPool SessionPool;
+
+SessionPool* poolCreate(ViSession resourceManager, int capacity, ViUInt32 timeoutMs);
+void poolDestroy(SessionPool* pool);
+VisaSession* poolAcquire(SessionPool* pool, const char* resource, ViStatus* status);
+void poolRelease(SessionPool* pool, VisaSession* session);
+void poolStats(SessionPool* pool, unsigned long* hits, unsigned long* misses, unsigned long* evictions);
+
+#endif
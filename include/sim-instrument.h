@@ -0,0 +1,27 @@
+// file: sim-instrument.h
+#ifndef SIM_INSTRUMENT_H
+#define SIM_INSTRUMENT_H
+
+#include "visa.h"
+
+#define SIM_IDN "SIMULATED,SpectrumAnalyzer,SIM0001,1.0"    // *IDN? response of the simulated analyzer
+#define SIM_MAX_MARKERS 12          // Number of markers the simulated analyzer supports
+#define SIM_MAX_POINTS 24001        // Maximum sweep points of the simulated analyzer
+#define SIM_COMMAND_BYTES 512       // Longest single command the simulator parses
+#define SIM_ERROR_QUEUE 16          // Depth of the SCPI error queue
+
+typedef struct SimInstrument SimInstrument;
+
+SimInstrument* simCreate(unsigned int rttMicros);
+void simDestroy(SimInstrument* sim);
+void simSetRtt(SimInstrument* sim, unsigned int rttMicros);
+unsigned int simRtt(const SimInstrument* sim);
+void simSetResponding(SimInstrument* sim, int responding);
+ViStatus simReadStatusByte(SimInstrument* sim, ViPUInt16 statusByte, ViUInt32 timeoutMs);
+ViStatus simExecute(SimInstrument* sim, const unsigned char* buf, ViUInt32 count, ViPUInt32 retCount);
+ViStatus simTake(SimInstrument* sim, unsigned char* buf, ViUInt32 count, ViPUInt32 retCount);
+ViStatus simWrite(SimInstrument* sim, const unsigned char* buf, ViUInt32 count, ViPUInt32 retCount);
+ViStatus simRead(SimInstrument* sim, unsigned char* buf, ViUInt32 count, ViPUInt32 retCount, ViUInt32 timeoutMs);
+double simAmplitude(double freq, double resBW);
+
+#endif
@@ -0,0 +1,38 @@
+// file: snapshot.h
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include "visa-session.h"
+
+#define SNAPSHOT_MAX_SETTINGS 64        // Settings one snapshot tracks
+#define SNAPSHOT_PATTERN_BYTES 48       // Longest header pattern, including the terminator
+#define SNAPSHOT_VALUE_BYTES 64         // Longest value cached, including the terminator; longer values stay unknown
+#define SNAPSHOT_BATCH 16               // Settings snapshotCapture() queries per round trip
+
+/* A setting of the instrument and its last known value */
+typedef struct {
+    char pattern[SNAPSHOT_PATTERN_BYTES];   // Header in manual notation, e.g. "[:SENSe]:FREQuency:STARt"
+    int suffix;                             // Value of the '#' in pattern, e.g. the marker number; -1 if none
+    unsigned long long endings;             // Filter bits of the mnemonics a command for the setting can end with
+    char value[SNAPSHOT_VALUE_BYTES];       // Value last read or written
+    int known;                              // value is the instrument's current setting
+} SnapshotSetting;
+
+/* Cached configuration of one instrument; see sessionSnapshot() */
+struct StateSnapshot {
+    SnapshotSetting settings[SNAPSHOT_MAX_SETTINGS];
+    int numSettings;
+    unsigned long long endings;             // Filter bits of every tracked setting and of the commands that reset all
+    unsigned long sent;                     // Setup commands snapshotApply() sent
+    unsigned long skipped;                  // Setup commands snapshotApply() skipped as the setting had the value
+};
+
+void snapshotInit(StateSnapshot* snapshot);
+int snapshotTrack(StateSnapshot* snapshot, const char* pattern, int suffix);
+void snapshotForget(StateSnapshot* snapshot);
+void snapshotNote(StateSnapshot* snapshot, const char* message, size_t length, int failed);
+ViStatus snapshotCapture(VisaSession* session, StateSnapshot* snapshot);
+ViStatus snapshotApply(VisaSession* session, StateSnapshot* snapshot, const char* const* commands, int count, int* numSent);
+
+#endif
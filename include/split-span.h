@@ -0,0 +1,13 @@
+// file: split-span.h
+#ifndef SPLIT_SPAN_H
+#define SPLIT_SPAN_H
+
+#include "visa.h"
+#include "visa-session.h"
+
+#define SPLIT_SPAN_MAX 8                // Maximum number of analyzers a span can be split across
+#define SPLIT_COMMAND_BYTES 256         // Longest command a worker formats
+
+int splitSpanCapture(VisaSession** sessions, int numSessions, double startFreq, double stopFreq, int numPoints, double* freq, double* amp);
+
+#endif
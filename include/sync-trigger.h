@@ -0,0 +1,53 @@
+// file: sync-trigger.h
+#ifndef SYNC_TRIGGER_H
+#define SYNC_TRIGGER_H
+
+#include "visa.h"
+#include "visa-session.h"
+
+#define SYNC_MAX_TARGETS 32             // Most instruments triggered together
+#define SYNC_QUERY_BYTES 128            // Longest arm command or reading query a target may give
+#define SYNC_READING_BYTES 256          // Longest reading kept, including the terminator
+#define SYNC_DEFAULT_ARM ":INITiate:CONTinuous OFF;:TRIGger:SOURce BUS;:INITiate"  // Arms one bus-triggered measurement
+#define SYNC_DEFAULT_FETCH ":CALCulate:MARKer1:Y?"  // Reading of an analyzer; e.g. FETCh? for a power meter
+#define SYNC_SETTINGS_QUERY ":INITiate:CONTinuous?;:TRIGger:SOURce?"  // Settings SYNC_DEFAULT_ARM changes
+#define SYNC_SETTING_BYTES 32           // Longest setting kept, including the terminator
+
+/* Instrument to trigger and read */
+typedef struct {
+    VisaSession* session;
+    const char* arm;                    // Commands that arm a bus-triggered measurement, NULL for SYNC_DEFAULT_ARM
+    const char* fetch;                  // Query for the reading once the measurement completed, NULL for SYNC_DEFAULT_FETCH
+} SyncTarget;
+
+/* Trigger settings of a target from before it was armed */
+typedef struct {
+    char continuous[SYNC_SETTING_BYTES];    // Response to :INITiate:CONTinuous?
+    char source[SYNC_SETTING_BYTES];        // Response to :TRIGger:SOURce?
+} SyncSettings;
+
+/* Reading of one target. Times are host microseconds after the release of the triggers */
+typedef struct {
+    ViStatus status;                    // Status of the arm, trigger or read that failed, else of the read
+    int scpiTrigger;                    // 1 if *TRG was written, 0 if viAssertTrigger() triggered the instrument
+    unsigned long long triggerMicros;   // Middle of the trigger call, the best estimate of when the instrument triggered
+    unsigned long long triggerSpan;     // Duration of the trigger call; the trigger happened within it
+    unsigned long long readingMicros;   // When the reading arrived
+    double value;                       // First number in the reading
+    char reading[SYNC_READING_BYTES];   // Response to the reading query, without its terminator
+} SyncReading;
+
+/* Timing of one synchronized trigger */
+typedef struct {
+    unsigned long long releaseMicros;   // monotonicMicros() when the armed targets were released to trigger
+    unsigned long long armMicros;       // Time from the start until every target was armed
+    int triggered;                      // Targets whose trigger succeeded
+    unsigned long long skewMicros;      // Spread of triggerMicros over the targets triggered
+    unsigned long long maxSpanMicros;   // Longest triggerSpan, the uncertainty of each trigger time
+} SyncReport;
+
+ViStatus syncSaveSettings(VisaSession* session, SyncSettings* settings);
+ViStatus syncRestoreSettings(VisaSession* session, const SyncSettings* settings);
+int syncTrigger(const SyncTarget* targets, int numTargets, SyncReading* readings, SyncReport* report);
+
+#endif
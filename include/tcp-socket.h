@@ -0,0 +1,27 @@
+// file: tcp-socket.h
+#ifndef TCP_SOCKET_H
+#define TCP_SOCKET_H
+
+#include <stddef.h>
+#include "visa.h"
+
+#define TCP_RECEIVE_BYTES 65536     // Size of the receive buffer of each connection
+#define TCP_HOST_MAX 256            // Longest host name accepted in a resource descriptor
+
+typedef struct TcpSocket TcpSocket;
+typedef struct TcpListener TcpListener;
+
+int tcpParseResource(const char* resource, char* host, size_t hostSize, int* port);
+TcpSocket* tcpConnect(const char* host, int port, unsigned int timeoutMs);
+void tcpClose(TcpSocket* sock);
+void tcpSetTermChar(TcpSocket* sock, int enabled, unsigned char termChar);
+int tcpSetKeepAlive(TcpSocket* sock, int enabled);
+ViStatus tcpWrite(TcpSocket* sock, const unsigned char* buf, ViUInt32 count, ViPUInt32 retCount);
+ViStatus tcpRead(TcpSocket* sock, unsigned char* buf, ViUInt32 count, ViPUInt32 retCount, ViUInt32 timeoutMs);
+
+TcpListener* tcpListen(const char* host, int port);
+int tcpListenerPort(const TcpListener* listener);
+TcpSocket* tcpAccept(TcpListener* listener, unsigned int timeoutMs);
+void tcpCloseListener(TcpListener* listener);
+
+#endif
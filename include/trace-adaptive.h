@@ -0,0 +1,30 @@
+// file: trace-adaptive.h
+#ifndef TRACE_ADAPTIVE_H
+#define TRACE_ADAPTIVE_H
+
+#define ADAPTIVE_COARSE_DIVISOR 16      // Coarse pass measures one grid point in this many
+#define ADAPTIVE_COARSE_MIN 21          // Minimum number of points in the coarse pass
+#define ADAPTIVE_BUDGET_DIVISOR 4       // Default point budget as a fraction of the grid
+#define ADAPTIVE_GRADIENT_DB 3.0        // Refine an interval whose end points differ by at least this many dB
+#define ADAPTIVE_LEVEL_MARGIN_DB 10.0   // Refine an interval that rises this far above the coarse-pass median
+
+/**
+ * Callback that measures the amplitude at one frequency, e.g. by moving a marker and reading its Y value.
+ * Returns the amplitude in dB.
+ */
+typedef double (*MeasurePointFn)(void* context, double freq);
+
+typedef struct {
+    double startFreq;           // First frequency of the grid
+    double stopFreq;            // Last frequency of the grid
+    int gridPoints;             // Number of points on the uniform grid the planner may measure
+    int coarsePoints;           // Number of evenly spaced points measured in the coarse pass
+    int pointBudget;            // Maximum number of points measured in total
+    double gradientThreshold;   // See ADAPTIVE_GRADIENT_DB
+    double levelMargin;         // See ADAPTIVE_LEVEL_MARGIN_DB
+} AdaptivePlan;
+
+void adaptivePlanDefaults(AdaptivePlan* plan, double startFreq, double stopFreq, int gridPoints);
+int adaptiveCapture(const AdaptivePlan* plan, MeasurePointFn measure, void* context, double* freq, double* amp);
+
+#endif
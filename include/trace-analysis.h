@@ -0,0 +1,37 @@
+// file: trace-analysis.h
+#ifndef TRACE_ANALYSIS_H
+#define TRACE_ANALYSIS_H
+
+#include <stdio.h>
+
+#define ANALYSIS_MAX_PEAKS 16           // Capacity of the peak table in TraceAnalysis
+#define ANALYSIS_PEAKS 5                // Default number of peaks reported after a capture
+#define ANALYSIS_PEAK_EXCURSION 6.0     // Minimum rise and fall in dB for a point to count as a peak
+#define ANALYSIS_OBW_PERCENT 99.0       // Percentage of total power contained in the occupied bandwidth
+#define ANALYSIS_DB_FLOOR -400.0        // Value returned when converting zero or negative linear power to dB
+
+typedef struct {
+    int index;          // Index of the peak in the trace arrays
+    double freq;        // Frequency of the peak
+    double amp;         // Amplitude of the peak in dB
+} TracePeak;
+
+typedef struct {
+    TracePeak peaks[ANALYSIS_MAX_PEAKS];    // Peaks sorted from highest to lowest amplitude
+    int numPeaks;                           // Number of valid entries in peaks[]
+    double bandPower;                       // Integrated power over the whole trace in dB
+    double obw;                             // Occupied bandwidth containing ANALYSIS_OBW_PERCENT of the power
+    double obwLow;                          // Lower edge of the occupied bandwidth
+    double obwHigh;                         // Upper edge of the occupied bandwidth
+} TraceAnalysis;
+
+double fastDbToLinear(double db);
+double fastLinearToDb(double linear);
+
+int traceFindPeaks(const double* freq, const double* amp, int numPoints, int maxPeaks, double excursion, TracePeak* peaks);
+double traceBandPower(const double* freq, const double* amp, int numPoints, double lowFreq, double highFreq, double resBW);
+int traceOccupiedBandwidth(const double* freq, const double* amp, int numPoints, double percent, double* lowFreq, double* highFreq);
+int analyzeTrace(const double* freq, const double* amp, int numPoints, double resBW, TraceAnalysis* result);
+void fprintTraceAnalysis(FILE* stream, const TraceAnalysis* result, const char* prefix);
+
+#endif
@@ -0,0 +1,17 @@
+// file: trace-decimate.h
+#ifndef TRACE_DECIMATE_H
+#define TRACE_DECIMATE_H
+
+#include <stdio.h>
+
+#define DECIMATE_MINMAX 0       // Keep the minimum and maximum of each column (preserves peaks)
+#define DECIMATE_LTTB 1         // Largest-Triangle-Three-Buckets, keeps one representative point per column
+#define SPARKLINE_WIDTH 72      // Default number of columns in the terminal trace view
+#define SPARKLINE_ROWS 8        // Default number of rows in the terminal trace view
+
+int decimateMinMax(const double* amp, int numPoints, int width, double* outMin, double* outMax);
+int decimateLttb(const double* freq, const double* amp, int numPoints, int width, double* outFreq, double* outAmp);
+void fprintSparkline(FILE* stream, const double* minEnv, const double* maxEnv, int width, int rows);
+int fprintTraceSparkline(FILE* stream, const double* freq, const double* amp, int numPoints, int width, int rows, int mode);
+
+#endif
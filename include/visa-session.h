@@ -0,0 +1,110 @@
+// file: visa-session.h
+#ifndef VISA_SESSION_H
+#define VISA_SESSION_H
+
+#include <stddef.h>
+#include "visa.h"
+#include "scpi-validate.h"
+
+#define SESSION_TIMEOUT_MS 2500         // Default VISA timeout in milliseconds
+#define SESSION_COMMAND_BYTES 256       // Longest command sessionWritef() formats
+#define SESSION_RESPONSE_BYTES 256      // Read buffer for numeric query responses
+#define SESSION_MESSAGE_BYTES 1024      // Longest command or query checked mode extends, e.g. a batched marker readout
+#define SESSION_MAX_MARKERS 12          // Most markers a marker capture places per round trip
+#define SESSION_MARKER_MESSAGE_BYTES 48 // Longest share of a batched marker readout one marker needs
+#define SESSION_MAX_BUSES 32            // Maximum GPIB boards and serial ports arbitrated at once
+#define SESSION_HEADER_BYTES 32         // Leading query characters that identify a latency class
+#define SESSION_LATENCY_CLASSES 16      // Query headers whose latencies a session keeps
+#define SESSION_LATENCY_SAMPLES 64      // Latencies kept per query header
+#define SESSION_ADAPTIVE_MIN_SAMPLES 8  // Latencies needed before a query header gets an adaptive timeout
+#define SESSION_ADAPTIVE_MARGIN 3.0     // Adaptive timeout as a multiple of the p99 latency
+#define SESSION_ADAPTIVE_MIN_MS 20      // Shortest adaptive timeout in milliseconds
+#define SESSION_SWEEP_MARGIN 1.5        // Multiple of the sweep time added for queries that wait for a sweep
+#define SESSION_ERROR_BYTES 128         // Longest SCPI error message kept, including the terminator
+#define SESSION_DRAIN_BATCH 8           // :SYSTem:ERRor? queries sessionDrainErrors() sends per round trip
+#define SESSION_DRAIN_MAX 1024          // Most errors drained before giving up on a queue that never empties
+#define SESSION_PROBE_TIMEOUTS 3        // Probe timeouts in a row after which the connection counts as lost
+
+/* Not a VISA status: the instrument reported a SCPI error in checked mode, see sessionLastError() */
+#define SESSION_ERROR_SCPI (_VI_ERROR+0x3FFF8001L)
+/* Not a VISA status: the validator does not know a header of the message, which was not sent */
+#define SESSION_ERROR_HEADER (_VI_ERROR+0x3FFF8002L)
+/* Not a VISA status: a read was asked for while no query awaits its response */
+#define SESSION_ERROR_NO_QUERY (_VI_ERROR+0x3FFF8003L)
+#define SESSION_UNDEFINED_HEADER -113   // SCPI error code recorded for a header the validator rejected
+
+typedef struct VisaSession VisaSession;
+typedef struct StateSnapshot StateSnapshot;
+typedef struct CapabilityProfile CapabilityProfile;
+
+/* Span and bandwidths of a marker capture, read by sessionPrepareMarkerCapture() */
+typedef struct {
+    double startFreq;
+    double stopFreq;
+    double resBW;
+    double vidBW;
+    int numMarkers;     // Markers available for the capture, from 1 to SESSION_MAX_MARKERS; may be lowered
+} MarkerSetup;
+
+/* Entry of an instrument's error queue, e.g. -113,"Undefined header" */
+typedef struct {
+    int code;
+    char message[SESSION_ERROR_BYTES];
+} ScpiError;
+
+VisaSession* sessionOpen(ViSession resourceManager, const char* resource, ViUInt32 timeoutMs, ViStatus* status);
+void sessionClose(VisaSession* session);
+const char* sessionResource(const VisaSession* session);
+ViSession sessionHandle(const VisaSession* session);
+int sessionSharedBus(const VisaSession* session, char* bus, size_t size);
+void sessionLock(VisaSession* session);
+void sessionUnlock(VisaSession* session);
+void sessionBeginInternal(VisaSession* session);
+void sessionEndInternal(VisaSession* session);
+
+ViStatus sessionSetTimeout(VisaSession* session, ViUInt32 timeoutMs);
+ViUInt32 sessionTimeout(VisaSession* session);
+void sessionSetAdaptiveTimeout(VisaSession* session, int enabled);
+int sessionAdaptiveTimeout(VisaSession* session);
+
+ViStatus sessionWrite(VisaSession* session, const char* command);
+ViStatus sessionWritef(VisaSession* session, const char* format, ...);
+ViStatus sessionRead(VisaSession* session, char* response, ViUInt32 size, ViUInt32* count);
+ViStatus sessionQuery(VisaSession* session, const char* query, char* response, ViUInt32 size, ViUInt32* count);
+ViStatus sessionQueryDouble(VisaSession* session, const char* query, double* value);
+ViStatus sessionQueryBlock(VisaSession* session, const char* query, unsigned char* block, size_t size, size_t* received);
+
+void sessionSetValidator(VisaSession* session, ScpiValidator* validator);
+void sessionSetChecked(VisaSession* session, int enabled);
+int sessionChecked(VisaSession* session);
+int sessionLastError(VisaSession* session, ScpiError* error);
+ViStatus sessionDrainErrors(VisaSession* session, ScpiError* errors, int maxErrors, int* numErrors);
+
+void sessionSetProfile(VisaSession* session, const CapabilityProfile* profile);
+const CapabilityProfile* sessionProfile(VisaSession* session);
+
+ViStatus sessionCountMarkers(VisaSession* session, int* numMarkers);
+ViStatus sessionPrepareMarkerCapture(VisaSession* session, MarkerSetup* setup);
+ViStatus sessionMeasureMarker(VisaSession* session, double freq, double* amp);
+ViStatus sessionMeasureMarkers(VisaSession* session, const double* freq, int count, double* amp);
+double sessionMarkerPoint(void* session, double freq);
+ViStatus sessionCaptureMarkers(VisaSession* session, const MarkerSetup* setup, int numPoints, double* freq, double* amp);
+ViStatus sessionFinishMarkerCapture(VisaSession* session);
+ViStatus sessionCaptureTrace(VisaSession* session, int numPoints, MarkerSetup* setup, double* freq, double* amp);
+
+ViStatus sessionAssertTrigger(VisaSession* session, int* scpiTrigger);
+
+int sessionHealthy(VisaSession* session);
+unsigned long long sessionIdleMicros(VisaSession* session);
+ViStatus sessionEnableKeepAlive(VisaSession* session);
+ViStatus sessionProbe(VisaSession* session, ViUInt32 timeoutMs);
+ViStatus sessionReopen(VisaSession* session);
+
+StateSnapshot* sessionSnapshot(VisaSession* session);
+
+ViStatus sessionEnableAsync(VisaSession* session);
+ViStatus sessionWriteAsync(VisaSession* session, const char* command, ViJobId* job);
+ViStatus sessionReadAsync(VisaSession* session, char* response, ViUInt32 size, ViJobId* job);
+ViStatus sessionWaitAsync(VisaSession* session, ViUInt32 timeoutMs, ViJobId* job, ViStatus* jobStatus, ViUInt32* count);
+
+#endif
@@ -0,0 +1,18 @@
+// file: visa-sim.h
+#ifndef VISA_SIM_H
+#define VISA_SIM_H
+
+#define VISA_SIM_DEFAULT_RESOURCES "SIM0::INSTR"    // Resources simulated when VISA_SIM_RESOURCES is not set
+#define VISA_SIM_MAX_RESOURCES 128                  // Maximum number of simulated resources
+#define VISA_SIM_MAX_SESSIONS 256                   // Maximum number of sessions open at once
+#define VISA_SIM_DEFAULT_TIMEOUT 2000               // Default VI_ATTR_TMO_VALUE of a new session
+#define VISA_SIM_MAX_JOBS 16                        // Maximum asynchronous jobs pending on one session
+#define VISA_SIM_MAX_EVENTS 256                     // Maximum I/O completion events not yet closed
+#define VISA_SIM_OPEN_ROUND_TRIPS 4                 // Round trips viOpen() of a simulated resource takes, as a LAN handshake
+
+void visaSimConfigure(const char* resources, unsigned int rttMicros);
+unsigned long visaSimBusCollisions();
+int visaSimSetResponding(const char* resource, int responding);
+int visaSimRestart(const char* resource, unsigned int downMs);
+
+#endif
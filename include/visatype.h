@@ -71,7 +71,7 @@ typedef _VI_SIGNED __int64  ViInt64;
 #elif defined(__GNUC__) && (__GNUC__ >= 3)
 #include <limits.h>
 //#include <sys/types.h>
-#include <cstdint>
+#include <stdint.h>
 typedef uint64_t           ViUInt64;
 typedef int64_t             ViInt64;
 #define _VI_INT64_UINT64_DEFINED
@@ -0,0 +1,295 @@
+/*********************************************************************/
+/*                                                                   */
+/* Capability profiles of analyzer models.                           */
+/*                                                                   */
+/* A profile says what a model supports that makes captures faster: */
+/* binary REAL,32 trace transfers and their longest trace, how many  */
+/* markers a marker walk can read per round trip, how long a batched */
+/* message may be, and whether the LAN interface speaks HiSLIP.      */
+/* Profiles are matched on the manufacturer and model fields of the  */
+/* *IDN? response. A few models are built in; any other model is     */
+/* probed once by capabilitySelect() and the result is kept in the   */
+/* table, which capabilitySave() writes out so later runs skip the   */
+/* probe. A model whose probe fails gets a marker-only profile for  */
+/* the rest of the run, so it is not probed again on every connect;  */
+/* that profile is not saved, so a later run probes it again. A      */
+/* session given a profile with sessionSetProfile() uses it for      */
+/* every capture.                                                    */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "platform.h"
+#include "scpi-parse.h"
+#include "discovery.h"
+#include "capability.h"
+
+struct CapabilityTable {
+    PlatformMutex mutex;                // Guards the profiles; not held while a model is probed
+    CapabilityProfile profiles[CAPABILITY_MAX_PROFILES];
+    int numProfiles;
+};
+
+/* Models whose capabilities are documented, so they need no probe */
+static const CapabilityProfile builtinProfiles[] = {
+    { "Keysight*", "N90[0-4]0[AB]", 1, 40001, SESSION_MESSAGE_BYTES, 1, 12, 0, 0 },    // X-Series
+    { "Agilent*", "N90[0-3]0A", 1, 40001, SESSION_MESSAGE_BYTES, 0, 12, 0, 0 },        // X-Series, older firmware
+    { "Rohde&Schwarz", "FSV*", 1, 32001, SESSION_MESSAGE_BYTES, 1, 16, 0, 0 },
+    { "Rohde&Schwarz", "FSW*", 1, 100001, SESSION_MESSAGE_BYTES, 1, 16, 0, 0 }
+};
+
+/* Copies one comma separated field of an *IDN? response without surrounding whitespace. Returns the next field */
+static const char* copyField(const char* field, char* text) {
+    while (isspace((unsigned char)*field))
+        field++;
+    size_t length = 0;
+    while (field[length] != '\0' && field[length] != ',')
+        length++;
+    const char* next = field[length] == ',' ? field + length + 1 : field + length;
+    while (length > 0 && isspace((unsigned char)field[length - 1]))
+        length--;
+    if (length >= CAPABILITY_NAME_BYTES)
+        length = CAPABILITY_NAME_BYTES - 1;
+    memcpy(text, field, length);
+    text[length] = '\0';
+    return next;
+}
+
+/* Finds the profile of a manufacturer and model; the caller holds the mutex */
+static const CapabilityProfile* findProfile(const CapabilityTable* table, const char* manufacturer, const char* model) {
+    for (int i = 0; i < table->numProfiles; i++) {
+        const CapabilityProfile* profile = &table->profiles[i];
+        if (discoveryGlob(profile->manufacturer, manufacturer) && discoveryGlob(profile->model, model))
+            return profile;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Creates a table holding the built-in profiles.
+ * @return The table, or NULL on error.
+ */
+CapabilityTable* capabilityCreate(void) {
+    CapabilityTable* table = calloc(1, sizeof(CapabilityTable));
+    if (table == NULL)
+        return NULL;
+    mutexInit(&table->mutex);
+    table->numProfiles = (int)(sizeof(builtinProfiles) / sizeof(builtinProfiles[0]));
+    memcpy(table->profiles, builtinProfiles, sizeof(builtinProfiles));
+    return table;
+}
+
+/**
+ * @brief Frees a table. Sessions given one of its profiles must not use it any more.
+ */
+void capabilityDestroy(CapabilityTable* table) {
+    if (table == NULL)
+        return;
+    mutexDestroy(&table->mutex);
+    free(table);
+}
+
+/**
+ * @brief Finds the profile of the model that sent an *IDN? response, e.g. "Keysight Technologies,N9020B,...".
+ * @return The profile, valid until the table is destroyed, or NULL if the model is neither built in nor probed yet.
+ */
+const CapabilityProfile* capabilityFind(CapabilityTable* table, const char* idn) {
+    char manufacturer[CAPABILITY_NAME_BYTES], model[CAPABILITY_NAME_BYTES];
+    copyField(copyField(idn, manufacturer), model);
+    mutexLock(&table->mutex);
+    const CapabilityProfile* profile = findProfile(table, manufacturer, model);
+    mutexUnlock(&table->mutex);
+    return profile;
+}
+
+/**
+ * @brief Finds out what the analyzer on a session supports: its markers are counted, its sweep points read (with MAX
+ * where the analyzer understands it), a REAL,32 trace transfer tried and, for a VXI-11 LAN resource, a HiSLIP
+ * connection opened. Each probe waits at most CAPABILITY_PROBE_TIMEOUT_MS. The trace format is set back to ASCii,
+ * the byte order to what it was, and the error queue cleared afterwards. The manufacturer and model of profile are
+ * left as they are.
+ *
+ * @param resourceManager Resource manager to open the HiSLIP connection with.
+ * @param profile Output capabilities; probed is set.
+ * @return Status of the first probe that must succeed, i.e. counting markers and reading the sweep points.
+ */
+ViStatus capabilityProbe(VisaSession* session, ViSession resourceManager, CapabilityProfile* profile) {
+    char hislip[VI_FIND_BUFLEN];
+    char byteOrder[SESSION_RESPONSE_BYTES];
+    double points = 0, maxPoints = 0;
+    size_t received, offset, length;
+
+    profile->binaryTrace = 0;
+    profile->maxPoints = 0;
+    profile->maxMessageBytes = CAPABILITY_DEFAULT_MESSAGE_BYTES;
+    profile->hislip = 0;
+    profile->numMarkers = 1;
+    profile->probed = 1;
+    profile->failed = 0;
+
+    sessionBeginInternal(session);
+    ViUInt32 timeout = sessionTimeout(session);
+    if (timeout > CAPABILITY_PROBE_TIMEOUT_MS)
+        sessionSetTimeout(session, CAPABILITY_PROBE_TIMEOUT_MS);
+
+    ViStatus status = sessionCountMarkers(session, &profile->numMarkers);
+    if (status >= VI_SUCCESS)
+        status = sessionQueryDouble(session, ":SENSe:SWEep:POINts?", &points);
+    if (status < VI_SUCCESS || points < 1)
+        goto done;
+    if (sessionQueryDouble(session, ":SENSe:SWEep:POINts? MAX", &maxPoints) < VI_SUCCESS || maxPoints < points)
+        maxPoints = points;
+    profile->maxPoints = (int)maxPoints;
+
+    /* A trace of the current sweep points must come back as a block of exactly that many values */
+    if (sessionQuery(session, ":FORMat:BORDer?", byteOrder, sizeof(byteOrder), NULL) < VI_SUCCESS)
+        byteOrder[0] = '\0';
+    byteOrder[strcspn(byteOrder, "\r\n")] = '\0';
+    size_t size = (size_t)points * 4 + 32;
+    unsigned char* block = malloc(size);
+    if (block != NULL && sessionWrite(session, ":FORMat:TRACe:DATA REAL,32;:FORMat:BORDer SWAPped") >= VI_SUCCESS
+        && sessionQueryBlock(session, ":TRACe:DATA? TRACE1", block, size, &received) == VI_SUCCESS
+        && scpiBlockHeader(block, received, &offset, &length) == 0 && length == (size_t)points * 4)
+        profile->binaryTrace = 1;
+    free(block);
+    if (byteOrder[0] != '\0')
+        sessionWritef(session, ":FORMat:TRACe:DATA ASCii;:FORMat:BORDer %s;*CLS", byteOrder);
+    else
+        sessionWrite(session, ":FORMat:TRACe:DATA ASCii;*CLS");
+
+    if (capabilityHislipResource(sessionResource(session), hislip, sizeof(hislip)) == 0) {
+        ViSession instr;
+        if (viOpen(resourceManager, hislip, VI_NULL, CAPABILITY_PROBE_TIMEOUT_MS, &instr) >= VI_SUCCESS) {
+            profile->hislip = 1;
+            viClose(instr);
+        }
+    }
+
+done:
+    sessionSetTimeout(session, timeout);
+    sessionEndInternal(session);
+    return status;
+}
+
+/**
+ * @brief Returns the profile of the model that sent an *IDN? response. An unknown model is probed with
+ * capabilityProbe() on the session first and its profile added to the table, so it is probed once. If the probe
+ * fails the model gets a marker-only profile with failed set, which later calls return without probing.
+ *
+ * @param resourceManager Resource manager to open the HiSLIP connection of a probe with.
+ * @param status Output status of the probe, VI_SUCCESS if none was needed. May be NULL.
+ * @return The profile, valid until the table is destroyed, or NULL if the table is full.
+ */
+const CapabilityProfile* capabilitySelect(CapabilityTable* table, VisaSession* session, ViSession resourceManager,
+    const char* idn, ViStatus* status) {
+    CapabilityProfile probed;
+    if (status != NULL)
+        *status = VI_SUCCESS;
+    copyField(copyField(idn, probed.manufacturer), probed.model);
+
+    mutexLock(&table->mutex);
+    const CapabilityProfile* profile = findProfile(table, probed.manufacturer, probed.model);
+    mutexUnlock(&table->mutex);
+    if (profile != NULL)
+        return profile;
+
+    ViStatus probeStatus = capabilityProbe(session, resourceManager, &probed);
+    if (status != NULL)
+        *status = probeStatus;
+    if (probeStatus < VI_SUCCESS) {
+        probed.binaryTrace = 0;
+        probed.maxPoints = 0;
+        probed.hislip = 0;
+        probed.failed = 1;
+    }
+
+    /* Another session may have probed the same model meanwhile */
+    mutexLock(&table->mutex);
+    profile = findProfile(table, probed.manufacturer, probed.model);
+    if (profile == NULL && table->numProfiles < CAPABILITY_MAX_PROFILES) {
+        table->profiles[table->numProfiles] = probed;
+        profile = &table->profiles[table->numProfiles++];
+    }
+    mutexUnlock(&table->mutex);
+    if (profile == NULL && status != NULL && probeStatus >= VI_SUCCESS)
+        *status = VI_ERROR_ALLOC;
+    return profile;
+}
+
+/**
+ * @brief Adds the probed profiles saved by capabilitySave(). Profiles of models the table knows already are skipped.
+ * @return 0 on success, 1 if the file could not be read.
+ */
+int capabilityLoad(CapabilityTable* table, const char* path) {
+    char line[2 * CAPABILITY_NAME_BYTES + 64];
+    CapabilityProfile profile;
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return 1;
+
+    mutexLock(&table->mutex);
+    while (fgets(line, sizeof(line), file) != NULL && table->numProfiles < CAPABILITY_MAX_PROFILES) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%47[^,],%47[^,],%d,%d,%d,%d,%d", profile.manufacturer, profile.model, &profile.binaryTrace,
+            &profile.maxPoints, &profile.maxMessageBytes, &profile.hislip, &profile.numMarkers) != 7)
+            continue;
+        if (findProfile(table, profile.manufacturer, profile.model) != NULL)
+            continue;
+        profile.probed = 1;
+        profile.failed = 0;
+        table->profiles[table->numProfiles++] = profile;
+    }
+    mutexUnlock(&table->mutex);
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Writes the probed profiles, one per line, for capabilityLoad() to read in a later run.
+ * @return 0 on success, 1 if the file could not be written.
+ */
+int capabilitySave(CapabilityTable* table, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 1;
+    mutexLock(&table->mutex);
+    fprintf(file, "# manufacturer,model,binary trace,max points,max message bytes,HiSLIP,markers\n");
+    for (int i = 0; i < table->numProfiles; i++) {
+        const CapabilityProfile* profile = &table->profiles[i];
+        if (profile->probed && !profile->failed)
+            fprintf(file, "%s,%s,%d,%d,%d,%d,%d\n", profile->manufacturer, profile->model, profile->binaryTrace,
+                profile->maxPoints, profile->maxMessageBytes, profile->hislip, profile->numMarkers);
+    }
+    mutexUnlock(&table->mutex);
+    return fclose(file) != 0;
+}
+
+/**
+ * @brief Derives the HiSLIP resource of a LAN instrument, e.g. TCPIP0::192.168.1.5::hislip0::INSTR from
+ * TCPIP0::192.168.1.5::inst0::INSTR or TCPIP0::192.168.1.5::INSTR. A HiSLIP resource is copied as it is.
+ *
+ * @param hislip Output resource descriptor.
+ * @param size Capacity of hislip.
+ * @return 0 on success, 1 if the resource is not a TCPIP INSTR resource or the result does not fit.
+ */
+int capabilityHislipResource(const char* resource, char* hislip, size_t size) {
+    if (!discoveryGlob("TCPIP*::*INSTR", resource) || discoveryGlob("TCPIP*::*::*::*::*", resource))
+        return 1;
+    const char* host = strstr(resource, "::") + 2;
+    const char* hostEnd = strstr(host, "::");
+    if (hostEnd == NULL)
+        return 1;
+    const char* device = hostEnd + 2;
+    if (discoveryGlob("hislip*::INSTR", device)) {
+        if (strlen(resource) >= size)
+            return 1;
+        strcpy(hislip, resource);
+        return 0;
+    }
+    int written = snprintf(hislip, size, "%.*s::hislip0::INSTR", (int)(hostEnd - resource), resource);
+    return written < 0 || (size_t)written >= size;
+}
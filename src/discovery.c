@@ -0,0 +1,220 @@
+/*********************************************************************/
+/*                                                                   */
+/* Selective resource discovery.                                     */
+/*                                                                   */
+/* Searching for "?*" lists every resource, including serial ports   */
+/* that each take a while to open. A DiscoveryFilter narrows the     */
+/* search: an interface list becomes a viFindRsrc() expression such  */
+/* as "GPIB?*|TCPIP?*", so VISA does not enumerate the rest at all,  */
+/* and include/exclude globs are applied to the descriptors found.   */
+/* Probing, i.e. opening each resource to check that it responds,    */
+/* can be turned off to list descriptors straight away.              */
+/*                                                                   */
+/* Globs are case-insensitive: '*' matches any run of characters,    */
+/* '?' one character and [...] a character class, e.g.              */
+/* "TCPIP*::5025::SOCKET" or "ASRL[1-4]::*".                         */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "discovery.h"
+
+/**
+ * @brief Initializes a filter that lists and probes every resource.
+ */
+void discoveryInit(DiscoveryFilter* filter) {
+    memset(filter, 0, sizeof(DiscoveryFilter));
+    filter->probe = 1;
+}
+
+/**
+ * @brief Adds a glob that descriptors may match to be listed. The pattern must stay valid while the filter is used.
+ * @return 0 on success, 1 if the filter has DISCOVERY_MAX_PATTERNS include patterns already.
+ */
+int discoveryInclude(DiscoveryFilter* filter, const char* pattern) {
+    if (filter->numInclude == DISCOVERY_MAX_PATTERNS)
+        return 1;
+    filter->include[filter->numInclude++] = pattern;
+    return 0;
+}
+
+/**
+ * @brief Adds a glob that keeps matching descriptors from being listed. The pattern must stay valid while the filter
+ * is used.
+ * @return 0 on success, 1 if the filter has DISCOVERY_MAX_PATTERNS exclude patterns already.
+ */
+int discoveryExclude(DiscoveryFilter* filter, const char* pattern) {
+    if (filter->numExclude == DISCOVERY_MAX_PATTERNS)
+        return 1;
+    filter->exclude[filter->numExclude++] = pattern;
+    return 0;
+}
+
+/**
+ * @brief Adds interfaces whose resources are listed, e.g. "gpib,tcpip". Names are the descriptor prefixes without the
+ * board number: GPIB, GPIB-VXI, VXI, ASRL, PXI, TCPIP, USB.
+ * @return 0 on success, 1 if a name is empty or invalid or there are too many.
+ */
+int discoveryInterfaces(DiscoveryFilter* filter, const char* list) {
+    while (*list != '\0') {
+        size_t length = strcspn(list, ",");
+        if (length == 0 || length >= DISCOVERY_INTF_NAME || filter->numInterfaces == DISCOVERY_MAX_PATTERNS)
+            return 1;
+        char* name = filter->interfaces[filter->numInterfaces];
+        for (size_t i = 0; i < length; i++) {
+            if (!isalpha((unsigned char)list[i]) && list[i] != '-')
+                return 1;
+            name[i] = (char)toupper((unsigned char)list[i]);
+        }
+        name[length] = '\0';
+        filter->numInterfaces++;
+        list += length;
+        if (*list == ',')
+            list++;
+    }
+    return 0;
+}
+
+/* Matches one character against the class starting at pattern[0] == '['. Returns the position after the class, or
+   NULL if the character is not in it or the class is not terminated */
+static const char* matchClass(const char* pattern, char c) {
+    const char* p = pattern + 1;
+    int negate = (*p == '!' || *p == '^');
+    if (negate)
+        p++;
+    if (*p == '\0')
+        return NULL;
+    int upper = toupper((unsigned char)c);
+    int found = 0;
+    do {
+        int low = toupper((unsigned char)*p), high = low;
+        if (p[1] == '-' && p[2] != ']' && p[2] != '\0') {
+            high = toupper((unsigned char)p[2]);
+            p += 2;
+        }
+        if (low <= upper && upper <= high)
+            found = 1;
+        p++;
+    } while (*p != ']' && *p != '\0');
+    if (*p == '\0')
+        return NULL;
+    return found != negate ? p + 1 : NULL;
+}
+
+/**
+ * @brief Matches text against a case-insensitive glob.
+ * @return 1 if the whole text matches, 0 otherwise.
+ */
+int discoveryGlob(const char* pattern, const char* text) {
+    switch (*pattern) {
+    case '\0':
+        return *text == '\0';
+    case '*':
+        do {
+            if (discoveryGlob(pattern + 1, text))
+                return 1;
+        } while (*text++ != '\0');
+        return 0;
+    case '?':
+        return *text != '\0' && discoveryGlob(pattern + 1, text + 1);
+    case '[': {
+        if (*text == '\0')
+            return 0;
+        const char* rest = matchClass(pattern, *text);
+        return rest != NULL && discoveryGlob(rest, text + 1);
+    }
+    default:
+        return toupper((unsigned char)*pattern) == toupper((unsigned char)*text) && discoveryGlob(pattern + 1, text + 1);
+    }
+}
+
+/**
+ * @brief Tests whether a resource descriptor passes the interface list and the include and exclude globs.
+ * @return 1 if the resource is listed, 0 otherwise.
+ */
+int discoveryMatches(const DiscoveryFilter* filter, const char* descriptor) {
+    if (filter->numInterfaces > 0) {
+        size_t length = 0;
+        while (isalpha((unsigned char)descriptor[length]) || descriptor[length] == '-')
+            length++;
+        int found = 0;
+        for (int i = 0; i < filter->numInterfaces && !found; i++) {
+            const char* name = filter->interfaces[i];
+            found = strlen(name) == length;
+            for (size_t j = 0; j < length && found; j++)
+                found = name[j] == toupper((unsigned char)descriptor[j]);
+        }
+        if (!found)
+            return 0;
+    }
+
+    int included = filter->numInclude == 0;
+    for (int i = 0; i < filter->numInclude && !included; i++)
+        included = discoveryGlob(filter->include[i], descriptor);
+    for (int i = 0; i < filter->numExclude && included; i++)
+        included = !discoveryGlob(filter->exclude[i], descriptor);
+    return included;
+}
+
+/**
+ * @brief Builds the viFindRsrc() expression for a filter: DISCOVERY_ALL, or one alternative per interface.
+ *
+ * @param expression Output expression. DISCOVERY_ALL if the alternatives do not fit.
+ * @param size Capacity of expression, at least sizeof(DISCOVERY_ALL).
+ */
+void discoveryExpression(const DiscoveryFilter* filter, char* expression, size_t size) {
+    size_t length = 0;
+    for (int i = 0; i < filter->numInterfaces; i++) {
+        int written = snprintf(expression + length, size - length, "%s%s?*", i > 0 ? "|" : "", filter->interfaces[i]);
+        if (written < 0 || (size_t)written >= size - length) {
+            length = 0;
+            break;
+        }
+        length += written;
+    }
+    if (length == 0)
+        strcpy(expression, DISCOVERY_ALL);
+}
+
+/**
+ * @brief Finds the resources that pass a filter and reports each one, probed with viOpen() if the filter says so. With
+ * a pool the probe opens a session through it, so the sessions to the resources probed last stay open.
+ *
+ * @param found Called for each resource, in the order VISA finds them.
+ * @param context Passed to found.
+ * @return VI_SUCCESS, VI_ERROR_RSRC_NFOUND if VISA finds nothing, or the error status of the failed search.
+ */
+ViStatus discoveryFind(ViSession resourceManager, const DiscoveryFilter* filter, DiscoveryFn found, void* context) {
+    char expression[VI_FIND_BUFLEN];
+    char descriptor[VI_FIND_BUFLEN];
+    ViFindList findList;
+    ViUInt32 numFound;
+
+    discoveryExpression(filter, expression, sizeof(expression));
+    ViStatus status = viFindRsrc(resourceManager, expression, &findList, &numFound, descriptor);
+    if (status < VI_SUCCESS)
+        return status;
+
+    for (ViUInt32 i = 0; i < numFound; i++) {
+        if (i > 0 && (status = viFindNext(findList, descriptor)) < VI_SUCCESS)
+            break;
+        if (!discoveryMatches(filter, descriptor))
+            continue;
+
+        ViStatus probeStatus = VI_SUCCESS;
+        if (filter->probe && filter->pool != NULL) {
+            poolRelease(filter->pool, poolAcquire(filter->pool, descriptor, &probeStatus));
+        }
+        else if (filter->probe) {
+            ViSession instr;
+            probeStatus = viOpen(resourceManager, descriptor, VI_NULL, VI_NULL, &instr);
+            if (probeStatus >= VI_SUCCESS)
+                viClose(instr);
+        }
+        found(descriptor, probeStatus, context);
+    }
+    viClose(findList);
+    return status < VI_SUCCESS ? status : VI_SUCCESS;
+}
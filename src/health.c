@@ -0,0 +1,161 @@
+/*********************************************************************/
+/*                                                                   */
+/* Background connection health monitor.                             */
+/*                                                                   */
+/* A thread watches a set of sessions. Sessions that have been idle  */
+/* for the probe interval are probed with *STB?, unless the VISA     */
+/* library keeps their LAN connection alive (VI_ATTR_TCPIP_KEEPALIVE)*/
+/* and reports a lost connection by itself. A session found          */
+/* unhealthy, by a probe or by a failed call, is reopened with       */
+/* exponential back-off, so a rebooted instrument is usable again    */
+/* within moments of coming back while callers fail fast meanwhile.  */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+#include "health.h"
+
+typedef struct {
+    VisaSession* session;
+    int keepAlive;                      // The VISA library watches the connection; no probes needed
+    unsigned int backoffMs;             // Wait before the next reconnect attempt
+    unsigned long long nextAttempt;     // monotonicMicros() of the next reconnect attempt, 0 if none is due
+} WatchedSession;
+
+struct HealthMonitor {
+    PlatformThread thread;
+    PlatformMutex mutex;                // Guards the watch list; held while a session is probed or reopened
+    WatchedSession watched[HEALTH_MAX_SESSIONS];
+    int numWatched;
+    unsigned int probeIntervalMs;
+    int stopping;
+    unsigned long probes;
+    unsigned long reconnects;
+};
+
+/* Probes an idle session, or tries to reopen an unhealthy one when its back-off has elapsed */
+static void checkSession(HealthMonitor* monitor, WatchedSession* watched) {
+    unsigned long long now = monotonicMicros();
+
+    if (sessionHealthy(watched->session)) {
+        if (watched->keepAlive || sessionIdleMicros(watched->session) < (unsigned long long)monitor->probeIntervalMs * 1000)
+            return;
+        ViUInt32 timeout = sessionTimeout(watched->session);
+        monitor->probes++;
+        sessionProbe(watched->session, timeout < HEALTH_PROBE_TIMEOUT_MS ? timeout : HEALTH_PROBE_TIMEOUT_MS);
+        /* A probe that timed out while the instrument is busy leaves the session healthy; it is probed again later */
+        if (sessionHealthy(watched->session))
+            return;
+    }
+    if (watched->nextAttempt == 0) {
+        watched->backoffMs = HEALTH_BACKOFF_MIN_MS;
+        watched->nextAttempt = now + (unsigned long long)watched->backoffMs * 1000;
+        return;
+    }
+    if (now < watched->nextAttempt)
+        return;
+
+    if (sessionReopen(watched->session) >= VI_SUCCESS) {
+        monitor->reconnects++;
+        watched->nextAttempt = 0;
+        return;
+    }
+    watched->backoffMs = watched->backoffMs * 2 < HEALTH_BACKOFF_MAX_MS ? watched->backoffMs * 2 : HEALTH_BACKOFF_MAX_MS;
+    watched->nextAttempt = monotonicMicros() + (unsigned long long)watched->backoffMs * 1000;
+}
+
+static THREAD_FUNC monitorThread(void* arg) {
+    HealthMonitor* monitor = arg;
+    for (;;) {
+        mutexLock(&monitor->mutex);
+        if (monitor->stopping) {
+            mutexUnlock(&monitor->mutex);
+            return THREAD_RETURN;
+        }
+        for (int i = 0; i < monitor->numWatched; i++)
+            checkSession(monitor, &monitor->watched[i]);
+        mutexUnlock(&monitor->mutex);
+        sleepMs(HEALTH_TICK_MS);
+    }
+}
+
+/**
+ * @brief Starts a monitor thread with no sessions to watch.
+ *
+ * @param probeIntervalMs Idle time after which a session is probed, e.g. HEALTH_PROBE_INTERVAL_MS.
+ * @return The monitor, or NULL on error.
+ */
+HealthMonitor* healthStart(unsigned int probeIntervalMs) {
+    HealthMonitor* monitor = calloc(1, sizeof(HealthMonitor));
+    if (monitor == NULL)
+        return NULL;
+    mutexInit(&monitor->mutex);
+    monitor->probeIntervalMs = probeIntervalMs;
+    if (threadCreate(&monitor->thread, monitorThread, monitor) != 0) {
+        mutexDestroy(&monitor->mutex);
+        free(monitor);
+        return NULL;
+    }
+    return monitor;
+}
+
+/**
+ * @brief Stops the monitor thread and frees the monitor. Watched sessions are left open.
+ */
+void healthStop(HealthMonitor* monitor) {
+    if (monitor == NULL)
+        return;
+    mutexLock(&monitor->mutex);
+    monitor->stopping = 1;
+    mutexUnlock(&monitor->mutex);
+    threadJoin(monitor->thread);
+    mutexDestroy(&monitor->mutex);
+    free(monitor);
+}
+
+/**
+ * @brief Starts watching a session. VI_ATTR_TCPIP_KEEPALIVE is enabled on it where supported; other sessions are
+ * probed when idle.
+ * @return 0 on success, 1 if the monitor watches HEALTH_MAX_SESSIONS sessions already.
+ */
+int healthWatch(HealthMonitor* monitor, VisaSession* session) {
+    int keepAlive = sessionEnableKeepAlive(session) >= VI_SUCCESS;
+    mutexLock(&monitor->mutex);
+    if (monitor->numWatched == HEALTH_MAX_SESSIONS) {
+        mutexUnlock(&monitor->mutex);
+        return 1;
+    }
+    WatchedSession* watched = &monitor->watched[monitor->numWatched++];
+    watched->session = session;
+    watched->keepAlive = keepAlive;
+    watched->backoffMs = HEALTH_BACKOFF_MIN_MS;
+    watched->nextAttempt = 0;
+    mutexUnlock(&monitor->mutex);
+    return 0;
+}
+
+/**
+ * @brief Stops watching a session. Once this returns the monitor no longer uses it, so it may be closed.
+ */
+void healthUnwatch(HealthMonitor* monitor, VisaSession* session) {
+    mutexLock(&monitor->mutex);
+    for (int i = 0; i < monitor->numWatched; i++) {
+        if (monitor->watched[i].session == session) {
+            monitor->watched[i] = monitor->watched[--monitor->numWatched];
+            break;
+        }
+    }
+    mutexUnlock(&monitor->mutex);
+}
+
+/**
+ * @brief Reports how many probes have been sent and how many sessions have been reopened.
+ */
+void healthStats(HealthMonitor* monitor, unsigned long* probes, unsigned long* reconnects) {
+    mutexLock(&monitor->mutex);
+    *probes = monitor->probes;
+    *reconnects = monitor->reconnects;
+    mutexUnlock(&monitor->mutex);
+}
@@ -0,0 +1,418 @@
+/*********************************************************************/
+/*                                                                   */
+/* Command journal recording and deterministic replay.               */
+/*                                                                   */
+/* While recording, every write and read made through                */
+/* journalViWrite() and journalViRead() is appended to a binary      */
+/* journal. Each record is, in host byte order:                      */
+/*      unsigned long long  microseconds since recording started     */
+/*      unsigned int        session handle                           */
+/*      char                direction (JOURNAL_OPEN/WRITE/READ)      */
+/*      int                 VISA status of the call                  */
+/*      unsigned int        byte count                               */
+/*      byte count bytes    data written or read                     */
+/*                                                                   */
+/* journalViOpen() records the resource descriptor of each session   */
+/* it opens, so the records of several sessions can be told apart.   */
+/*                                                                   */
+/* While replaying, the same functions stand in for the instruments: */
+/* journalViOpen() hands out a session for each recorded resource,   */
+/* writes on it are checked against that resource's recorded writes  */
+/* and reads return its recorded bytes and status, paced to the      */
+/* recorded timestamps divided by the replay speed. A resource        */
+/* reopened while recording is still one resource when replayed.     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "journal.h"
+
+typedef struct {
+    unsigned long long timestamp;   // Microseconds since recording started
+    ViSession session;              // Session the call was made on
+    char direction;                 // JOURNAL_WRITE or JOURNAL_READ
+    ViStatus status;                // Status returned by the call
+    ViUInt32 length;                // Number of data bytes
+    long offset;                    // Offset of the data bytes in replayData
+    int resource;                   // Index in replayResources of the session's resource, -1 if it was not opened
+} JournalRecord;
+
+/* Session handle of the recording and the resource it was opened to, while a journal is loaded */
+typedef struct {
+    ViSession handle;
+    int resource;
+} JournalHandle;
+
+static PlatformMutex journalMutex;
+static int mutexReady;
+static PlatformAtomic recording;            // Set while recordFile is open, so callers need not take the mutex
+static PlatformAtomic replaying;            // Set while replayRecords are loaded
+
+static FILE* recordFile;                    // Journal being recorded, NULL when not recording
+static unsigned long long recordStart;      // monotonicMicros() when recording started
+
+static JournalRecord* replayRecords;        // Records loaded for replay, NULL when not replaying
+static int replayCount;                     // Number of loaded records
+static char replayResources[JOURNAL_MAX_RESOURCES][VI_FIND_BUFLEN];    // Resources opened in the journal
+static int replayResourceCount;             // Number of resources opened in the journal
+static int replayCursors[JOURNAL_MAX_RESOURCES];    // Index of the next record to replay of each resource
+static unsigned char* replayData;           // Data bytes of all loaded records
+static double replaySpeed;                  // Playback speed factor, 0 or less to replay without delays
+static unsigned long long replayStart;      // monotonicMicros() when replay started
+
+static void ensureMutex() {
+    if (!mutexReady) {
+        mutexInit(&journalMutex);
+        mutexReady = 1;
+    }
+}
+
+/**
+ * @brief Starts recording all I/O made through the journal functions to a new journal file.
+ *
+ * @param path Journal file to create. An existing file is overwritten.
+ * @return 0 on success, 1 on error.
+ */
+int journalStartRecording(const char* path) {
+    ensureMutex();
+    journalStopRecording();
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Error: Could not create journal %s.\n", path);
+        return 1;
+    }
+    unsigned short version = JOURNAL_VERSION;
+    fwrite(JOURNAL_MAGIC, 1, 4, file);
+    fwrite(&version, sizeof(version), 1, file);
+
+    mutexLock(&journalMutex);
+    recordFile = file;
+    recordStart = monotonicMicros();
+    atomicStore(&recording, 1);
+    mutexUnlock(&journalMutex);
+    return 0;
+}
+
+/**
+ * @brief Stops recording and closes the journal file. Does nothing if not recording.
+ */
+void journalStopRecording() {
+    ensureMutex();
+    mutexLock(&journalMutex);
+    if (recordFile != NULL) {
+        atomicStore(&recording, 0);
+        fclose(recordFile);
+        recordFile = NULL;
+    }
+    mutexUnlock(&journalMutex);
+}
+
+/**
+ * @brief Appends one record to the journal being recorded.
+ */
+static void journalRecord(ViSession session, char direction, ViStatus status, const void* data, ViUInt32 length) {
+    mutexLock(&journalMutex);
+    if (recordFile != NULL) {
+        unsigned long long timestamp = monotonicMicros() - recordStart;
+        fwrite(&timestamp, sizeof(timestamp), 1, recordFile);
+        fwrite(&session, sizeof(session), 1, recordFile);
+        fwrite(&direction, sizeof(direction), 1, recordFile);
+        fwrite(&status, sizeof(status), 1, recordFile);
+        fwrite(&length, sizeof(length), 1, recordFile);
+        if (length > 0)
+            fwrite(data, 1, length, recordFile);
+    }
+    mutexUnlock(&journalMutex);
+}
+
+/* Finds a resource among the first count opened in the journal. Returns its index, or -1 if it is not there */
+static int findResource(const void* descriptor, size_t length, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strlen(replayResources[i]) == length && memcmp(replayResources[i], descriptor, length) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Loads a journal and switches the journal functions to replay it as a fake instrument.
+ *
+ * @param path Journal file to replay.
+ * @param speed Playback speed factor: 1 replays at recorded speed, 10 ten times faster, 0 without any delay.
+ * @return 0 on success, 1 on error.
+ */
+int journalStartReplay(const char* path, double speed) {
+    ensureMutex();
+    journalStopReplay();
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Error: Could not open journal %s.\n", path);
+        return 1;
+    }
+    char magic[4];
+    unsigned short version;
+    if (fread(magic, 1, 4, file) != 4 || memcmp(magic, JOURNAL_MAGIC, 4) != 0
+        || fread(&version, sizeof(version), 1, file) != 1 || version != JOURNAL_VERSION) {
+        printf("Error: %s is not a version %d journal.\n", path, JOURNAL_VERSION);
+        fclose(file);
+        return 1;
+    }
+
+    /* The data blob is never larger than the file, so size it once from the file length */
+    long headerEnd = ftell(file);
+    fseek(file, 0, SEEK_END);
+    long dataCapacity = ftell(file) - headerEnd;
+    fseek(file, headerEnd, SEEK_SET);
+
+    int capacity = 256;
+    JournalRecord* records = malloc(sizeof(JournalRecord) * capacity);
+    unsigned char* data = malloc(dataCapacity > 0 ? dataCapacity : 1);
+    long dataUsed = 0;
+    int count = 0;
+    if (records == NULL || data == NULL) {
+        free(records);
+        free(data);
+        fclose(file);
+        return 1;
+    }
+
+    JournalHandle handles[JOURNAL_MAX_RESOURCES];
+    int numHandles = 0, numResources = 0, opens = 0;
+    JournalRecord record;
+    while (fread(&record.timestamp, sizeof(record.timestamp), 1, file) == 1) {
+        if (fread(&record.session, sizeof(record.session), 1, file) != 1
+            || fread(&record.direction, sizeof(record.direction), 1, file) != 1
+            || fread(&record.status, sizeof(record.status), 1, file) != 1
+            || fread(&record.length, sizeof(record.length), 1, file) != 1
+            || dataUsed + (long)record.length > dataCapacity
+            || fread(data + dataUsed, 1, record.length, file) != record.length) {
+            printf("Warning: Journal %s is truncated after %d records.\n", path, count);
+            break;
+        }
+        if (record.direction == JOURNAL_OPEN) {
+            /* Later records of the handle belong to this resource, until the handle is opened again */
+            int resource = findResource(data + dataUsed, record.length, numResources);
+            if (resource < 0 && numResources < JOURNAL_MAX_RESOURCES && record.length < VI_FIND_BUFLEN) {
+                resource = numResources++;
+                memcpy(replayResources[resource], data + dataUsed, record.length);
+                replayResources[resource][record.length] = '\0';
+            }
+            int handle = 0;
+            while (handle < numHandles && handles[handle].handle != record.session)
+                handle++;
+            if (handle == numHandles && numHandles < JOURNAL_MAX_RESOURCES)
+                numHandles++;
+            else if (handle == numHandles)
+                handle = opens % JOURNAL_MAX_RESOURCES;     // Forget the handle opened longest ago
+            handles[handle].handle = record.session;
+            handles[handle].resource = resource;
+            opens++;
+            continue;
+        }
+        record.resource = -1;
+        for (int h = 0; h < numHandles; h++) {
+            if (handles[h].handle == record.session)
+                record.resource = handles[h].resource;
+        }
+        record.offset = dataUsed;
+        dataUsed += record.length;
+        if (count == capacity) {
+            capacity *= 2;
+            JournalRecord* grown = realloc(records, sizeof(JournalRecord) * capacity);
+            if (grown == NULL)
+                break;
+            records = grown;
+        }
+        records[count++] = record;
+    }
+    fclose(file);
+
+    mutexLock(&journalMutex);
+    replayRecords = records;
+    replayData = data;
+    replayCount = count;
+    replayResourceCount = numResources;
+    memset(replayCursors, 0, sizeof(replayCursors));
+    replaySpeed = speed;
+    replayStart = monotonicMicros();
+    atomicStore(&replaying, 1);
+    mutexUnlock(&journalMutex);
+
+    printf("Replaying %d journal records of %d resources from %s\n", count, numResources, path);
+    return 0;
+}
+
+/**
+ * @brief Stops replaying and frees the loaded journal. Does nothing if not replaying.
+ */
+void journalStopReplay() {
+    ensureMutex();
+    mutexLock(&journalMutex);
+    atomicStore(&replaying, 0);
+    free(replayRecords);
+    free(replayData);
+    replayRecords = NULL;
+    replayData = NULL;
+    replayCount = 0;
+    replayResourceCount = 0;
+    mutexUnlock(&journalMutex);
+}
+
+/**
+ * @return 1 if a journal is being recorded, 0 otherwise.
+ */
+int journalIsRecording() {
+    return atomicLoad(&recording) != 0;
+}
+
+/**
+ * @return 1 if the journal functions are replaying a journal instead of talking to instruments, 0 otherwise.
+ */
+int journalIsReplaying() {
+    return atomicLoad(&replaying) != 0;
+}
+
+/**
+ * @brief Finds the next record of a resource with a given direction, reporting any records of the resource skipped on
+ * the way as a divergence. Records of sessions the journal has no open for belong to every resource. The journal
+ * mutex must be held.
+ *
+ * @param resource Index of the resource in replayResources.
+ * @return Index of the record, or -1 at the end of the resource's records or if resource is out of range.
+ */
+static int nextReplayRecord(int resource, char direction) {
+    if (resource < 0 || resource >= replayResourceCount)
+        return -1;
+    int cursor = replayCursors[resource];
+    int index = cursor, skipped = 0;
+    for (; index < replayCount; index++) {
+        const JournalRecord* record = &replayRecords[index];
+        if (record->resource != resource && record->resource >= 0)
+            continue;
+        if (record->direction == direction)
+            break;
+        skipped++;
+    }
+    if (skipped > 0 && index < replayCount)
+        printf("Journal divergence: skipped %d recorded operations of %s at record %d.\n", skipped,
+            replayResources[resource], cursor);
+    if (index >= replayCount) {
+        if (cursor <= replayCount)
+            printf("Journal divergence: end of the records of %s reached.\n", replayResources[resource]);
+        replayCursors[resource] = replayCount + 1;  // Report the end only once
+        return -1;
+    }
+    replayCursors[resource] = index + 1;
+    return index;
+}
+
+/**
+ * @brief Waits until a record's timestamp, scaled by the replay speed, has elapsed since replay started.
+ */
+static void paceReplay(const JournalRecord* record) {
+    if (replaySpeed <= 0)
+        return;
+    unsigned long long due = (unsigned long long)(record->timestamp / replaySpeed);
+    unsigned long long elapsed = monotonicMicros() - replayStart;
+    if (due > elapsed)
+        sleepMs((unsigned int)((due - elapsed) / 1000));
+}
+
+/**
+ * @brief Returns a resource opened in the journal being replayed, for journalViOpen() to open.
+ *
+ * @param index Index of the resource, from 0.
+ * @return The resource descriptor, valid until replay stops, or NULL past the last resource or when not replaying.
+ */
+const char* journalReplayResource(int index) {
+    ensureMutex();
+    mutexLock(&journalMutex);
+    const char* descriptor = index >= 0 && index < replayResourceCount ? replayResources[index] : NULL;
+    mutexUnlock(&journalMutex);
+    return descriptor;
+}
+
+/**
+ * @brief Drop-in replacement for viOpen() that records the resource opened. While replaying, hands out a fake
+ * session answering from the records of the resource, without touching VISA.
+ *
+ * @return VI_ERROR_RSRC_NFOUND while replaying if the journal has no records of the resource.
+ */
+ViStatus journalViOpen(ViSession rm, ViConstRsrc descriptor, ViPSession session) {
+    if (journalIsReplaying()) {
+        mutexLock(&journalMutex);
+        int resource = findResource(descriptor, strlen(descriptor), replayResourceCount);
+        mutexUnlock(&journalMutex);
+        if (resource < 0)
+            return VI_ERROR_RSRC_NFOUND;
+        *session = JOURNAL_REPLAY_SESSION + (ViSession)resource;
+        return VI_SUCCESS;
+    }
+
+    ViStatus status = viOpen(rm, descriptor, VI_NULL, VI_NULL, session);
+    if (status >= VI_SUCCESS && journalIsRecording())
+        journalRecord(*session, JOURNAL_OPEN, status, descriptor, (ViUInt32)strlen(descriptor));
+    return status;
+}
+
+/**
+ * @brief Drop-in replacement for viWrite() that records the call, or checks it against the journal while replaying.
+ */
+ViStatus journalViWrite(ViSession session, ViConstBuf buf, ViUInt32 count, ViPUInt32 retCount) {
+    if (journalIsReplaying()) {
+        mutexLock(&journalMutex);
+        int index = nextReplayRecord((int)(session - JOURNAL_REPLAY_SESSION), JOURNAL_WRITE);
+        if (index < 0) {
+            mutexUnlock(&journalMutex);
+            *retCount = 0;
+            return VI_ERROR_TMO;
+        }
+        JournalRecord record = replayRecords[index];
+        if (record.length != count || memcmp(replayData + record.offset, buf, count) != 0)
+            printf("Journal divergence: record %d wrote %.*s, now writing %.*s\n", index,
+                (int)record.length, (const char*)(replayData + record.offset), (int)count, (const char*)buf);
+        mutexUnlock(&journalMutex);
+
+        paceReplay(&record);
+        *retCount = record.status < VI_SUCCESS ? 0 : count;
+        return record.status;
+    }
+
+    ViStatus status = viWrite(session, buf, count, retCount);
+    if (journalIsRecording())
+        journalRecord(session, JOURNAL_WRITE, status, buf, status < VI_SUCCESS ? 0 : *retCount);
+    return status;
+}
+
+/**
+ * @brief Drop-in replacement for viRead() that records the call, or returns the recorded response while replaying.
+ */
+ViStatus journalViRead(ViSession session, ViPBuf buf, ViUInt32 count, ViPUInt32 retCount) {
+    if (journalIsReplaying()) {
+        mutexLock(&journalMutex);
+        int index = nextReplayRecord((int)(session - JOURNAL_REPLAY_SESSION), JOURNAL_READ);
+        if (index < 0) {
+            mutexUnlock(&journalMutex);
+            *retCount = 0;
+            return VI_ERROR_TMO;
+        }
+        JournalRecord record = replayRecords[index];
+        ViUInt32 length = record.length < count ? record.length : count;
+        memcpy(buf, replayData + record.offset, length);
+        mutexUnlock(&journalMutex);
+
+        paceReplay(&record);
+        *retCount = length;
+        return record.status;
+    }
+
+    ViStatus status = viRead(session, buf, count, retCount);
+    if (journalIsRecording())
+        journalRecord(session, JOURNAL_READ, status, buf, status < VI_SUCCESS ? 0 : *retCount);
+    return status;
+}
@@ -0,0 +1,262 @@
+/*********************************************************************/
+/*                                                                   */
+/* Asynchronous structured logger.                                   */
+/*                                                                   */
+/* Records are submitted to a bounded lock-free queue (the           */
+/* multi-producer, multi-consumer ring of D. Vyukov: every cell      */
+/* carries a sequence number that tells producers and the consumer   */
+/* whose turn it is). Submitting copies the text into a cell and     */
+/* never blocks or formats; when the queue is full the record is     */
+/* dropped and counted. A writer thread formats the records as       */
+/* key=value lines, e.g.                                             */
+/*   t=1.234567 level=debug event=visa.write subject=SIM0::INSTR     */
+/*   text=":FREQ:STAR 1e9"                                           */
+/* and writes them to the output, so a slow terminal does not slow   */
+/* down the I/O path. Below the threshold a LOG_TEXT() costs one     */
+/* comparison.                                                       */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "platform.h"
+#include "logger.h"
+
+#define QUEUE_MASK (LOG_QUEUE_SIZE - 1)
+
+typedef struct {
+    PlatformAtomic sequence;            // Position the cell is ready for: to fill if equal, to read if one more
+    unsigned long long timestamp;       // monotonicMicros() at submission
+    int level;
+    const char* event;                  // Static event name, e.g. "visa.write"
+    char subject[LOG_SUBJECT_BYTES];
+    unsigned short length;              // Bytes in text
+    char text[LOG_TEXT_BYTES];
+} LogCell;
+
+int logThreshold = LOG_OFF;
+
+static LogCell* cells;
+static PlatformAtomic enqueuePos;
+static PlatformAtomic dequeuePos;
+static PlatformAtomic dropped;
+static unsigned long droppedReported;
+static PlatformThread writer;
+static PlatformAtomic stopping;
+static FILE* output;
+static unsigned long long startTime;
+
+static const char* levelNames[] = { "error", "warn", "info", "debug" };
+
+/* Takes the oldest record off the queue into copy. Returns 1 on success, 0 if the queue is empty */
+static int dequeue(LogCell* copy) {
+    long pos = atomicLoad(&dequeuePos);
+    for (;;) {
+        LogCell* cell = &cells[pos & QUEUE_MASK];
+        long diff = (long)((unsigned long)atomicLoad(&cell->sequence) - (unsigned long)(pos + 1));
+        if (diff == 0) {
+            if (atomicCompareExchange(&dequeuePos, pos, pos + 1)) {
+                memcpy(copy, cell, sizeof(LogCell));
+                atomicStore(&cell->sequence, pos + LOG_QUEUE_SIZE);
+                return 1;
+            }
+            pos = atomicLoad(&dequeuePos);
+        }
+        else if (diff < 0) {
+            return 0;
+        }
+        else {
+            pos = atomicLoad(&dequeuePos);
+        }
+    }
+}
+
+/* Writes text as a quoted value, escaping quotes, backslashes and unprintable bytes */
+static void writeQuoted(const char* text, size_t length) {
+    fputc('"', output);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\')
+            fprintf(output, "\\%c", c);
+        else if (c == '\n')
+            fputs("\\n", output);
+        else if (c < 0x20 || c >= 0x7F)
+            fprintf(output, "\\x%02X", c);
+        else
+            fputc(c, output);
+    }
+    fputc('"', output);
+}
+
+static void writeRecord(const LogCell* record) {
+    double seconds = (record->timestamp - startTime) / 1e6;
+    fprintf(output, "t=%.6f level=%s event=%s", seconds, levelNames[record->level], record->event);
+    if (record->subject[0] != '\0')
+        fprintf(output, " subject=%s", record->subject);
+    if (record->length > 0) {
+        fputs(" text=", output);
+        writeQuoted(record->text, record->length);
+    }
+    fputc('\n', output);
+}
+
+static THREAD_FUNC writerThread(void* arg) {
+    LogCell record;
+    (void)arg;
+    for (;;) {
+        int written = 0;
+        while (dequeue(&record)) {
+            writeRecord(&record);
+            written = 1;
+        }
+        unsigned long lost = (unsigned long)atomicLoad(&dropped);
+        if (lost != droppedReported) {
+            fprintf(output, "t=%.6f level=warn event=log.dropped count=%lu\n", (monotonicMicros() - startTime) / 1e6,
+                lost - droppedReported);
+            droppedReported = lost;
+            written = 1;
+        }
+        if (written)
+            fflush(output);
+        else if (atomicLoad(&stopping))
+            return THREAD_RETURN;
+        else
+            sleepMs(LOG_IDLE_MS);
+    }
+}
+
+/**
+ * @brief Starts the writer thread and enables records up to a level.
+ *
+ * @param out Stream the records are written to, e.g. stderr or a file opened by the caller.
+ * @param level Most verbose level written, LOG_ERROR to LOG_DEBUG.
+ * @return 0 on success, 1 if the logger is running already or could not be started.
+ */
+int logStart(FILE* out, int level) {
+    if (cells != NULL || level < LOG_ERROR || level > LOG_DEBUG)
+        return 1;
+    cells = malloc(sizeof(LogCell) * LOG_QUEUE_SIZE);
+    if (cells == NULL)
+        return 1;
+    for (long i = 0; i < LOG_QUEUE_SIZE; i++)
+        atomicStore(&cells[i].sequence, i);
+    atomicStore(&enqueuePos, 0);
+    atomicStore(&dequeuePos, 0);
+    atomicStore(&dropped, 0);
+    atomicStore(&stopping, 0);
+    droppedReported = 0;
+    output = out;
+    startTime = monotonicMicros();
+    if (threadCreate(&writer, writerThread, NULL) != 0) {
+        free(cells);
+        cells = NULL;
+        return 1;
+    }
+    logThreshold = level;
+    return 0;
+}
+
+/**
+ * @brief Disables logging, writes the records still queued and stops the writer thread. Records must no longer be
+ * submitted from other threads.
+ */
+void logStop() {
+    if (cells == NULL)
+        return;
+    logThreshold = LOG_OFF;
+    atomicStore(&stopping, 1);
+    threadJoin(writer);
+    free(cells);
+    cells = NULL;
+}
+
+/**
+ * @brief Converts a level name (error, warn, info, debug or off) to a level.
+ * @return The level, or LOG_OFF - 1 if the name is unknown.
+ */
+int logParseLevel(const char* name) {
+    if (strcmp(name, "off") == 0)
+        return LOG_OFF;
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, levelNames[i]) == 0)
+            return i;
+    }
+    return LOG_OFF - 1;
+}
+
+/**
+ * @brief Queues a record without blocking. Use LOG_TEXT() to skip the call when the level is disabled.
+ *
+ * @param event Event name. Must be a string that outlives the logger, e.g. a literal.
+ * @param subject What the record is about, e.g. a resource descriptor, or NULL.
+ * @param text Payload bytes, e.g. a command or response; need not be null-terminated. May be NULL.
+ * @param length Bytes in text; only the first LOG_TEXT_BYTES are kept.
+ */
+void logSubmit(int level, const char* event, const char* subject, const char* text, size_t length) {
+    if (!LOG_ENABLED(level) || cells == NULL)
+        return;
+
+    LogCell* cell;
+    long pos = atomicLoad(&enqueuePos);
+    for (;;) {
+        cell = &cells[pos & QUEUE_MASK];
+        long diff = (long)((unsigned long)atomicLoad(&cell->sequence) - (unsigned long)pos);
+        if (diff == 0) {
+            if (atomicCompareExchange(&enqueuePos, pos, pos + 1))
+                break;
+            pos = atomicLoad(&enqueuePos);
+        }
+        else if (diff < 0) {
+            atomicFetchAdd(&dropped, 1);
+            return;
+        }
+        else {
+            pos = atomicLoad(&enqueuePos);
+        }
+    }
+
+    cell->timestamp = monotonicMicros();
+    cell->level = level;
+    cell->event = event;
+    cell->subject[0] = '\0';
+    if (subject != NULL) {
+        size_t subjectLength = strlen(subject);
+        if (subjectLength >= LOG_SUBJECT_BYTES)
+            subjectLength = LOG_SUBJECT_BYTES - 1;
+        memcpy(cell->subject, subject, subjectLength);
+        cell->subject[subjectLength] = '\0';
+    }
+    if (text == NULL)
+        length = 0;
+    else if (length > LOG_TEXT_BYTES)
+        length = LOG_TEXT_BYTES;
+    if (length > 0)
+        memcpy(cell->text, text, length);
+    cell->length = (unsigned short)length;
+    atomicStore(&cell->sequence, pos + 1);
+}
+
+/**
+ * @brief Formats a record as printf() does and queues it. Formatting happens on the calling thread, so prefer
+ * logSubmit() on hot paths.
+ */
+void logPrintf(int level, const char* event, const char* subject, const char* format, ...) {
+    char text[LOG_TEXT_BYTES + 1];
+    if (!LOG_ENABLED(level))
+        return;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length < 0)
+        return;
+    logSubmit(level, event, subject, text, (size_t)length < LOG_TEXT_BYTES ? (size_t)length : LOG_TEXT_BYTES);
+}
+
+/**
+ * @brief Returns how many records were dropped because the queue was full.
+ */
+unsigned long logDropped() {
+    return cells == NULL ? 0 : (unsigned long)atomicLoad(&dropped);
+}
@@ -7,6 +7,7 @@
 /*      Find the next instrument using viFindNext()                  */
 /*      Open a session to this device.                               */
 /*      Loop on finding the next instrument until all have been found*/
+/*      (the search, filters and probing are in discovery.c)         */
 /*      Prompt user to select a device to connect to                 */
 /*      Identify device and open options menu for actions            */
 /*                                                                   */
@@ -19,12 +20,19 @@
 #include <string.h>
 #include "visa.h"
 #include "integer-input.h"
+#include "journal.h"
+#include "discovery.h"
+#include "health.h"
+#include "session-pool.h"
+#include "resource-registry.h"
+#include "logger.h"
+#include "scpi-validate.h"
+#include "capability.h"
+#include "remote-capture.h"
+#include "visa-session.h"
+#include "visacommands.h"
 
 
-/*   CONSTANTS   */
-#define LOG_MAX 256     // Maximum amount of scanned resources to log
-#define TIMEOUT_MS 2500 // Default VISA timeout in milliseconds
-
 /*   STATE CONSTANTS    */
 #define RETURN_SUCCESS 0
 #define RETURN_ERROR 1
@@ -32,7 +40,6 @@
 #define MAINMENU 10
 #define RSRC_SELECT 20
 #define MEMORY 30
-#define EXIT 0
 #define CHANGE 1
 #define IDENTIFY 2
 #define QUERY 3
@@ -44,38 +51,123 @@
 #define NEXT 9
 #define MEM_CATALOG 1
 #define MEM_SAVE 2
+#define MEM_ADAPTIVE 3
+#define MEM_SPLIT 4
+#define MEM_SYNC 5
 
 /*   VI VARIABLES   */
-static char instrDescriptor[VI_FIND_BUFLEN];
-static ViUInt32 numInstrs;
-static ViFindList findList;
-static ViSession defaultRM, instr;
+static ViSession defaultRM;
 static ViStatus status;
-static ViUInt32 retCount;
-static ViUInt32 writeCount;
 
 /*   STATE VARIABLES    */
 int menuState;
 
 /*   GLOBAL VARIABLES   */
-int rsrcIndx;           // Stores the VISA parameter 'instr'
-int instFound;          // Stores the VISA parameter 'numInstr'
-int rsrcSelect;         // Stores the index of instrLog[] which is then passed to VISA functions as 'instr'
-char instDescLog[LOG_MAX][VI_FIND_BUFLEN] = { {0} };    // Array which stores the VISA string 'instrDescriptor'
-ViSession* instrLog[LOG_MAX];                           // Array which stores VISA parameter 'instr'
-static unsigned char buffer[100];
-static char stringinput[512];
+static ResourceRegistry* registry;  // Resources found, selected by their index in it
+static VisaSession* session;    // Session to the selected resource, NULL before one is opened
+static SessionPool* pool;       // Keeps sessions open across resource switches, created by openPool()
+int poolCapacity = POOL_DEFAULT_CAPACITY;   // Sessions the pool keeps open, set by --pool
+const char* replayPath;     // Journal to replay instead of searching for resources, NULL when not replaying
+double replaySpeed = 1.0;   // Replay speed factor passed to journalStartReplay()
+int monitorHealth;          // Watch the open session and reconnect it when the connection is lost
+static HealthMonitor* monitor;  // Started by --monitor, NULL otherwise
+int checkErrors;            // Read the instrument's error queue with every write and query
+static DiscoveryFilter discovery;   // Resources findResources() lists, set by --include, --exclude, --intf, --no-probe
+int logLevel = LOG_OFF;     // Most verbose level the logger writes, set by --log
+const char* logPath;        // File the log is written to, NULL for stderr
+static FILE* logFile;       // Opened from logPath by startLogging()
+const char* commandListPath;    // Command lists loaded by --scpi-list or written by --scpi-learn, '*' for the model
+int learnCommands;          // Learn the accepted headers into commandListPath instead of rejecting unknown ones
+static ValidatorTable* validators;  // Command lists of the models connected to, created by startValidator()
+const char* profilePath;    // Probed capability profiles loaded and saved by --profiles, NULL to keep them for one run
+static CapabilityTable* capabilities;   // Capability profiles of the models connected to, created in main()
+int agentListenPort;        // Port --agent serves captures on, 0 when the menu runs instead
+const char* agentBindAddress = REMOTE_DEFAULT_BIND;    // Interface --agent listens on, NULL for all interfaces
+const char* agentList;      // Comma separated agents given by --coordinate, NULL when not coordinating
+
+/**
+ * @brief Adds a resource found by findResources() to the registry, with its interface and alias. Resources that could
+ * not be opened are reported and skipped.
+ */
+static void logResource(const char* descriptor, ViStatus probeStatus, void* context) {
+    ViUInt16 intfType, intfNum;
+    ViChar alias[VI_FIND_BUFLEN];
+    (void)context;
+
+    if (probeStatus < VI_SUCCESS) {
+        printf("Error code 0x%X. An error occurred opening a session to %s\n", probeStatus, descriptor);
+        return;
+    }
+    int index = registryAdd(registry, descriptor);
+    if (index < 0) {
+        printf("Error: out of memory, %s not listed.\n", descriptor);
+        return;
+    }
+    if (viParseRsrcEx(defaultRM, descriptor, &intfType, &intfNum, VI_NULL, VI_NULL, alias) >= VI_SUCCESS) {
+        registrySetInterface(registry, index, intfType, intfNum);
+        registrySetAlias(registry, index, alias);
+    }
+}
 
-#include "visacommands.h"
 
 /**
- * @brief Saves instrDescriptor and instr, then iterates rsrcIndx while scanning for resources.
+ * @brief Lists the resources in the registry with their alias and, once identified, their *IDN? response.
  */
-static void logResource() {
-    strcpy(instDescLog[rsrcIndx], instrDescriptor);
-    instrLog[rsrcIndx] = &instr;
-    
-    rsrcIndx++;
+static void listResources() {
+    printf("%d instruments, serial ports, and other resources found:\n\n", registryCount(registry));
+    for (int i = 0; i < registryCount(registry); i++) {
+        const RegistryEntry* entry = registryEntry(registry, i);
+        printf("%3d --- %s", i, entry->descriptor);
+        if (entry->alias != NULL)
+            printf(" (%s)", entry->alias);
+        if (entry->idn != NULL)
+            printf("  %s", entry->idn);
+        printf("\n");
+    }
+}
+
+
+/**
+ * @brief Gives the open session the capability profile of its model, probing a model seen for the first time, and
+ * prints what captures will use. A LAN instrument that supports HiSLIP is switched over to a HiSLIP session.
+ *
+ * @param idn The instrument's *IDN? response.
+ */
+static void selectProfile(const char* idn) {
+    char hislip[VI_FIND_BUFLEN];
+    ViStatus probeStatus;
+
+    if (capabilityFind(capabilities, idn) == NULL)
+        printf("Unknown model, probing its capabilities...\n");
+    const CapabilityProfile* profile = capabilitySelect(capabilities, session, defaultRM, idn, &probeStatus);
+    if (profile == NULL || probeStatus < VI_SUCCESS)
+        printf("Error code 0x%X. Capabilities could not be probed, traces are captured with markers.\n", probeStatus);
+    if (profile == NULL)
+        return;
+    if (profile->binaryTrace)
+        printf("Capabilities: binary traces up to %d points, %d markers", profile->maxPoints, profile->numMarkers);
+    else
+        printf("Capabilities: marker captures only, %d markers", profile->numMarkers);
+    printf("%s%s\n", profile->hislip ? ", HiSLIP" : "",
+        profile->failed ? " (probe failed)" : profile->probed ? " (probed)" : "");
+
+    if (profile->hislip && capabilityHislipResource(sessionResource(session), hislip, sizeof(hislip)) == 0
+        && strcmp(hislip, sessionResource(session)) != 0)
+    {
+        VisaSession* fast = poolAcquire(pool, hislip, &status);
+        if (fast == NULL)
+        {
+            printf("Error code 0x%X. Could not open %s, staying on the current session.\n", status, hislip);
+        }
+        else
+        {
+            printf("Switched to %s\n", hislip);
+            poolRelease(pool, session);
+            session = fast;
+            sessionSetValidator(session, validatorTableSelect(validators, idn));
+        }
+    }
+    sessionSetProfile(session, profile);
 }
 
 
@@ -85,54 +177,50 @@ static void logResource() {
  * @return 1 on error, 0 otherwise.
  */
 static int connectToRsrc() {
-    int errorFlag;
+    int rsrcSelect;     // Index of the resource in the registry to open
+    const char* descriptor;
+    char response[READ_BYTES];
 
     printf("\nPlease enter a resource index to open:\n");
     fflush(stdin);
     getIntegerFromStdin(&rsrcSelect);
-    if (0 <= rsrcSelect && rsrcSelect <= instFound - 1) {
+    if (0 <= rsrcSelect && rsrcSelect < registryCount(registry)) {
         printf("\n ------------------------------------- \n");
-        printf("Opening session to resource %s\n", instDescLog[rsrcSelect]);
+        descriptor = registryEntry(registry, rsrcSelect)->descriptor;
+        printf("Opening session to resource %s\n", descriptor);
     }
     else {
         printf("Invalid input: integer out of range.\n");
-        errorFlag = RETURN_ERROR;
-        goto Close;
+        return RETURN_ERROR;
     }  
-    /* Now open a session to the resource*/
-    status = viOpen(defaultRM, instDescLog[rsrcSelect], VI_NULL, VI_NULL, &instrLog[rsrcSelect]);
+    /* Now open a session to the resource, or reuse the one the pool kept open */
+    session = poolAcquire(pool, descriptor, &status);
+    if (session == NULL)
+    {
+        printf("Error code 0x%X. An error occurred opening a session to %s\n", status, descriptor);
+        return RETURN_ERROR;
+    }
+
+    /* Send an *IDN? query */
+    status = sessionQuery(session, "*IDN?", response, sizeof(response), NULL);
     if (status < VI_SUCCESS)
     {
-        printf("Error code 0x%X. An error occurred opening a session to %s\n", status, instrDescriptor);
-        errorFlag = RETURN_ERROR;
+        printf("Error code 0x%X. Error querying *IDN? from the device\n", status);
     }
     else
-    {   /* Set timeout value and send an *IDN? query */
-        status = viSetAttribute(instrLog[rsrcSelect], VI_ATTR_TMO_VALUE, TIMEOUT_MS);
-
-        strcpy(stringinput, "*IDN?");
-        status = viWrite(instrLog[rsrcSelect], (ViBuf)stringinput, (ViUInt32)strlen(stringinput), &writeCount);
-        if (status < VI_SUCCESS)
-        {
-            printf("Error code 0x%X. Error writing *IDN? to the device\n", status);
-        }
-
-        status = viRead(instrLog[rsrcSelect], buffer, 128, &retCount);
-        if (status < VI_SUCCESS)
-        {
-            printf("Error code 0x%X. Error reading *IDN? response from the device\n", status);
-        }
-        else
-        {
-            printf("%*s\n", retCount, buffer);
-        }
+    {
+        printf("%s\n", response);
+        registrySetIdn(registry, rsrcSelect, response);
+        ScpiValidator* validator = validatorTableSelect(validators, response);
+        if (validators != NULL && validator == NULL)
+            printf("No command list for this model, its commands are not checked.\n");
+        sessionSetValidator(session, validator);
+        selectProfile(response);
     }
-
+    if (monitor != NULL)
+        healthWatch(monitor, session);
+    sessionSetChecked(session, checkErrors);
     return RETURN_SUCCESS;
-
-    Close:
-    viClose(instrLog[rsrcSelect]);
-    return RETURN_ERROR;
 }
 
 /**
@@ -163,23 +251,23 @@ static int optionsMenuFSM() {
             menuState = RSRC_SELECT;
             return RETURN_LOOP;
         case IDENTIFY:
-            visaIdentify();
+            visaIdentify(session);
             enterToContinue();
             return RETURN_LOOP;
         case QUERY:
-            visaQuery();
+            visaQuery(session);
             enterToContinue();
             return RETURN_LOOP;
         case WRITE:
-            visaWriteFromStdin();
+            visaWriteFromStdin(session);
             enterToContinue();
             return RETURN_LOOP;
         case READ:
-            visaRead();
+            visaRead(session);
             enterToContinue();
             return RETURN_LOOP;
         case SET_TIMEOUT:
-            visaSetTimeout();
+            visaSetTimeout(session);
             enterToContinue();
             return RETURN_LOOP;
         case SET_READ:
@@ -187,7 +275,7 @@ static int optionsMenuFSM() {
             enterToContinue();
             return RETURN_LOOP;
         case FREEZE:
-            visaToggleFreeze();
+            visaToggleFreeze(session);
             enterToContinue();
             return RETURN_LOOP;
         case NEXT:
@@ -201,29 +289,46 @@ static int optionsMenuFSM() {
         printf(" Please select an option:\n");
         printf("%d: Previous page.\n", EXIT);
         printf("%d: View local memory at C:\\\n", MEM_CATALOG);
-        printf("%d: Save trace to computer using markers. (Spectrum Analyzer)\n", MEM_SAVE);
+        printf("%d: Save trace to computer, in binary where supported. (Spectrum Analyzer)\n", MEM_SAVE);
+        printf("%d: Save trace using adaptive marker steps. (Spectrum Analyzer)\n", MEM_ADAPTIVE);
+        printf("%d: Save trace split across several analyzers. (Spectrum Analyzer)\n", MEM_SPLIT);
+        printf("%d: Save readings triggered together with other instruments.\n", MEM_SYNC);
         
-        switch (getInput(3)) {
+        switch (getInput(5)) {
         case EXIT:
             menuState = MAINMENU;
             return RETURN_LOOP;
         case MEM_CATALOG:
             printf("Return format: <mem_used>, <mem_free>, <file_listing>\n");
             printf("Where <file_listing> is <file_name>, <file_size> for each file in the directory.\n");
-            visaWrite(":MMEM:CAT? \"C:\"");
-            visaRead();
+            visaWrite(session, ":MMEM:CAT? \"C:\"");
+            visaRead(session);
             return RETURN_LOOP;
         case MEM_SAVE:
-            visaGetTraceFromMarkers();
+            visaGetTraceFromMarkers(session);
+            enterToContinue();
+            return RETURN_LOOP;
+        case MEM_ADAPTIVE:
+            visaGetTraceAdaptive(session);
+            enterToContinue();
+            return RETURN_LOOP;
+        case MEM_SPLIT:
+            visaSplitSpanCapture(session, pool, registry);
             enterToContinue();
             return RETURN_LOOP;
+        case MEM_SYNC:
+            visaSyncCapture(session, pool, registry);
+            enterToContinue();
+            return RETURN_LOOP;
+        default:
+            goto errInvInput;
         }
     case RSRC_SELECT:
-        viClose(instrLog[rsrcSelect]);
-        printf("%d instruments, serial ports, and other resources found:\n\n", instFound);
-        for (int i = 0; i < instFound; i++) {
-            printf("%3d --- %s\n", i, instDescLog[i]);
-        }
+        if (monitor != NULL)
+            healthUnwatch(monitor, session);
+        poolRelease(pool, session);
+        session = NULL;
+        listResources();
 
         int exitFlag;
         do {
@@ -246,7 +351,27 @@ errInvInput:
 }
 
 
-int main(void) {
+/**
+ * @brief Creates the session pool that resources are opened through.
+ */
+static void openPool() {
+   pool = poolCreate(defaultRM, poolCapacity, TIMEOUT_MS);
+   if (pool == NULL)
+   {
+      printf("Error: could not create the session pool.\n");
+      exit (EXIT_FAILURE);
+   }
+   discovery.pool = pool;
+}
+
+
+/**
+ * @brief Opens the default resource manager, then finds and logs the VISA resources that pass the discovery filter.
+ * Probed resources stay open in the session pool.
+ *
+ * @return VI_SUCCESS, or the error status of the failed VISA call.
+ */
+static ViStatus findResources() {
    /* Open the default resource manager. */
    status = viOpenDefaultRM (&defaultRM);
    if (status < VI_SUCCESS)
@@ -254,11 +379,12 @@ int main(void) {
       printf("Error code 0x%X. Could not open a session to the VISA Resource Manager!\n", status);
       exit (EXIT_FAILURE);
    }  
+   openPool();
 
     /*
-     * Find all the VISA resources in our system and store the number of resources
-     * in the system in numInstrs.  Notice the different query descriptions a
-     * that are available.
+     * Find the VISA resources in our system. Without --intf every resource is
+     * searched for with "?*"; with it the expression is narrowed to the
+     * interfaces given, e.g. "GPIB?*|TCPIP?*". Examples of expressions:
 
         Interface         Expression
     --------------------------------------
@@ -271,7 +397,7 @@ int main(void) {
         All instruments   "?*INSTR"
         All resources     "?*"
     */
-   status = viFindRsrc (defaultRM, "?*", &findList, &numInstrs, instrDescriptor);
+   status = discoveryFind(defaultRM, &discovery, logResource, NULL);
    if (status < VI_SUCCESS)
    {
       printf ("Error code 0x%X. An error occurred while finding resources.\nHit enter to continue.", status);
@@ -280,68 +406,325 @@ int main(void) {
       viClose (defaultRM);
       return status;
    }
-   instFound = numInstrs;
-   printf("%d instruments, serial ports, and other resources found:\n\n",numInstrs);
-   printf("%3d --- %s\n", rsrcIndx, instrDescriptor);
+   if (registryCount(registry) == 0)
+   {
+      printf("No resources match the search filters.\n");
+      viClose (defaultRM);
+      return VI_ERROR_RSRC_NFOUND;
+   }
+   listResources();
 
-   /* Now we will open a session to the instrument we just found. */
-   status = viOpen (defaultRM, instrDescriptor, VI_NULL, VI_NULL, &instr);
-   if (status < VI_SUCCESS)
+   return VI_SUCCESS;
+}
+
+
+/**
+ * @brief Parses command line options.
+ * --record <file>  Records every write and read to a journal file.
+ * --replay <file>  Replays a journal as a fake instrument instead of searching for resources.
+ * --speed <x>      Replay speed factor. 1 replays at recorded speed, 0 without delays. Default: 1.
+ * --monitor        Probes the open session in the background and reconnects it after the connection is lost.
+ * --checked        Reads the instrument's error queue in the same message as every write and query.
+ * --include <glob> Lists only resources matching one of the --include globs, e.g. "TCPIP*". Repeatable.
+ * --exclude <glob> Leaves out resources matching the glob, e.g. "ASRL*". Repeatable.
+ * --intf <list>    Searches only the comma separated interfaces, e.g. gpib,tcpip.
+ * --no-probe       Lists resources without opening each one to check it responds.
+ * --log <level>    Logs I/O and events at error, warn, info or debug level. Default: off.
+ * --log-file <file> Writes the log to a file instead of stderr.
+ * --pool <n>       Keeps up to n sessions open to switch between resources without reopening. 0 closes them. Default: 8.
+ * --scpi-list <file>  Rejects commands with headers missing from the command list instead of waiting for a timeout.
+ *                     A '*' in the file name stands for the model, e.g. cmds-*.txt, so each model has its own list.
+ * --scpi-learn <file> Learns the headers the instrument accepts and writes them to a command list on exit.
+ * --profiles <file>   Loads the capability profiles of models probed in earlier runs and saves new ones on exit.
+ * --agent <port>      Serves trace captures of the resources found to coordinators on other hosts instead of the menu.
+ * --bind <address>    Interface --agent listens on, or * for all of them. Default: 127.0.0.1, this host only.
+ * --coordinate <list> Runs a capture campaign on the comma separated agents, e.g. labpc1:5990,labpc2:5990, and exits.
+ *
+ * @return 0 on success, 1 on invalid options.
+ */
+static int parseArguments(int argc, char* argv[]) {
+   discoveryInit(&discovery);
+   for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+         if (journalStartRecording(argv[++i]) != 0)
+            return RETURN_ERROR;
+      }
+      else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+         replayPath = argv[++i];
+      }
+      else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+         replaySpeed = atof(argv[++i]);
+      }
+      else if (strcmp(argv[i], "--monitor") == 0) {
+         monitorHealth = 1;
+      }
+      else if (strcmp(argv[i], "--checked") == 0) {
+         checkErrors = 1;
+      }
+      else if (strcmp(argv[i], "--include") == 0 && i + 1 < argc) {
+         if (discoveryInclude(&discovery, argv[++i]) != 0)
+            return RETURN_ERROR;
+      }
+      else if (strcmp(argv[i], "--exclude") == 0 && i + 1 < argc) {
+         if (discoveryExclude(&discovery, argv[++i]) != 0)
+            return RETURN_ERROR;
+      }
+      else if (strcmp(argv[i], "--intf") == 0 && i + 1 < argc) {
+         if (discoveryInterfaces(&discovery, argv[++i]) != 0) {
+            printf("Invalid interface list: %s\n", argv[i]);
+            return RETURN_ERROR;
+         }
+      }
+      else if (strcmp(argv[i], "--no-probe") == 0) {
+         discovery.probe = 0;
+      }
+      else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+         logLevel = logParseLevel(argv[++i]);
+         if (logLevel < LOG_OFF) {
+            printf("Invalid log level: %s\n", argv[i]);
+            return RETURN_ERROR;
+         }
+      }
+      else if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+         logPath = argv[++i];
+      }
+      else if (strcmp(argv[i], "--pool") == 0 && i + 1 < argc) {
+         poolCapacity = atoi(argv[++i]);
+         if (poolCapacity < 0 || poolCapacity > POOL_MAX_SESSIONS) {
+            printf("Invalid pool size: %s. Min: 0, Max: %d\n", argv[i], POOL_MAX_SESSIONS);
+            return RETURN_ERROR;
+         }
+      }
+      else if (strcmp(argv[i], "--scpi-list") == 0 && i + 1 < argc) {
+         commandListPath = argv[++i];
+         learnCommands = 0;
+      }
+      else if (strcmp(argv[i], "--scpi-learn") == 0 && i + 1 < argc) {
+         commandListPath = argv[++i];
+         learnCommands = 1;
+      }
+      else if (strcmp(argv[i], "--profiles") == 0 && i + 1 < argc) {
+         profilePath = argv[++i];
+      }
+      else if (strcmp(argv[i], "--agent") == 0 && i + 1 < argc) {
+         agentListenPort = atoi(argv[++i]);
+         if (agentListenPort <= 0 || agentListenPort > 65535) {
+            printf("Invalid agent port: %s\n", argv[i]);
+            return RETURN_ERROR;
+         }
+      }
+      else if (strcmp(argv[i], "--bind") == 0 && i + 1 < argc) {
+         i++;
+         agentBindAddress = strcmp(argv[i], "*") == 0 ? NULL : argv[i];
+      }
+      else if (strcmp(argv[i], "--coordinate") == 0 && i + 1 < argc) {
+         agentList = argv[++i];
+      }
+      else {
+         printf("Usage: %s [--record <file>] [--replay <file> [--speed <x>]] [--monitor] [--checked]\n"
+            "       [--include <glob>]... [--exclude <glob>]... [--intf <list>] [--no-probe]\n"
+            "       [--log <level>] [--log-file <file>] [--pool <n>] [--scpi-list <file> | --scpi-learn <file>]\n"
+            "       [--profiles <file>] [--agent <port> [--bind <address>] | --coordinate <host:port,...>]\n",
+            argv[0]);
+         return RETURN_ERROR;
+      }
+   }
+   return RETURN_SUCCESS;
+}
+
+
+/**
+ * @brief Starts the logger selected by --log and --log-file.
+ *
+ * @return 1 on error, 0 otherwise.
+ */
+static int startLogging() {
+   if (logLevel == LOG_OFF)
+      return RETURN_SUCCESS;
+   logFile = stderr;
+   if (logPath != NULL) {
+      logFile = fopen(logPath, "w");
+      if (logFile == NULL) {
+         printf("Error: could not open log file %s\n", logPath);
+         return RETURN_ERROR;
+      }
+   }
+   if (logStart(logFile, logLevel) != 0) {
+      printf("Error: could not start the logger.\n");
+      return RETURN_ERROR;
+   }
+   return RETURN_SUCCESS;
+}
+
+
+/**
+ * @brief Creates the validators selected by --scpi-list or --scpi-learn, one per model connected to. When learning,
+ * an existing command list is loaded first so it is extended rather than replaced. A command list shared by every
+ * model, i.e. a path without '*', must exist unless learning.
+ *
+ * @return 1 on error, 0 otherwise.
+ */
+static int startValidator() {
+   if (commandListPath == NULL)
+      return RETURN_SUCCESS;
+   validators = validatorTableCreate(commandListPath, !learnCommands);
+   if (validators == NULL) {
+      printf("Error: could not create the SCPI validators.\n");
+      return RETURN_ERROR;
+   }
+   if (!learnCommands && strchr(commandListPath, '*') == NULL && validatorTableSelect(validators, "") == NULL) {
+      printf("Error: could not load the command list %s\n", commandListPath);
+      return RETURN_ERROR;
+   }
+   return RETURN_SUCCESS;
+}
+
+
+/**
+ * @brief Runs a capture campaign on the agents given by --coordinate. No resources are searched for on this host.
+ *
+ * @return 1 on error, 0 otherwise.
+ */
+static int coordinate() {
+   RemoteAddress agents[REMOTE_MAX_AGENTS];
+   char list[REMOTE_LINE_BYTES];
+   int numAgents = 0;
+
+   snprintf(list, sizeof(list), "%s", agentList);
+   for (char* address = strtok(list, ","); address != NULL; address = strtok(NULL, ",")) {
+      if (numAgents == REMOTE_MAX_AGENTS || remoteParseAddress(address, &agents[numAgents]) != 0) {
+         printf("Invalid agent address: %s. At most %d agents.\n", address, REMOTE_MAX_AGENTS);
+         return RETURN_ERROR;
+      }
+      numAgents++;
+   }
+   visaCoordinateCapture(agents, numAgents);
+   return RETURN_SUCCESS;
+}
+
+
+/**
+ * @brief Serves captures of the resources found to coordinators until the user hits enter.
+ */
+static void serveAgent() {
+   unsigned long captures, failures;
+   const char* listenOn = agentBindAddress != NULL ? agentBindAddress : "all interfaces";
+   CaptureAgent* agent = agentStart(defaultRM, pool, capabilities, registry, agentBindAddress, agentListenPort);
+   if (agent == NULL)
    {
-      printf ("Error code 0x%X. An error occurred opening a session to %s\n", status, instrDescriptor);
+      printf("Error: could not listen for coordinators on %s port %d.\n", listenOn, agentListenPort);
+      return;
    }
-   else
+   printf("\nCapture agent listening on %s port %d.\nHit enter to stop.", listenOn, agentPort(agent));
+   fflush(stdin);
+   getchar();
+   agentStats(agent, &captures, &failures);
+   agentStop(agent);
+   printf("Served %lu captures, %lu failed.\n", captures, failures);
+}
+
+
+int main(int argc, char* argv[]) {
+   if (parseArguments(argc, argv) != RETURN_SUCCESS || startLogging() != RETURN_SUCCESS
+      || startValidator() != RETURN_SUCCESS)
+      exit (EXIT_FAILURE);
+   if (agentList != NULL)
+   {  /* The analyzers are on the agents' hosts, so there is nothing to search for here */
+      int result = coordinate();
+      validatorTableDestroy(validators);
+      journalStopRecording();
+      logStop();
+      if (logFile != NULL && logFile != stderr)
+         fclose(logFile);
+      return result;
+   }
+   registry = registryCreate();
+   if (registry == NULL)
    {
-      logResource();
-      viClose (instr);
+      printf("Error: could not create the resource registry.\n");
+      exit (EXIT_FAILURE);
    }
-        
-   while (--numInstrs)
+   capabilities = capabilityCreate();
+   if (capabilities == NULL)
    {
-      /* stay in this loop until we find all instruments */
-      status = viFindNext (findList, instrDescriptor);  /* find next desriptor */
-      if (status < VI_SUCCESS) 
-      {   /* did we find the next resource? */
-         printf ("Error code 0x%X. An error occurred finding the next resource.\nHit enter to continue.", status);
-         fflush(stdin);
-         getchar();
-         viClose (defaultRM);
-         return status; 
-      } 
-      printf("%3d --- %s\n", rsrcIndx, instrDescriptor);
-    
-      /* Now we will open a session to the instrument we just found */
-      status = viOpen (defaultRM, instrDescriptor, VI_NULL, VI_NULL, &instr);
-      if (status < VI_SUCCESS)
+      printf("Error: could not create the capability table.\n");
+      exit (EXIT_FAILURE);
+   }
+   /* A missing file is created on exit */
+   if (profilePath != NULL)
+      capabilityLoad(capabilities, profilePath);
+
+   if (replayPath != NULL)
+   {  /* The journal stands in for the instrument, so there is nothing to search for */
+      if (journalStartReplay(replayPath, replaySpeed) != 0)
+         exit (EXIT_FAILURE);
+      openPool();
+      const char* descriptor;
+      for (int i = 0; (descriptor = journalReplayResource(i)) != NULL; i++)
       {
-          printf ("Error code 0x%X. An error occurred opening a session to %s\n", status, instrDescriptor);
+         registryAdd(registry, descriptor);
+         printf("%3d --- %s\n", i, descriptor);
       }
-      else
+      if (registryCount(registry) == 0)
       {
-          logResource();
-          viClose (instr);
+         printf("Error: journal %s has no sessions to replay.\n", replayPath);
+         exit (EXIT_FAILURE);
       }
-   }    /* end while */
+   }
+   else
+   {
+      status = findResources();
+      if (status < VI_SUCCESS)
+         return status;
+   }
+
+   /* There is no connection to watch while replaying */
+   if (monitorHealth && replayPath == NULL)
+   {
+      monitor = healthStart(HEALTH_PROBE_INTERVAL_MS);
+      if (monitor == NULL)
+         printf("Error: could not start the connection health monitor.\n");
+   }
 
-   /* List all resources and prompt user to select one to open */
-   int exitFlag;
-   do {
-       exitFlag = connectToRsrc();
-   } while (exitFlag != RETURN_SUCCESS);
+   if (agentListenPort > 0)
+   {  /* Coordinators drive the instruments instead of the menu */
+      serveAgent();
+   }
+   else
+   {
+      /* List all resources and prompt user to select one to open */
+      int exitFlag;
+      do {
+          exitFlag = connectToRsrc();
+      } while (exitFlag != RETURN_SUCCESS);
+
+      /* User actions for opened resource */
+      menuState = MAINMENU;
+      do {
+          exitFlag = optionsMenuFSM();
+      } while (exitFlag != RETURN_SUCCESS);
+   }
 
-   /* User actions for opened resource */
-   menuState = MAINMENU;
-   do {
-       exitFlag = optionsMenuFSM();
-   } while (exitFlag != RETURN_SUCCESS);
-   
 
    /* Close program */
    printf("Closing Program\nHit enter to continue.");
    fflush(stdin);
    getchar();
-   status = viClose(instr);
+   healthStop(monitor);
+   poolRelease(pool, session);
+   poolDestroy(pool);
+   registryDestroy(registry);
+   if (learnCommands && validatorTableSave(validators) != 0)
+      printf("Error: could not write the command lists %s\n", commandListPath);
+   validatorTableDestroy(validators);
+   if (profilePath != NULL && capabilitySave(capabilities, profilePath) != 0)
+      printf("Error: could not write the capability profiles %s\n", profilePath);
+   capabilityDestroy(capabilities);
    status = viClose(defaultRM);
+   journalStopRecording();
+   logStop();
+   if (logFile != NULL && logFile != stderr)
+      fclose(logFile);
 
    return 0;
 }
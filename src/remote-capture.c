@@ -0,0 +1,513 @@
+/*********************************************************************/
+/*                                                                   */
+/* Capture campaigns spread over several lab hosts.                  */
+/*                                                                   */
+/* An agent runs on each host with analyzers attached. It listens on */
+/* a TCP port and captures traces of the resources it found for any */
+/* coordinator that connects, taking sessions from its pool and the  */
+/* fastest capture path from the analyzers' capability profiles.     */
+/* The coordinator (remoteDispatch()) opens one connection per       */
+/* analyzer and drives them all at once from worker threads, so a    */
+/* campaign takes about as long as its busiest analyzer no matter    */
+/* how many hosts it spans.                                          */
+/*                                                                   */
+/* Requests and responses are newline-terminated text lines:         */
+/*      RESOURCES?              descriptors, comma separated         */
+/*      CAPTURE? <points>,<rsrc> status,points,start,stop,rbw,vbw,   */
+/*                              microseconds, then the amplitudes as */
+/*                              a little-endian REAL,32 definite     */
+/*                              length block and a newline           */
+/* A failed capture answers with its status and 0 points, no block.  */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "platform.h"
+#include "scpi-parse.h"
+#include "remote-capture.h"
+
+/* Connection from a coordinator, served on its own thread */
+typedef struct {
+    CaptureAgent* agent;
+    TcpSocket* sock;
+    PlatformThread thread;
+    PlatformAtomic done;                // Set by the thread when the connection closed; the slot may be joined
+    int used;                           // A thread was started in the slot and not joined yet
+} AgentConnection;
+
+struct CaptureAgent {
+    ViSession resourceManager;
+    SessionPool* pool;                  // Sessions to the analyzers; not owned
+    CapabilityTable* capabilities;      // Profiles selected for the analyzers, NULL for marker captures; not owned
+    const ResourceRegistry* registry;   // Resources served; must not change while the agent runs
+    TcpListener* listener;
+    PlatformThread thread;              // Accepts connections
+    PlatformAtomic stopping;
+    PlatformAtomic captures;
+    PlatformAtomic failures;
+    AgentConnection connections[REMOTE_MAX_WORKERS];
+};
+
+/* Coordinator thread driving every analyzer whose index is firstGroup plus a multiple of stride */
+typedef struct {
+    const RemoteAddress* agents;
+    const RemoteJob* jobs;
+    RemoteResult* results;
+    const int* firstJob;                // First job of each analyzer
+    const int* nextJob;                 // Next job of the same analyzer, -1 after the last
+    int firstGroup;
+    int numGroups;
+    int stride;
+    unsigned long long start;           // monotonicMicros() when the dispatch started
+    PlatformThread thread;
+    int started;                        // The thread runs; otherwise the worker ran on the calling thread
+} DispatchWorker;
+
+/* Reads a line and drops its newline. Waits at most timeoutMs, or until stopping is set if timeoutMs is 0 */
+static ViStatus readLine(TcpSocket* sock, char* line, size_t size, unsigned int timeoutMs, PlatformAtomic* stopping) {
+    unsigned long long deadline = monotonicMicros() + (unsigned long long)timeoutMs * 1000;
+    size_t length = 0;
+    ViUInt32 count;
+
+    for (;;) {
+        ViStatus status = tcpRead(sock, (unsigned char*)line + length, (ViUInt32)(size - 1 - length), &count, REMOTE_TICK_MS);
+        length += count;
+        if (status == VI_SUCCESS_TERM_CHAR) {
+            length--;
+            if (length > 0 && line[length - 1] == '\r')
+                length--;
+            line[length] = '\0';
+            return VI_SUCCESS;
+        }
+        if (status == VI_SUCCESS_MAX_CNT)
+            return VI_ERROR_IO;
+        if (status != VI_ERROR_TMO)
+            return status;
+        if (stopping != NULL && atomicLoad(stopping))
+            return VI_ERROR_TMO;
+        if (timeoutMs > 0 && monotonicMicros() >= deadline)
+            return VI_ERROR_TMO;
+    }
+}
+
+/* Reads exactly length bytes, ignoring newlines */
+static ViStatus readBytes(TcpSocket* sock, unsigned char* data, size_t length) {
+    size_t received = 0;
+    ViUInt32 count;
+    ViStatus status = VI_SUCCESS;
+    tcpSetTermChar(sock, 0, '\n');
+    while (received < length && status >= VI_SUCCESS) {
+        status = tcpRead(sock, data + received, (ViUInt32)(length - received), &count, REMOTE_REPLY_TIMEOUT_MS);
+        received += count;
+    }
+    tcpSetTermChar(sock, 1, '\n');
+    return received == length ? VI_SUCCESS : status;
+}
+
+static ViStatus writeText(TcpSocket* sock, const char* text) {
+    return tcpWrite(sock, (const unsigned char*)text, (ViUInt32)strlen(text), NULL);
+}
+
+/**
+ * @brief Parses an agent address of the form host[:port], e.g. "labpc3:5990". The port defaults to REMOTE_DEFAULT_PORT.
+ * @return 0 on success, 1 if the address is invalid.
+ */
+int remoteParseAddress(const char* text, RemoteAddress* address) {
+    const char* colon = strrchr(text, ':');
+    size_t hostLength = colon != NULL ? (size_t)(colon - text) : strlen(text);
+    address->port = REMOTE_DEFAULT_PORT;
+    if (colon != NULL) {
+        char* end;
+        long port = strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != '\0' || port <= 0 || port > 65535)
+            return 1;
+        address->port = (int)port;
+    }
+    if (hostLength == 0 || hostLength >= TCP_HOST_MAX)
+        return 1;
+    memcpy(address->host, text, hostLength);
+    address->host[hostLength] = '\0';
+    return 0;
+}
+
+/* Gives a session the capability profile of its analyzer's model the first time the agent uses it */
+static void selectProfile(CaptureAgent* agent, VisaSession* session) {
+    char idn[SESSION_RESPONSE_BYTES];
+    if (agent->capabilities == NULL || sessionProfile(session) != NULL)
+        return;
+    if (sessionQuery(session, "*IDN?", idn, sizeof(idn), NULL) >= VI_SUCCESS)
+        sessionSetProfile(session, capabilitySelect(agent->capabilities, session, agent->resourceManager, idn, NULL));
+}
+
+/* Answers CAPTURE? <points>,<resource> */
+static ViStatus serveCapture(CaptureAgent* agent, TcpSocket* sock, const char* params) {
+    char line[REMOTE_LINE_BYTES];
+    MarkerSetup setup;
+    unsigned long long micros = 0;
+    char* resource;
+    ViStatus status = VI_SUCCESS;
+    double* freq = NULL;
+    double* amp = NULL;
+    float* values = NULL;
+    unsigned char* block = NULL;
+    size_t blockLength = 0;
+
+    long numPoints = strtol(params, &resource, 10);
+    int index = *resource == ',' ? registryFind(agent->registry, resource + 1) : -1;
+    if (numPoints < 2 || numPoints > REMOTE_MAX_POINTS)
+        status = VI_ERROR_INV_PARAMETER;
+    else if (index < 0)
+        status = VI_ERROR_RSRC_NFOUND;
+
+    if (status >= VI_SUCCESS) {
+        size_t blockSize = (size_t)numPoints * 4 + 16;
+        freq = malloc(sizeof(double) * numPoints);
+        amp = malloc(sizeof(double) * numPoints);
+        values = malloc(sizeof(float) * numPoints);
+        block = malloc(blockSize + 1);
+        VisaSession* session = NULL;
+        if (freq == NULL || amp == NULL || values == NULL || block == NULL)
+            status = VI_ERROR_ALLOC;
+        else
+            session = poolAcquire(agent->pool, registryEntry(agent->registry, index)->descriptor, &status);
+        if (session != NULL) {
+            selectProfile(agent, session);
+            unsigned long long start = monotonicMicros();
+            status = sessionCaptureTrace(session, (int)numPoints, &setup, freq, amp);
+            micros = monotonicMicros() - start;
+            poolRelease(agent->pool, session);
+        }
+        if (status >= VI_SUCCESS) {
+            for (long i = 0; i < numPoints; i++)
+                values[i] = (float)amp[i];
+            blockLength = scpiEncodeReal32(values, (int)numPoints, 0, block, blockSize);
+            block[blockLength++] = '\n';
+        }
+    }
+
+    if (status >= VI_SUCCESS) {
+        atomicFetchAdd(&agent->captures, 1);
+        sprintf(line, "%ld,%ld,%.10g,%.10g,%.10g,%.10g,%lu\n", (long)status, numPoints, setup.startFreq, setup.stopFreq,
+            setup.resBW, setup.vidBW, (unsigned long)micros);
+    }
+    else {
+        atomicFetchAdd(&agent->failures, 1);
+        sprintf(line, "%ld,0,0,0,0,0,%lu\n", (long)status, (unsigned long)micros);
+    }
+    ViStatus replyStatus = writeText(sock, line);
+    if (replyStatus >= VI_SUCCESS && blockLength > 0)
+        replyStatus = tcpWrite(sock, block, (ViUInt32)blockLength, NULL);
+    free(freq);
+    free(amp);
+    free(values);
+    free(block);
+    return replyStatus;
+}
+
+/* Answers RESOURCES? with the descriptors that fit in one line */
+static ViStatus serveResources(CaptureAgent* agent, TcpSocket* sock) {
+    char line[REMOTE_LINE_BYTES];
+    size_t length = 0;
+    for (int i = 0; i < registryCount(agent->registry); i++) {
+        const char* descriptor = registryEntry(agent->registry, i)->descriptor;
+        size_t descriptorLength = strlen(descriptor);
+        if (length + descriptorLength + 2 >= sizeof(line))
+            break;
+        if (length > 0)
+            line[length++] = ',';
+        memcpy(line + length, descriptor, descriptorLength);
+        length += descriptorLength;
+    }
+    line[length++] = '\n';
+    line[length] = '\0';
+    return writeText(sock, line);
+}
+
+static THREAD_FUNC connectionThread(void* arg) {
+    AgentConnection* connection = arg;
+    CaptureAgent* agent = connection->agent;
+    char line[REMOTE_LINE_BYTES];
+    ViStatus status = VI_SUCCESS;
+
+    while (status >= VI_SUCCESS && readLine(connection->sock, line, sizeof(line), 0, &agent->stopping) == VI_SUCCESS) {
+        if (strncmp(line, "CAPTURE? ", 9) == 0)
+            status = serveCapture(agent, connection->sock, line + 9);
+        else if (strcmp(line, "RESOURCES?") == 0)
+            status = serveResources(agent, connection->sock);
+        else {
+            sprintf(line, "%ld,0,0,0,0,0,0\n", (long)VI_ERROR_NSUP_OPER);
+            status = writeText(connection->sock, line);
+        }
+    }
+    tcpClose(connection->sock);
+    atomicStore(&connection->done, 1);
+    return THREAD_RETURN;
+}
+
+static THREAD_FUNC acceptThread(void* arg) {
+    CaptureAgent* agent = arg;
+    while (!atomicLoad(&agent->stopping)) {
+        TcpSocket* sock = tcpAccept(agent->listener, REMOTE_TICK_MS);
+        if (sock == NULL)
+            continue;
+
+        /* Slots of closed connections are joined and reused; beyond REMOTE_MAX_WORKERS connections are refused */
+        AgentConnection* slot = NULL;
+        for (int i = 0; i < REMOTE_MAX_WORKERS; i++) {
+            AgentConnection* connection = &agent->connections[i];
+            if (connection->used && atomicLoad(&connection->done)) {
+                threadJoin(connection->thread);
+                connection->used = 0;
+            }
+            if (!connection->used && slot == NULL)
+                slot = connection;
+        }
+        if (slot == NULL) {
+            tcpClose(sock);
+            continue;
+        }
+        slot->agent = agent;
+        slot->sock = sock;
+        atomicStore(&slot->done, 0);
+        slot->used = threadCreate(&slot->thread, connectionThread, slot) == 0;
+        if (!slot->used)
+            tcpClose(sock);
+    }
+    for (int i = 0; i < REMOTE_MAX_WORKERS; i++) {
+        if (agent->connections[i].used)
+            threadJoin(agent->connections[i].thread);
+    }
+    return THREAD_RETURN;
+}
+
+/**
+ * @brief Starts an agent that captures traces of the resources in a registry for coordinators on other hosts.
+ *
+ * @param resourceManager Resource manager used to probe the capabilities of unknown models.
+ * @param pool Pool the analyzers' sessions are taken from; shared with the caller.
+ * @param capabilities Profiles that select each analyzer's fastest capture path, or NULL to walk markers.
+ * @param registry Resources the agent lists and captures; must not change until agentStop().
+ * @param bindAddress Interface to listen on, e.g. REMOTE_DEFAULT_BIND, or NULL for all interfaces. Coordinators are
+ * not authenticated, so any host that can reach the interface may drive the analyzers.
+ * @param port Port to listen on, or 0 for any free port; see agentPort().
+ * @return The agent, or NULL if the port could not be bound or on error.
+ */
+CaptureAgent* agentStart(ViSession resourceManager, SessionPool* pool, CapabilityTable* capabilities,
+    const ResourceRegistry* registry, const char* bindAddress, int port) {
+    CaptureAgent* agent = calloc(1, sizeof(CaptureAgent));
+    if (agent == NULL)
+        return NULL;
+    agent->resourceManager = resourceManager;
+    agent->pool = pool;
+    agent->capabilities = capabilities;
+    agent->registry = registry;
+    agent->listener = tcpListen(bindAddress, port);
+    if (agent->listener == NULL || threadCreate(&agent->thread, acceptThread, agent) != 0) {
+        tcpCloseListener(agent->listener);
+        free(agent);
+        return NULL;
+    }
+    return agent;
+}
+
+/**
+ * @brief Returns the port an agent listens on.
+ */
+int agentPort(const CaptureAgent* agent) {
+    return tcpListenerPort(agent->listener);
+}
+
+/**
+ * @brief Reads how many captures an agent has served and how many of them failed.
+ */
+void agentStats(CaptureAgent* agent, unsigned long* captures, unsigned long* failures) {
+    *captures = (unsigned long)atomicLoad(&agent->captures);
+    *failures = (unsigned long)atomicLoad(&agent->failures);
+}
+
+/**
+ * @brief Stops listening, waits for the captures in progress and closes every connection. Sessions stay in the pool.
+ */
+void agentStop(CaptureAgent* agent) {
+    if (agent == NULL)
+        return;
+    atomicStore(&agent->stopping, 1);
+    threadJoin(agent->thread);
+    tcpCloseListener(agent->listener);
+    free(agent);
+}
+
+/**
+ * @brief Asks an agent for the resources it captures.
+ *
+ * @param list Output descriptors, comma separated.
+ * @param size Capacity of list.
+ * @return VI_SUCCESS, VI_ERROR_RSRC_NFOUND if the agent could not be reached, or the status of the exchange.
+ */
+ViStatus remoteListResources(const RemoteAddress* agent, char* list, size_t size) {
+    list[0] = '\0';
+    TcpSocket* sock = tcpConnect(agent->host, agent->port, REMOTE_CONNECT_TIMEOUT_MS);
+    if (sock == NULL)
+        return VI_ERROR_RSRC_NFOUND;
+    ViStatus status = writeText(sock, "RESOURCES?\n");
+    if (status >= VI_SUCCESS)
+        status = readLine(sock, list, size, REMOTE_REPLY_TIMEOUT_MS, NULL);
+    tcpClose(sock);
+    return status;
+}
+
+/* Sends one job and reads its trace. Returns the status of the exchange; the capture's own status is in result */
+static ViStatus runJob(TcpSocket* sock, const RemoteJob* job, RemoteResult* result) {
+    char line[REMOTE_LINE_BYTES];
+    long status, numPoints;
+    unsigned long micros;
+    size_t offset, length;
+
+    snprintf(line, sizeof(line), "CAPTURE? %d,%s\n", job->numPoints, job->resource);
+    ViStatus exchange = writeText(sock, line);
+    if (exchange >= VI_SUCCESS)
+        exchange = readLine(sock, line, sizeof(line), REMOTE_REPLY_TIMEOUT_MS, NULL);
+    if (exchange < VI_SUCCESS)
+        return result->status = exchange;
+    if (sscanf(line, "%ld,%ld,%lf,%lf,%lf,%lf,%lu", &status, &numPoints, &result->startFreq, &result->stopFreq,
+        &result->resBW, &result->vidBW, &micros) != 7 || numPoints < 0 || numPoints > REMOTE_MAX_POINTS
+        || (status >= VI_SUCCESS && numPoints != job->numPoints))
+        return result->status = VI_ERROR_IO;
+    result->status = (ViStatus)status;
+    result->captureMicros = micros;
+    if (numPoints == 0)
+        return VI_SUCCESS;
+
+    /* "#<digits><length>", the payload and the newline */
+    unsigned char* block = malloc((size_t)numPoints * 4 + 16);
+    result->amp = malloc(sizeof(float) * numPoints);
+    if (block == NULL || result->amp == NULL) {
+        free(block);
+        return result->status = VI_ERROR_ALLOC;
+    }
+    exchange = readBytes(sock, block, 2);
+    size_t digits = exchange >= VI_SUCCESS && isdigit(block[1]) ? (size_t)(block[1] - '0') : 0;
+    if (digits > 0)
+        exchange = readBytes(sock, block + 2, digits);
+    if (exchange >= VI_SUCCESS && (digits == 0 || scpiBlockHeader(block, 2 + digits + (size_t)numPoints * 4, &offset,
+        &length) != 0 || length != (size_t)numPoints * 4))
+        exchange = VI_ERROR_IO;
+    if (exchange >= VI_SUCCESS)
+        exchange = readBytes(sock, block + offset, length + 1);
+    if (exchange >= VI_SUCCESS) {
+        scpiDecodeReal32(block + offset, length, 0, result->amp, (int)numPoints);
+        result->numPoints = (int)numPoints;
+    }
+    else {
+        result->status = exchange;
+    }
+    free(block);
+    return exchange;
+}
+
+static THREAD_FUNC dispatchThread(void* arg) {
+    DispatchWorker* worker = arg;
+    for (int group = worker->firstGroup; group < worker->numGroups; group += worker->stride) {
+        int job = worker->firstJob[group];
+        const RemoteAddress* agent = &worker->agents[worker->jobs[job].agent];
+        TcpSocket* sock = tcpConnect(agent->host, agent->port, REMOTE_CONNECT_TIMEOUT_MS);
+        ViStatus status = sock == NULL ? VI_ERROR_RSRC_NFOUND : VI_SUCCESS;
+
+        /* A broken connection fails the rest of the analyzer's jobs with its status */
+        for (; job >= 0; job = worker->nextJob[job]) {
+            if (status >= VI_SUCCESS)
+                status = runJob(sock, &worker->jobs[job], &worker->results[job]);
+            else
+                worker->results[job].status = status;
+            worker->results[job].doneMicros = monotonicMicros() - worker->start;
+        }
+        tcpClose(sock);
+    }
+    return THREAD_RETURN;
+}
+
+/**
+ * @brief Runs capture jobs on their agents and gathers the traces. Each analyzer, i.e. each agent and resource pair,
+ * gets its own connection; up to REMOTE_MAX_WORKERS analyzers are driven at once and each one's jobs run in order.
+ *
+ * @param agents Agent addresses the jobs refer to by index.
+ * @param jobs Jobs to run.
+ * @param results Output traces, one per job; free them with remoteFreeResults().
+ * @return Number of jobs whose trace was captured, or -1 on error.
+ */
+int remoteDispatch(const RemoteAddress* agents, int numAgents, const RemoteJob* jobs, int numJobs, RemoteResult* results) {
+    DispatchWorker workers[REMOTE_MAX_WORKERS];
+    int* firstJob = malloc(sizeof(int) * (numJobs + 1));
+    int* lastJob = malloc(sizeof(int) * (numJobs + 1));
+    int* nextJob = malloc(sizeof(int) * (numJobs + 1));
+    int numGroups = 0, captured = 0;
+
+    memset(results, 0, sizeof(RemoteResult) * numJobs);
+    if (firstJob == NULL || lastJob == NULL || nextJob == NULL) {
+        free(firstJob);
+        free(lastJob);
+        free(nextJob);
+        return -1;
+    }
+
+    /* Chain the jobs of each analyzer in their order */
+    for (int i = 0; i < numJobs; i++) {
+        int group = 0;
+        nextJob[i] = -1;
+        if (jobs[i].agent < 0 || jobs[i].agent >= numAgents) {
+            results[i].status = VI_ERROR_INV_PARAMETER;
+            continue;
+        }
+        while (group < numGroups && !(jobs[firstJob[group]].agent == jobs[i].agent
+            && strcmp(jobs[firstJob[group]].resource, jobs[i].resource) == 0))
+            group++;
+        if (group == numGroups)
+            firstJob[numGroups++] = i;
+        else
+            nextJob[lastJob[group]] = i;
+        lastJob[group] = i;
+    }
+
+    int numWorkers = numGroups < REMOTE_MAX_WORKERS ? numGroups : REMOTE_MAX_WORKERS;
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < numWorkers; i++) {
+        DispatchWorker* worker = &workers[i];
+        worker->agents = agents;
+        worker->jobs = jobs;
+        worker->results = results;
+        worker->firstJob = firstJob;
+        worker->nextJob = nextJob;
+        worker->firstGroup = i;
+        worker->numGroups = numGroups;
+        worker->stride = numWorkers;
+        worker->start = start;
+        worker->started = threadCreate(&worker->thread, dispatchThread, worker) == 0;
+        if (!worker->started)
+            dispatchThread(worker);
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        if (workers[i].started)
+            threadJoin(workers[i].thread);
+    }
+
+    for (int i = 0; i < numJobs; i++)
+        captured += results[i].status >= VI_SUCCESS && results[i].numPoints > 0;
+    free(firstJob);
+    free(lastJob);
+    free(nextJob);
+    return captured;
+}
+
+/**
+ * @brief Frees the traces of remoteDispatch() results.
+ */
+void remoteFreeResults(RemoteResult* results, int numResults) {
+    for (int i = 0; i < numResults; i++) {
+        free(results[i].amp);
+        results[i].amp = NULL;
+        results[i].numPoints = 0;
+    }
+}
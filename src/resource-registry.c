@@ -0,0 +1,287 @@
+/*********************************************************************/
+/*                                                                   */
+/* Registry of the resources found, indexed by descriptor and alias. */
+/*                                                                   */
+/* Entries live in an array that doubles when full, so an index      */
+/* handed out stays valid however many resources are added. Their    */
+/* strings are copied once into large arena blocks instead of a      */
+/* fixed VI_FIND_BUFLEN buffer each, which keeps a registry of       */
+/* thousands of LAN instruments compact. An open addressing hash     */
+/* table maps each descriptor and alias to its entry, so finding a   */
+/* resource by name takes constant time; names are compared without */
+/* regard to case, as VISA does.                                     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "resource-registry.h"
+
+/* Arena block; the interned strings follow the header */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t size;
+} ArenaBlock;
+
+struct ResourceRegistry {
+    RegistryEntry* entries;
+    int numEntries;
+    int capacity;
+    int* slots;                 // Hash table; index + 1 of an entry keyed by descriptor, -(index + 1) by alias, 0 if empty
+    int numSlots;               // Power of two, at least twice the number of keys
+    int numKeys;
+    ArenaBlock* arena;          // Block strings are added to, followed by the full ones
+};
+
+static unsigned int hashName(const char* name) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p != '\0'; p++) {
+        hash ^= (unsigned int)toupper(*p);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int sameName(const char* a, const char* b) {
+    while (*a != '\0' && toupper((unsigned char)*a) == toupper((unsigned char)*b)) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static const char* slotName(const ResourceRegistry* registry, int slot) {
+    return slot > 0 ? registry->entries[slot - 1].descriptor : registry->entries[-slot - 1].alias;
+}
+
+/* Returns the position of the slot keyed by name, or of the empty slot where it would go */
+static int findSlot(const ResourceRegistry* registry, const char* name) {
+    unsigned int mask = (unsigned int)registry->numSlots - 1;
+    unsigned int i = hashName(name) & mask;
+    while (registry->slots[i] != 0 && !sameName(slotName(registry, registry->slots[i]), name))
+        i = (i + 1) & mask;
+    return (int)i;
+}
+
+static void insertSlot(ResourceRegistry* registry, int slot) {
+    registry->slots[findSlot(registry, slotName(registry, slot))] = slot;
+    registry->numKeys++;
+}
+
+/* Builds the hash table again with numSlots slots, e.g. to grow it or drop a replaced alias. Returns 1 on error */
+static int rebuildSlots(ResourceRegistry* registry, int numSlots) {
+    int* slots = calloc((size_t)numSlots, sizeof(int));
+    if (slots == NULL)
+        return 1;
+    free(registry->slots);
+    registry->slots = slots;
+    registry->numSlots = numSlots;
+    registry->numKeys = 0;
+    for (int i = 0; i < registry->numEntries; i++) {
+        insertSlot(registry, i + 1);
+        if (registry->entries[i].alias != NULL)
+            insertSlot(registry, -(i + 1));
+    }
+    return 0;
+}
+
+/* Makes room in the hash table for one more key. Returns 1 on error */
+static int reserveSlot(ResourceRegistry* registry) {
+    if ((registry->numKeys + 1) * 2 <= registry->numSlots)
+        return 0;
+    return rebuildSlots(registry, registry->numSlots * 2);
+}
+
+/* Copies length bytes of text into the arena and terminates them. Returns NULL on error */
+static char* intern(ResourceRegistry* registry, const char* text, size_t length) {
+    ArenaBlock* block = registry->arena;
+    if (block == NULL || block->size - block->used < length + 1) {
+        size_t size = length + 1 > REGISTRY_ARENA_BLOCK ? length + 1 : REGISTRY_ARENA_BLOCK;
+        ArenaBlock* added = malloc(sizeof(ArenaBlock) + size);
+        if (added == NULL)
+            return NULL;
+        added->used = 0;
+        added->size = size;
+        /* A string larger than a block gets a block of its own behind the current one, which keeps its free space */
+        if (block != NULL && size > REGISTRY_ARENA_BLOCK) {
+            added->next = block->next;
+            block->next = added;
+        }
+        else {
+            added->next = block;
+            registry->arena = added;
+        }
+        block = added;
+    }
+    char* copy = (char*)(block + 1) + block->used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    block->used += length + 1;
+    return copy;
+}
+
+/**
+ * @brief Creates an empty registry.
+ * @return The registry, or NULL on error.
+ */
+ResourceRegistry* registryCreate(void) {
+    ResourceRegistry* registry = calloc(1, sizeof(ResourceRegistry));
+    if (registry == NULL)
+        return NULL;
+    registry->entries = malloc(sizeof(RegistryEntry) * REGISTRY_INITIAL_CAPACITY);
+    registry->slots = calloc(REGISTRY_INITIAL_CAPACITY * 2, sizeof(int));
+    if (registry->entries == NULL || registry->slots == NULL) {
+        registryDestroy(registry);
+        return NULL;
+    }
+    registry->capacity = REGISTRY_INITIAL_CAPACITY;
+    registry->numSlots = REGISTRY_INITIAL_CAPACITY * 2;
+    return registry;
+}
+
+/**
+ * @brief Frees the registry and every string it interned.
+ */
+void registryDestroy(ResourceRegistry* registry) {
+    if (registry == NULL)
+        return;
+    while (registry->arena != NULL) {
+        ArenaBlock* next = registry->arena->next;
+        free(registry->arena);
+        registry->arena = next;
+    }
+    free(registry->slots);
+    free(registry->entries);
+    free(registry);
+}
+
+/**
+ * @brief Adds a resource reported by a search, or marks a known one as seen again.
+ * @return Index of the resource's entry, or -1 on error.
+ */
+int registryAdd(ResourceRegistry* registry, const char* descriptor) {
+    int slot = registry->slots[findSlot(registry, descriptor)];
+    if (slot > 0) {
+        registry->entries[slot - 1].lastSeen = time(NULL);
+        return slot - 1;
+    }
+
+    if (registry->numEntries == registry->capacity) {
+        RegistryEntry* entries = realloc(registry->entries, sizeof(RegistryEntry) * registry->capacity * 2);
+        if (entries == NULL)
+            return -1;
+        registry->entries = entries;
+        registry->capacity *= 2;
+    }
+    const char* copy = intern(registry, descriptor, strlen(descriptor));
+    if (copy == NULL || reserveSlot(registry) != 0)
+        return -1;
+
+    int index = registry->numEntries++;
+    RegistryEntry* entry = &registry->entries[index];
+    memset(entry, 0, sizeof(RegistryEntry));
+    entry->descriptor = copy;
+    entry->lastSeen = time(NULL);
+    insertSlot(registry, index + 1);
+    return index;
+}
+
+/**
+ * @brief Finds a resource by its descriptor or alias.
+ * @return Index of the resource's entry, or -1 if the registry has no resource of that name.
+ */
+int registryFind(const ResourceRegistry* registry, const char* name) {
+    int slot = registry->slots[findSlot(registry, name)];
+    if (slot == 0)
+        return -1;
+    return slot > 0 ? slot - 1 : -slot - 1;
+}
+
+/**
+ * @brief Sets the alias of a resource, by which registryFind() finds it too. Replacing an alias rebuilds the hash
+ * table, which is meant for the rare case of an alias changing between searches.
+ *
+ * @param alias The alias, NULL or "" to remove it.
+ * @return 0 on success, 1 if another resource already has that name or on error.
+ */
+int registrySetAlias(ResourceRegistry* registry, int index, const char* alias) {
+    RegistryEntry* entry = &registry->entries[index];
+    if (alias != NULL && alias[0] == '\0')
+        alias = NULL;
+    if (alias == NULL) {
+        if (entry->alias == NULL)
+            return 0;
+        entry->alias = NULL;
+        return rebuildSlots(registry, registry->numSlots);
+    }
+
+    int slot = registry->slots[findSlot(registry, alias)];
+    if (slot != 0)
+        return (slot > 0 ? slot - 1 : -slot - 1) == index ? 0 : 1;
+    const char* copy = intern(registry, alias, strlen(alias));
+    if (copy == NULL)
+        return 1;
+    if (entry->alias != NULL) {
+        entry->alias = copy;
+        return rebuildSlots(registry, registry->numSlots);
+    }
+    if (reserveSlot(registry) != 0)
+        return 1;
+    entry->alias = copy;
+    insertSlot(registry, -(index + 1));
+    return 0;
+}
+
+/**
+ * @brief Records the *IDN? response of a resource. Trailing white space, e.g. the termination character, is dropped.
+ * @return 0 on success, 1 on error.
+ */
+int registrySetIdn(ResourceRegistry* registry, int index, const char* idn) {
+    RegistryEntry* entry = &registry->entries[index];
+    size_t length = strlen(idn);
+    while (length > 0 && isspace((unsigned char)idn[length - 1]))
+        length--;
+    if (entry->idn != NULL && strncmp(entry->idn, idn, length) == 0 && entry->idn[length] == '\0')
+        return 0;
+    const char* copy = intern(registry, idn, length);
+    if (copy == NULL)
+        return 1;
+    entry->idn = copy;
+    return 0;
+}
+
+/**
+ * @brief Records the interface of a resource, e.g. as parsed by viParseRsrc().
+ */
+void registrySetInterface(ResourceRegistry* registry, int index, ViUInt16 intfType, ViUInt16 intfNum) {
+    registry->entries[index].intfType = intfType;
+    registry->entries[index].intfNum = intfNum;
+}
+
+/**
+ * @brief Returns the entry at an index from 0 to registryCount() - 1. The pointer is valid until the next
+ * registryAdd(); the index stays valid for the lifetime of the registry.
+ */
+const RegistryEntry* registryEntry(const ResourceRegistry* registry, int index) {
+    return &registry->entries[index];
+}
+
+/**
+ * @brief Returns the number of resources in the registry.
+ */
+int registryCount(const ResourceRegistry* registry) {
+    return registry->numEntries;
+}
+
+/**
+ * @brief Returns the bytes the registry has allocated, including unused capacity.
+ */
+size_t registryMemory(const ResourceRegistry* registry) {
+    size_t bytes = sizeof(ResourceRegistry) + sizeof(RegistryEntry) * registry->capacity
+        + sizeof(int) * registry->numSlots;
+    for (const ArenaBlock* block = registry->arena; block != NULL; block = block->next)
+        bytes += sizeof(ArenaBlock) + block->size;
+    return bytes;
+}
@@ -0,0 +1,332 @@
+/*********************************************************************/
+/*                                                                   */
+/* Work-stealing job scheduler for instrument fleets.                */
+/*                                                                   */
+/* Each worker thread has its own deque of jobs. A worker runs the   */
+/* newest job of its own deque and, when that is empty, steals the   */
+/* oldest job of another worker, so load spreads across the pool     */
+/* without a central queue.                                          */
+/*                                                                   */
+/* Jobs may name a shared bus (a GPIB board or serial port, see      */
+/* sessionSharedBus()). At most one job per bus runs at a time:      */
+/* a job submitted while its bus is taken is parked on the bus, and  */
+/* the worker that frees the bus runs the parked jobs in submission  */
+/* order. Jobs without a bus, e.g. LAN instruments, run fully in     */
+/* parallel.                                                         */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "scheduler.h"
+
+#define DEQUE_INITIAL_CAPACITY 16
+
+typedef struct SchedulerJob {
+    SchedulerJobFn fn;
+    void* arg;
+    int bus;                            // Index into Scheduler.buses, or -1
+    struct SchedulerJob* next;          // Next job parked on the same bus
+} SchedulerJob;
+
+/* Jobs of one worker: the owner pushes and pops at the back, thieves take from the front */
+typedef struct {
+    PlatformMutex mutex;
+    SchedulerJob** jobs;
+    int head;
+    int count;
+    int capacity;
+} WorkDeque;
+
+typedef struct {
+    char name[SCHEDULER_BUS_NAME];
+    int busy;                           // A job on this bus is queued or running
+    SchedulerJob* waitHead;             // Jobs parked until the bus is free, oldest first
+    SchedulerJob* waitTail;
+} SchedulerBus;
+
+typedef struct {
+    Scheduler* scheduler;
+    int index;
+} SchedulerWorker;
+
+struct Scheduler {
+    int numWorkers;
+    PlatformThread threads[SCHEDULER_MAX_WORKERS];
+    SchedulerWorker workers[SCHEDULER_MAX_WORKERS];
+    WorkDeque deques[SCHEDULER_MAX_WORKERS];
+
+    PlatformMutex mutex;                // Guards everything below
+    PlatformCond workAvailable;         // Signalled when a job is pushed or the pool stops
+    PlatformCond allDone;               // Broadcast when pending drops to zero
+    SchedulerBus buses[SCHEDULER_MAX_BUSES];
+    int numBuses;
+    int queued;                         // Jobs in the deques
+    int pending;                        // Jobs submitted and not finished
+    int nextWorker;                     // Deque the next submission goes to
+    int stopping;
+    unsigned long executed;
+    unsigned long stolen;
+};
+
+/* Appends a job to a worker's deque, growing it when full. Returns 1 if out of memory */
+static int pushBack(WorkDeque* deque, SchedulerJob* job) {
+    mutexLock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        int capacity = deque->capacity * 2;
+        SchedulerJob** jobs = malloc(sizeof(SchedulerJob*) * capacity);
+        if (jobs == NULL) {
+            mutexUnlock(&deque->mutex);
+            return 1;
+        }
+        for (int i = 0; i < deque->count; i++)
+            jobs[i] = deque->jobs[(deque->head + i) % deque->capacity];
+        free(deque->jobs);
+        deque->jobs = jobs;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->jobs[(deque->head + deque->count) % deque->capacity] = job;
+    deque->count++;
+    mutexUnlock(&deque->mutex);
+    return 0;
+}
+
+static SchedulerJob* popBack(WorkDeque* deque) {
+    SchedulerJob* job = NULL;
+    mutexLock(&deque->mutex);
+    if (deque->count > 0) {
+        deque->count--;
+        job = deque->jobs[(deque->head + deque->count) % deque->capacity];
+    }
+    mutexUnlock(&deque->mutex);
+    return job;
+}
+
+static SchedulerJob* popFront(WorkDeque* deque) {
+    SchedulerJob* job = NULL;
+    mutexLock(&deque->mutex);
+    if (deque->count > 0) {
+        job = deque->jobs[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    mutexUnlock(&deque->mutex);
+    return job;
+}
+
+/* Takes a job from the worker's own deque, or steals one from the others */
+static SchedulerJob* takeJob(Scheduler* scheduler, int index) {
+    SchedulerJob* job = popBack(&scheduler->deques[index]);
+    int stolen = 0;
+    for (int i = 1; job == NULL && i < scheduler->numWorkers; i++) {
+        job = popFront(&scheduler->deques[(index + i) % scheduler->numWorkers]);
+        stolen = job != NULL;
+    }
+    if (job != NULL) {
+        mutexLock(&scheduler->mutex);
+        scheduler->queued--;
+        scheduler->stolen += stolen;
+        mutexUnlock(&scheduler->mutex);
+    }
+    return job;
+}
+
+/* Runs a job and any jobs parked on its bus behind it */
+static void runJob(Scheduler* scheduler, SchedulerJob* job) {
+    while (job != NULL) {
+        job->fn(job->arg);
+
+        SchedulerJob* next = NULL;
+        mutexLock(&scheduler->mutex);
+        if (job->bus >= 0) {
+            SchedulerBus* bus = &scheduler->buses[job->bus];
+            next = bus->waitHead;
+            if (next != NULL) {
+                bus->waitHead = next->next;
+                if (bus->waitHead == NULL)
+                    bus->waitTail = NULL;
+            }
+            else {
+                bus->busy = 0;
+            }
+        }
+        scheduler->executed++;
+        if (--scheduler->pending == 0)
+            condBroadcast(&scheduler->allDone);
+        mutexUnlock(&scheduler->mutex);
+
+        free(job);
+        job = next;
+    }
+}
+
+static THREAD_FUNC workerThread(void* arg) {
+    SchedulerWorker* worker = arg;
+    Scheduler* scheduler = worker->scheduler;
+
+    for (;;) {
+        SchedulerJob* job = takeJob(scheduler, worker->index);
+        if (job == NULL) {
+            mutexLock(&scheduler->mutex);
+            while (scheduler->queued == 0 && !scheduler->stopping)
+                condWait(&scheduler->workAvailable, &scheduler->mutex);
+            int stop = scheduler->stopping && scheduler->queued == 0;
+            mutexUnlock(&scheduler->mutex);
+            if (stop)
+                return THREAD_RETURN;
+            continue;
+        }
+
+        runJob(scheduler, job);
+    }
+}
+
+/**
+ * @brief Starts a pool of worker threads.
+ *
+ * @param numWorkers Number of workers, from 1 to SCHEDULER_MAX_WORKERS.
+ * @return The scheduler, or NULL on error.
+ */
+Scheduler* schedulerCreate(int numWorkers) {
+    if (numWorkers < 1 || numWorkers > SCHEDULER_MAX_WORKERS)
+        return NULL;
+    Scheduler* scheduler = calloc(1, sizeof(Scheduler));
+    if (scheduler == NULL)
+        return NULL;
+
+    mutexInit(&scheduler->mutex);
+    condInit(&scheduler->workAvailable);
+    condInit(&scheduler->allDone);
+    for (int i = 0; i < numWorkers; i++) {
+        WorkDeque* deque = &scheduler->deques[i];
+        mutexInit(&deque->mutex);
+        deque->capacity = DEQUE_INITIAL_CAPACITY;
+        deque->jobs = malloc(sizeof(SchedulerJob*) * deque->capacity);
+    }
+    for (int i = 0; i < numWorkers; i++) {
+        scheduler->workers[i].scheduler = scheduler;
+        scheduler->workers[i].index = i;
+        if (threadCreate(&scheduler->threads[i], workerThread, &scheduler->workers[i]) != 0)
+            break;
+        scheduler->numWorkers++;
+    }
+    if (scheduler->numWorkers < numWorkers) {
+        schedulerDestroy(scheduler);
+        return NULL;
+    }
+    return scheduler;
+}
+
+/**
+ * @brief Waits for every submitted job, stops the workers and frees the scheduler.
+ */
+void schedulerDestroy(Scheduler* scheduler) {
+    if (scheduler == NULL)
+        return;
+    schedulerWait(scheduler);
+    mutexLock(&scheduler->mutex);
+    scheduler->stopping = 1;
+    condBroadcast(&scheduler->workAvailable);
+    mutexUnlock(&scheduler->mutex);
+    for (int i = 0; i < scheduler->numWorkers; i++)
+        threadJoin(scheduler->threads[i]);
+
+    for (int i = 0; i < SCHEDULER_MAX_WORKERS; i++) {
+        if (scheduler->deques[i].jobs != NULL) {
+            free(scheduler->deques[i].jobs);
+            mutexDestroy(&scheduler->deques[i].mutex);
+        }
+    }
+    condDestroy(&scheduler->workAvailable);
+    condDestroy(&scheduler->allDone);
+    mutexDestroy(&scheduler->mutex);
+    free(scheduler);
+}
+
+/**
+ * @brief Queues a job. Jobs on the same bus never run at the same time and start in submission order.
+ *
+ * @param bus Shared bus the job uses, e.g. from sessionSharedBus(), or NULL or "" if it can run in parallel with
+ * anything.
+ * @return 0 on success, 1 if the job could not be queued.
+ */
+int schedulerSubmit(Scheduler* scheduler, const char* bus, SchedulerJobFn fn, void* arg) {
+    SchedulerJob* job = malloc(sizeof(SchedulerJob));
+    if (job == NULL)
+        return 1;
+    job->fn = fn;
+    job->arg = arg;
+    job->bus = -1;
+    job->next = NULL;
+
+    mutexLock(&scheduler->mutex);
+    if (bus != NULL && bus[0] != '\0') {
+        int i = 0;
+        while (i < scheduler->numBuses && strcmp(scheduler->buses[i].name, bus) != 0)
+            i++;
+        if (i == scheduler->numBuses) {
+            if (i == SCHEDULER_MAX_BUSES || strlen(bus) >= SCHEDULER_BUS_NAME) {
+                mutexUnlock(&scheduler->mutex);
+                free(job);
+                return 1;
+            }
+            strcpy(scheduler->buses[i].name, bus);
+            scheduler->numBuses++;
+        }
+        job->bus = i;
+    }
+    scheduler->pending++;
+    if (job->bus >= 0) {
+        SchedulerBus* busEntry = &scheduler->buses[job->bus];
+        if (busEntry->busy) {
+            /* Parked behind the jobs already on the bus, so they start in submission order */
+            if (busEntry->waitTail != NULL)
+                busEntry->waitTail->next = job;
+            else
+                busEntry->waitHead = job;
+            busEntry->waitTail = job;
+            mutexUnlock(&scheduler->mutex);
+            return 0;
+        }
+        busEntry->busy = 1;
+    }
+
+    /* Counted in the same critical section as the push, so no worker takes the job before it is counted */
+    int worker = scheduler->nextWorker;
+    if (pushBack(&scheduler->deques[worker], job) != 0) {
+        scheduler->pending--;
+        if (job->bus >= 0)
+            scheduler->buses[job->bus].busy = 0;
+        mutexUnlock(&scheduler->mutex);
+        free(job);
+        return 1;
+    }
+    scheduler->nextWorker = (worker + 1) % scheduler->numWorkers;
+    scheduler->queued++;
+    condSignal(&scheduler->workAvailable);
+    mutexUnlock(&scheduler->mutex);
+    return 0;
+}
+
+/**
+ * @brief Waits until every job submitted so far has finished.
+ */
+void schedulerWait(Scheduler* scheduler) {
+    mutexLock(&scheduler->mutex);
+    while (scheduler->pending > 0)
+        condWait(&scheduler->allDone, &scheduler->mutex);
+    mutexUnlock(&scheduler->mutex);
+}
+
+/**
+ * @brief Reports how many jobs have run and how many of them were stolen from another worker's deque.
+ */
+void schedulerStats(Scheduler* scheduler, unsigned long* executed, unsigned long* stolen) {
+    mutexLock(&scheduler->mutex);
+    *executed = scheduler->executed;
+    *stolen = scheduler->stolen;
+    mutexUnlock(&scheduler->mutex);
+}
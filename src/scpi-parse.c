@@ -0,0 +1,500 @@
+/*********************************************************************/
+/*                                                                   */
+/* Helpers for parsing SCPI traffic.                                 */
+/*                                                                   */
+/* Header patterns use the notation of instrument manuals:           */
+/*      uppercase letters   short form of a mnemonic                 */
+/*      [:NODe]             optional mnemonic                        */
+/*      #                   numeric suffix, e.g. MARKer# for MARK3   */
+/*      trailing ?          the header is a query                    */
+/* e.g. "[:SENSe]:FREQuency:STARt?" or ":CALCulate:MARKer#:Y?"       */
+/*                                                                   */
+/* Definite length binary blocks (#<n><length><payload>) as sent     */
+/* by :TRACe:DATA? in REAL,32 format are decoded in place.           */
+/*                                                                   */
+/* Responses to several queries sent in one message come back as     */
+/* units separated by ';', and :SYSTem:ERRor? entries are parsed     */
+/* into a number and a message.                                      */
+/*                                                                   */
+/* The mnemonics of headers and patterns are hashed, so callers can  */
+/* sort patterns by how a header ends, and each unit of a message    */
+/* can be told apart as a command or a query.                        */
+/*                                                                   */
+/*********************************************************************/
+
+#include <string.h>
+#include <ctype.h>
+#include "scpi-parse.h"
+
+typedef struct {
+    char name[SCPI_MAX_MNEMONIC];   // Long form of the mnemonic, short form in uppercase
+    int shortLength;                // Length of the short form
+    int optional;                   // Node may be omitted
+    int numeric;                    // Node accepts a numeric suffix
+} PatternNode;
+
+typedef struct {
+    const char* text;               // Mnemonic letters
+    int length;                     // Number of letters
+    int suffix;                     // Numeric suffix, -1 if none
+} HeaderNode;
+
+/**
+ * @brief Splits a header pattern into nodes.
+ * @return Number of nodes, or -1 if the pattern is malformed. *query is set if the pattern ends in '?'.
+ */
+static int parsePattern(const char* pattern, PatternNode* nodes, int* query) {
+    int count = 0;
+    const char* p = pattern;
+    *query = 0;
+
+    while (*p != '\0') {
+        if (*p == '?') {
+            *query = 1;
+            break;
+        }
+        if (count == SCPI_MAX_NODES)
+            return -1;
+
+        PatternNode* node = &nodes[count];
+        node->optional = 0;
+        node->numeric = 0;
+        node->shortLength = 0;
+        if (*p == '[') {
+            node->optional = 1;
+            p++;
+        }
+        if (*p == ':')
+            p++;
+
+        int n = 0;
+        while (*p != '\0' && *p != ':' && *p != '[' && *p != ']' && *p != '?') {
+            if (*p == '#') {
+                node->numeric = 1;
+            }
+            else if (n < SCPI_MAX_MNEMONIC - 1) {
+                if (isupper((unsigned char)*p) || *p == '*')
+                    node->shortLength = n + 1;
+                node->name[n++] = *p;
+            }
+            p++;
+        }
+        node->name[n] = '\0';
+        if (node->optional) {
+            if (*p != ']')
+                return -1;
+            p++;
+        }
+        if (n == 0)
+            return -1;
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Splits the header of a command (everything before the first space) into nodes.
+ * @return Number of nodes, or -1 if the header is malformed. *query is set if the header ends in '?'.
+ */
+static int parseHeader(const char* header, size_t length, HeaderNode* nodes, int* query) {
+    int count = 0;
+    size_t i = 0;
+    *query = 0;
+
+    while (i < length && isspace((unsigned char)header[i]))
+        i++;
+    if (i < length && header[i] == ':')
+        i++;
+
+    while (i < length && !isspace((unsigned char)header[i])) {
+        if (header[i] == '?') {
+            *query = 1;
+            i++;
+            break;
+        }
+        if (count == SCPI_MAX_NODES)
+            return -1;
+
+        HeaderNode* node = &nodes[count];
+        node->text = header + i;
+        node->length = 0;
+        node->suffix = -1;
+        while (i < length && (isalpha((unsigned char)header[i]) || header[i] == '*' || header[i] == '_')) {
+            node->length++;
+            i++;
+        }
+        if (i < length && isdigit((unsigned char)header[i])) {
+            node->suffix = 0;
+            while (i < length && isdigit((unsigned char)header[i])) {
+                node->suffix = node->suffix * 10 + (header[i] - '0');
+                i++;
+            }
+        }
+        if (node->length == 0)
+            return -1;
+        count++;
+        if (i < length && header[i] == ':')
+            i++;
+    }
+    if (i < length && !isspace((unsigned char)header[i]))
+        return -1;
+    return count;
+}
+
+static int mnemonicMatches(const HeaderNode* input, const PatternNode* pattern) {
+    if (input->suffix >= 0 && !pattern->numeric)
+        return 0;
+    int longLength = (int)strlen(pattern->name);
+    if (input->length != pattern->shortLength && input->length != longLength)
+        return 0;
+    for (int i = 0; i < input->length; i++) {
+        if (toupper((unsigned char)input->text[i]) != toupper((unsigned char)pattern->name[i]))
+            return 0;
+    }
+    return 1;
+}
+
+static int matchNodes(const HeaderNode* input, int numInput, const PatternNode* pattern, int numPattern, int* suffix) {
+    if (numPattern == 0)
+        return numInput == 0;
+
+    if (pattern->optional && matchNodes(input, numInput, pattern + 1, numPattern - 1, suffix))
+        return 1;
+    if (numInput == 0 || !mnemonicMatches(input, pattern))
+        return 0;
+    if (!matchNodes(input + 1, numInput - 1, pattern + 1, numPattern - 1, suffix))
+        return 0;
+    if (pattern->numeric && suffix != NULL && *suffix < 0)
+        *suffix = input->suffix >= 0 ? input->suffix : 1;
+    return 1;
+}
+
+/**
+ * @brief Tests whether a command header matches a header pattern, accepting short and long forms in any case.
+ *
+ * @param header Command, or the header part of one. Parsing stops at the first whitespace.
+ * @param length Number of characters in header.
+ * @param pattern Header pattern in manual notation, e.g. ":CALCulate:MARKer#:X".
+ * @param suffix Output numeric suffix of the last numeric node that matched (1 if omitted). May be NULL.
+ * @return 1 if the header matches, 0 otherwise.
+ */
+int scpiMatchHeader(const char* header, size_t length, const char* pattern, int* suffix) {
+    PatternNode patternNodes[SCPI_MAX_NODES];
+    HeaderNode headerNodes[SCPI_MAX_NODES];
+    int patternQuery, headerQuery;
+
+    int numPattern = parsePattern(pattern, patternNodes, &patternQuery);
+    int numHeader = parseHeader(header, length, headerNodes, &headerQuery);
+    if (numPattern < 0 || numHeader < 0 || patternQuery != headerQuery)
+        return 0;
+
+    int found = -1;
+    if (!matchNodes(headerNodes, numHeader, patternNodes, numPattern, &found))
+        return 0;
+    if (suffix != NULL)
+        *suffix = found;
+    return 1;
+}
+
+/**
+ * @brief Returns a pointer to the parameters of a command, after its header and any whitespace.
+ *
+ * @param command Command text.
+ * @param length Number of characters in command.
+ * @return Pointer to the first parameter character, or command + length if there are no parameters.
+ */
+const char* scpiSkipHeader(const char* command, size_t length) {
+    size_t i = 0;
+    while (i < length && isspace((unsigned char)command[i]))
+        i++;
+    while (i < length && !isspace((unsigned char)command[i]))
+        i++;
+    while (i < length && isspace((unsigned char)command[i]))
+        i++;
+    return command + i;
+}
+
+/**
+ * @brief Hashes a mnemonic in any case, e.g. to sort header patterns by the mnemonic they end with.
+ *
+ * @param text Mnemonic letters, without numeric suffix.
+ * @param length Number of letters.
+ * @return FNV-1a hash of the mnemonic in upper case.
+ */
+unsigned int scpiMnemonicHash(const char* text, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)toupper((unsigned char)text[i])) * 16777619u;
+    return hash;
+}
+
+/**
+ * @brief Hashes the mnemonics a header matching a pattern can end with: short and long form of the last node, and of
+ * the nodes before it while they are optional.
+ *
+ * @param hashes Output scpiMnemonicHash() values, room for SCPI_MAX_ENDINGS.
+ * @return Number of hashes.
+ */
+int scpiPatternEndings(const char* pattern, unsigned int* hashes) {
+    const char* names[SCPI_MAX_NODES];
+    size_t lengths[SCPI_MAX_NODES];
+    int optional[SCPI_MAX_NODES];
+    int numNodes = 0;
+    const char* p = pattern;
+
+    while (*p != '\0' && *p != '?' && numNodes < SCPI_MAX_NODES) {
+        optional[numNodes] = *p == '[';
+        if (*p == '[')
+            p++;
+        if (*p == ':')
+            p++;
+        names[numNodes] = p;
+        while (*p != '\0' && *p != ':' && *p != '[' && *p != ']' && *p != '?' && *p != '#')
+            p++;
+        lengths[numNodes] = (size_t)(p - names[numNodes]);
+        while (*p == '#' || *p == ']')
+            p++;
+        if (lengths[numNodes] > 0)
+            numNodes++;
+    }
+
+    int numHashes = 0;
+    for (int i = numNodes - 1; i >= 0; i--) {
+        size_t shortLength = 0;
+        while (shortLength < lengths[i] && !islower((unsigned char)names[i][shortLength]))
+            shortLength++;
+        hashes[numHashes++] = scpiMnemonicHash(names[i], lengths[i]);
+        if (shortLength < lengths[i])
+            hashes[numHashes++] = scpiMnemonicHash(names[i], shortLength);
+        if (!optional[i])
+            break;
+    }
+    return numHashes;
+}
+
+/**
+ * @brief Finds the last mnemonic of a command header, without its numeric suffix.
+ *
+ * @param command Command text; the header ends at the first whitespace.
+ * @param length Number of characters in command.
+ * @param mnemonicLength Output number of letters in the mnemonic.
+ * @param query Output 1 if the header ends in '?', 0 otherwise.
+ * @return Pointer to the first letter of the mnemonic.
+ */
+const char* scpiLastMnemonic(const char* command, size_t length, size_t* mnemonicLength, int* query) {
+    size_t end = 0;
+    while (end < length && !isspace((unsigned char)command[end]))
+        end++;
+    *query = end > 0 && command[end - 1] == '?';
+    if (*query)
+        end--;
+    while (end > 0 && isdigit((unsigned char)command[end - 1]))
+        end--;
+    size_t start = end;
+    while (start > 0 && command[start - 1] != ':')
+        start--;
+    *mnemonicLength = end - start;
+    return command + start;
+}
+
+/**
+ * @brief Tests whether a message expects a response, i.e. whether the header of any of its units ends in '?'.
+ *
+ * @param message Command or query text, possibly several units separated by ';'.
+ * @param length Number of characters in message.
+ * @return 1 if the message contains a query, 0 otherwise.
+ */
+int scpiIsQuery(const char* message, size_t length) {
+    for (size_t unit = 0; unit < length; unit += scpiUnitLength(message + unit, length - unit) + 1) {
+        size_t i = unit;
+        while (i < length && isspace((unsigned char)message[i]))
+            i++;
+        while (i < length && !isspace((unsigned char)message[i]) && message[i] != ';')
+            i++;
+        if (i > unit && message[i - 1] == '?')
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Measures the first unit of a response message. Units are separated by ';' outside of quoted strings and
+ * definite length blocks.
+ *
+ * @param response Response text.
+ * @param length Number of characters in response.
+ * @return Number of characters in the first unit, length if it is the only one.
+ */
+size_t scpiUnitLength(const char* response, size_t length) {
+    size_t payloadOffset, payloadLength;
+    if (length > 0 && response[0] == '#'
+        && scpiBlockHeader((const unsigned char*)response, length, &payloadOffset, &payloadLength) == 0) {
+        size_t i = payloadOffset + payloadLength;
+        while (i < length && response[i] != ';')
+            i++;
+        return i;
+    }
+
+    char quote = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (quote != 0) {
+            if (response[i] == quote)
+                quote = 0;
+        }
+        else if (response[i] == '"' || response[i] == '\'') {
+            quote = response[i];
+        }
+        else if (response[i] == ';') {
+            return i;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Parses an entry of the error queue as returned by :SYSTem:ERRor?, e.g. -113,"Undefined header".
+ *
+ * @param response Response text; surrounding whitespace is ignored.
+ * @param length Number of characters in response.
+ * @param code Output error number, 0 if the queue was empty.
+ * @param message Output message without quotes, truncated to size - 1 characters.
+ * @param size Capacity of message.
+ * @return 0 on success, 1 if the response is not an error queue entry.
+ */
+int scpiParseError(const char* response, size_t length, int* code, char* message, size_t size) {
+    size_t i = 0;
+    while (i < length && isspace((unsigned char)response[i]))
+        i++;
+    int sign = 1;
+    if (i < length && (response[i] == '+' || response[i] == '-'))
+        sign = response[i++] == '-' ? -1 : 1;
+    if (i == length || !isdigit((unsigned char)response[i]))
+        return 1;
+    int number = 0;
+    while (i < length && isdigit((unsigned char)response[i]))
+        number = number * 10 + (response[i++] - '0');
+    if (i == length || response[i] != ',')
+        return 1;
+    i++;
+
+    while (i < length && isspace((unsigned char)response[i]))
+        i++;
+    size_t end = length;
+    while (end > i && isspace((unsigned char)response[end - 1]))
+        end--;
+    if (end - i >= 2 && response[i] == '"' && response[end - 1] == '"') {
+        i++;
+        end--;
+    }
+    size_t copied = end - i < size - 1 ? end - i : size - 1;
+    memcpy(message, response + i, copied);
+    message[copied] = '\0';
+    *code = sign * number;
+    return 0;
+}
+
+/**
+ * @brief Parses the header of an IEEE 488.2 definite length block (#<n><length>).
+ *
+ * @param data Response bytes, starting with '#'.
+ * @param length Number of response bytes.
+ * @param payloadOffset Output offset of the first payload byte.
+ * @param payloadLength Output number of payload bytes.
+ * @return 0 on success, 1 if the block header is malformed or the payload is incomplete.
+ */
+int scpiBlockHeader(const unsigned char* data, size_t length, size_t* payloadOffset, size_t* payloadLength) {
+    if (length < 2 || data[0] != '#' || !isdigit(data[1]) || data[1] == '0')
+        return 1;
+
+    size_t digits = data[1] - '0';
+    if (length < 2 + digits)
+        return 1;
+    size_t count = 0;
+    for (size_t i = 0; i < digits; i++) {
+        if (!isdigit(data[2 + i]))
+            return 1;
+        count = count * 10 + (data[2 + i] - '0');
+    }
+    if (length < 2 + digits + count)
+        return 1;
+
+    *payloadOffset = 2 + digits;
+    *payloadLength = count;
+    return 0;
+}
+
+/**
+ * @brief Decodes a payload of IEEE 754 single precision values.
+ *
+ * @param payload Payload bytes.
+ * @param payloadLength Number of payload bytes.
+ * @param bigEndian Nonzero for FORMat:BORDer NORMal (big-endian), zero for SWAPped (little-endian).
+ * @param values Output array.
+ * @param maxValues Capacity of values[].
+ * @return Number of values decoded.
+ */
+int scpiDecodeReal32(const unsigned char* payload, size_t payloadLength, int bigEndian, float* values, int maxValues) {
+    int count = (int)(payloadLength / 4);
+    if (count > maxValues)
+        count = maxValues;
+
+    for (int i = 0; i < count; i++) {
+        const unsigned char* b = payload + 4 * i;
+        unsigned int bits = bigEndian
+            ? ((unsigned int)b[0] << 24) | ((unsigned int)b[1] << 16) | ((unsigned int)b[2] << 8) | b[3]
+            : ((unsigned int)b[3] << 24) | ((unsigned int)b[2] << 16) | ((unsigned int)b[1] << 8) | b[0];
+        memcpy(&values[i], &bits, 4);
+    }
+    return count;
+}
+
+/**
+ * @brief Encodes single precision values as a definite length block, as an instrument would send them.
+ *
+ * @param values Values to encode.
+ * @param numValues Number of values.
+ * @param bigEndian Nonzero for big-endian payload bytes.
+ * @param out Output buffer.
+ * @param outSize Capacity of out in bytes.
+ * @return Number of bytes written, or 0 if out is too small.
+ */
+size_t scpiEncodeReal32(const float* values, int numValues, int bigEndian, unsigned char* out, size_t outSize) {
+    char header[16];
+    size_t payloadLength = (size_t)numValues * 4;
+    int lengthDigits = 1;
+    for (size_t n = payloadLength; n >= 10; n /= 10)
+        lengthDigits++;
+
+    int headerLength = 0;
+    header[headerLength++] = '#';
+    header[headerLength++] = (char)('0' + lengthDigits);
+    for (int i = lengthDigits - 1; i >= 0; i--) {
+        size_t n = payloadLength;
+        for (int j = 0; j < i; j++)
+            n /= 10;
+        header[headerLength++] = (char)('0' + n % 10);
+    }
+    if (outSize < headerLength + payloadLength)
+        return 0;
+
+    memcpy(out, header, headerLength);
+    unsigned char* p = out + headerLength;
+    for (int i = 0; i < numValues; i++) {
+        unsigned int bits;
+        memcpy(&bits, &values[i], 4);
+        if (bigEndian) {
+            p[0] = (unsigned char)(bits >> 24);
+            p[1] = (unsigned char)(bits >> 16);
+            p[2] = (unsigned char)(bits >> 8);
+            p[3] = (unsigned char)bits;
+        }
+        else {
+            p[0] = (unsigned char)bits;
+            p[1] = (unsigned char)(bits >> 8);
+            p[2] = (unsigned char)(bits >> 16);
+            p[3] = (unsigned char)(bits >> 24);
+        }
+        p += 4;
+    }
+    return headerLength + payloadLength;
+}
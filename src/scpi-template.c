@@ -0,0 +1,178 @@
+/*********************************************************************/
+/*                                                                   */
+/* Precompiled SCPI command templates.                               */
+/*                                                                   */
+/* A template such as ":CALC:MARK%d:X %f" is parsed once into its    */
+/* literal text and typed slots. Rendering copies the literals and   */
+/* formats each argument straight into the caller's buffer, without  */
+/* reparsing the format or allocating, which matters in loops that   */
+/* send a command per trace point.                                   */
+/*                                                                   */
+/* Slots are %d (int), %f or %.<n>f (double with n decimals, 6 by    */
+/* default), %s (string) and %% for a literal percent sign. Fixed    */
+/* point values are rounded half away from zero from the binary      */
+/* value, so the last decimal can differ from printf() for values    */
+/* exactly halfway in decimal; values too large for 64-bit integer   */
+/* arithmetic and non-finite values are formatted by snprintf().     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include "scpi-template.h"
+
+#define FIXED_LIMIT 9.0e18      // Largest scaled value formatted with integer arithmetic
+
+static const double powersOfTen[TEMPLATE_MAX_PRECISION + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+/**
+ * @brief Parses a command template.
+ *
+ * @param format Command with slots, e.g. ":CALC:MARK%d:X %f".
+ * @return 0 on success, 1 if the format has an unknown slot, more than TEMPLATE_MAX_SLOTS slots or is longer than
+ * TEMPLATE_TEXT_BYTES - 1.
+ */
+int templateCompile(ScpiTemplate* tmpl, const char* format) {
+    size_t length = 0;
+    tmpl->numSlots = 0;
+    for (const char* p = format; *p != '\0'; p++) {
+        if (length == TEMPLATE_TEXT_BYTES - 1)
+            return 1;
+        if (*p != '%') {
+            tmpl->text[length++] = *p;
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            tmpl->text[length++] = '%';
+            continue;
+        }
+        if (tmpl->numSlots == TEMPLATE_MAX_SLOTS)
+            return 1;
+
+        TemplateSlot* slot = &tmpl->slots[tmpl->numSlots++];
+        slot->offset = (unsigned short)length;
+        slot->precision = 6;
+        if (p[0] == '.' && p[1] >= '0' && p[1] <= '0' + TEMPLATE_MAX_PRECISION && p[2] == 'f') {
+            slot->precision = (unsigned char)(p[1] - '0');
+            p += 2;
+        }
+        if (*p == 'd' && p[-1] == '%')
+            slot->type = TEMPLATE_INT;
+        else if (*p == 'f')
+            slot->type = TEMPLATE_FIXED;
+        else if (*p == 's' && p[-1] == '%')
+            slot->type = TEMPLATE_STRING;
+        else
+            return 1;
+    }
+    tmpl->text[length] = '\0';
+    tmpl->length = length;
+    return 0;
+}
+
+/* Writes the digits of value, at least minDigits of them, backwards from end. Returns the new start */
+static char* writeDigits(unsigned long long value, int minDigits, char* end) {
+    do {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+        minDigits--;
+    } while (value != 0 || minDigits > 0);
+    return end;
+}
+
+/* Copies a formatted number into out. Returns its length, or 0 if out is too small */
+static size_t copyNumber(const char* start, const char* end, char* out, size_t size) {
+    size_t length = end - start;
+    if (length >= size)
+        return 0;
+    memcpy(out, start, length);
+    return length;
+}
+
+static size_t formatInt(int value, char* out, size_t size) {
+    char buffer[24];
+    char* end = buffer + sizeof(buffer);
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)(long long)value : (unsigned long long)value;
+    char* start = writeDigits(magnitude, 1, end);
+    if (value < 0)
+        *--start = '-';
+    return copyNumber(start, end, out, size);
+}
+
+static size_t formatFixed(double value, int precision, char* out, size_t size) {
+    double magnitude = fabs(value) * powersOfTen[precision];
+    if (!(magnitude < FIXED_LIMIT)) {
+        int length = snprintf(out, size, "%.*f", precision, value);
+        return length < 0 || (size_t)length >= size ? 0 : (size_t)length;
+    }
+
+    char buffer[48];
+    char* end = buffer + sizeof(buffer);
+    unsigned long long scaled = (unsigned long long)(magnitude + 0.5);
+    unsigned long long divisor = (unsigned long long)powersOfTen[precision];
+    char* start = end;
+    if (precision > 0) {
+        start = writeDigits(scaled % divisor, precision, end);
+        *--start = '.';
+    }
+    start = writeDigits(scaled / divisor, 1, start);
+    if (signbit(value))
+        *--start = '-';
+    return copyNumber(start, end, out, size);
+}
+
+/**
+ * @brief Renders a template with one argument per slot, of the slot's type, and null-terminates it.
+ *
+ * @param out Output buffer.
+ * @param size Capacity of out.
+ * @return Length of the command, or 0 if out is too small.
+ */
+size_t templateRender(const ScpiTemplate* tmpl, char* out, size_t size, ...) {
+    va_list args;
+    size_t used = 0, literal = 0;
+    va_start(args, size);
+    for (int i = 0; i <= tmpl->numSlots; i++) {
+        size_t next = i < tmpl->numSlots ? tmpl->slots[i].offset : tmpl->length;
+        if (used + (next - literal) >= size) {
+            used = 0;
+            break;
+        }
+        memcpy(out + used, tmpl->text + literal, next - literal);
+        used += next - literal;
+        literal = next;
+        if (i == tmpl->numSlots)
+            break;
+
+        size_t written;
+        const TemplateSlot* slot = &tmpl->slots[i];
+        if (slot->type == TEMPLATE_INT) {
+            written = formatInt(va_arg(args, int), out + used, size - used);
+        }
+        else if (slot->type == TEMPLATE_FIXED) {
+            written = formatFixed(va_arg(args, double), slot->precision, out + used, size - used);
+        }
+        else {
+            const char* string = va_arg(args, const char*);
+            written = strlen(string);
+            if (written >= size - used)
+                written = 0;
+            else
+                memcpy(out + used, string, written);
+            if (string[0] == '\0')
+                continue;
+        }
+        if (written == 0) {
+            used = 0;
+            break;
+        }
+        used += written;
+    }
+    va_end(args);
+    if (size > 0)
+        out[used] = '\0';
+    return used;
+}
@@ -0,0 +1,467 @@
+/*********************************************************************/
+/*                                                                   */
+/* Local SCPI command tree, to catch mistyped headers before they    */
+/* are sent.                                                         */
+/*                                                                   */
+/* An instrument ignores a command it does not know and never        */
+/* answers a query it does not know, so a typo costs a full timeout. */
+/* A validator holds the header patterns of one model (see           */
+/* scpi-parse.c), loaded from a command list with one pattern per    */
+/* line or learned from commands the instrument accepted, and checks */
+/* every header of a message against them. Relative headers, as in   */
+/* ":FREQ:STAR 1;STOP 2", are resolved against the header before     */
+/* them first. The IEEE 488.2 common commands are always known.      */
+/*                                                                   */
+/* Patterns are sorted into buckets by the mnemonics they can end    */
+/* with, so a check only matches a header against the few patterns   */
+/* sharing its last mnemonic, however large the command list.        */
+/*                                                                   */
+/* Each model has its own command tree, so a ValidatorTable keeps    */
+/* one validator per model, keyed like capability profiles by the    */
+/* model field of *IDN?. A '*' in the command list path stands for   */
+/* the model, e.g. "cmds-*.txt" loads cmds-N9020B.txt for an        */
+/* N9020B; a path without '*' gives every model the same list.       */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "platform.h"
+#include "scpi-parse.h"
+#include "scpi-validate.h"
+
+#define HEADER_BYTES (2 * VALIDATOR_PATTERN_BYTES)  // Longest resolved header checked; longer ones are unknown
+
+typedef struct {
+    int* patterns;                      // Indices of the patterns that can end with a mnemonic of this bucket
+    int count;
+    int capacity;
+} Bucket;
+
+struct ScpiValidator {
+    PlatformMutex mutex;                // Guards everything below; the sessions to several instruments may share one
+    char (*patterns)[VALIDATOR_PATTERN_BYTES];
+    int numPatterns;
+    int numCommon;                      // Leading patterns that are common commands, known without a command list
+    int strict;                         // Headers not in the list are rejected instead of learned
+    Bucket buckets[VALIDATOR_BUCKETS];
+};
+
+/* Validator of one model, NULL if strict and the model has no command list */
+typedef struct {
+    char model[VALIDATOR_MODEL_BYTES];
+    char path[VALIDATOR_PATH_BYTES];    // Command list of the model
+    ScpiValidator* validator;
+} ModelValidator;
+
+struct ValidatorTable {
+    PlatformMutex mutex;                // Guards the models
+    char path[VALIDATOR_PATH_BYTES];    // Command list path, '*' standing for the model
+    int strict;                         // Validators reject unknown headers instead of learning them
+    ModelValidator models[VALIDATOR_MAX_MODELS];
+    int numModels;
+};
+
+/* Iterates the resolved headers of a message */
+typedef struct {
+    const char* message;
+    size_t length;
+    size_t position;                    // Start of the next unit
+    char path[HEADER_BYTES];            // Header path relative headers continue, e.g. ":FREQ" after ":FREQ:STAR 1"
+    size_t pathLength;
+} HeaderWalk;
+
+static const char* const commonCommands[] = {
+    "*CLS", "*ESE", "*ESE?", "*ESR?", "*IDN?", "*OPC", "*OPC?", "*OPT?", "*RCL", "*RST", "*SAV", "*SRE", "*SRE?",
+    "*STB?", "*TRG", "*TST?", "*WAI", ":SYSTem:ERRor[:NEXT]?", ":SYSTem:VERSion?"
+};
+
+/* Resolves the header of the next unit. Returns its length, 0 when there are no more units, or HEADER_BYTES if it is
+   too long to resolve */
+static size_t nextHeader(HeaderWalk* walk, char* header) {
+    while (walk->position < walk->length) {
+        const char* unit = walk->message + walk->position;
+        size_t unitLength = scpiUnitLength(unit, walk->length - walk->position);
+        walk->position += unitLength + 1;
+
+        size_t start = 0;
+        while (start < unitLength && isspace((unsigned char)unit[start]))
+            start++;
+        size_t end = start;
+        while (end < unitLength && !isspace((unsigned char)unit[end]))
+            end++;
+        if (end == start)
+            continue;
+
+        /* Common commands neither use nor change the path */
+        size_t length = 0;
+        if (unit[start] != ':' && unit[start] != '*') {
+            memcpy(header, walk->path, walk->pathLength);
+            length = walk->pathLength;
+            header[length++] = ':';
+        }
+        if (length + end - start >= HEADER_BYTES)
+            return HEADER_BYTES;
+        memcpy(header + length, unit + start, end - start);
+        length += end - start;
+        header[length] = '\0';
+
+        if (header[0] == ':') {
+            walk->pathLength = length;
+            while (walk->pathLength > 0 && header[walk->pathLength] != ':')
+                walk->pathLength--;
+            memcpy(walk->path, header, walk->pathLength);
+        }
+        return length;
+    }
+    return 0;
+}
+
+static void startWalk(HeaderWalk* walk, const char* message, size_t length) {
+    walk->message = message;
+    walk->length = length;
+    walk->position = 0;
+    walk->pathLength = 0;
+}
+
+static Bucket* headerBucket(ScpiValidator* validator, const char* header, size_t length) {
+    size_t mnemonicLength;
+    int query;
+    const char* mnemonic = scpiLastMnemonic(header, length, &mnemonicLength, &query);
+    return &validator->buckets[scpiMnemonicHash(mnemonic, mnemonicLength) % VALIDATOR_BUCKETS];
+}
+
+static int knownHeader(ScpiValidator* validator, const char* header, size_t length) {
+    const Bucket* bucket = headerBucket(validator, header, length);
+    for (int i = 0; i < bucket->count; i++) {
+        if (scpiMatchHeader(header, length, validator->patterns[bucket->patterns[i]], NULL))
+            return 1;
+    }
+    return 0;
+}
+
+/* Adds a pattern to the buckets of its endings; the caller holds the mutex. Returns 0 on success, 1 on error */
+static int addPattern(ScpiValidator* validator, const char* pattern) {
+    unsigned int hashes[SCPI_MAX_ENDINGS];
+    int numHashes = scpiPatternEndings(pattern, hashes);
+    if (numHashes == 0 || strlen(pattern) >= VALIDATOR_PATTERN_BYTES)
+        return 1;
+    for (int i = 0; i < numHashes; i++) {
+        const Bucket* bucket = &validator->buckets[hashes[i] % VALIDATOR_BUCKETS];
+        for (int j = 0; j < bucket->count; j++) {
+            if (strcmp(validator->patterns[bucket->patterns[j]], pattern) == 0)
+                return 0;
+        }
+    }
+    if (validator->numPatterns == VALIDATOR_MAX_COMMANDS)
+        return 1;
+
+    int index = validator->numPatterns;
+    for (int i = 0; i < numHashes; i++) {
+        Bucket* bucket = &validator->buckets[hashes[i] % VALIDATOR_BUCKETS];
+        if (bucket->count > 0 && bucket->patterns[bucket->count - 1] == index)
+            continue;
+        if (bucket->count == bucket->capacity) {
+            int capacity = bucket->capacity > 0 ? bucket->capacity * 2 : 4;
+            int* patterns = realloc(bucket->patterns, sizeof(int) * capacity);
+            if (patterns == NULL)
+                return 1;
+            bucket->patterns = patterns;
+            bucket->capacity = capacity;
+        }
+        bucket->patterns[bucket->count++] = index;
+    }
+    strcpy(validator->patterns[index], pattern);
+    validator->numPatterns++;
+    return 0;
+}
+
+/**
+ * @brief Creates a validator that knows the common commands, e.g. *IDN?, and :SYSTem:ERRor?.
+ *
+ * @param strict 1 to reject headers the validator does not know, 0 to let sessions send them and learn those the
+ * instrument accepts.
+ * @return The validator, or NULL on error.
+ */
+ScpiValidator* validatorCreate(int strict) {
+    ScpiValidator* validator = calloc(1, sizeof(ScpiValidator));
+    if (validator == NULL)
+        return NULL;
+    validator->patterns = malloc(sizeof(*validator->patterns) * VALIDATOR_MAX_COMMANDS);
+    if (validator->patterns == NULL) {
+        free(validator);
+        return NULL;
+    }
+    mutexInit(&validator->mutex);
+    validator->strict = strict;
+    for (size_t i = 0; i < sizeof(commonCommands) / sizeof(commonCommands[0]); i++) {
+        if (addPattern(validator, commonCommands[i]) != 0) {
+            validatorDestroy(validator);
+            return NULL;
+        }
+    }
+    validator->numCommon = validator->numPatterns;
+    return validator;
+}
+
+/**
+ * @brief Frees a validator. No session may use it any more.
+ */
+void validatorDestroy(ScpiValidator* validator) {
+    if (validator == NULL)
+        return;
+    for (int i = 0; i < VALIDATOR_BUCKETS; i++)
+        free(validator->buckets[i].patterns);
+    mutexDestroy(&validator->mutex);
+    free(validator->patterns);
+    free(validator);
+}
+
+/**
+ * @brief Returns 1 if the validator rejects unknown headers, 0 if it learns them.
+ */
+int validatorStrict(ScpiValidator* validator) {
+    return validator->strict;
+}
+
+/**
+ * @brief Adds a header pattern in manual notation, e.g. "[:SENSe]:FREQuency:STARt". The query form is a separate
+ * pattern, e.g. "[:SENSe]:FREQuency:STARt?". Adding a pattern twice has no effect.
+ * @return 0 on success, 1 if the pattern is malformed or too long, or the validator is full.
+ */
+int validatorAdd(ScpiValidator* validator, const char* pattern) {
+    mutexLock(&validator->mutex);
+    int result = addPattern(validator, pattern);
+    mutexUnlock(&validator->mutex);
+    return result;
+}
+
+/**
+ * @brief Adds the header patterns of a command list: one per line, blank lines and lines starting with '#' ignored.
+ * @return 0 on success, 1 if the file could not be read or a pattern could not be added.
+ */
+int validatorLoad(ScpiValidator* validator, const char* path) {
+    char line[VALIDATOR_PATTERN_BYTES * 2];
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return 1;
+    int result = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* start = line;
+        while (isspace((unsigned char)*start))
+            start++;
+        size_t length = strlen(start);
+        while (length > 0 && isspace((unsigned char)start[length - 1]))
+            start[--length] = '\0';
+        if (length > 0 && start[0] != '#' && validatorAdd(validator, start) != 0)
+            result = 1;
+    }
+    fclose(file);
+    return result;
+}
+
+/**
+ * @brief Writes every pattern added or learned, except the common commands, as a command list for validatorLoad().
+ * @return 0 on success, 1 if the file could not be written.
+ */
+int validatorSave(ScpiValidator* validator, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return 1;
+    mutexLock(&validator->mutex);
+    fprintf(file, "# SCPI command list, one header pattern per line\n");
+    for (int i = validator->numCommon; i < validator->numPatterns; i++)
+        fprintf(file, "%s\n", validator->patterns[i]);
+    mutexUnlock(&validator->mutex);
+    return fclose(file) != 0;
+}
+
+/**
+ * @brief Checks every header of a message against the known patterns.
+ *
+ * @param message Command or query, possibly several units separated by ';'.
+ * @param length Number of characters in message.
+ * @param unknown Output first unknown header, resolved to its full path and truncated to size - 1 characters. May
+ * be NULL.
+ * @param size Capacity of unknown.
+ * @return 0 if every header is known, 1 otherwise.
+ */
+int validatorCheck(ScpiValidator* validator, const char* message, size_t length, char* unknown, size_t size) {
+    char header[HEADER_BYTES];
+    HeaderWalk walk;
+    size_t headerLength;
+    int result = 0;
+
+    startWalk(&walk, message, length);
+    mutexLock(&validator->mutex);
+    while ((headerLength = nextHeader(&walk, header)) > 0) {
+        if (headerLength == HEADER_BYTES || !knownHeader(validator, header, headerLength)) {
+            if (unknown != NULL && size > 0) {
+                if (headerLength == HEADER_BYTES)
+                    header[0] = '\0';
+                strncpy(unknown, header, size - 1);
+                unknown[size - 1] = '\0';
+            }
+            result = 1;
+            break;
+        }
+    }
+    mutexUnlock(&validator->mutex);
+    return result;
+}
+
+/**
+ * @brief Learns the headers of a message the instrument accepted, in the spelling used, so validatorSave() can write
+ * a command list for the model. Numeric suffixes are generalized, e.g. :CALC:MARK2:X? to :CALC:MARK#:X?.
+ * @return Number of headers learned that were not known before.
+ */
+int validatorLearn(ScpiValidator* validator, const char* message, size_t length) {
+    char header[HEADER_BYTES];
+    char pattern[VALIDATOR_PATTERN_BYTES];
+    HeaderWalk walk;
+    size_t headerLength;
+    int learned = 0;
+
+    startWalk(&walk, message, length);
+    mutexLock(&validator->mutex);
+    while ((headerLength = nextHeader(&walk, header)) > 0) {
+        if (headerLength == HEADER_BYTES || knownHeader(validator, header, headerLength))
+            continue;
+        size_t n = 0;
+        for (size_t i = 0; i < headerLength && n < sizeof(pattern) - 1; i++) {
+            if (isdigit((unsigned char)header[i]) && i > 0 && isalpha((unsigned char)header[i - 1]))
+                pattern[n++] = '#';
+            if (!isdigit((unsigned char)header[i]) || n == 0 || pattern[n - 1] != '#')
+                pattern[n++] = (char)toupper((unsigned char)header[i]);
+        }
+        pattern[n] = '\0';
+        if (n < sizeof(pattern) - 1 && addPattern(validator, pattern) == 0)
+            learned++;
+    }
+    mutexUnlock(&validator->mutex);
+    return learned;
+}
+
+/**
+ * @brief Returns the number of patterns the validator knows, including the common commands.
+ */
+int validatorCount(ScpiValidator* validator) {
+    mutexLock(&validator->mutex);
+    int count = validator->numPatterns;
+    mutexUnlock(&validator->mutex);
+    return count;
+}
+
+/**
+ * @brief Creates a table of per-model validators whose command lists are found by path. No list is read until a
+ * model is selected.
+ *
+ * @param path Command list path. A '*' in it stands for the model field of *IDN?, e.g. "cmds-*.txt"; a path
+ * without '*' is the command list of every model.
+ * @param strict 1 for validators that reject headers they do not know, 0 for validators that learn them.
+ * @return The table, or NULL if the path is too long or on error.
+ */
+ValidatorTable* validatorTableCreate(const char* path, int strict) {
+    if (strlen(path) >= VALIDATOR_PATH_BYTES)
+        return NULL;
+    ValidatorTable* table = calloc(1, sizeof(ValidatorTable));
+    if (table == NULL)
+        return NULL;
+    mutexInit(&table->mutex);
+    strcpy(table->path, path);
+    table->strict = strict;
+    return table;
+}
+
+/**
+ * @brief Frees a table and its validators. No session may use them any more.
+ */
+void validatorTableDestroy(ValidatorTable* table) {
+    if (table == NULL)
+        return;
+    for (int i = 0; i < table->numModels; i++)
+        validatorDestroy(table->models[i].validator);
+    mutexDestroy(&table->mutex);
+    free(table);
+}
+
+/* Copies the model field of an *IDN? response into model, without surrounding whitespace and with any character
+   that does not belong in a file name replaced by '_' */
+static void idnModel(const char* idn, char* model) {
+    const char* field = strchr(idn, ',');
+    size_t length = 0;
+    field = field != NULL ? field + 1 : "";
+    while (isspace((unsigned char)*field))
+        field++;
+    while (field[length] != '\0' && field[length] != ',' && length < VALIDATOR_MODEL_BYTES - 1) {
+        char c = field[length];
+        model[length++] = isalnum((unsigned char)c) || c == '-' || c == '.' ? c : '_';
+    }
+    while (length > 0 && (isspace((unsigned char)field[length - 1]) || model[length - 1] == '_'))
+        length--;
+    model[length] = '\0';
+}
+
+/**
+ * @brief Returns the validator of the model that sent an *IDN? response, loading its command list the first time. A
+ * learning validator starts from the list if there is one.
+ *
+ * @param table Table of validators, or NULL for none.
+ * @return The validator, valid until the table is destroyed, or NULL if the table is NULL or full, or it is strict
+ * and the model has no command list.
+ */
+ScpiValidator* validatorTableSelect(ValidatorTable* table, const char* idn) {
+    char model[VALIDATOR_MODEL_BYTES];
+    if (table == NULL)
+        return NULL;
+    const char* star = strchr(table->path, '*');
+    if (star != NULL)
+        idnModel(idn, model);
+    else
+        model[0] = '\0';
+
+    mutexLock(&table->mutex);
+    for (int i = 0; i < table->numModels; i++) {
+        if (strcmp(table->models[i].model, model) == 0) {
+            mutexUnlock(&table->mutex);
+            return table->models[i].validator;
+        }
+    }
+    if (table->numModels == VALIDATOR_MAX_MODELS) {
+        mutexUnlock(&table->mutex);
+        return NULL;
+    }
+
+    ModelValidator* entry = &table->models[table->numModels];
+    strcpy(entry->model, model);
+    if (star == NULL)
+        strcpy(entry->path, table->path);
+    else
+        snprintf(entry->path, sizeof(entry->path), "%.*s%s%s", (int)(star - table->path), table->path, model, star + 1);
+    entry->validator = validatorCreate(table->strict);
+    if (entry->validator != NULL && validatorLoad(entry->validator, entry->path) != 0 && table->strict) {
+        validatorDestroy(entry->validator);
+        entry->validator = NULL;
+    }
+    table->numModels++;
+    ScpiValidator* validator = entry->validator;
+    mutexUnlock(&table->mutex);
+    return validator;
+}
+
+/**
+ * @brief Writes the command list of every model a learning table has a validator for, with validatorSave().
+ * @return 0 on success, 1 if a command list could not be written.
+ */
+int validatorTableSave(ValidatorTable* table) {
+    int result = 0;
+    mutexLock(&table->mutex);
+    for (int i = 0; i < table->numModels; i++) {
+        if (table->models[i].validator != NULL && validatorSave(table->models[i].validator, table->models[i].path) != 0)
+            result = 1;
+    }
+    mutexUnlock(&table->mutex);
+    return result;
+}
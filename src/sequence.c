@@ -0,0 +1,290 @@
+/*********************************************************************/
+/*                                                                   */
+/* Command sequences multiplexed on one thread.                      */
+/*                                                                   */
+/* A sequence is a resumable function (see sequence.h) that stops    */
+/* at each write, query or delay. The event loop starts the          */
+/* operation, moves on to other sequences and resumes the sequence   */
+/* when its I/O completion event arrives, so dozens of instruments   */
+/* can be driven without a thread each.                              */
+/*                                                                   */
+/* Operations use asynchronous VISA I/O when the session supports    */
+/* it. Otherwise, e.g. for socket resources, instruments on a shared */
+/* GPIB board or while a journal is recorded, they run synchronously */
+/* and the loop waits for them.                                      */
+/* Only one operation is in flight per session at a time; sequences  */
+/* sharing a session take turns.                                     */
+/*                                                                   */
+/* When a sequence on a session in checked mode finishes, the        */
+/* instrument's error queue is drained in one batch and any errors   */
+/* fail the sequence, so asynchronous commands are checked too       */
+/* without a :SYSTem:ERRor? round trip each.                         */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "platform.h"
+#include "sequence.h"
+
+#define STATE_READY 0           // Body runs on the next pass
+#define STATE_PENDING 1         // Operation requested but not started
+#define STATE_IO 2              // Asynchronous job in flight
+#define STATE_TIMER 3           // Waiting for wakeAt
+#define STATE_DRAIN 4           // Body finished; the error queue of its checked session is due to be drained
+#define STATE_FINISHED 5        // Body returned SEQ_DONE or SEQ_FAILED and any errors were drained
+
+#define OP_WRITE 0
+#define OP_QUERY 1
+#define OP_DELAY 2
+
+/**
+ * @brief Initializes an empty event loop.
+ */
+void loopInit(EventLoop* loop) {
+    loop->head = NULL;
+}
+
+/**
+ * @brief Adds a sequence to the loop. The sequence is started by loopRun() and must stay valid until it returns.
+ *
+ * @param fn Body of the sequence.
+ * @param session Session the sequence's operations go to. Asynchronous I/O is enabled on it if available.
+ * @param context Caller state, available to the body as seq->context.
+ */
+void loopAdd(EventLoop* loop, Sequence* seq, SequenceFn fn, VisaSession* session, void* context) {
+    memset(seq, 0, sizeof(Sequence));
+    seq->fn = fn;
+    seq->session = session;
+    seq->context = context;
+    seq->state = STATE_READY;
+    sessionEnableAsync(session);
+
+    Sequence** tail = &loop->head;
+    while (*tail != NULL)
+        tail = &(*tail)->next;
+    *tail = seq;
+}
+
+static int formatCommand(Sequence* seq, const char* format, va_list args) {
+    int length = vsnprintf(seq->command, sizeof(seq->command), format, args);
+    if (length < 0 || length >= (int)sizeof(seq->command)) {
+        seq->status = VI_ERROR_INV_PARAMETER;
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Requests a write of a printf() style command. Used by SEQ_WRITE().
+ * @return 1 on success, 0 if the command is longer than SESSION_COMMAND_BYTES.
+ */
+int sequenceWritef(Sequence* seq, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int ok = formatCommand(seq, format, args);
+    va_end(args);
+    seq->op = OP_WRITE;
+    return ok;
+}
+
+/**
+ * @brief Requests a query of a printf() style command; the response is left in seq->response. Used by SEQ_QUERY().
+ * @return 1 on success, 0 if the command is longer than SESSION_COMMAND_BYTES.
+ */
+int sequenceQueryf(Sequence* seq, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int ok = formatCommand(seq, format, args);
+    va_end(args);
+    seq->op = OP_QUERY;
+    return ok;
+}
+
+/**
+ * @brief Requests a pause of the sequence without blocking the loop. Used by SEQ_DELAY().
+ */
+void sequenceDelay(Sequence* seq, unsigned int ms) {
+    seq->op = OP_DELAY;
+    seq->wakeAt = monotonicMicros() + (unsigned long long)ms * 1000;
+}
+
+static int sessionBusy(const EventLoop* loop, const VisaSession* session) {
+    for (const Sequence* seq = loop->head; seq != NULL; seq = seq->next) {
+        if (seq->session == session && seq->state == STATE_IO)
+            return 1;
+    }
+    return 0;
+}
+
+static void runSynchronously(Sequence* seq) {
+    if (seq->op == OP_WRITE) {
+        seq->status = sessionWrite(seq->session, seq->command);
+    }
+    else {
+        seq->status = sessionQuery(seq->session, seq->command, seq->response, sizeof(seq->response), &seq->count);
+    }
+    seq->state = STATE_READY;
+}
+
+/* Starts the requested operation. Falls back to synchronous I/O when the session has no asynchronous support */
+static void startOperation(Sequence* seq) {
+    if (seq->op == OP_DELAY) {
+        seq->status = VI_SUCCESS;
+        seq->state = STATE_TIMER;
+        return;
+    }
+    seq->stage = 0;
+    seq->count = 0;
+    seq->response[0] = '\0';
+    ViStatus status = sessionWriteAsync(seq->session, seq->command, &seq->job);
+    if (status == VI_ERROR_NSUP_OPER) {
+        runSynchronously(seq);
+    }
+    else if (status < VI_SUCCESS) {
+        seq->status = status;
+        seq->state = STATE_READY;
+    }
+    else {
+        seq->state = STATE_IO;
+    }
+}
+
+/* Handles the completion of the job in flight; a query's write is followed by its read */
+static void completeJob(Sequence* seq, ViStatus jobStatus, ViUInt32 count) {
+    if (seq->op == OP_QUERY && seq->stage == 0 && jobStatus >= VI_SUCCESS) {
+        seq->stage = 1;
+        ViStatus status = sessionReadAsync(seq->session, seq->response, sizeof(seq->response) - 1, &seq->job);
+        if (status >= VI_SUCCESS)
+            return;
+        jobStatus = status;
+        count = 0;
+    }
+    if (seq->op == OP_QUERY) {
+        seq->count = jobStatus < VI_SUCCESS ? 0 : count;
+        seq->response[seq->count] = '\0';
+    }
+    seq->status = jobStatus;
+    seq->state = STATE_READY;
+}
+
+/* Polls a sequence's session for a completed job. Returns 1 if the sequence made progress */
+static int pollJob(Sequence* seq, ViUInt32 timeoutMs) {
+    ViJobId job;
+    ViStatus jobStatus;
+    ViUInt32 count;
+    ViStatus status = sessionWaitAsync(seq->session, timeoutMs, &job, &jobStatus, &count);
+    if (status == VI_ERROR_TMO)
+        return 0;
+    if (status < VI_SUCCESS) {
+        seq->status = status;
+        seq->state = STATE_READY;
+        return 1;
+    }
+    if (job == seq->job)
+        completeJob(seq, jobStatus, count);
+    return 1;
+}
+
+/* Drains the error queue after a sequence on a checked session. Returns 1 if the sequence failed */
+static int drainErrors(Sequence* seq) {
+    int numErrors;
+    ViStatus status = sessionDrainErrors(seq->session, NULL, 0, &numErrors);
+    seq->scpiErrors = numErrors;
+    if (seq->result == SEQ_FAILED)
+        return 1;
+    if (status < VI_SUCCESS || numErrors > 0) {
+        seq->status = status < VI_SUCCESS ? status : SESSION_ERROR_SCPI;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs every sequence in the loop to completion on the calling thread.
+ * @return Number of sequences that failed, including those whose checked session reported SCPI errors.
+ */
+int loopRun(EventLoop* loop) {
+    int failed = 0;
+    for (;;) {
+        int active = 0;
+        int progressed = 0;
+        int numIo = 0;
+        Sequence* ioSeq = NULL;
+        unsigned long long now = monotonicMicros();
+        unsigned long long nextWake = 0;
+
+        for (Sequence* seq = loop->head; seq != NULL; seq = seq->next) {
+            switch (seq->state) {
+            case STATE_READY: {
+                int result = seq->fn(seq);
+                if (result == SEQ_WAITING) {
+                    seq->state = STATE_PENDING;
+                }
+                else if (sessionChecked(seq->session)) {
+                    seq->result = result;
+                    seq->state = STATE_DRAIN;
+                }
+                else {
+                    seq->state = STATE_FINISHED;
+                    if (result == SEQ_FAILED)
+                        failed++;
+                }
+                progressed = 1;
+                break;
+            }
+            case STATE_DRAIN:
+                if (!sessionBusy(loop, seq->session)) {
+                    failed += drainErrors(seq);
+                    seq->state = STATE_FINISHED;
+                    progressed = 1;
+                }
+                break;
+            case STATE_PENDING:
+                if (!sessionBusy(loop, seq->session)) {
+                    startOperation(seq);
+                    progressed = 1;
+                }
+                break;
+            case STATE_IO:
+                if (pollJob(seq, 0))
+                    progressed = 1;
+                else {
+                    numIo++;
+                    ioSeq = seq;
+                }
+                break;
+            case STATE_TIMER:
+                if (now >= seq->wakeAt) {
+                    seq->state = STATE_READY;
+                    progressed = 1;
+                }
+                else if (nextWake == 0 || seq->wakeAt < nextWake) {
+                    nextWake = seq->wakeAt;
+                }
+                break;
+            }
+            if (seq->state != STATE_FINISHED)
+                active = 1;
+        }
+
+        if (!active)
+            return failed;
+        if (progressed)
+            continue;
+
+        /* Nothing to do until a job completes or a timer expires */
+        if (numIo == 1 && nextWake == 0) {
+            pollJob(ioSeq, sessionTimeout(ioSeq->session));
+        }
+        else {
+            unsigned long long wait = SEQUENCE_POLL_US;
+            if (numIo == 0 && nextWake > now)
+                wait = nextWake - now;
+            else if (nextWake > now && nextWake - now < wait)
+                wait = nextWake - now;
+            sleepMicros(wait);
+        }
+    }
+}
@@ -0,0 +1,195 @@
+/*********************************************************************/
+/*                                                                   */
+/* Pool of open sessions, reused by resource descriptor.             */
+/*                                                                   */
+/* Opening a session to a LAN instrument takes a connection          */
+/* handshake, so a program that switches between instruments keeps   */
+/* their sessions open instead. poolAcquire() returns the pooled     */
+/* session to a resource, or opens one; poolRelease() hands it back  */
+/* without closing it. At most capacity sessions stay open: when a   */
+/* release goes over, the least recently used idle sessions are      */
+/* closed. Sessions in use are never evicted, so the pool may hold   */
+/* more than capacity while they are.                                */
+/*                                                                   */
+/* A pooled session keeps the settings its last user left, e.g. its  */
+/* timeout or checked mode, and any cached instrument state. A       */
+/* session found unhealthy on acquire is closed and opened again.    */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "session-pool.h"
+
+typedef struct {
+    VisaSession* session;
+    int users;                          // Acquires not yet released
+    unsigned long long lastUsed;        // Value of SessionPool.clock at the last acquire or release
+} PoolEntry;
+
+struct SessionPool {
+    PlatformMutex mutex;                // Guards everything below; not held while sessions open or close
+    ViSession resourceManager;
+    ViUInt32 timeoutMs;
+    int capacity;
+    PoolEntry entries[POOL_MAX_SESSIONS];
+    int numEntries;
+    unsigned long long clock;           // Counts acquires and releases, orders entries by recency
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+static int findEntry(const SessionPool* pool, const char* resource) {
+    for (int i = 0; i < pool->numEntries; i++) {
+        if (strcmp(sessionResource(pool->entries[i].session), resource) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/* Removes idle entries, least recently used first, until at most capacity remain. Returns the sessions to close */
+static int evictIdle(SessionPool* pool, VisaSession** evicted) {
+    int count = 0;
+    while (pool->numEntries > pool->capacity) {
+        int oldest = -1;
+        for (int i = 0; i < pool->numEntries; i++) {
+            if (pool->entries[i].users == 0 && (oldest < 0 || pool->entries[i].lastUsed < pool->entries[oldest].lastUsed))
+                oldest = i;
+        }
+        if (oldest < 0)
+            break;
+        evicted[count++] = pool->entries[oldest].session;
+        pool->entries[oldest] = pool->entries[--pool->numEntries];
+        pool->evictions++;
+    }
+    return count;
+}
+
+/**
+ * @brief Creates an empty pool.
+ *
+ * @param capacity Number of sessions kept open, from 0 (every release closes the session) to POOL_MAX_SESSIONS.
+ * @param timeoutMs Timeout of the sessions the pool opens.
+ * @return The pool, or NULL on error.
+ */
+SessionPool* poolCreate(ViSession resourceManager, int capacity, ViUInt32 timeoutMs) {
+    if (capacity < 0 || capacity > POOL_MAX_SESSIONS)
+        return NULL;
+    SessionPool* pool = calloc(1, sizeof(SessionPool));
+    if (pool == NULL)
+        return NULL;
+    mutexInit(&pool->mutex);
+    pool->resourceManager = resourceManager;
+    pool->timeoutMs = timeoutMs;
+    pool->capacity = capacity;
+    return pool;
+}
+
+/**
+ * @brief Closes every pooled session and frees the pool. No session may be in use.
+ */
+void poolDestroy(SessionPool* pool) {
+    if (pool == NULL)
+        return;
+    for (int i = 0; i < pool->numEntries; i++)
+        sessionClose(pool->entries[i].session);
+    mutexDestroy(&pool->mutex);
+    free(pool);
+}
+
+/**
+ * @brief Returns a session to a resource: the pooled one if there is one, otherwise a newly opened one. Several users
+ * may hold the same session; its lock keeps their exchanges apart.
+ *
+ * @param resource Resource descriptor, e.g. "TCPIP0::192.168.0.10::INSTR".
+ * @param status Output status of the open, VI_SUCCESS for a pooled session. May be NULL.
+ * @return The session, or NULL on error. Hand it back with poolRelease().
+ */
+VisaSession* poolAcquire(SessionPool* pool, const char* resource, ViStatus* status) {
+    VisaSession* stale = NULL;
+    mutexLock(&pool->mutex);
+    int found = findEntry(pool, resource);
+    if (found >= 0 && !sessionHealthy(pool->entries[found].session) && pool->entries[found].users == 0) {
+        stale = pool->entries[found].session;
+        pool->entries[found] = pool->entries[--pool->numEntries];
+        found = -1;
+    }
+    if (found >= 0) {
+        PoolEntry* entry = &pool->entries[found];
+        VisaSession* session = entry->session;
+        entry->users++;
+        entry->lastUsed = ++pool->clock;
+        pool->hits++;
+        mutexUnlock(&pool->mutex);
+        if (status != NULL)
+            *status = VI_SUCCESS;
+        return session;
+    }
+    pool->misses++;
+    mutexUnlock(&pool->mutex);
+
+    sessionClose(stale);
+    ViStatus openStatus;
+    VisaSession* session = sessionOpen(pool->resourceManager, resource, pool->timeoutMs, &openStatus);
+    if (status != NULL)
+        *status = openStatus;
+    if (session == NULL)
+        return NULL;
+
+    mutexLock(&pool->mutex);
+    found = findEntry(pool, resource);
+    if (found < 0 && pool->numEntries < POOL_MAX_SESSIONS) {
+        PoolEntry* entry = &pool->entries[pool->numEntries++];
+        entry->session = session;
+        entry->users = 1;
+        entry->lastUsed = ++pool->clock;
+    }
+    mutexUnlock(&pool->mutex);
+
+    /* Another thread pooled the resource meanwhile; use its session. A pool full of sessions in use hands out this
+       one unpooled, and poolRelease() closes it */
+    if (found >= 0) {
+        sessionClose(session);
+        return poolAcquire(pool, resource, status);
+    }
+    return session;
+}
+
+/**
+ * @brief Hands back a session from poolAcquire(). It stays open for the next acquire unless the pool is over capacity,
+ * in which case the least recently used idle sessions are closed. A session must not be watched by a health monitor
+ * when it is handed back, since it may be closed.
+ */
+void poolRelease(SessionPool* pool, VisaSession* session) {
+    VisaSession* evicted[POOL_MAX_SESSIONS + 1];
+    if (session == NULL)
+        return;
+    int count = 0, pooled = 0;
+    mutexLock(&pool->mutex);
+    for (int i = 0; i < pool->numEntries && !pooled; i++) {
+        if (pool->entries[i].session == session) {
+            pool->entries[i].users--;
+            pool->entries[i].lastUsed = ++pool->clock;
+            pooled = 1;
+        }
+    }
+    if (!pooled)
+        evicted[count++] = session;
+    count += evictIdle(pool, evicted + count);
+    mutexUnlock(&pool->mutex);
+    for (int i = 0; i < count; i++)
+        sessionClose(evicted[i]);
+}
+
+/**
+ * @brief Reports how many acquires found a pooled session, how many opened one and how many sessions were evicted.
+ */
+void poolStats(SessionPool* pool, unsigned long* hits, unsigned long* misses, unsigned long* evictions) {
+    mutexLock(&pool->mutex);
+    *hits = pool->hits;
+    *misses = pool->misses;
+    *evictions = pool->evictions;
+    mutexUnlock(&pool->mutex);
+}
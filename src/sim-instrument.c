@@ -0,0 +1,458 @@
+/*********************************************************************/
+/*                                                                   */
+/* Simulated SCPI spectrum analyzer.                                 */
+/*                                                                   */
+/* Understands the subset of SCPI this program sends: frequency      */
+/* span, bandwidths, sweep control, markers, trace transfer in       */
+/* ASCii or REAL,32 format and the error queue. The spectrum is a    */
+/* deterministic noise floor with two tones so captures can be       */
+/* checked. Each write and each response costs half the configured   */
+/* round trip time, and a read with no pending response waits out    */
+/* the timeout, just like a real instrument that was sent a bad      */
+/* query.                                                            */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include "platform.h"
+#include "scpi-parse.h"
+#include "sim-instrument.h"
+
+#define SIM_OUTPUT_BYTES (SIM_MAX_POINTS * 16 + 64)     // Room for a full trace in ASCii format
+
+struct SimInstrument {
+    PlatformMutex mutex;
+    unsigned int rttMicros;             // Simulated round trip time
+    int responding;                     // Cleared to simulate a hung instrument that ignores every message
+    double startFreq;
+    double stopFreq;
+    double resBW;
+    double vidBW;
+    int sweepPoints;
+    int continuous;                     // :INITiate:CONTinuous state
+    int busTrigger;                     // :TRIGger:SOURce BUS when set, IMMediate otherwise
+    int binaryFormat;                   // :FORMat REAL,32 when set, ASCii otherwise
+    int bigEndian;                      // :FORMat:BORDer NORMal when set, SWAPped otherwise
+    double markerX[SIM_MAX_MARKERS];    // Marker frequencies
+    int markerOn[SIM_MAX_MARKERS];      // Marker states
+    int markerBandPower[SIM_MAX_MARKERS];   // :CALCulate:MARKer#:FUNCtion BPOWer rather than OFF
+    int markerCount[SIM_MAX_MARKERS];   // :CALCulate:MARKer#:FCOunt:STATe
+    int errors[SIM_ERROR_QUEUE];        // Pending SCPI error codes
+    int numErrors;
+    unsigned char* output;              // Pending response bytes
+    size_t outputLength;
+    size_t outputRead;                  // Bytes of output already returned by simRead()
+};
+
+/**
+ * @brief Creates a simulated analyzer in its preset state.
+ *
+ * @param rttMicros Round trip time to simulate for every write/read pair.
+ * @return New instrument, or NULL if out of memory.
+ */
+SimInstrument* simCreate(unsigned int rttMicros) {
+    SimInstrument* sim = calloc(1, sizeof(SimInstrument));
+    if (sim == NULL)
+        return NULL;
+    sim->output = malloc(SIM_OUTPUT_BYTES);
+    if (sim->output == NULL) {
+        free(sim);
+        return NULL;
+    }
+    mutexInit(&sim->mutex);
+    sim->rttMicros = rttMicros;
+    sim->responding = 1;
+    sim->startFreq = 1.0e9;
+    sim->stopFreq = 2.0e9;
+    sim->resBW = 1.0e6;
+    sim->vidBW = 1.0e6;
+    sim->sweepPoints = 1001;
+    sim->continuous = 1;
+    sim->bigEndian = 1;
+    for (int i = 0; i < SIM_MAX_MARKERS; i++)
+        sim->markerX[i] = (sim->startFreq + sim->stopFreq) / 2;
+    return sim;
+}
+
+void simDestroy(SimInstrument* sim) {
+    if (sim == NULL)
+        return;
+    mutexDestroy(&sim->mutex);
+    free(sim->output);
+    free(sim);
+}
+
+void simSetRtt(SimInstrument* sim, unsigned int rttMicros) {
+    sim->rttMicros = rttMicros;
+}
+
+unsigned int simRtt(const SimInstrument* sim) {
+    return sim->rttMicros;
+}
+
+/**
+ * @brief Makes the analyzer hang or recover. A hung analyzer accepts messages but ignores them, so every read times out.
+ */
+void simSetResponding(SimInstrument* sim, int responding) {
+    mutexLock(&sim->mutex);
+    sim->responding = responding;
+    mutexUnlock(&sim->mutex);
+}
+
+/**
+ * @brief Returns the simulated spectrum in dBm: a noise floor with ripple plus tones at 1.25 GHz and 1.6 GHz.
+ *
+ * @param freq Frequency in Hz.
+ * @param resBW Resolution bandwidth, which sets the width of the tones.
+ */
+double simAmplitude(double freq, double resBW) {
+    double floor = -90.0 + 1.5 * sin(freq * 1.0e-5) + 0.8 * sin(freq * 3.7e-6);
+    double d1 = (freq - 1.25e9) / resBW;
+    double d2 = (freq - 1.6e9) / resBW;
+    double tones = 1.0e7 * exp(-d1 * d1) + 3.2e4 * exp(-d2 * d2);     // -20 dBm and -45 dBm over a -90 dBm floor
+    return floor + 10 * log10(1 + tones);
+}
+
+static void pushError(SimInstrument* sim, int code) {
+    if (sim->numErrors < SIM_ERROR_QUEUE)
+        sim->errors[sim->numErrors++] = code;
+}
+
+static void appendText(SimInstrument* sim, const char* text) {
+    size_t length = strlen(text);
+    if (sim->outputLength + length < SIM_OUTPUT_BYTES) {
+        memcpy(sim->output + sim->outputLength, text, length);
+        sim->outputLength += length;
+    }
+}
+
+static void appendTrace(SimInstrument* sim) {
+    int points = sim->sweepPoints;
+    double spacing = points > 1 ? (sim->stopFreq - sim->startFreq) / (points - 1) : 0;
+
+    if (sim->binaryFormat) {
+        float* values = malloc(sizeof(float) * points);
+        if (values == NULL)
+            return;
+        for (int i = 0; i < points; i++)
+            values[i] = (float)simAmplitude(sim->startFreq + i * spacing, sim->resBW);
+        sim->outputLength += scpiEncodeReal32(values, points, sim->bigEndian,
+            sim->output + sim->outputLength, SIM_OUTPUT_BYTES - sim->outputLength);
+        free(values);
+    }
+    else {
+        char value[32];
+        for (int i = 0; i < points; i++) {
+            sprintf(value, i == 0 ? "%.3f" : ",%.3f", simAmplitude(sim->startFreq + i * spacing, sim->resBW));
+            appendText(sim, value);
+        }
+    }
+}
+
+static void appendDouble(SimInstrument* sim, double value) {
+    char text[32];
+    sprintf(text, "%.10g", value);
+    appendText(sim, text);
+}
+
+/**
+ * @brief Executes a single command. Returns 1 if it was a query that appended a response, 0 otherwise.
+ */
+static int executeCommand(SimInstrument* sim, const char* command, size_t length) {
+    const char* params = scpiSkipHeader(command, length);
+    double value = atof(params);
+    int n = -1;
+
+#define IS(pattern) scpiMatchHeader(command, length, pattern, &n)
+    if (IS("*IDN?")) {
+        appendText(sim, SIM_IDN);
+        return 1;
+    }
+    if (IS("*OPC?") || IS(":INITiate[:IMMediate]?")) {
+        appendText(sim, "1");
+        return 1;
+    }
+    if (IS("*CLS")) {
+        sim->numErrors = 0;
+        return 0;
+    }
+    if (IS("*RST") || IS("*TRG") || IS("*WAI") || IS(":INITiate[:IMMediate]")) {
+        return 0;
+    }
+    if (IS("*STB?")) {
+        appendText(sim, sim->numErrors > 0 ? "4" : "0");
+        return 1;
+    }
+    if (IS("[:SENSe]:FREQuency:STARt?")) {
+        appendDouble(sim, sim->startFreq);
+        return 1;
+    }
+    if (IS("[:SENSe]:FREQuency:STARt")) {
+        sim->startFreq = value;
+        return 0;
+    }
+    if (IS("[:SENSe]:FREQuency:STOP?")) {
+        appendDouble(sim, sim->stopFreq);
+        return 1;
+    }
+    if (IS("[:SENSe]:FREQuency:STOP")) {
+        sim->stopFreq = value;
+        return 0;
+    }
+    if (IS("[:SENSe]:BANDwidth[:RESolution]?")) {
+        appendDouble(sim, sim->resBW);
+        return 1;
+    }
+    if (IS("[:SENSe]:BANDwidth[:RESolution]")) {
+        sim->resBW = value > 0 ? value : sim->resBW;
+        return 0;
+    }
+    if (IS("[:SENSe]:BANDwidth:VIDeo?")) {
+        appendDouble(sim, sim->vidBW);
+        return 1;
+    }
+    if (IS("[:SENSe]:BANDwidth:VIDeo")) {
+        sim->vidBW = value > 0 ? value : sim->vidBW;
+        return 0;
+    }
+    if (IS("[:SENSe]:SWEep:POINts?")) {
+        appendDouble(sim, toupper((unsigned char)params[0]) == 'M' && toupper((unsigned char)params[1]) == 'A'
+            ? SIM_MAX_POINTS : sim->sweepPoints);
+        return 1;
+    }
+    if (IS("[:SENSe]:SWEep:POINts")) {
+        if (value >= 2 && value <= SIM_MAX_POINTS)
+            sim->sweepPoints = (int)value;
+        else
+            pushError(sim, -222);
+        return 0;
+    }
+    if (IS("[:SENSe]:SWEep:TIME?")) {
+        appendDouble(sim, 0.001 * sim->sweepPoints / 100);
+        return 1;
+    }
+    if (IS(":INITiate:CONTinuous?")) {
+        appendText(sim, sim->continuous ? "1" : "0");
+        return 1;
+    }
+    if (IS(":INITiate:CONTinuous")) {
+        sim->continuous = (strncmp(params, "ON", 2) == 0 || strncmp(params, "on", 2) == 0 || params[0] == '1');
+        return 0;
+    }
+    if (IS(":TRIGger[:SEQuence]:SOURce?")) {
+        appendText(sim, sim->busTrigger ? "BUS" : "IMM");
+        return 1;
+    }
+    if (IS(":TRIGger[:SEQuence]:SOURce")) {
+        sim->busTrigger = toupper((unsigned char)params[0]) == 'B';
+        return 0;
+    }
+    if (IS(":CALCulate:MARKer:AOFF")) {
+        for (int i = 0; i < SIM_MAX_MARKERS; i++)
+            sim->markerOn[i] = 0;
+        return 0;
+    }
+    if (IS(":CALCulate:MARKer#:X?") || IS(":CALCulate:MARKer#:Y?") || IS(":CALCulate:MARKer#:STATe?")
+        || IS(":CALCulate:MARKer#:MODE?") || IS(":CALCulate:MARKer#:FUNCtion?") || IS(":CALCulate:MARKer#:FCOunt[:STATe]?")) {
+        if (n < 1 || n > SIM_MAX_MARKERS) {
+            pushError(sim, -114);
+            return 0;
+        }
+        if (IS(":CALCulate:MARKer#:X?"))
+            appendDouble(sim, sim->markerX[n - 1]);
+        else if (IS(":CALCulate:MARKer#:Y?"))
+            appendDouble(sim, simAmplitude(sim->markerX[n - 1], sim->resBW));
+        else if (IS(":CALCulate:MARKer#:MODE?"))
+            appendText(sim, sim->markerOn[n - 1] ? "POS" : "OFF");
+        else if (IS(":CALCulate:MARKer#:FUNCtion?"))
+            appendText(sim, sim->markerBandPower[n - 1] ? "BPOW" : "OFF");
+        else if (IS(":CALCulate:MARKer#:FCOunt[:STATe]?"))
+            appendText(sim, sim->markerCount[n - 1] ? "1" : "0");
+        else
+            appendText(sim, sim->markerOn[n - 1] ? "1" : "0");
+        return 1;
+    }
+    if (IS(":CALCulate:MARKer#:X") || IS(":CALCulate:MARKer#:STATe") || IS(":CALCulate:MARKer#:MODE")
+        || IS(":CALCulate:MARKer#:FUNCtion") || IS(":CALCulate:MARKer#:FCOunt[:STATe]")) {
+        if (n < 1 || n > SIM_MAX_MARKERS) {
+            pushError(sim, -114);
+            return 0;
+        }
+        if (IS(":CALCulate:MARKer#:X")) {
+            sim->markerX[n - 1] = value;
+            sim->markerOn[n - 1] = 1;
+        }
+        else if (IS(":CALCulate:MARKer#:STATe")) {
+            sim->markerOn[n - 1] = (strncmp(params, "ON", 2) == 0 || strncmp(params, "on", 2) == 0 || params[0] == '1');
+        }
+        else if (IS(":CALCulate:MARKer#:FUNCtion")) {
+            sim->markerBandPower[n - 1] = params[0] == 'B' || params[0] == 'b';
+            sim->markerOn[n - 1] = 1;
+        }
+        else if (IS(":CALCulate:MARKer#:FCOunt[:STATe]")) {
+            sim->markerCount[n - 1] = (strncmp(params, "ON", 2) == 0 || strncmp(params, "on", 2) == 0 || params[0] == '1');
+            sim->markerOn[n - 1] = 1;
+        }
+        else {
+            sim->markerOn[n - 1] = 1;
+        }
+        return 0;
+    }
+    if (IS(":FORMat[:TRACe][:DATA]")) {
+        sim->binaryFormat = (params[0] == 'R' || params[0] == 'r');
+        return 0;
+    }
+    if (IS(":FORMat:BORDer?")) {
+        appendText(sim, sim->bigEndian ? "NORM" : "SWAP");
+        return 1;
+    }
+    if (IS(":FORMat:BORDer")) {
+        sim->bigEndian = (params[0] == 'N' || params[0] == 'n');
+        return 0;
+    }
+    if (IS(":TRACe[:DATA]?")) {
+        appendTrace(sim);
+        return 1;
+    }
+    if (IS(":SYSTem:ERRor[:NEXT]?")) {
+        if (sim->numErrors == 0) {
+            appendText(sim, "+0,\"No error\"");
+        }
+        else {
+            char text[64];
+            sprintf(text, "%d,\"%s\"", sim->errors[0], sim->errors[0] == -113 ? "Undefined header" : "Parameter error");
+            appendText(sim, text);
+            memmove(sim->errors, sim->errors + 1, sizeof(int) * (--sim->numErrors));
+        }
+        return 1;
+    }
+    if (IS(":MMEMory:CATalog?")) {
+        appendText(sim, "0,0");
+        return 1;
+    }
+#undef IS
+
+    pushError(sim, -113);
+    return 0;
+}
+
+/**
+ * @brief Answers a serial poll, which takes a round trip and times out like a read if the analyzer hangs.
+ * @return VI_SUCCESS with status byte 0, or VI_ERROR_TMO.
+ */
+ViStatus simReadStatusByte(SimInstrument* sim, ViPUInt16 statusByte, ViUInt32 timeoutMs) {
+    mutexLock(&sim->mutex);
+    int responding = sim->responding;
+    mutexUnlock(&sim->mutex);
+    *statusByte = 0;
+    if (!responding) {
+        sleepMs(timeoutMs);
+        return VI_ERROR_TMO;
+    }
+    if (sim->rttMicros > 0)
+        sleepMicros(sim->rttMicros);
+    return VI_SUCCESS;
+}
+
+/**
+ * @brief Executes a message at once, without the simulated transfer delay. Commands separated by ';' are executed in
+ * order and the responses of any queries are joined with ';' into a single newline-terminated response.
+ */
+ViStatus simExecute(SimInstrument* sim, const unsigned char* buf, ViUInt32 count, ViPUInt32 retCount) {
+    mutexLock(&sim->mutex);
+    /* A new message discards any response that was not read, as a real instrument does */
+    sim->outputLength = 0;
+    sim->outputRead = 0;
+    if (!sim->responding) {
+        mutexUnlock(&sim->mutex);
+        *retCount = count;
+        return VI_SUCCESS;
+    }
+
+    int responses = 0;
+    ViUInt32 start = 0;
+    while (start < count) {
+        ViUInt32 end = start;
+        while (end < count && buf[end] != ';' && buf[end] != '\n')
+            end++;
+
+        char command[SIM_COMMAND_BYTES];
+        size_t length = end - start;
+        if (length >= SIM_COMMAND_BYTES)
+            length = SIM_COMMAND_BYTES - 1;
+        memcpy(command, buf + start, length);
+        command[length] = '\0';
+
+        if (length > 0) {
+            size_t before = sim->outputLength;
+            if (responses > 0)
+                appendText(sim, ";");
+            if (executeCommand(sim, command, length))
+                responses++;
+            else
+                sim->outputLength = before;
+        }
+        start = end + 1;
+    }
+    if (responses > 0)
+        appendText(sim, "\n");
+    mutexUnlock(&sim->mutex);
+
+    *retCount = count;
+    return VI_SUCCESS;
+}
+
+/**
+ * @brief Sends a message to the simulated analyzer, taking half the round trip time. See simExecute().
+ */
+ViStatus simWrite(SimInstrument* sim, const unsigned char* buf, ViUInt32 count, ViPUInt32 retCount) {
+    if (sim->rttMicros > 0)
+        sleepMicros(sim->rttMicros / 2);
+    return simExecute(sim, buf, count, retCount);
+}
+
+/**
+ * @brief Takes up to count bytes of the pending response at once, without the simulated transfer delay.
+ * @return VI_SUCCESS, VI_SUCCESS_MAX_CNT if more of the response remains, or VI_ERROR_TMO if no response is pending.
+ */
+ViStatus simTake(SimInstrument* sim, unsigned char* buf, ViUInt32 count, ViPUInt32 retCount) {
+    mutexLock(&sim->mutex);
+    size_t pending = sim->outputLength - sim->outputRead;
+    if (pending == 0) {
+        mutexUnlock(&sim->mutex);
+        *retCount = 0;
+        return VI_ERROR_TMO;
+    }
+
+    ViUInt32 length = pending < count ? (ViUInt32)pending : count;
+    memcpy(buf, sim->output + sim->outputRead, length);
+    sim->outputRead += length;
+    if (sim->outputRead == sim->outputLength)
+        sim->outputLength = sim->outputRead = 0;
+    mutexUnlock(&sim->mutex);
+
+    *retCount = length;
+    return length < pending ? VI_SUCCESS_MAX_CNT : VI_SUCCESS;
+}
+
+/**
+ * @brief Reads the pending response. Returns VI_SUCCESS_MAX_CNT if the response does not fit in count bytes;
+ * the remainder is returned by the next read. The first chunk of a response takes half the round trip time.
+ *
+ * @param timeoutMs How long to wait before reporting VI_ERROR_TMO when no response is pending.
+ */
+ViStatus simRead(SimInstrument* sim, unsigned char* buf, ViUInt32 count, ViPUInt32 retCount, ViUInt32 timeoutMs) {
+    int firstChunk = (sim->outputRead == 0);
+    ViStatus status = simTake(sim, buf, count, retCount);
+    if (status == VI_ERROR_TMO) {
+        sleepMs(timeoutMs);
+        return status;
+    }
+    if (firstChunk && sim->rttMicros > 0)
+        sleepMicros(sim->rttMicros / 2);
+    return status;
+}
@@ -0,0 +1,392 @@
+/*********************************************************************/
+/*                                                                   */
+/* Instrument state snapshots and differential setup.                */
+/*                                                                   */
+/* A snapshot tracks a list of settings, given as header patterns    */
+/* (see scpi-parse.c), and caches the value each one last had:       */
+/* read back with snapshotCapture() or taken from the commands       */
+/* written to the session. snapshotApply() then sends only the       */
+/* commands of a setup whose value differs from the cache, in as     */
+/* few messages as possible, so repeated test steps on an analyzer   */
+/* that is already configured cost little or no traffic.             */
+/*                                                                   */
+/* Every message a session writes passes through snapshotNote().     */
+/* A command for a tracked setting updates its cached value, or      */
+/* clears it if the write failed or the command cannot be resolved,  */
+/* e.g. a header relative to the previous command in the message;    */
+/* *RST, *RCL and :SYSTem:PRESet clear them all, and                 */
+/* :CALCulate:MARKer:AOFF or turning a marker off clears the marker  */
+/* settings. A command the instrument rejected in checked mode is    */
+/* noted again as failed. To keep this cheap,                        */
+/* the last mnemonic of each command is hashed to one bit of a       */
+/* 64-bit filter first, and only commands whose bit belongs to a     */
+/* tracked setting are parsed in full. The cache assumes the         */
+/* program is the only one changing the tracked settings; a value   */
+/* the instrument rejected is only noticed in checked mode.          */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "scpi-parse.h"
+#include "snapshot.h"
+
+#define VALUE_TOLERANCE 1e-9    // Relative difference below which two numeric values are the same
+
+/* Maps a mnemonic, without numeric suffix and in any case, to one bit of a 64-bit filter */
+static unsigned long long mnemonicBit(const char* text, size_t length) {
+    return 1ULL << (scpiMnemonicHash(text, length) & 63);
+}
+
+/* Filter bits of the mnemonics a header matching the pattern can end with */
+static unsigned long long patternEndings(const char* pattern) {
+    unsigned int hashes[SCPI_MAX_ENDINGS];
+    int numHashes = scpiPatternEndings(pattern, hashes);
+    unsigned long long endings = 0;
+    for (int i = 0; i < numHashes; i++)
+        endings |= 1ULL << (hashes[i] & 63);
+    return endings;
+}
+
+static int equalsIgnoreCase(const char* a, size_t length, const char* b) {
+    if (strlen(b) != length)
+        return 0;
+    for (size_t i = 0; i < length; i++) {
+        if (toupper((unsigned char)a[i]) != toupper((unsigned char)b[i]))
+            return 0;
+    }
+    return 1;
+}
+
+/* Copies a command's parameters, without surrounding whitespace. Returns 0 if they do not fit */
+static int copyValue(const char* command, size_t length, char* value) {
+    const char* params = scpiSkipHeader(command, length);
+    size_t n = (size_t)(command + length - params);
+    while (n > 0 && isspace((unsigned char)params[n - 1]))
+        n--;
+    if (n >= SNAPSHOT_VALUE_BYTES)
+        return 0;
+    memcpy(value, params, n);
+    value[n] = '\0';
+    return 1;
+}
+
+static int parseNumber(const char* text, double* number) {
+    char* end;
+    *number = strtod(text, &end);
+    if (end == text)
+        return 0;
+    while (isspace((unsigned char)*end))
+        end++;
+    return *end == '\0';
+}
+
+/* Tests whether a value in manual notation, e.g. POSition, has the other value as its short or long form */
+static int sameMnemonic(const char* manual, const char* other) {
+    size_t shortLength = 0;
+    while (isupper((unsigned char)manual[shortLength]) || isdigit((unsigned char)manual[shortLength]))
+        shortLength++;
+    if (shortLength == 0 || manual[shortLength] == '\0' || strlen(other) != shortLength)
+        return 0;
+    for (size_t i = 0; i < shortLength; i++) {
+        if (toupper((unsigned char)other[i]) != manual[i])
+            return 0;
+    }
+    return 1;
+}
+
+/* Compares two parameter values as SCPI does: numbers by value, ON and OFF as 1 and 0, mnemonics in any case and in
+   short or long form */
+static int sameValue(const char* a, const char* b) {
+    double x, y;
+    const char* bools[] = { "OFF", "ON" };
+    for (int i = 0; i < 2; i++) {
+        if (equalsIgnoreCase(a, strlen(a), bools[i]))
+            a = i ? "1" : "0";
+        if (equalsIgnoreCase(b, strlen(b), bools[i]))
+            b = i ? "1" : "0";
+    }
+    if (parseNumber(a, &x) && parseNumber(b, &y))
+        return fabs(x - y) <= VALUE_TOLERANCE * fmax(fabs(x), fabs(y));
+    return equalsIgnoreCase(a, strlen(a), b) || sameMnemonic(a, b) || sameMnemonic(b, a);
+}
+
+/* Returns the tracked setting a command is for, or -1 */
+static int findSetting(const StateSnapshot* snapshot, const char* command, size_t length, unsigned long long ending) {
+    for (int i = 0; i < snapshot->numSettings; i++) {
+        const SnapshotSetting* setting = &snapshot->settings[i];
+        int suffix = -1;
+        if ((setting->endings & ending) && scpiMatchHeader(command, length, setting->pattern, &suffix)
+            && suffix == setting->suffix)
+            return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Initializes a snapshot that tracks no settings.
+ */
+void snapshotInit(StateSnapshot* snapshot) {
+    snapshot->numSettings = 0;
+    snapshot->endings = mnemonicBit("*RST", 4) | mnemonicBit("*RCL", 4) | mnemonicBit("PRES", 4)
+        | mnemonicBit("PRESet", 6) | mnemonicBit("AOFF", 4) | mnemonicBit("STAT", 4) | mnemonicBit("STATe", 5);
+    snapshot->sent = 0;
+    snapshot->skipped = 0;
+}
+
+/**
+ * @brief Starts tracking a setting, with an unknown value. Tracking a setting twice has no effect.
+ *
+ * @param pattern Header of the setting in manual notation, e.g. "[:SENSe]:BANDwidth[:RESolution]" or
+ * ":CALCulate:MARKer#:MODE". Optional nodes and long forms are included in the query snapshotCapture() sends.
+ * @param suffix Numeric suffix the '#' in pattern stands for, or -1 if pattern has none.
+ * @return 0 on success, 1 if the snapshot is full or the pattern too long.
+ */
+int snapshotTrack(StateSnapshot* snapshot, const char* pattern, int suffix) {
+    for (int i = 0; i < snapshot->numSettings; i++) {
+        if (snapshot->settings[i].suffix == suffix && strcmp(snapshot->settings[i].pattern, pattern) == 0)
+            return 0;
+    }
+    if (snapshot->numSettings == SNAPSHOT_MAX_SETTINGS || strlen(pattern) >= SNAPSHOT_PATTERN_BYTES)
+        return 1;
+    SnapshotSetting* setting = &snapshot->settings[snapshot->numSettings++];
+    strcpy(setting->pattern, pattern);
+    setting->suffix = suffix;
+    setting->endings = patternEndings(pattern);
+    setting->known = 0;
+    snapshot->endings |= setting->endings;
+    return 0;
+}
+
+/**
+ * @brief Marks every tracked setting unknown, e.g. after the instrument was reset or reconnected.
+ */
+void snapshotForget(StateSnapshot* snapshot) {
+    for (int i = 0; i < snapshot->numSettings; i++)
+        snapshot->settings[i].known = 0;
+}
+
+/* Marks the settings of one marker, or of all markers if marker is -1, unknown */
+static void forgetMarkers(StateSnapshot* snapshot, int marker) {
+    for (int i = 0; i < snapshot->numSettings; i++) {
+        SnapshotSetting* setting = &snapshot->settings[i];
+        if (strstr(setting->pattern, "MARKer#") != NULL && (marker < 0 || setting->suffix == marker))
+            setting->known = 0;
+    }
+}
+
+/**
+ * @brief Updates the cache from a message written to the instrument. Called by the session for every write.
+ *
+ * @param message Commands separated by ';'; need not be null-terminated.
+ * @param length Number of characters in message.
+ * @param failed The write failed, so the values it carried are unknown.
+ */
+void snapshotNote(StateSnapshot* snapshot, const char* message, size_t length, int failed) {
+    size_t unitLength;
+    for (size_t unit = 0; unit < length; unit += unitLength + 1) {
+        const char* command = message + unit;
+        unitLength = scpiUnitLength(command, length - unit);
+        size_t n = unitLength;
+        while (n > 0 && isspace((unsigned char)*command)) {
+            command++;
+            n--;
+        }
+        int query;
+        size_t mnemonicLength;
+        const char* mnemonic = scpiLastMnemonic(command, n, &mnemonicLength, &query);
+        unsigned long long ending = mnemonicBit(mnemonic, mnemonicLength);
+        if (query || !(snapshot->endings & ending))
+            continue;
+
+        if (equalsIgnoreCase(mnemonic, mnemonicLength, "*RST") || equalsIgnoreCase(mnemonic, mnemonicLength, "*RCL")
+            || equalsIgnoreCase(mnemonic, mnemonicLength, "PRES") || equalsIgnoreCase(mnemonic, mnemonicLength, "PRESET")) {
+            snapshotForget(snapshot);
+            continue;
+        }
+        int relative = command[0] != ':' && command[0] != '*' && unit > 0;
+
+        /* Markers turned off lose their function, counter and mode; a relative header may be for any marker */
+        int marker = -1;
+        char value[SNAPSHOT_VALUE_BYTES];
+        if (equalsIgnoreCase(mnemonic, mnemonicLength, "AOFF")
+            && (relative || scpiMatchHeader(command, n, ":CALCulate:MARKer:AOFF", &marker))) {
+            forgetMarkers(snapshot, -1);
+            continue;
+        }
+        if ((relative || scpiMatchHeader(command, n, ":CALCulate:MARKer#:STATe", &marker))
+            && (equalsIgnoreCase(mnemonic, mnemonicLength, "STAT") || equalsIgnoreCase(mnemonic, mnemonicLength, "STATE"))
+            && copyValue(command, n, value) && (equalsIgnoreCase(value, strlen(value), "OFF") || strcmp(value, "0") == 0))
+            forgetMarkers(snapshot, relative ? -1 : marker);
+
+        int found = relative ? -1 : findSetting(snapshot, command, n, ending);
+        if (found >= 0) {
+            SnapshotSetting* setting = &snapshot->settings[found];
+            setting->known = !failed && copyValue(command, n, setting->value);
+            continue;
+        }
+        /* A header relative to the previous command may be for any setting ending in the same mnemonic */
+        for (int i = 0; relative && i < snapshot->numSettings; i++) {
+            if (snapshot->settings[i].endings & ending)
+                snapshot->settings[i].known = 0;
+        }
+    }
+}
+
+/* Writes the query for a setting: its pattern with optional nodes included, the suffix filled in and '?' added */
+static size_t settingQuery(const SnapshotSetting* setting, char* query, size_t size) {
+    size_t used = 0;
+    for (const char* p = setting->pattern; *p != '\0'; p++) {
+        if (*p == '[' || *p == ']')
+            continue;
+        if (*p == '#') {
+            used += snprintf(query + used, size > used ? size - used : 0, "%d", setting->suffix);
+        }
+        else if (used < size) {
+            query[used++] = *p;
+        }
+    }
+    if (used + 1 >= size)
+        return 0;
+    query[used++] = '?';
+    query[used] = '\0';
+    return used;
+}
+
+/**
+ * @brief Reads the value of every tracked setting from the instrument, SNAPSHOT_BATCH settings per round trip, e.g.
+ * when the instrument may already be set up after a restart of the program. The queries are internal exchanges (see
+ * sessionBeginInternal()), so the session's validator does not check them.
+ *
+ * @return Status of the first failed exchange, VI_ERROR_INV_SETUP if a response held fewer values than queried (the
+ * settings of that batch stay unknown), otherwise VI_SUCCESS.
+ */
+ViStatus snapshotCapture(VisaSession* session, StateSnapshot* snapshot) {
+    char query[SESSION_MESSAGE_BYTES];
+    char response[SNAPSHOT_BATCH * (SNAPSHOT_VALUE_BYTES + 1)];
+    ViStatus result = VI_SUCCESS;
+
+    sessionBeginInternal(session);
+    for (int first = 0; first < snapshot->numSettings; ) {
+        int count = 0;
+        size_t used = 0;
+        while (first + count < snapshot->numSettings && count < SNAPSHOT_BATCH) {
+            if (count > 0)
+                query[used++] = ';';
+            size_t written = settingQuery(&snapshot->settings[first + count], query + used, sizeof(query) - used);
+            if (written == 0) {
+                used -= count > 0;
+                break;
+            }
+            used += written;
+            count++;
+        }
+        if (count == 0) {
+            result = VI_ERROR_INV_PARAMETER;
+            break;
+        }
+        query[used] = '\0';
+
+        ViUInt32 length;
+        ViStatus status = sessionQuery(session, query, response, sizeof(response), &length);
+        while (length > 0 && isspace((unsigned char)response[length - 1]))
+            length--;
+        size_t unit = 0, unitLength;
+        int missing = 0;
+        for (int i = 0; i < count; i++) {
+            SnapshotSetting* setting = &snapshot->settings[first + i];
+            setting->known = 0;
+            if (status < VI_SUCCESS)
+                continue;
+            if (unit > length) {
+                missing = 1;
+                continue;
+            }
+            unitLength = scpiUnitLength(response + unit, length - unit);
+            const char* value = response + unit;
+            size_t n = unitLength;
+            while (n > 0 && isspace((unsigned char)*value)) {
+                value++;
+                n--;
+            }
+            if (n > 0 && n < SNAPSHOT_VALUE_BYTES) {
+                memcpy(setting->value, value, n);
+                setting->value[n] = '\0';
+                setting->known = 1;
+            }
+            unit += unitLength + 1;
+        }
+        if (result >= VI_SUCCESS && status < VI_SUCCESS)
+            result = status;
+        else if (result >= VI_SUCCESS && missing)
+            result = VI_ERROR_INV_SETUP;
+        if (status < VI_SUCCESS && status != SESSION_ERROR_SCPI)
+            break;
+        first += count;
+    }
+    sessionEndInternal(session);
+    return result;
+}
+
+/**
+ * @brief Brings the instrument to a setup, sending only the commands whose setting is untracked, unknown or has a
+ * different value. The commands sent are joined into as few messages as possible, as internal exchanges (see
+ * sessionBeginInternal()) the session's validator does not check.
+ *
+ * @param commands Setup commands with absolute headers, e.g. ":SENSe:FREQuency:STARt 1e9". A value written this way
+ * is cached, so applying the same setup again sends nothing.
+ * @param count Number of commands.
+ * @param numSent Output number of commands sent. May be NULL.
+ * @return Status of the first failed write, or VI_ERROR_INV_PARAMETER if a command is longer than
+ * SESSION_MESSAGE_BYTES.
+ */
+ViStatus snapshotApply(VisaSession* session, StateSnapshot* snapshot, const char* const* commands, int count, int* numSent) {
+    char message[SESSION_MESSAGE_BYTES];
+    char value[SNAPSHOT_VALUE_BYTES];
+    ViStatus status = VI_SUCCESS;
+    size_t used = 0;
+    int sent = 0;
+
+    sessionBeginInternal(session);
+    for (int i = 0; i < count && status >= VI_SUCCESS; i++) {
+        const char* command = commands[i];
+        size_t length = strlen(command);
+        int query;
+        size_t mnemonicLength;
+        const char* mnemonic = scpiLastMnemonic(command, length, &mnemonicLength, &query);
+        int found = findSetting(snapshot, command, length, mnemonicBit(mnemonic, mnemonicLength));
+        if (found >= 0 && snapshot->settings[found].known && copyValue(command, length, value)
+            && sameValue(snapshot->settings[found].value, value)) {
+            snapshot->skipped++;
+            continue;
+        }
+
+        int separator = used > 0, colon = command[0] != ':' && command[0] != '*';
+        if (used + separator + colon + length >= sizeof(message) && used > 0) {
+            status = sessionWrite(session, message);
+            used = 0;
+            separator = 0;
+        }
+        if (separator + colon + length >= sizeof(message)) {
+            status = VI_ERROR_INV_PARAMETER;
+            break;
+        }
+        if (separator)
+            message[used++] = ';';
+        if (colon)
+            message[used++] = ':';
+        memcpy(message + used, command, length + 1);
+        used += length;
+        sent++;
+    }
+    if (used > 0 && status >= VI_SUCCESS)
+        status = sessionWrite(session, message);
+    snapshot->sent += sent;
+    sessionEndInternal(session);
+    if (numSent != NULL)
+        *numSent = sent;
+    return status;
+}
@@ -0,0 +1,160 @@
+/*********************************************************************/
+/*                                                                   */
+/* Split-span capture across several identical analyzers.            */
+/*      Lay out one uniform grid over the full span                  */
+/*      Give each analyzer a contiguous slice of the grid            */
+/*      On its own thread, each analyzer tunes to its slice, takes   */
+/*      a single sweep and walks marker 1 across the slice points    */
+/*      Every worker writes straight into its slice of the output,   */
+/*      so the stitched trace is already in frequency order          */
+/*                                                                   */
+/* Workers only touch their own VisaSession and buffers, and hold    */
+/* the session lock for the whole slice, so nothing else can retune  */
+/* the analyzer in the middle of it. Every analyzer must have its    */
+/* own session; the same session twice is rejected.                  */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "platform.h"
+#include "split-span.h"
+#include "visa-session.h"
+
+typedef struct {
+    VisaSession* session;   // Session to the analyzer driven by this worker
+    int firstIndex;         // First grid index of the slice
+    int lastIndex;          // Last grid index of the slice (inclusive)
+    const double* freq;     // Full-span frequency grid
+    double* amp;            // Full-span amplitude output
+    ViStatus status;        // First error hit by the worker, VI_SUCCESS otherwise
+} SpanWorker;
+
+/**
+ * @brief Writes a command to a worker's analyzer, keeping the first error in the worker status.
+ */
+static ViStatus spanWrite(SpanWorker* worker, const char* command) {
+    ViStatus status = sessionWrite(worker->session, command);
+    if (status < VI_SUCCESS && worker->status >= VI_SUCCESS)
+        worker->status = status;
+    return status;
+}
+
+/**
+ * @brief Writes a query to a worker's analyzer and converts the response to a double.
+ * @return Value of the response, or 0 on error.
+ */
+static double spanQueryDouble(SpanWorker* worker, const char* query) {
+    double value;
+    ViStatus status = sessionQueryDouble(worker->session, query, &value);
+    if (status < VI_SUCCESS && worker->status >= VI_SUCCESS)
+        worker->status = status;
+    return value;
+}
+
+/**
+ * @brief Thread body: tunes one analyzer to its slice, sweeps once and reads every slice point with marker 1.
+ * The analyzer's original span is restored afterwards.
+ */
+static THREAD_FUNC spanWorkerThread(void* arg) {
+    SpanWorker* worker = arg;
+    char command[SPLIT_COMMAND_BYTES];
+
+    sessionLock(worker->session);
+    double oldStart = spanQueryDouble(worker, ":SENSe:FREQuency:STARt?");
+    double oldStop = spanQueryDouble(worker, ":SENSe:FREQuency:STOP?");
+
+    spanWrite(worker, ":INITiate:CONTinuous OFF");
+    sprintf(command, ":SENSe:FREQuency:STARt %f", worker->freq[worker->firstIndex]);
+    spanWrite(worker, command);
+    sprintf(command, ":SENSe:FREQuency:STOP %f", worker->freq[worker->lastIndex]);
+    spanWrite(worker, command);
+    spanQueryDouble(worker, ":INITiate:IMMediate;*OPC?");   // Returns once the sweep of the new span is complete
+
+    spanWrite(worker, ":CALCulate:MARKer:AOff");
+    spanWrite(worker, ":CALCulate:MARKer1:FUNCtion BPower");
+    spanWrite(worker, ":CALCulate:MARKer1:FCOunt:STATe ON");
+    spanWrite(worker, ":CALCulate:MARKer1:MODE POSition");
+
+    for (int i = worker->firstIndex; i <= worker->lastIndex && worker->status >= VI_SUCCESS; i++) {
+        ViStatus status = sessionMeasureMarker(worker->session, worker->freq[i], &worker->amp[i]);
+        if (status < VI_SUCCESS)
+            worker->status = status;
+    }
+
+    if (oldStop > oldStart) {
+        sprintf(command, ":SENSe:FREQuency:STARt %f", oldStart);
+        spanWrite(worker, command);
+        sprintf(command, ":SENSe:FREQuency:STOP %f", oldStop);
+        spanWrite(worker, command);
+    }
+    spanWrite(worker, ":INITiate:CONTinuous ON");
+    sessionUnlock(worker->session);
+    return THREAD_RETURN;
+}
+
+/**
+ * @brief Captures one trace over startFreq..stopFreq by splitting the span across several analyzers in parallel.
+ *
+ * @param sessions Open sessions to the analyzers, in the order their slices should cover the span. Each session may
+ * appear only once.
+ * @param numSessions Number of sessions, at most SPLIT_SPAN_MAX.
+ * @param startFreq First frequency of the stitched trace.
+ * @param stopFreq Last frequency of the stitched trace.
+ * @param numPoints Number of points in the stitched trace, at least 2 per analyzer.
+ * @param freq Output frequency array of numPoints values.
+ * @param amp Output amplitude array of numPoints values.
+ * @return 0 on success, 1 if any analyzer failed or a session was given twice.
+ */
+int splitSpanCapture(VisaSession** sessions, int numSessions, double startFreq, double stopFreq, int numPoints, double* freq, double* amp) {
+    SpanWorker workers[SPLIT_SPAN_MAX];
+    PlatformThread threads[SPLIT_SPAN_MAX];
+    int started[SPLIT_SPAN_MAX] = { 0 };
+    int errorFlag = 0;
+
+    if (numSessions < 1 || numSessions > SPLIT_SPAN_MAX || numPoints < 2 * numSessions)
+        return 1;
+    for (int k = 0; k < numSessions; k++) {
+        for (int j = 0; j < k; j++) {
+            if (sessions[j] == sessions[k]) {
+                printf("Error: Analyzers %d and %d are the same session.\n", j, k);
+                return 1;
+            }
+        }
+    }
+
+    double freqSpacing = (stopFreq - startFreq) / (numPoints - 1);
+    for (int i = 0; i < numPoints; i++) {
+        freq[i] = round(startFreq + i * freqSpacing);
+        amp[i] = 0;
+    }
+
+    for (int k = 0; k < numSessions; k++) {
+        workers[k].session = sessions[k];
+        workers[k].firstIndex = (int)((long long)k * numPoints / numSessions);
+        workers[k].lastIndex = (int)((long long)(k + 1) * numPoints / numSessions) - 1;
+        workers[k].freq = freq;
+        workers[k].amp = amp;
+        workers[k].status = VI_SUCCESS;
+        if (threadCreate(&threads[k], spanWorkerThread, &workers[k]) != 0) {
+            printf("Error: Could not start a capture thread for analyzer %d.\n", k);
+            errorFlag = 1;
+            continue;
+        }
+        started[k] = 1;
+    }
+
+    for (int k = 0; k < numSessions; k++) {
+        if (!started[k])
+            continue;
+        threadJoin(threads[k]);
+        if (workers[k].status < VI_SUCCESS) {
+            printf("Error %X: Analyzer %d failed while capturing %e to %e.\n", workers[k].status, k,
+                freq[workers[k].firstIndex], freq[workers[k].lastIndex]);
+            errorFlag = 1;
+        }
+    }
+    return errorFlag;
+}
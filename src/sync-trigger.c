@@ -0,0 +1,217 @@
+/*********************************************************************/
+/*                                                                   */
+/* Synchronized triggering of several instruments, so readings of   */
+/* e.g. an analyzer and a power meter describe the same moment.      */
+/*                                                                   */
+/* Each target gets its own thread. The thread arms a bus-triggered  */
+/* measurement and confirms the arm with *STB?, which an overlapped  */
+/* :INITiate does not hold up, so the trigger cannot overtake it.    */
+/* It then sleeps on a condition variable until every target is     */
+/* armed, which may take as long as the slowest instrument. Waking   */
+/* takes longer than a trigger call, so the woken threads spin on a  */
+/* shared flag, yielding the processor, until all of them are awake; */
+/* the caller then sets the flag and all threads fire at once with   */
+/* sessionAssertTrigger(). The skew is the spread of the trigger     */
+/* calls rather than their sum, and no thread spins for longer than  */
+/* the others take to wake. Each thread then waits for *OPC? and     */
+/* reads the target's reading.                                       */
+/*                                                                   */
+/* Every trigger call is timestamped with monotonicMicros() before   */
+/* and after; the instrument triggered somewhere in between. The     */
+/* report gives the spread of the midpoints (the skew) and the       */
+/* longest call (the uncertainty of each timestamp). Instruments on  */
+/* one GPIB board or serial port take turns on the bus, so their     */
+/* triggers are at least one transfer apart.                         */
+/*                                                                   */
+/* The default arm leaves a target in single, bus-triggered sweeps.  */
+/* syncSaveSettings() before a run and syncRestoreSettings() after   */
+/* it put back the sweep mode and trigger source it had.             */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "sync-trigger.h"
+
+/* Where the threads wait for each other between arming and triggering */
+typedef struct {
+    PlatformMutex mutex;
+    PlatformCond changed;               // Broadcast when a target is armed and when the threads are woken
+    int armed;                          // Targets done arming, whether or not the arm succeeded
+    int woken;                          // Set once every target is armed
+    PlatformAtomic spinning;            // Threads woken and spinning on release
+    PlatformAtomic release;             // Set once every thread is spinning
+} SyncGate;
+
+/* Thread arming, triggering and reading one target */
+typedef struct {
+    const SyncTarget* target;
+    SyncReading* reading;
+    SyncGate* gate;
+    unsigned long long fireMicros;      // monotonicMicros() when the trigger call started
+    int triggered;                      // The trigger call succeeded
+    PlatformThread thread;
+    int started;
+} SyncWorker;
+
+static THREAD_FUNC syncWorker(void* arg) {
+    SyncWorker* worker = arg;
+    VisaSession* session = worker->target->session;
+    SyncReading* reading = worker->reading;
+    const char* arm = worker->target->arm != NULL ? worker->target->arm : SYNC_DEFAULT_ARM;
+    const char* fetch = worker->target->fetch != NULL ? worker->target->fetch : SYNC_DEFAULT_FETCH;
+    char response[SESSION_RESPONSE_BYTES];
+
+    ViStatus status = sessionWrite(session, arm);
+    if (status >= VI_SUCCESS)
+        status = sessionQuery(session, "*STB?", response, sizeof(response), NULL);
+    SyncGate* gate = worker->gate;
+    mutexLock(&gate->mutex);
+    gate->armed++;
+    condBroadcast(&gate->changed);
+    while (!gate->woken)
+        condWait(&gate->changed, &gate->mutex);
+    mutexUnlock(&gate->mutex);
+
+    /* Spin rather than block, so every thread leaves the wait within a few instructions of the release */
+    atomicFetchAdd(&gate->spinning, 1);
+    while (atomicLoad(&gate->release) == 0)
+        threadYield();
+    if (status < VI_SUCCESS) {
+        reading->status = status;
+        return THREAD_RETURN;
+    }
+
+    worker->fireMicros = monotonicMicros();
+    status = sessionAssertTrigger(session, &reading->scpiTrigger);
+    reading->triggerSpan = monotonicMicros() - worker->fireMicros;
+    worker->triggered = status >= VI_SUCCESS;
+    if (!worker->triggered) {
+        reading->status = status;
+        return THREAD_RETURN;
+    }
+
+    status = sessionQuery(session, "*OPC?", response, sizeof(response), NULL);
+    if (status >= VI_SUCCESS)
+        status = sessionQuery(session, fetch, reading->reading, SYNC_READING_BYTES, NULL);
+    reading->readingMicros = monotonicMicros();
+    if (status >= VI_SUCCESS) {
+        reading->reading[strcspn(reading->reading, "\r\n")] = '\0';
+        reading->value = strtod(reading->reading, NULL);
+    }
+    reading->status = status;
+    return THREAD_RETURN;
+}
+
+/**
+ * @brief Reads the sweep mode and trigger source SYNC_DEFAULT_ARM changes, to put back with syncRestoreSettings().
+ *
+ * @param settings Output settings of the instrument.
+ * @return Status of the query.
+ */
+ViStatus syncSaveSettings(VisaSession* session, SyncSettings* settings) {
+    char response[SESSION_RESPONSE_BYTES];
+
+    memset(settings, 0, sizeof(SyncSettings));
+    ViStatus status = sessionQuery(session, SYNC_SETTINGS_QUERY, response, sizeof(response), NULL);
+    if (status < VI_SUCCESS)
+        return status;
+    response[strcspn(response, "\r\n")] = '\0';
+    size_t split = strcspn(response, ";");
+    if (response[split] == '\0' || split >= SYNC_SETTING_BYTES || strlen(response + split + 1) >= SYNC_SETTING_BYTES)
+        return VI_ERROR_IO;
+    memcpy(settings->continuous, response, split);
+    strcpy(settings->source, response + split + 1);
+    return status;
+}
+
+/**
+ * @brief Puts back the trigger source and sweep mode read by syncSaveSettings(). Does nothing if they were not read.
+ *
+ * @return Status of the write.
+ */
+ViStatus syncRestoreSettings(VisaSession* session, const SyncSettings* settings) {
+    char command[SYNC_QUERY_BYTES];
+
+    if (settings->continuous[0] == '\0' || settings->source[0] == '\0')
+        return VI_SUCCESS;
+    snprintf(command, sizeof(command), ":TRIGger:SOURce %s;:INITiate:CONTinuous %s", settings->source,
+        settings->continuous);
+    return sessionWrite(session, command);
+}
+
+/**
+ * @brief Arms several instruments, triggers them as close together as possible and reads each one's reading.
+ *
+ * @param targets Instruments to trigger, at most SYNC_MAX_TARGETS, each with its own session.
+ * @param readings Output reading of each target, with the host time of its trigger.
+ * @param report Output skew between the triggers.
+ * @return Number of readings taken, or -1 if numTargets is out of range.
+ */
+int syncTrigger(const SyncTarget* targets, int numTargets, SyncReading* readings, SyncReport* report) {
+    SyncWorker workers[SYNC_MAX_TARGETS];
+    SyncGate gate;
+    int started = 0, taken = 0;
+
+    memset(report, 0, sizeof(SyncReport));
+    if (numTargets < 1 || numTargets > SYNC_MAX_TARGETS)
+        return -1;
+    memset(readings, 0, sizeof(SyncReading) * numTargets);
+
+    mutexInit(&gate.mutex);
+    condInit(&gate.changed);
+    gate.armed = gate.woken = 0;
+    gate.spinning = gate.release = 0;
+
+    unsigned long long start = monotonicMicros();
+    for (int i = 0; i < numTargets; i++) {
+        workers[i].target = &targets[i];
+        workers[i].reading = &readings[i];
+        workers[i].gate = &gate;
+        workers[i].triggered = 0;
+        workers[i].started = threadCreate(&workers[i].thread, syncWorker, &workers[i]) == 0;
+        if (workers[i].started)
+            started++;
+        else
+            readings[i].status = VI_ERROR_ALLOC;
+    }
+    mutexLock(&gate.mutex);
+    while (gate.armed < started)
+        condWait(&gate.changed, &gate.mutex);
+    report->armMicros = monotonicMicros() - start;
+    gate.woken = 1;
+    condBroadcast(&gate.changed);
+    mutexUnlock(&gate.mutex);
+    while (atomicLoad(&gate.spinning) < started)
+        threadYield();
+    report->releaseMicros = monotonicMicros();
+    atomicStore(&gate.release, 1);
+    for (int i = 0; i < numTargets; i++) {
+        if (workers[i].started)
+            threadJoin(workers[i].thread);
+    }
+    condDestroy(&gate.changed);
+    mutexDestroy(&gate.mutex);
+
+    unsigned long long first = 0, last = 0;
+    for (int i = 0; i < numTargets; i++) {
+        SyncReading* reading = &readings[i];
+        if (reading->status >= VI_SUCCESS)
+            taken++;
+        if (!workers[i].triggered)
+            continue;
+        reading->triggerMicros = workers[i].fireMicros + reading->triggerSpan / 2 - report->releaseMicros;
+        reading->readingMicros -= report->releaseMicros;
+        if (report->triggered == 0 || reading->triggerMicros < first)
+            first = reading->triggerMicros;
+        if (report->triggered == 0 || reading->triggerMicros > last)
+            last = reading->triggerMicros;
+        if (reading->triggerSpan > report->maxSpanMicros)
+            report->maxSpanMicros = reading->triggerSpan;
+        report->triggered++;
+    }
+    report->skewMicros = last - first;
+    return taken;
+}
@@ -0,0 +1,378 @@
+/*********************************************************************/
+/*                                                                   */
+/* Raw TCP transport for TCPIP[board]::host::port::SOCKET resources, */
+/* used by the built-in VISA implementation on hosts without a       */
+/* vendor VISA library. Most analyzers accept SCPI on port 5025.     */
+/* Listeners accept connections the same way, e.g. from the capture  */
+/* coordinator to an agent (remote-capture.h).                       */
+/*                                                                   */
+/* As with VI_ATTR_TERMCHAR_EN set, reads end at the termination     */
+/* character (newline by default), when the buffer is full, or at    */
+/* the timeout.                                                      */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "tcp-socket.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET SocketHandle;
+typedef int SocketLength;
+#define closeSocket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+typedef int SocketHandle;
+typedef socklen_t SocketLength;
+#define INVALID_SOCKET (-1)
+#define closeSocket close
+#endif
+
+/* A peer that closed its end fails the send instead of raising SIGPIPE */
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+struct TcpSocket {
+    SocketHandle handle;
+    int termCharEnabled;
+    unsigned char termChar;
+    unsigned char receive[TCP_RECEIVE_BYTES];   // Bytes received but not yet returned by tcpRead()
+    size_t start, end;                          // Unread bytes are receive[start..end)
+};
+
+struct TcpListener {
+    SocketHandle handle;
+    int port;                                   // Port bound, found after binding port 0
+};
+
+/* Starts Winsock once per process. Returns 0 on success */
+static int startSockets(void) {
+#ifdef _WIN32
+    static int started;
+    if (!started) {
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+            return 1;
+        started = 1;
+    }
+#endif
+    return 0;
+}
+
+/* Wraps a connected socket, disabling Nagle's algorithm since the traffic is many small request/response exchanges */
+static TcpSocket* wrapSocket(SocketHandle handle) {
+    int noDelay = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+
+    TcpSocket* sock = malloc(sizeof(TcpSocket));
+    if (sock == NULL) {
+        closeSocket(handle);
+        return NULL;
+    }
+    sock->handle = handle;
+    sock->termCharEnabled = 1;
+    sock->termChar = '\n';
+    sock->start = sock->end = 0;
+    return sock;
+}
+
+/**
+ * @brief Parses a TCPIP[board]::host::port::SOCKET resource descriptor (case-insensitive).
+ *
+ * @param resource Resource descriptor.
+ * @param host Output host name or address.
+ * @param hostSize Capacity of host.
+ * @param port Output port number.
+ * @return 0 if the descriptor is a socket resource, 1 otherwise.
+ */
+int tcpParseResource(const char* resource, char* host, size_t hostSize, int* port) {
+    if (strncmp(resource, "TCPIP", 5) != 0 && strncmp(resource, "tcpip", 5) != 0)
+        return 1;
+    const char* p = resource + 5;
+    while (isdigit((unsigned char)*p))
+        p++;
+    if (strncmp(p, "::", 2) != 0)
+        return 1;
+    p += 2;
+
+    const char* hostEnd = strstr(p, "::");
+    if (hostEnd == NULL || hostEnd == p || (size_t)(hostEnd - p) >= hostSize)
+        return 1;
+    const char* portStart = hostEnd + 2;
+    char* portEnd;
+    long value = strtol(portStart, &portEnd, 10);
+    if (portEnd == portStart || value <= 0 || value > 65535 || strncmp(portEnd, "::", 2) != 0)
+        return 1;
+    const char* suffix = portEnd + 2;
+    for (const char* s = "SOCKET"; *s != '\0'; s++, suffix++) {
+        if (toupper((unsigned char)*suffix) != *s)
+            return 1;
+    }
+    if (*suffix != '\0')
+        return 1;
+
+    memcpy(host, p, hostEnd - p);
+    host[hostEnd - p] = '\0';
+    *port = (int)value;
+    return 0;
+}
+
+/**
+ * @brief Waits until a socket is readable or writable.
+ * @return 1 if ready, 0 on timeout or error.
+ */
+static int waitSocket(SocketHandle handle, int forWrite, unsigned int timeoutMs) {
+    fd_set set;
+    struct timeval tv;
+    FD_ZERO(&set);
+    FD_SET(handle, &set);
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    int ready = select((int)handle + 1, forWrite ? NULL : &set, forWrite ? &set : NULL, NULL, &tv);
+    return ready > 0;
+}
+
+/* Switches a socket between blocking and non-blocking mode */
+static void setBlocking(SocketHandle handle, int blocking) {
+#ifdef _WIN32
+    u_long nonBlocking = !blocking;
+    ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+    int flags = fcntl(handle, F_GETFL, 0);
+    fcntl(handle, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+#endif
+}
+
+/* Connects without blocking for longer than timeoutMs, as a blocking connect() waits out the system's own timeout
+   (a minute or more) on a host that does not answer. Returns 0 once connected */
+static int connectSocket(SocketHandle handle, const struct sockaddr* address, SocketLength length,
+    unsigned int timeoutMs) {
+    setBlocking(handle, 0);
+    if (connect(handle, address, length) != 0) {
+#ifdef _WIN32
+        if (WSAGetLastError() != WSAEWOULDBLOCK)
+            return 1;
+#else
+        if (errno != EINPROGRESS)
+            return 1;
+#endif
+        int error = 0;
+        SocketLength errorLength = sizeof(error);
+        if (!waitSocket(handle, 1, timeoutMs)
+            || getsockopt(handle, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength) != 0 || error != 0)
+            return 1;
+    }
+    setBlocking(handle, 1);
+    return 0;
+}
+
+/**
+ * @brief Opens a TCP connection to an instrument. Nagle's algorithm is disabled since SCPI traffic is many small
+ * request/response exchanges.
+ *
+ * @param host Host name or address.
+ * @param port Port number.
+ * @param timeoutMs Connection timeout in milliseconds.
+ * @return The connection, or NULL if it could not be opened.
+ */
+TcpSocket* tcpConnect(const char* host, int port, unsigned int timeoutMs) {
+    struct addrinfo hints, *addresses, *a;
+    char service[16];
+
+    if (startSockets() != 0)
+        return NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%d", port);
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        return NULL;
+
+    SocketHandle handle = INVALID_SOCKET;
+    for (a = addresses; a != NULL; a = a->ai_next) {
+        handle = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (handle == INVALID_SOCKET)
+            continue;
+        if (connectSocket(handle, a->ai_addr, (SocketLength)a->ai_addrlen, timeoutMs) == 0)
+            break;
+        closeSocket(handle);
+        handle = INVALID_SOCKET;
+    }
+    freeaddrinfo(addresses);
+    if (handle == INVALID_SOCKET)
+        return NULL;
+    return wrapSocket(handle);
+}
+
+/**
+ * @brief Closes a connection opened with tcpConnect() or tcpAccept().
+ */
+void tcpClose(TcpSocket* sock) {
+    if (sock == NULL)
+        return;
+    closeSocket(sock->handle);
+    free(sock);
+}
+
+/**
+ * @brief Sets whether reads end at a termination character (VI_ATTR_TERMCHAR_EN / VI_ATTR_TERMCHAR).
+ */
+void tcpSetTermChar(TcpSocket* sock, int enabled, unsigned char termChar) {
+    sock->termCharEnabled = enabled;
+    sock->termChar = termChar;
+}
+
+/**
+ * @brief Turns TCP keep-alive probes on or off, so a peer that disappears without closing the connection is noticed.
+ * @return 0 on success, 1 on error.
+ */
+int tcpSetKeepAlive(TcpSocket* sock, int enabled) {
+    int value = enabled != 0;
+    return setsockopt(sock->handle, SOL_SOCKET, SO_KEEPALIVE, (const char*)&value, sizeof(value)) != 0;
+}
+
+/**
+ * @brief Sends a complete message.
+ * @return VI_SUCCESS, or VI_ERROR_CONN_LOST if the connection failed.
+ */
+ViStatus tcpWrite(TcpSocket* sock, const unsigned char* buf, ViUInt32 count, ViPUInt32 retCount) {
+    ViUInt32 sent = 0;
+    while (sent < count) {
+        int n = send(sock->handle, (const char*)buf + sent, (int)(count - sent), SEND_FLAGS);
+        if (n <= 0) {
+            if (retCount != NULL)
+                *retCount = sent;
+            return VI_ERROR_CONN_LOST;
+        }
+        sent += n;
+    }
+    if (retCount != NULL)
+        *retCount = sent;
+    return VI_SUCCESS;
+}
+
+/**
+ * @brief Reads a response, ending at the termination character, when count bytes have been read, or at the timeout.
+ *
+ * @return VI_SUCCESS_TERM_CHAR, VI_SUCCESS_MAX_CNT if more data may follow, VI_ERROR_TMO if the response did not
+ * complete in time (*retCount holds any bytes received), or VI_ERROR_CONN_LOST if the connection was closed or failed.
+ */
+ViStatus tcpRead(TcpSocket* sock, unsigned char* buf, ViUInt32 count, ViPUInt32 retCount, ViUInt32 timeoutMs) {
+    ViUInt32 copied = 0;
+    *retCount = 0;
+
+    for (;;) {
+        /* Return buffered bytes up to and including the termination character */
+        while (sock->start < sock->end && copied < count) {
+            unsigned char c = sock->receive[sock->start++];
+            buf[copied++] = c;
+            if (sock->termCharEnabled && c == sock->termChar) {
+                *retCount = copied;
+                return VI_SUCCESS_TERM_CHAR;
+            }
+        }
+        *retCount = copied;
+        if (copied == count)
+            return VI_SUCCESS_MAX_CNT;
+
+        if (!waitSocket(sock->handle, 0, timeoutMs))
+            return VI_ERROR_TMO;
+        int n = recv(sock->handle, (char*)sock->receive, TCP_RECEIVE_BYTES, 0);
+        if (n <= 0)
+            return VI_ERROR_CONN_LOST;
+        sock->start = 0;
+        sock->end = n;
+    }
+}
+
+/**
+ * @brief Listens for TCP connections on one IPv4 interface, or on all of them.
+ *
+ * @param host Address or name of the interface to listen on, e.g. "127.0.0.1" to accept local connections only, or
+ * NULL for all interfaces.
+ * @param port Port number, or 0 for any free port; see tcpListenerPort().
+ * @return The listener, or NULL if the host is unknown or the port could not be bound.
+ */
+TcpListener* tcpListen(const char* host, int port) {
+    struct addrinfo hints, *bound;
+    struct sockaddr_in address;
+    SocketLength length = sizeof(address);
+    char service[16];
+
+    if (startSockets() != 0)
+        return NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    sprintf(service, "%d", port);
+    if (getaddrinfo(host, service, &hints, &bound) != 0)
+        return NULL;
+    memcpy(&address, bound->ai_addr, sizeof(address));
+    freeaddrinfo(bound);
+
+    SocketHandle handle = socket(AF_INET, SOCK_STREAM, 0);
+    if (handle == INVALID_SOCKET)
+        return NULL;
+    int reuse = 1;
+    setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    TcpListener* listener = malloc(sizeof(TcpListener));
+    if (listener == NULL || bind(handle, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(handle, 16) != 0
+        || getsockname(handle, (struct sockaddr*)&address, &length) != 0) {
+        closeSocket(handle);
+        free(listener);
+        return NULL;
+    }
+    listener->handle = handle;
+    listener->port = ntohs(address.sin_port);
+    return listener;
+}
+
+/**
+ * @brief Returns the port a listener is bound to.
+ */
+int tcpListenerPort(const TcpListener* listener) {
+    return listener->port;
+}
+
+/**
+ * @brief Waits for the next connection to a listener.
+ *
+ * @param timeoutMs Longest wait in milliseconds.
+ * @return The connection, with reads ending at a newline, or NULL if none came in time.
+ */
+TcpSocket* tcpAccept(TcpListener* listener, unsigned int timeoutMs) {
+    if (!waitSocket(listener->handle, 0, timeoutMs))
+        return NULL;
+    SocketHandle handle = accept(listener->handle, NULL, NULL);
+    if (handle == INVALID_SOCKET)
+        return NULL;
+    return wrapSocket(handle);
+}
+
+/**
+ * @brief Stops listening. Connections already accepted stay open.
+ */
+void tcpCloseListener(TcpListener* listener) {
+    if (listener == NULL)
+        return;
+    closeSocket(listener->handle);
+    free(listener);
+}
@@ -0,0 +1,187 @@
+/*********************************************************************/
+/*                                                                   */
+/* Adaptive frequency step planner for point-by-point captures.      */
+/*      Measure a coarse, evenly spaced subset of the grid           */
+/*      Score every interval between measured points by its          */
+/*      amplitude gradient and its level above the noise floor       */
+/*      Repeatedly bisect the highest scoring interval until the     */
+/*      point budget is spent or no interval needs refining          */
+/*                                                                   */
+/* Flat noise floor is left at coarse resolution while signals are   */
+/* resolved down to the full grid spacing. A signal narrower than    */
+/* the coarse spacing that falls between two coarse points on the    */
+/* floor is not detected, so the coarse pass must stay dense enough  */
+/* for the narrowest signal of interest.                             */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "trace-adaptive.h"
+
+typedef struct {
+    int low;            // Grid index of the measured point at the low end
+    int high;           // Grid index of the measured point at the high end
+    double score;       // Refinement priority, higher is refined first
+} Interval;
+
+/**
+ * @brief Fills a plan with the default coarse density, point budget and thresholds for a grid.
+ *
+ * @param plan Plan to fill.
+ * @param startFreq First frequency of the grid.
+ * @param stopFreq Last frequency of the grid.
+ * @param gridPoints Number of points on the full-resolution grid.
+ */
+void adaptivePlanDefaults(AdaptivePlan* plan, double startFreq, double stopFreq, int gridPoints) {
+    plan->startFreq = startFreq;
+    plan->stopFreq = stopFreq;
+    plan->gridPoints = gridPoints;
+    plan->coarsePoints = gridPoints / ADAPTIVE_COARSE_DIVISOR + 1;
+    if (plan->coarsePoints < ADAPTIVE_COARSE_MIN)
+        plan->coarsePoints = ADAPTIVE_COARSE_MIN;
+    if (plan->coarsePoints > gridPoints)
+        plan->coarsePoints = gridPoints;
+    plan->pointBudget = gridPoints / ADAPTIVE_BUDGET_DIVISOR;
+    if (plan->pointBudget < plan->coarsePoints)
+        plan->pointBudget = plan->coarsePoints;
+    plan->gradientThreshold = ADAPTIVE_GRADIENT_DB;
+    plan->levelMargin = ADAPTIVE_LEVEL_MARGIN_DB;
+}
+
+static int compareDouble(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Scores an interval between two measured grid points. Returns a negative value if it does not need refining.
+ */
+static double scoreInterval(const AdaptivePlan* plan, const double* gridAmp, int low, int high, double levelThreshold) {
+    if (high - low < 2)
+        return -1;
+
+    double gradient = fabs(gridAmp[high] - gridAmp[low]);
+    double level = (gridAmp[high] > gridAmp[low] ? gridAmp[high] : gridAmp[low]) - levelThreshold;
+    if (gradient < plan->gradientThreshold && level < 0)
+        return -1;
+
+    /* Wider intervals win ties so refinement spreads across a signal before drilling into one edge */
+    return gradient + (level > 0 ? level : 0) + (double)(high - low) / plan->gridPoints;
+}
+
+static void heapPush(Interval* heap, int* size, Interval item) {
+    int i = (*size)++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent].score >= item.score)
+            break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+static Interval heapPop(Interval* heap, int* size) {
+    Interval top = heap[0];
+    Interval last = heap[--(*size)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *size)
+            break;
+        if (child + 1 < *size && heap[child + 1].score > heap[child].score)
+            child++;
+        if (last.score >= heap[child].score)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/**
+ * @brief Captures a trace with a coarse pass followed by budget-limited refinement of interesting regions.
+ *
+ * @param plan Grid, budget and thresholds for the capture.
+ * @param measure Callback that measures a single frequency.
+ * @param context Passed unchanged to measure().
+ * @param freq Output frequency array, must hold plan->pointBudget values. Points are in ascending order.
+ * @param amp Output amplitude array, must hold plan->pointBudget values.
+ * @return Number of points measured, or -1 on error.
+ */
+int adaptiveCapture(const AdaptivePlan* plan, MeasurePointFn measure, void* context, double* freq, double* amp) {
+    int gridPoints = plan->gridPoints;
+    int coarsePoints = plan->coarsePoints;
+    if (gridPoints < 2 || coarsePoints < 2 || coarsePoints > gridPoints || plan->pointBudget < coarsePoints)
+        return -1;
+
+    double spacing = (plan->stopFreq - plan->startFreq) / (gridPoints - 1);
+    double* gridAmp = malloc(sizeof(double) * gridPoints);
+    char* measured = calloc(gridPoints, 1);
+    double* sorted = malloc(sizeof(double) * coarsePoints);
+    Interval* heap = malloc(sizeof(Interval) * (plan->pointBudget + coarsePoints));
+    if (gridAmp == NULL || measured == NULL || sorted == NULL || heap == NULL) {
+        free(gridAmp);
+        free(measured);
+        free(sorted);
+        free(heap);
+        return -1;
+    }
+
+    /* Coarse pass over evenly spaced grid indices, always including both ends */
+    for (int i = 0; i < coarsePoints; i++) {
+        int index = (int)((long long)i * (gridPoints - 1) / (coarsePoints - 1));
+        gridAmp[index] = measure(context, round(plan->startFreq + index * spacing));
+        measured[index] = 1;
+        sorted[i] = gridAmp[index];
+    }
+    qsort(sorted, coarsePoints, sizeof(double), compareDouble);
+    double levelThreshold = sorted[coarsePoints / 2] + plan->levelMargin;
+
+    /* Queue every coarse interval that needs refining */
+    int heapSize = 0;
+    int previous = 0;
+    for (int index = 1; index < gridPoints; index++) {
+        if (!measured[index])
+            continue;
+        Interval item = { previous, index, scoreInterval(plan, gridAmp, previous, index, levelThreshold) };
+        if (item.score >= 0)
+            heapPush(heap, &heapSize, item);
+        previous = index;
+    }
+
+    /* Bisect the highest scoring interval until the budget is spent */
+    int used = coarsePoints;
+    while (heapSize > 0 && used < plan->pointBudget) {
+        Interval item = heapPop(heap, &heapSize);
+        int mid = (item.low + item.high) / 2;
+        gridAmp[mid] = measure(context, round(plan->startFreq + mid * spacing));
+        measured[mid] = 1;
+        used++;
+
+        Interval lower = { item.low, mid, scoreInterval(plan, gridAmp, item.low, mid, levelThreshold) };
+        Interval upper = { mid, item.high, scoreInterval(plan, gridAmp, mid, item.high, levelThreshold) };
+        if (lower.score >= 0)
+            heapPush(heap, &heapSize, lower);
+        if (upper.score >= 0)
+            heapPush(heap, &heapSize, upper);
+    }
+
+    /* Compact the measured grid points into the output in frequency order */
+    int count = 0;
+    for (int index = 0; index < gridPoints; index++) {
+        if (measured[index]) {
+            freq[count] = round(plan->startFreq + index * spacing);
+            amp[count] = gridAmp[index];
+            count++;
+        }
+    }
+
+    free(gridAmp);
+    free(measured);
+    free(sorted);
+    free(heap);
+    return count;
+}
@@ -0,0 +1,257 @@
+/*********************************************************************/
+/*                                                                   */
+/* Post-processing of captured traces. Every routine works on the    */
+/* freq[]/amp[] arrays produced by the capture functions and makes   */
+/* a fixed number of linear passes over them, so analysis cost stays */
+/* negligible next to the time spent reading the trace.              */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "trace-analysis.h"
+
+#define LOG2_10_OVER_10 0.33219280948873623     // log2(10) / 10, converts dB to a power of two
+#define DB_PER_LOG2 3.0102999566398120          // 10 * log10(2), converts log2 to dB
+
+/**
+ * @brief Converts a value in dB to linear power using a polynomial approximation of 2^x.
+ * Relative error is below 1e-5, which is far finer than any analyzer amplitude accuracy.
+ *
+ * @param db Value in dB.
+ * @return 10^(db/10).
+ */
+double fastDbToLinear(double db) {
+    double x = db * LOG2_10_OVER_10;
+    double whole = floor(x + 0.5);     // Keeps the polynomial argument within [-0.5, 0.5)
+    double f = x - whole;
+    double p = 1.0 + f * (0.69314718 + f * (0.24022651 + f * (0.05550411 + f * (0.00961813 + f * 0.00133336))));
+    return ldexp(p, (int)whole);
+}
+
+/**
+ * @brief Converts linear power to dB using frexp() and a short series for the mantissa logarithm.
+ *
+ * @param linear Linear power.
+ * @return 10*log10(linear), or ANALYSIS_DB_FLOOR if linear is not positive.
+ */
+double fastLinearToDb(double linear) {
+    if (linear <= 0)
+        return ANALYSIS_DB_FLOOR;
+
+    int exponent;
+    double m = frexp(linear, &exponent) * 2.0;  // m is in [1, 2)
+    double t = (m - 1.0) / (m + 1.0);
+    double t2 = t * t;
+    double ln = 2.0 * t * (1.0 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 * (1.0 / 9)))));
+    return ((exponent - 1) + ln * 1.4426950408889634) * DB_PER_LOG2;
+}
+
+/**
+ * @brief Returns the width of the frequency bin around freq[i], taken as half the distance between its neighbours.
+ * Works for both uniformly and non-uniformly spaced traces.
+ */
+static double binWidth(const double* freq, int numPoints, int i) {
+    if (numPoints < 2)
+        return 0;
+    if (i == 0)
+        return freq[1] - freq[0];
+    if (i == numPoints - 1)
+        return freq[i] - freq[i - 1];
+    return (freq[i + 1] - freq[i - 1]) / 2;
+}
+
+/**
+ * @brief Inserts a peak into a table kept sorted from highest to lowest amplitude, dropping the lowest when full.
+ */
+static void insertPeak(TracePeak* peaks, int* numPeaks, int maxPeaks, int index, const double* freq, const double* amp) {
+    int pos = *numPeaks;
+    if (pos == maxPeaks) {
+        if (amp[index] <= peaks[maxPeaks - 1].amp)
+            return;
+        pos--;
+    }
+    else {
+        (*numPeaks)++;
+    }
+    while (pos > 0 && peaks[pos - 1].amp < amp[index]) {
+        peaks[pos] = peaks[pos - 1];
+        pos--;
+    }
+    peaks[pos].index = index;
+    peaks[pos].freq = freq[index];
+    peaks[pos].amp = amp[index];
+}
+
+/**
+ * @brief Finds the highest peaks of a trace in a single pass.
+ * A point counts as a peak when the trace rises at least `excursion` dB into it and falls at least `excursion` dB after it,
+ * which rejects noise ripple without needing a second pass. A trace that is still rising at the last point reports that point.
+ *
+ * @param freq Frequency array of the trace.
+ * @param amp Amplitude array of the trace in dB.
+ * @param numPoints Number of points in the trace.
+ * @param maxPeaks Maximum number of peaks to return (at most ANALYSIS_MAX_PEAKS).
+ * @param excursion Minimum rise and fall in dB around a peak.
+ * @param peaks Output table, sorted from highest to lowest amplitude.
+ * @return Number of peaks written to peaks[].
+ */
+int traceFindPeaks(const double* freq, const double* amp, int numPoints, int maxPeaks, double excursion, TracePeak* peaks) {
+    int numPeaks = 0;
+    if (numPoints <= 0 || maxPeaks <= 0)
+        return 0;
+    if (maxPeaks > ANALYSIS_MAX_PEAKS)
+        maxPeaks = ANALYSIS_MAX_PEAKS;
+
+    int lookForMax = 1;
+    int maxIndex = 0;
+    double maxAmp = amp[0];
+    double minAmp = amp[0];
+    double valley = amp[0];     // Lowest point seen before the current rising edge
+
+    for (int i = 1; i < numPoints; i++) {
+        double a = amp[i];
+        if (a > maxAmp) {
+            maxAmp = a;
+            maxIndex = i;
+        }
+        if (a < minAmp)
+            minAmp = a;
+
+        if (lookForMax) {
+            if (a < maxAmp - excursion) {
+                if (maxAmp - valley >= excursion || maxIndex == 0)
+                    insertPeak(peaks, &numPeaks, maxPeaks, maxIndex, freq, amp);
+                minAmp = a;
+                lookForMax = 0;
+            }
+        }
+        else {
+            if (a > minAmp + excursion) {
+                valley = minAmp;
+                maxAmp = a;
+                maxIndex = i;
+                lookForMax = 1;
+            }
+        }
+    }
+    if (lookForMax && maxAmp - valley >= excursion)
+        insertPeak(peaks, &numPeaks, maxPeaks, maxIndex, freq, amp);
+
+    return numPeaks;
+}
+
+/**
+ * @brief Integrates the power of all trace points between two frequencies.
+ * Each point is weighted by its bin width over the resolution bandwidth so the result approximates channel power.
+ *
+ * @param freq Frequency array of the trace.
+ * @param amp Amplitude array of the trace in dB.
+ * @param numPoints Number of points in the trace.
+ * @param lowFreq Lower edge of the band.
+ * @param highFreq Upper edge of the band.
+ * @param resBW Resolution bandwidth of the capture. Pass 0 to sum point powers without bandwidth correction.
+ * @return Band power in dB, or ANALYSIS_DB_FLOOR if no points fall within the band.
+ */
+double traceBandPower(const double* freq, const double* amp, int numPoints, double lowFreq, double highFreq, double resBW) {
+    double sum = 0;
+    for (int i = 0; i < numPoints; i++) {
+        if (freq[i] < lowFreq || freq[i] > highFreq)
+            continue;
+        double weight = resBW > 0 ? binWidth(freq, numPoints, i) / resBW : 1.0;
+        sum += fastDbToLinear(amp[i]) * weight;
+    }
+    return fastLinearToDb(sum);
+}
+
+/**
+ * @brief Finds the band containing `percent` of the total trace power, centred on the power distribution.
+ *
+ * @param freq Frequency array of the trace.
+ * @param amp Amplitude array of the trace in dB.
+ * @param numPoints Number of points in the trace.
+ * @param percent Percentage of the total power the band must contain.
+ * @param lowFreq Output lower edge of the band.
+ * @param highFreq Output upper edge of the band.
+ * @return 0 on success, 1 if the trace is empty or carries no power.
+ */
+int traceOccupiedBandwidth(const double* freq, const double* amp, int numPoints, double percent, double* lowFreq, double* highFreq) {
+    if (numPoints <= 0)
+        return 1;
+
+    double* linear = malloc(sizeof(double) * numPoints);
+    if (linear == NULL)
+        return 1;
+
+    double total = 0;
+    for (int i = 0; i < numPoints; i++) {
+        linear[i] = fastDbToLinear(amp[i]) * binWidth(freq, numPoints, i);
+        total += linear[i];
+    }
+    if (total <= 0) {
+        free(linear);
+        return 1;
+    }
+
+    double lowLimit = total * (1 - percent / 100) / 2;
+    double highLimit = total - lowLimit;
+    double cumulative = 0;
+    int lowIndex = 0, highIndex = numPoints - 1;
+    int lowFound = 0;
+    for (int i = 0; i < numPoints; i++) {
+        cumulative += linear[i];
+        if (!lowFound && cumulative >= lowLimit) {
+            lowIndex = i;
+            lowFound = 1;
+        }
+        if (cumulative >= highLimit) {
+            highIndex = i;
+            break;
+        }
+    }
+    free(linear);
+
+    *lowFreq = freq[lowIndex];
+    *highFreq = freq[highIndex];
+    return 0;
+}
+
+/**
+ * @brief Runs the standard post-capture analysis: top peaks, full-span band power and occupied bandwidth.
+ *
+ * @param freq Frequency array of the trace.
+ * @param amp Amplitude array of the trace in dB.
+ * @param numPoints Number of points in the trace.
+ * @param resBW Resolution bandwidth of the capture, used for band power correction.
+ * @param result Output analysis results.
+ * @return 0 on success, 1 if the trace is empty.
+ */
+int analyzeTrace(const double* freq, const double* amp, int numPoints, double resBW, TraceAnalysis* result) {
+    if (numPoints <= 0)
+        return 1;
+
+    result->numPeaks = traceFindPeaks(freq, amp, numPoints, ANALYSIS_PEAKS, ANALYSIS_PEAK_EXCURSION, result->peaks);
+    result->bandPower = traceBandPower(freq, amp, numPoints, freq[0], freq[numPoints - 1], resBW);
+    if (traceOccupiedBandwidth(freq, amp, numPoints, ANALYSIS_OBW_PERCENT, &result->obwLow, &result->obwHigh) == 0) {
+        result->obw = result->obwHigh - result->obwLow;
+    }
+    else {
+        result->obwLow = result->obwHigh = result->obw = 0;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prints analysis results, one item per line.
+ *
+ * @param stream Stream to print to (stdout or a trace file).
+ * @param result Analysis results from analyzeTrace().
+ * @param prefix String printed at the start of each line, e.g. "# " to match the trace file header.
+ */
+void fprintTraceAnalysis(FILE* stream, const TraceAnalysis* result, const char* prefix) {
+    for (int i = 0; i < result->numPeaks; i++) {
+        fprintf(stream, "%sPeak %d: %e, %f\n", prefix, i + 1, result->peaks[i].freq, result->peaks[i].amp);
+    }
+    fprintf(stream, "%sBand power: %f\n", prefix, result->bandPower);
+    fprintf(stream, "%sOccupied bandwidth (%.1f%%): %e (%e to %e)\n", prefix, ANALYSIS_OBW_PERCENT, result->obw, result->obwLow, result->obwHigh);
+}
@@ -0,0 +1,207 @@
+/*********************************************************************/
+/*                                                                   */
+/* Reduces captured traces to a small number of columns so they can  */
+/* be viewed in the terminal. Both decimation methods make a single  */
+/* streaming pass over the trace and never copy it.                  */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdlib.h>
+#include <math.h>
+#include "trace-decimate.h"
+
+/**
+ * @brief Reduces a trace to `width` columns, keeping the minimum and maximum amplitude that falls in each column.
+ * Narrow peaks survive decimation because every point contributes to exactly one column's envelope.
+ *
+ * @param amp Amplitude array of the trace.
+ * @param numPoints Number of points in the trace.
+ * @param width Number of output columns.
+ * @param outMin Output array of `width` column minimums.
+ * @param outMax Output array of `width` column maximums.
+ * @return Number of columns written, which is less than width if the trace has fewer points than columns.
+ */
+int decimateMinMax(const double* amp, int numPoints, int width, double* outMin, double* outMax) {
+    if (numPoints <= 0 || width <= 0)
+        return 0;
+    if (width > numPoints)
+        width = numPoints;
+
+    int column = -1;
+    for (int i = 0; i < numPoints; i++) {
+        int c = (int)((long long)i * width / numPoints);
+        if (c != column) {
+            column = c;
+            outMin[c] = amp[i];
+            outMax[c] = amp[i];
+        }
+        else if (amp[i] < outMin[c]) {
+            outMin[c] = amp[i];
+        }
+        else if (amp[i] > outMax[c]) {
+            outMax[c] = amp[i];
+        }
+    }
+    return width;
+}
+
+/**
+ * @brief Reduces a trace to `width` points with the Largest-Triangle-Three-Buckets algorithm.
+ * The first and last points are always kept. In between, each bucket keeps the point forming the largest triangle
+ * with the previously kept point and the average of the next bucket, which preserves the visual shape of the trace.
+ *
+ * @param freq Frequency array of the trace.
+ * @param amp Amplitude array of the trace.
+ * @param numPoints Number of points in the trace.
+ * @param width Number of output points (at least 3).
+ * @param outFreq Output frequency array of `width` points.
+ * @param outAmp Output amplitude array of `width` points.
+ * @return Number of points written.
+ */
+int decimateLttb(const double* freq, const double* amp, int numPoints, int width, double* outFreq, double* outAmp) {
+    if (numPoints <= 0 || width <= 0)
+        return 0;
+    if (width >= numPoints || width < 3) {
+        int count = width < numPoints ? width : numPoints;
+        for (int i = 0; i < count; i++) {
+            int src = (int)((long long)i * numPoints / count);
+            outFreq[i] = freq[src];
+            outAmp[i] = amp[src];
+        }
+        return count;
+    }
+
+    double every = (double)(numPoints - 2) / (width - 2);
+    int a = 0;
+    int count = 0;
+    outFreq[count] = freq[0];
+    outAmp[count++] = amp[0];
+
+    for (int i = 0; i < width - 2; i++) {
+        /* Average of the next bucket, the third vertex of the triangle */
+        int avgStart = (int)floor((i + 1) * every) + 1;
+        int avgEnd = (int)floor((i + 2) * every) + 1;
+        if (avgEnd > numPoints)
+            avgEnd = numPoints;
+        double avgFreq = 0, avgAmp = 0;
+        for (int j = avgStart; j < avgEnd; j++) {
+            avgFreq += freq[j];
+            avgAmp += amp[j];
+        }
+        avgFreq /= (avgEnd - avgStart);
+        avgAmp /= (avgEnd - avgStart);
+
+        /* Pick the point of the current bucket with the largest triangle area */
+        int rangeStart = (int)floor(i * every) + 1;
+        int rangeEnd = (int)floor((i + 1) * every) + 1;
+        double maxArea = -1;
+        int next = rangeStart;
+        for (int j = rangeStart; j < rangeEnd; j++) {
+            double area = fabs((freq[a] - avgFreq) * (amp[j] - amp[a]) - (freq[a] - freq[j]) * (avgAmp - amp[a]));
+            if (area > maxArea) {
+                maxArea = area;
+                next = j;
+            }
+        }
+        outFreq[count] = freq[next];
+        outAmp[count++] = amp[next];
+        a = next;
+    }
+
+    outFreq[count] = freq[numPoints - 1];
+    outAmp[count++] = amp[numPoints - 1];
+    return count;
+}
+
+/**
+ * @brief Prints a min/max envelope as a block plot, one character per column, with the amplitude scale on the left.
+ *
+ * @param stream Stream to print to.
+ * @param minEnv Column minimums.
+ * @param maxEnv Column maximums.
+ * @param width Number of columns.
+ * @param rows Number of text rows to use for the amplitude axis.
+ */
+void fprintSparkline(FILE* stream, const double* minEnv, const double* maxEnv, int width, int rows) {
+    if (width <= 0 || rows <= 0)
+        return;
+
+    double low = minEnv[0], high = maxEnv[0];
+    for (int c = 1; c < width; c++) {
+        if (minEnv[c] < low)
+            low = minEnv[c];
+        if (maxEnv[c] > high)
+            high = maxEnv[c];
+    }
+    double step = (high - low) / rows;
+    if (step <= 0)
+        step = 1;
+
+    char* line = malloc(width + 1);
+    if (line == NULL)
+        return;
+    line[width] = '\0';
+
+    for (int r = 0; r < rows; r++) {
+        double top = high - r * step;
+        double bottom = top - step;
+        for (int c = 0; c < width; c++) {
+            line[c] = (maxEnv[c] >= bottom && minEnv[c] <= top) ? '#' : ' ';
+        }
+        fprintf(stream, "%9.2f |%s\n", top, line);
+    }
+    fprintf(stream, "%9.2f +", low);
+    for (int c = 0; c < width; c++)
+        fputc('-', stream);
+    fputc('\n', stream);
+    free(line);
+}
+
+/**
+ * @brief Decimates a trace and prints it as a compact terminal plot with the frequency range underneath.
+ *
+ * @param stream Stream to print to.
+ * @param freq Frequency array of the trace.
+ * @param amp Amplitude array of the trace.
+ * @param numPoints Number of points in the trace.
+ * @param width Number of columns to decimate to.
+ * @param rows Number of text rows in the plot.
+ * @param mode DECIMATE_MINMAX or DECIMATE_LTTB.
+ * @return 0 on success, 1 on error.
+ */
+int fprintTraceSparkline(FILE* stream, const double* freq, const double* amp, int numPoints, int width, int rows, int mode) {
+    if (numPoints <= 0 || width <= 0)
+        return 1;
+
+    double* minEnv = malloc(sizeof(double) * width);
+    double* maxEnv = malloc(sizeof(double) * width);
+    if (minEnv == NULL || maxEnv == NULL) {
+        free(minEnv);
+        free(maxEnv);
+        return 1;
+    }
+
+    int columns;
+    if (mode == DECIMATE_LTTB) {
+        double* colFreq = malloc(sizeof(double) * width);
+        if (colFreq == NULL) {
+            free(minEnv);
+            free(maxEnv);
+            return 1;
+        }
+        columns = decimateLttb(freq, amp, numPoints, width, colFreq, minEnv);
+        for (int c = 0; c < columns; c++)
+            maxEnv[c] = minEnv[c];
+        free(colFreq);
+    }
+    else {
+        columns = decimateMinMax(amp, numPoints, width, minEnv, maxEnv);
+    }
+
+    fprintSparkline(stream, minEnv, maxEnv, columns, rows);
+    fprintf(stream, "%11s%-*e%e\n", "", columns > 13 ? columns - 12 : 1, freq[0], freq[numPoints - 1]);
+
+    free(minEnv);
+    free(maxEnv);
+    return 0;
+}
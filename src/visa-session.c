@@ -0,0 +1,1553 @@
+/*********************************************************************/
+/*                                                                   */
+/* Session objects for driving an instrument without global state.   */
+/*                                                                   */
+/* Every VisaSession owns its VISA handle and a lock. Each call      */
+/* takes the lock for its whole exchange, so a query's write and     */
+/* read are never interleaved with another thread's traffic. Hold    */
+/* sessionLock() around several calls to make them one transaction;  */
+/* the lock is recursive. Responses are read into buffers supplied   */
+/* by the caller, so nothing is shared between sessions.             */
+/*                                                                   */
+/* Functions report VISA status codes and print nothing; messages    */
+/* for the user are left to the caller. Every message written and   */
+/* read is passed to the asynchronous logger (logger.h) at the debug */
+/* level, which costs one comparison while debug logging is off.     */
+/*                                                                   */
+/* Sessions to instruments on one GPIB board or serial port share   */
+/* the bus, found with viParseRsrcEx(). Every write and read on the  */
+/* bus waits its turn in a first come, first served ticket queue;    */
+/* LAN, USB and other resources are not arbitrated and run in        */
+/* parallel. Sessions may be opened from several threads at once.   */
+/*                                                                   */
+/* With adaptive timeouts enabled, each query waits for its response */
+/* only as long as its own recent latencies justify: the p99 of the  */
+/* last SESSION_LATENCY_SAMPLES exchanges with the same header,      */
+/* times SESSION_ADAPTIVE_MARGIN, capped at the session timeout.     */
+/* Queries that wait for a sweep get the sweep time on top, read     */
+/* with :SWEep:TIME? before the first of them and again after a      */
+/* sweep, bandwidth or frequency setting was written, so a dead      */
+/* instrument is noticed in milliseconds while long sweeps still     */
+/* complete. A query that misses its limit while the instrument      */
+/* still answers a serial poll reads on until the session timeout;   */
+/* one that times out clears the instrument with viClear(), so its   */
+/* late response cannot be read as the response to the next query.   */
+/*                                                                   */
+/* A write or read that fails because the connection is gone marks  */
+/* the session unhealthy, and later calls fail at once with          */
+/* VI_ERROR_CONN_LOST instead of waiting out timeouts, until         */
+/* sessionReopen() connects again. health.c probes and reopens       */
+/* sessions in the background.                                       */
+/*                                                                   */
+/* In checked mode every write and query carries ";:SYST:ERR?" in   */
+/* the same message, so the instrument's verdict on the commands     */
+/* comes back in the same round trip as any response and a SCPI      */
+/* error fails the call with SESSION_ERROR_SCPI. sessionDrainErrors()*/
+/* empties the error queue in batches, e.g. after a sequence.        */
+/*                                                                   */
+/* With a validator (scpi-validate.h) attached, a strict one rejects */
+/* a message with an unknown header before it is sent, failing the   */
+/* call with SESSION_ERROR_HEADER at once instead of after a         */
+/* timeout; a learning one is taught the headers the instrument      */
+/* accepted. Exchanges the library makes on its own, such as marker  */
+/* setup, snapshot apply and capability probes, are bracketed by     */
+/* sessionBeginInternal() and neither checked nor learned, so a      */
+/* command list need only hold what the user sends. A query without  */
+/* '?' in any header is written without waiting for a response, and  */
+/* sessionRead() fails at once with SESSION_ERROR_NO_QUERY when no   */
+/* query awaits its response.                                        */
+/*                                                                   */
+/* A capability profile (capability.h) set on the session tells the  */
+/* captures what the model supports: sessionCaptureTrace() reads a   */
+/* whole trace as one REAL,32 block where the model can, the marker  */
+/* count is taken from the profile instead of being probed, and the  */
+/* markers read per round trip are limited to the batch length the   */
+/* model accepts.                                                    */
+/*                                                                   */
+/* The asynchronous calls submit jobs with viWriteAsync() and        */
+/* viReadAsync() and collect their I/O completion events. They are   */
+/* used by the event loop in sequence.c; a session driven that way   */
+/* should not be used from other threads at the same time. Sessions  */
+/* on a shared bus stay synchronous, so their I/O is arbitrated.     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include "platform.h"
+#include "journal.h"
+#include "logger.h"
+#include "scpi-parse.h"
+#include "scpi-template.h"
+#include "snapshot.h"
+#include "capability.h"
+#include "tcp-socket.h"
+#include "visa-session.h"
+
+#define ERROR_QUERY ":SYST:ERR?"
+#define CHECK_SUFFIX ";" ERROR_QUERY    // Appended to commands in checked mode
+#define SWEEP_TIME_QUERY ":SWE:TIME?"   // Read before a query that waits for a sweep with adaptive timeouts
+
+/* Recent latencies of the queries sharing one header */
+typedef struct {
+    char header[SESSION_HEADER_BYTES];              // Query up to its parameters, in upper case
+    unsigned int samples[SESSION_LATENCY_SAMPLES];  // Ring of latencies in microseconds
+    int count;                                      // Samples recorded, up to SESSION_LATENCY_SAMPLES
+    int next;                                       // Slot of the next sample
+} LatencyClass;
+
+/* Ticket queue of one shared bus. Entries live until the program exits */
+typedef struct {
+    ViUInt16 intfType;
+    ViUInt16 intfNum;
+    PlatformMutex mutex;
+    PlatformCond turn;                  // Broadcast when nowServing advances
+    unsigned long nextTicket;           // Ticket handed to the next transfer
+    unsigned long nowServing;           // Ticket allowed on the bus
+} BusArbiter;
+
+static BusArbiter arbiters[SESSION_MAX_BUSES];
+static int numArbiters;
+static PlatformMutex arbitersMutex;     // Guards arbiters and numArbiters while sessions are opened
+static PlatformAtomic openState;        // 0 before the first sessionOpen(), 1 while it initializes, 2 after
+
+/* Marker commands sent per trace point, compiled by the first sessionOpen() */
+static ScpiTemplate markerXTemplate;
+static ScpiTemplate markerYTemplate;
+
+struct VisaSession {
+    ViSession handle;                   // VISA session to the instrument, VI_NULL after a failed reopen
+    ViSession resourceManager;          // Resource manager the session was opened with, for sessionReopen()
+    char resource[VI_FIND_BUFLEN];      // Resource descriptor the session was opened with
+    ViUInt32 timeout;                   // Timeout set with sessionSetTimeout() in milliseconds
+    ViUInt32 appliedTimeout;            // Current VI_ATTR_TMO_VALUE, below timeout while an adaptive query reads
+    int adaptiveTimeout;                // Queries wait according to their observed latencies
+    double sweepTime;                   // Last :SWEep:TIME? response in seconds, 0 if unknown, -1 if not supported
+    LatencyClass latency[SESSION_LATENCY_CLASSES];
+    int numLatency;                     // Classes used; the oldest is replaced when all are
+    int asyncEnabled;                   // I/O completion events are queued for asynchronous jobs
+    int asyncJobs;                      // Asynchronous jobs submitted and not yet collected; probes wait for them
+    ViJobId asyncWriteJob;              // Job of the last asynchronous write
+    const char* asyncCommand;           // Command of that write until it completes, NULL once it has
+    ViUInt16 intfType;                  // Interface from viParseRsrcEx(), 0 if unknown
+    ViUInt16 intfNum;                   // Board number of the interface
+    BusArbiter* bus;                    // Queue of the shared bus, or NULL if I/O is not arbitrated
+    int healthy;                        // Cleared when the connection is lost, set again by sessionReopen()
+    int probeTimeouts;                  // Probes in a row that timed out, e.g. during a long sweep
+    int keepAlive;                      // VI_ATTR_TCPIP_KEEPALIVE was enabled with sessionEnableKeepAlive()
+    unsigned long long lastActivity;    // monotonicMicros() of the last successful exchange
+    int responsePending;                // A query was written and its response not read; probes would discard it
+    int checked;                        // Writes and queries ask for the error queue in the same message
+    ScpiError lastError;                // Last SCPI error reported in checked mode or drained, code 0 if none
+    StateSnapshot* snapshot;            // Cached settings, created by sessionSnapshot(); NULL until then
+    ScpiValidator* validator;           // Command tree headers are checked against, NULL if none; not owned
+    int internal;                       // Nesting of sessionBeginInternal(); the validator ignores these exchanges
+    const CapabilityProfile* profile;   // Capabilities of the instrument's model, NULL if unknown; not owned
+    int numMarkers;                     // Markers found by the first marker capture, 0 if not counted yet
+    PlatformMutex mutex;                // Serializes every exchange on the session
+};
+
+/* Initializes what all sessions share exactly once; threads opening sessions meanwhile wait until it is done */
+static void initShared(void) {
+    if (atomicLoad(&openState) == 2)
+        return;
+    if (atomicCompareExchange(&openState, 0, 1)) {
+        mutexInit(&arbitersMutex);
+        templateCompile(&markerXTemplate, ":CALC:MARK%d:X %f");
+        templateCompile(&markerYTemplate, "%s:CALC:MARK%d:Y?");
+        atomicStore(&openState, 2);
+        return;
+    }
+    while (atomicLoad(&openState) != 2)
+        threadYield();
+}
+
+/* Returns the arbiter of a shared bus, creating it on first use, or NULL for interfaces that need no arbitration */
+static BusArbiter* findArbiter(ViUInt16 intfType, ViUInt16 intfNum) {
+    BusArbiter* bus = NULL;
+    if (intfType != VI_INTF_GPIB && intfType != VI_INTF_GPIB_VXI && intfType != VI_INTF_ASRL)
+        return NULL;
+    mutexLock(&arbitersMutex);
+    for (int i = 0; i < numArbiters; i++) {
+        if (arbiters[i].intfType == intfType && arbiters[i].intfNum == intfNum) {
+            bus = &arbiters[i];
+            goto done;
+        }
+    }
+    if (numArbiters == SESSION_MAX_BUSES)
+        goto done;
+    bus = &arbiters[numArbiters++];
+    bus->intfType = intfType;
+    bus->intfNum = intfNum;
+    mutexInit(&bus->mutex);
+    condInit(&bus->turn);
+    bus->nextTicket = bus->nowServing = 0;
+done:
+    mutexUnlock(&arbitersMutex);
+    return bus;
+}
+
+/* Waits for the session's turn on its bus. Transfers are granted in the order they asked */
+static void busAcquire(VisaSession* session) {
+    BusArbiter* bus = session->bus;
+    if (bus == NULL)
+        return;
+    mutexLock(&bus->mutex);
+    unsigned long ticket = bus->nextTicket++;
+    while (bus->nowServing != ticket)
+        condWait(&bus->turn, &bus->mutex);
+    mutexUnlock(&bus->mutex);
+}
+
+static void busRelease(VisaSession* session) {
+    BusArbiter* bus = session->bus;
+    if (bus == NULL)
+        return;
+    mutexLock(&bus->mutex);
+    bus->nowServing++;
+    condBroadcast(&bus->turn);
+    mutexUnlock(&bus->mutex);
+}
+
+/**
+ * @brief Opens a session to a resource and sets its timeout.
+ *
+ * @param resourceManager Session to the default resource manager.
+ * @param resource Resource descriptor, e.g. from viFindRsrc().
+ * @param timeoutMs VISA timeout in milliseconds.
+ * @param status Output status of the open. May be NULL.
+ * @return The session, or NULL if it could not be opened.
+ */
+VisaSession* sessionOpen(ViSession resourceManager, const char* resource, ViUInt32 timeoutMs, ViStatus* status) {
+    ViSession handle;
+    initShared();
+    ViStatus openStatus = journalViOpen(resourceManager, resource, &handle);
+    if (status != NULL)
+        *status = openStatus;
+    if (openStatus < VI_SUCCESS)
+        return NULL;
+
+    VisaSession* session = malloc(sizeof(VisaSession));
+    if (session == NULL) {
+        viClose(handle);
+        if (status != NULL)
+            *status = VI_ERROR_ALLOC;
+        return NULL;
+    }
+    session->handle = handle;
+    session->resourceManager = resourceManager;
+    strncpy(session->resource, resource, VI_FIND_BUFLEN - 1);
+    session->resource[VI_FIND_BUFLEN - 1] = '\0';
+    session->asyncEnabled = 0;
+    session->asyncJobs = 0;
+    session->asyncCommand = NULL;
+    session->timeout = session->appliedTimeout = 0;
+    session->adaptiveTimeout = 0;
+    session->sweepTime = 0;
+    session->numLatency = 0;
+    session->intfType = session->intfNum = 0;
+    session->bus = NULL;
+    session->healthy = 1;
+    session->probeTimeouts = 0;
+    session->keepAlive = 0;
+    session->responsePending = 0;
+    session->checked = 0;
+    session->lastError.code = 0;
+    session->lastError.message[0] = '\0';
+    session->snapshot = NULL;
+    session->validator = NULL;
+    session->internal = 0;
+    session->profile = NULL;
+    session->numMarkers = 0;
+    session->lastActivity = monotonicMicros();
+    if (!journalIsReplaying()
+        && viParseRsrcEx(resourceManager, resource, &session->intfType, &session->intfNum, VI_NULL, VI_NULL, VI_NULL) >= VI_SUCCESS)
+        session->bus = findArbiter(session->intfType, session->intfNum);
+    mutexInit(&session->mutex);
+    sessionSetTimeout(session, timeoutMs);
+    LOG_TEXT(LOG_INFO, "session.open", session->resource, NULL, 0);
+    return session;
+}
+
+/**
+ * @brief Closes the VISA session and frees the session object.
+ */
+void sessionClose(VisaSession* session) {
+    if (session == NULL)
+        return;
+    if (!journalIsReplaying() && session->handle != VI_NULL) {
+        if (session->asyncEnabled)
+            viDisableEvent(session->handle, VI_EVENT_IO_COMPLETION, VI_QUEUE);
+        viClose(session->handle);
+    }
+    mutexDestroy(&session->mutex);
+    free(session->snapshot);
+    free(session);
+}
+
+/**
+ * @brief Returns the resource descriptor the session was opened with.
+ */
+const char* sessionResource(const VisaSession* session) {
+    return session->resource;
+}
+
+/**
+ * @brief Returns the underlying VISA session, for VISA calls not wrapped here.
+ */
+ViSession sessionHandle(const VisaSession* session) {
+    return session->handle;
+}
+
+/**
+ * @brief Names the shared bus the session's instrument is on, e.g. for schedulerSubmit(). Instruments on one GPIB
+ * board ("GPIB0", "GPIB-VXI0") or serial port ("ASRL1") share a bus; LAN, USB and unparsed resources do not.
+ *
+ * @param bus Output bus name, or "" if the instrument does not share a bus.
+ * @return 1 if the instrument is on a shared bus, 0 otherwise.
+ */
+int sessionSharedBus(const VisaSession* session, char* bus, size_t size) {
+    const char* type = session->intfType == VI_INTF_GPIB ? "GPIB"
+        : session->intfType == VI_INTF_GPIB_VXI ? "GPIB-VXI"
+        : session->intfType == VI_INTF_ASRL ? "ASRL" : NULL;
+    if (type == NULL || session->bus == NULL) {
+        bus[0] = '\0';
+        return 0;
+    }
+    snprintf(bus, size, "%s%u", type, (unsigned int)session->intfNum);
+    return 1;
+}
+
+/**
+ * @brief Takes the session lock so several calls run as one transaction. Calls made while holding it do not block.
+ */
+void sessionLock(VisaSession* session) {
+    mutexLock(&session->mutex);
+}
+
+/**
+ * @brief Releases a lock taken with sessionLock().
+ */
+void sessionUnlock(VisaSession* session) {
+    mutexUnlock(&session->mutex);
+}
+
+/**
+ * @brief Takes the session lock, like sessionLock(), for exchanges the library makes on its own rather than commands
+ * the user sent, e.g. a capability probe. The validator neither checks nor learns them until
+ * sessionEndInternal(). Calls nest.
+ */
+void sessionBeginInternal(VisaSession* session) {
+    mutexLock(&session->mutex);
+    session->internal++;
+}
+
+/**
+ * @brief Ends the internal exchanges begun with sessionBeginInternal() and releases the lock.
+ */
+void sessionEndInternal(VisaSession* session) {
+    session->internal--;
+    mutexUnlock(&session->mutex);
+}
+
+/**
+ * @brief Sets the VISA timeout of the session.
+ * @return Status of viSetAttribute(), or VI_SUCCESS when replaying a journal.
+ */
+ViStatus sessionSetTimeout(VisaSession* session, ViUInt32 timeoutMs) {
+    ViStatus status = VI_SUCCESS;
+    mutexLock(&session->mutex);
+    if (!journalIsReplaying())
+        status = viSetAttribute(session->handle, VI_ATTR_TMO_VALUE, timeoutMs);
+    if (status >= VI_SUCCESS)
+        session->timeout = session->appliedTimeout = timeoutMs;
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Returns the VISA timeout of the session in milliseconds. With adaptive timeouts this is the longest a query
+ * may wait.
+ */
+ViUInt32 sessionTimeout(VisaSession* session) {
+    return session->timeout;
+}
+
+/**
+ * @brief Turns adaptive query timeouts on or off. Latencies are recorded either way, so enabling them later takes
+ * effect immediately.
+ */
+void sessionSetAdaptiveTimeout(VisaSession* session, int enabled) {
+    mutexLock(&session->mutex);
+    session->adaptiveTimeout = enabled;
+    mutexUnlock(&session->mutex);
+}
+
+/**
+ * @brief Returns 1 if adaptive query timeouts are enabled, 0 otherwise.
+ */
+int sessionAdaptiveTimeout(VisaSession* session) {
+    return session->adaptiveTimeout;
+}
+
+/* Sets VI_ATTR_TMO_VALUE if it differs from the value in effect */
+static void applyTimeout(VisaSession* session, ViUInt32 timeoutMs) {
+    if (session->appliedTimeout == timeoutMs || journalIsReplaying())
+        return;
+    if (viSetAttribute(session->handle, VI_ATTR_TMO_VALUE, timeoutMs) >= VI_SUCCESS)
+        session->appliedTimeout = timeoutMs;
+}
+
+/* Returns the latency class of a query, creating it if create is set, or NULL */
+static LatencyClass* findLatencyClass(VisaSession* session, const char* query, int create) {
+    char header[SESSION_HEADER_BYTES];
+    size_t length = 0;
+    while (query[length] != '\0' && query[length] != ' ' && query[length] != '\t' && length < sizeof(header) - 1) {
+        header[length] = (char)toupper((unsigned char)query[length]);
+        length++;
+    }
+    header[length] = '\0';
+
+    int used = session->numLatency < SESSION_LATENCY_CLASSES ? session->numLatency : SESSION_LATENCY_CLASSES;
+    for (int i = 0; i < used; i++) {
+        if (strcmp(session->latency[i].header, header) == 0)
+            return &session->latency[i];
+    }
+    if (!create)
+        return NULL;
+    LatencyClass* latency = &session->latency[session->numLatency++ % SESSION_LATENCY_CLASSES];
+    strcpy(latency->header, header);
+    latency->count = latency->next = 0;
+    return latency;
+}
+
+static int compareUnsigned(const void* a, const void* b) {
+    unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+/* Tests whether the last command of a query waits for a sweep to finish */
+static int waitsForSweep(const char* query) {
+    const char* last = strrchr(query, ';');
+    last = last != NULL ? last + 1 : query;
+    size_t length = strlen(last);
+    return scpiMatchHeader(last, length, "*OPC?", NULL) || scpiMatchHeader(last, length, ":INITiate[:IMMediate]?", NULL)
+        || scpiMatchHeader(last, length, ":TRACe[:DATA]?", NULL);
+}
+
+/* Last mnemonics of the settings that change the sweep time, e.g. [:SENSe]:BANDwidth[:RESolution]. A few unrelated
+   settings end the same way and only cost reading the sweep time again */
+static const char* const sweepMnemonics[] = {
+    "TIME", "POINts", "RESolution", "BANDwidth", "BWIDth", "VIDeo", "SPAN", "STARt", "STOP", "AUTO", "*RST", "*RCL",
+    "PRESet"
+};
+
+/* Tests whether a message writes a setting that changes the sweep time */
+static int changesSweepTime(const char* message, size_t length) {
+    size_t unitLength;
+    for (size_t unit = 0; unit < length; unit += unitLength + 1) {
+        const char* command = message + unit;
+        unitLength = scpiUnitLength(command, length - unit);
+        size_t n = unitLength;
+        while (n > 0 && isspace((unsigned char)*command)) {
+            command++;
+            n--;
+        }
+        int query;
+        size_t mnemonicLength;
+        const char* mnemonic = scpiLastMnemonic(command, n, &mnemonicLength, &query);
+        for (size_t i = 0; !query && i < sizeof(sweepMnemonics) / sizeof(sweepMnemonics[0]); i++) {
+            if (scpiMatchHeader(mnemonic, mnemonicLength, sweepMnemonics[i], NULL))
+                return 1;
+        }
+    }
+    return 0;
+}
+
+/* Timeout for reading the response to a query */
+static ViUInt32 queryTimeout(VisaSession* session, const char* query) {
+    if (!session->adaptiveTimeout)
+        return session->timeout;
+
+    ViUInt32 timeout = session->timeout;
+    LatencyClass* latency = findLatencyClass(session, query, 0);
+    if (latency != NULL && latency->count >= SESSION_ADAPTIVE_MIN_SAMPLES) {
+        unsigned int sorted[SESSION_LATENCY_SAMPLES];
+        memcpy(sorted, latency->samples, sizeof(unsigned int) * latency->count);
+        qsort(sorted, latency->count, sizeof(unsigned int), compareUnsigned);
+        double p99 = sorted[(latency->count * 99 + 99) / 100 - 1] / 1000.0;
+        double adaptive = ceil(p99 * SESSION_ADAPTIVE_MARGIN);
+        if (adaptive < SESSION_ADAPTIVE_MIN_MS)
+            adaptive = SESSION_ADAPTIVE_MIN_MS;
+        if (adaptive < timeout)
+            timeout = (ViUInt32)adaptive;
+    }
+    if (session->sweepTime > 0 && waitsForSweep(query))
+        timeout += (ViUInt32)ceil(session->sweepTime * 1000 * SESSION_SWEEP_MARGIN);
+    return timeout;
+}
+
+static void recordLatency(VisaSession* session, const char* query, unsigned long long micros) {
+    LatencyClass* latency = findLatencyClass(session, query, 1);
+    latency->samples[latency->next] = micros > 0xFFFFFFFFULL ? 0xFFFFFFFFU : (unsigned int)micros;
+    latency->next = (latency->next + 1) % SESSION_LATENCY_SAMPLES;
+    if (latency->count < SESSION_LATENCY_SAMPLES)
+        latency->count++;
+}
+
+/* Tests whether an instrument whose response is late still answers a serial poll, which GPIB, VXI-11, HiSLIP and
+   USBTMC carry outside the message stream, so it is busy rather than hung. A raw socket has no such channel, so its
+   instrument counts as busy. The caller holds the session mutex */
+static int instrumentBusy(VisaSession* session) {
+    char host[VI_FIND_BUFLEN];
+    int port;
+    ViUInt16 statusByte;
+    if (journalIsReplaying() || tcpParseResource(session->resource, host, sizeof(host), &port) == 0)
+        return 1;
+    busAcquire(session);
+    ViStatus status = viReadSTB(session->handle, &statusByte);
+    busRelease(session);
+    return status >= VI_SUCCESS;
+}
+
+/* Clears the instrument's input and output buffers after a query timed out, so a response arriving late is not read
+   as the response to the next query; the caller holds the session mutex */
+static void discardResponse(VisaSession* session) {
+    if (session->healthy && !journalIsReplaying()) {
+        busAcquire(session);
+        viClear(session->handle);
+        busRelease(session);
+    }
+    session->responsePending = 0;
+}
+
+/* Tracks the connection state from the status of an exchange */
+static ViStatus noteStatus(VisaSession* session, ViStatus status) {
+    if (status == VI_ERROR_CONN_LOST || status == VI_ERROR_IO || status == VI_ERROR_INV_OBJECT)
+        session->healthy = 0;
+    else if (status >= VI_SUCCESS) {
+        session->lastActivity = monotonicMicros();
+        session->probeTimeouts = 0;
+    }
+    return status;
+}
+
+/* Writes a message as it is; the caller holds the session mutex */
+static ViStatus writeMessage(VisaSession* session, const char* message) {
+    ViUInt32 writeCount;
+    if (!session->healthy)
+        return VI_ERROR_CONN_LOST;
+    busAcquire(session);
+    size_t length = strlen(message);
+    ViStatus status = journalViWrite(session->handle, (ViConstBuf)message, (ViUInt32)length, &writeCount);
+    busRelease(session);
+    noteStatus(session, status);
+    if (session->snapshot != NULL)
+        snapshotNote(session->snapshot, message, length, status < VI_SUCCESS);
+    if (session->sweepTime > 0 && changesSweepTime(message, length))
+        session->sweepTime = 0;
+    LOG_TEXT(LOG_DEBUG, "visa.write", session->resource, message, length);
+    if (status < VI_SUCCESS && LOG_ENABLED(LOG_WARN))
+        logPrintf(LOG_WARN, "visa.write.failed", session->resource, "status=%X", (unsigned int)status);
+    session->responsePending = status >= VI_SUCCESS && scpiIsQuery(message, length);
+    return status;
+}
+
+/* Reads a response with the given timeout and null-terminates it; the caller holds the session mutex */
+static ViStatus readMessage(VisaSession* session, char* response, ViUInt32 size, ViUInt32 timeout, ViUInt32* count) {
+    ViUInt32 retCount = 0;
+    ViStatus status = VI_ERROR_CONN_LOST;
+    if (session->healthy) {
+        applyTimeout(session, timeout);
+        busAcquire(session);
+        status = noteStatus(session, journalViRead(session->handle, (ViPBuf)response, size - 1, &retCount));
+        busRelease(session);
+        session->responsePending = status == VI_SUCCESS_MAX_CNT;
+    }
+    if (status < VI_SUCCESS) {
+        retCount = 0;
+        if (LOG_ENABLED(LOG_WARN))
+            logPrintf(LOG_WARN, "visa.read.failed", session->resource, "status=%X", (unsigned int)status);
+    }
+    response[retCount] = '\0';
+    *count = retCount;
+    LOG_TEXT(LOG_DEBUG, "visa.read", session->resource, response, retCount);
+    return status;
+}
+
+/* Reads the sweep time a query waiting for a sweep adds to its adaptive timeout; the caller holds the session mutex.
+   An instrument that does not answer :SWEep:TIME? is not asked again */
+static void readSweepTime(VisaSession* session) {
+    char response[SESSION_RESPONSE_BYTES];
+    ViUInt32 count;
+    ViStatus status = writeMessage(session, SWEEP_TIME_QUERY);
+    if (status >= VI_SUCCESS)
+        status = readMessage(session, response, sizeof(response), session->timeout, &count);
+    if (status >= VI_SUCCESS)
+        session->sweepTime = atof(response) > 0 ? atof(response) : -1;
+    else if (status == VI_ERROR_TMO) {
+        discardResponse(session);
+        session->sweepTime = -1;
+    }
+}
+
+/* Splits the error queue entry that checked mode appended off the end of a response, keeping its terminator.
+   Returns SESSION_ERROR_SCPI if the entry reports an error, otherwise status */
+static ViStatus takeCheckedError(VisaSession* session, char* response, ViUInt32* count, ViStatus status) {
+    if (status < VI_SUCCESS || status == VI_SUCCESS_MAX_CNT)
+        return status;
+
+    size_t length = *count, last = 0;
+    for (size_t unit = 0; unit < length; unit += scpiUnitLength(response + unit, length - unit) + 1)
+        last = unit;
+    ScpiError error;
+    if (scpiParseError(response + last, length - last, &error.code, error.message, sizeof(error.message)) != 0)
+        return status;
+
+    size_t kept = 0;
+    if (last > 0) {
+        kept = last - 1;
+        if (response[length - 1] == '\n')
+            response[kept++] = '\n';
+    }
+    response[kept] = '\0';
+    *count = (ViUInt32)kept;
+    if (error.code == 0)
+        return status;
+    session->lastError = error;
+    return SESSION_ERROR_SCPI;
+}
+
+/* Marks the settings a message carried unknown after the instrument rejected it in checked mode; the write itself
+   succeeded, so writeMessage() cached them. The caller holds the session mutex */
+static void forgetRejected(VisaSession* session, const char* message, ViStatus status) {
+    if (status == SESSION_ERROR_SCPI && session->snapshot != NULL)
+        snapshotNote(session->snapshot, message, strlen(message), 1);
+}
+
+/* Fails with SESSION_ERROR_HEADER if a strict validator does not know a header of the message, recording it as the
+   last error; the caller holds the session mutex */
+static ViStatus validateMessage(VisaSession* session, const char* message) {
+    char header[SESSION_ERROR_BYTES / 2];
+    if (session->validator == NULL || session->internal > 0 || !validatorStrict(session->validator)
+        || validatorCheck(session->validator, message, strlen(message), header, sizeof(header)) == 0)
+        return VI_SUCCESS;
+    session->lastError.code = SESSION_UNDEFINED_HEADER;
+    sprintf(session->lastError.message, "Undefined header, not sent: %s", header);
+    if (LOG_ENABLED(LOG_WARN))
+        logPrintf(LOG_WARN, "scpi.rejected", session->resource, "header=%s", header);
+    return SESSION_ERROR_HEADER;
+}
+
+/* Teaches a learning validator the headers of a message the instrument accepted: any message whose error queue entry
+   was read in checked mode, otherwise only a single query that was answered. Internal exchanges are not learned */
+static void learnMessage(VisaSession* session, const char* message, int checked) {
+    if (session->validator == NULL || session->internal > 0 || validatorStrict(session->validator))
+        return;
+    size_t length = strlen(message);
+    if (checked || (scpiUnitLength(message, length) == length && scpiIsQuery(message, length)))
+        validatorLearn(session->validator, message, length);
+}
+
+/**
+ * @brief Writes a command to the instrument. In checked mode the error queue is read in the same round trip, unless
+ * the command contains a query whose response the caller reads later.
+ * @return Status of the write, SESSION_ERROR_SCPI if the instrument reported an error in checked mode, or
+ * SESSION_ERROR_HEADER if the validator rejected the command.
+ */
+ViStatus sessionWrite(VisaSession* session, const char* command) {
+    char message[SESSION_MESSAGE_BYTES + sizeof(CHECK_SUFFIX)];
+    mutexLock(&session->mutex);
+    ViStatus status = validateMessage(session, command);
+    if (status < VI_SUCCESS || !session->checked || scpiIsQuery(command, strlen(command))
+        || strlen(command) >= SESSION_MESSAGE_BYTES) {
+        if (status >= VI_SUCCESS)
+            status = writeMessage(session, command);
+        mutexUnlock(&session->mutex);
+        return status;
+    }
+
+    char response[SESSION_RESPONSE_BYTES];
+    ViUInt32 count;
+    sprintf(message, "%s" CHECK_SUFFIX, command);
+    status = writeMessage(session, message);
+    if (status >= VI_SUCCESS) {
+        status = readMessage(session, response, sizeof(response), session->timeout, &count);
+        status = takeCheckedError(session, response, &count, status);
+        forgetRejected(session, command, status);
+        if (status >= VI_SUCCESS) {
+            learnMessage(session, command, 1);
+            status = VI_SUCCESS;
+        }
+    }
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Formats a command as printf() does and writes it to the instrument.
+ * @return Status of the write, or VI_ERROR_INV_PARAMETER if the command is longer than SESSION_COMMAND_BYTES.
+ */
+ViStatus sessionWritef(VisaSession* session, const char* format, ...) {
+    char command[SESSION_COMMAND_BYTES];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(command, sizeof(command), format, args);
+    va_end(args);
+    if (length < 0 || length >= (int)sizeof(command))
+        return VI_ERROR_INV_PARAMETER;
+    return sessionWrite(session, command);
+}
+
+/**
+ * @brief Reads a response into a caller buffer and null-terminates it.
+ *
+ * @param response Output buffer.
+ * @param size Capacity of response; at most size - 1 bytes are read.
+ * @param count Output number of bytes read. May be NULL.
+ * @return Status of the read. VI_SUCCESS_MAX_CNT means the response did not fit. SESSION_ERROR_NO_QUERY means no
+ * query written on the session awaits its response, so the read would only time out.
+ */
+ViStatus sessionRead(VisaSession* session, char* response, ViUInt32 size, ViUInt32* count) {
+    ViUInt32 retCount = 0;
+    ViStatus status = SESSION_ERROR_NO_QUERY;
+    mutexLock(&session->mutex);
+    if (session->responsePending)
+        status = readMessage(session, response, size, session->timeout, &retCount);
+    else
+        response[0] = '\0';
+    mutexUnlock(&session->mutex);
+    if (count != NULL)
+        *count = retCount;
+    return status;
+}
+
+/**
+ * @brief Writes a query and reads its response as one transaction. In checked mode the error queue entry is split off
+ * the response; if the response does not fit, the entry stays in the unread remainder. A message without a query is
+ * written with sessionWrite() and gets an empty response instead of waiting for one that never comes.
+ * @return Status of the write if it failed, SESSION_ERROR_SCPI if the instrument reported an error in checked mode,
+ * SESSION_ERROR_HEADER if the validator rejected the query, otherwise status of the read.
+ */
+ViStatus sessionQuery(VisaSession* session, const char* query, char* response, ViUInt32 size, ViUInt32* count) {
+    char message[SESSION_MESSAGE_BYTES + sizeof(CHECK_SUFFIX)];
+    ViUInt32 retCount = 0;
+    if (!scpiIsQuery(query, strlen(query))) {
+        response[0] = '\0';
+        if (count != NULL)
+            *count = 0;
+        return sessionWrite(session, query);
+    }
+    mutexLock(&session->mutex);
+    int checked = session->checked && strlen(query) < SESSION_MESSAGE_BYTES;
+    if (checked)
+        sprintf(message, "%s" CHECK_SUFFIX, query);
+    ViStatus status = validateMessage(session, query);
+    if (status >= VI_SUCCESS && session->adaptiveTimeout && session->sweepTime == 0 && waitsForSweep(query))
+        readSweepTime(session);
+    unsigned long long start = monotonicMicros();
+    if (status >= VI_SUCCESS)
+        status = writeMessage(session, checked ? message : query);
+    if (status >= VI_SUCCESS) {
+        ViUInt32 timeout = queryTimeout(session, query);
+        status = readMessage(session, response, size, timeout, &retCount);
+
+        /* An instrument that misses the adaptive limit but answers a serial poll is busy, e.g. with a sweep made
+           longer, and gets the rest of the session timeout. A hung one fails at once, its limit counting as twice
+           the limit so the limit backs off towards the session timeout if the instrument has merely slowed down */
+        int cutShort = status == VI_ERROR_TMO && timeout < session->timeout;
+        if (cutShort && instrumentBusy(session)) {
+            status = readMessage(session, response, size, session->timeout - timeout, &retCount);
+            cutShort = 0;
+        }
+        if (status >= VI_SUCCESS)
+            recordLatency(session, query, monotonicMicros() - start);
+        else if (cutShort)
+            recordLatency(session, query, (unsigned long long)timeout * 2000);
+        if (status == VI_ERROR_TMO)
+            discardResponse(session);
+        if (checked) {
+            status = takeCheckedError(session, response, &retCount, status);
+            forgetRejected(session, query, status);
+        }
+        if (status >= VI_SUCCESS)
+            learnMessage(session, query, checked);
+    }
+    else {
+        response[0] = '\0';
+    }
+    if (count != NULL)
+        *count = retCount;
+    if (status >= VI_SUCCESS && scpiMatchHeader(query, strlen(query), "[:SENSe]:SWEep:TIME?", NULL))
+        session->sweepTime = atof(response);
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Writes a query and converts the response to a double.
+ *
+ * @param value Output value, 0 if nothing could be read.
+ * @return Status of the query.
+ */
+ViStatus sessionQueryDouble(VisaSession* session, const char* query, double* value) {
+    char response[SESSION_RESPONSE_BYTES];
+    ViStatus status = sessionQuery(session, query, response, sizeof(response), NULL);
+    *value = status < VI_SUCCESS ? 0 : atof(response);
+    return status;
+}
+
+/**
+ * @brief Writes a query whose response is binary, e.g. a definite length block, and reads all of it as one
+ * transaction. Checked mode is not applied, since the error queue entry could not be told apart from the data.
+ *
+ * @param block Output buffer; the response is not terminated.
+ * @param size Capacity of block.
+ * @param received Output number of bytes read.
+ * @return Status of the write if it failed, SESSION_ERROR_HEADER if the validator rejected the query, otherwise
+ * status of the last read. VI_SUCCESS_MAX_CNT means the response did not fit; the remainder is discarded.
+ */
+ViStatus sessionQueryBlock(VisaSession* session, const char* query, unsigned char* block, size_t size, size_t* received) {
+    char discard[SESSION_RESPONSE_BYTES];
+    ViUInt32 count;
+    *received = 0;
+    mutexLock(&session->mutex);
+    ViStatus status = validateMessage(session, query);
+    if (status >= VI_SUCCESS)
+        status = writeMessage(session, query);
+    while (status >= VI_SUCCESS && *received + 1 < size) {
+        /* readMessage() terminates what it reads, so each read leaves one byte for the terminator */
+        status = readMessage(session, (char*)block + *received, (ViUInt32)(size - *received), session->timeout, &count);
+        *received += count;
+        if (status != VI_SUCCESS_MAX_CNT)
+            break;
+    }
+    if (status == VI_SUCCESS_MAX_CNT) {
+        while (readMessage(session, discard, sizeof(discard), session->timeout, &count) == VI_SUCCESS_MAX_CNT)
+            ;
+    }
+    if (status >= VI_SUCCESS)
+        learnMessage(session, query, 0);
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Attaches a validator that checks the headers of every write and query, or detaches it with NULL. A strict
+ * validator rejects unknown headers with SESSION_ERROR_HEADER; a learning one learns the headers the instrument
+ * accepts. The validator may be shared by the sessions to instruments of one model and must outlive them.
+ */
+void sessionSetValidator(VisaSession* session, ScpiValidator* validator) {
+    mutexLock(&session->mutex);
+    session->validator = validator;
+    mutexUnlock(&session->mutex);
+}
+
+/**
+ * @brief Turns checked mode on or off. In checked mode every write and query also reads the instrument's error queue,
+ * in the same message, and fails with SESSION_ERROR_SCPI if the instrument reported an error.
+ */
+void sessionSetChecked(VisaSession* session, int enabled) {
+    mutexLock(&session->mutex);
+    session->checked = enabled;
+    mutexUnlock(&session->mutex);
+}
+
+/**
+ * @brief Returns 1 if checked mode is on, 0 otherwise.
+ */
+int sessionChecked(VisaSession* session) {
+    return session->checked;
+}
+
+/**
+ * @brief Gets the last SCPI error reported in checked mode or drained by sessionDrainErrors().
+ *
+ * @param error Output error. May be NULL.
+ * @return Code of the error, 0 if none has been reported.
+ */
+int sessionLastError(VisaSession* session, ScpiError* error) {
+    mutexLock(&session->mutex);
+    int code = session->lastError.code;
+    if (error != NULL)
+        *error = session->lastError;
+    mutexUnlock(&session->mutex);
+    return code;
+}
+
+/**
+ * @brief Empties the instrument's error queue, reading SESSION_DRAIN_BATCH entries per round trip.
+ *
+ * @param errors Output errors, oldest first. May be NULL.
+ * @param maxErrors Capacity of errors[]; further errors are drained and counted but not stored.
+ * @param numErrors Output number of errors drained.
+ * @return Status of the first failed exchange, VI_ERROR_NSUP_OPER if the instrument does not answer :SYSTem:ERRor?,
+ * otherwise VI_SUCCESS.
+ */
+ViStatus sessionDrainErrors(VisaSession* session, ScpiError* errors, int maxErrors, int* numErrors) {
+    char query[SESSION_DRAIN_BATCH * sizeof(CHECK_SUFFIX)];
+    char response[SESSION_DRAIN_BATCH * (SESSION_ERROR_BYTES + 16)];
+    strcpy(query, ERROR_QUERY);
+    for (int i = 1; i < SESSION_DRAIN_BATCH; i++)
+        strcat(query, CHECK_SUFFIX);
+
+    ViStatus status = VI_SUCCESS;
+    int empty = 0;
+    *numErrors = 0;
+    mutexLock(&session->mutex);
+    while (!empty && *numErrors < SESSION_DRAIN_MAX) {
+        ViUInt32 count;
+        if ((status = writeMessage(session, query)) < VI_SUCCESS
+            || (status = readMessage(session, response, sizeof(response), session->timeout, &count)) < VI_SUCCESS)
+            break;
+        status = VI_SUCCESS;
+
+        size_t length = 0;
+        for (size_t unit = 0; unit < count && !empty; unit += length + 1) {
+            ScpiError error;
+            length = scpiUnitLength(response + unit, count - unit);
+            if (scpiParseError(response + unit, length, &error.code, error.message, sizeof(error.message)) != 0) {
+                status = VI_ERROR_NSUP_OPER;
+                break;
+            }
+            if (error.code == 0) {
+                empty = 1;
+                break;
+            }
+            if (errors != NULL && *numErrors < maxErrors)
+                errors[*numErrors] = error;
+            session->lastError = error;
+            (*numErrors)++;
+        }
+        if (status < VI_SUCCESS)
+            break;
+        if (session->responsePending) {
+            /* Entries longer than expected; skip the rest of the batch */
+            while (readMessage(session, response, sizeof(response), session->timeout, &count) == VI_SUCCESS_MAX_CNT)
+                ;
+        }
+    }
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/* Tests whether the instrument accepts marker n. The error queue is cleared first, so the answer is the error of the
+   marker command alone */
+static ViStatus markerSupported(VisaSession* session, int n, int* supported) {
+    char query[SESSION_COMMAND_BYTES];
+    char response[SESSION_RESPONSE_BYTES];
+    ScpiError error;
+    sprintf(query, "*CLS;:CALCulate:MARKer%d:STATe OFF;" ERROR_QUERY, n);
+    ViStatus status = sessionQuery(session, query, response, sizeof(response), NULL);
+    if (status >= VI_SUCCESS)
+        *supported = scpiParseError(response, strlen(response), &error.code, error.message, sizeof(error.message)) == 0
+            && error.code == 0;
+    return status == SESSION_ERROR_SCPI ? VI_SUCCESS : status;
+}
+
+/**
+ * @brief Finds the number of markers by bisection, assuming markers 1 to n exist. Takes about four round trips.
+ * Counting turns markers off behind the snapshot's back, so the session's cached settings are dropped.
+ *
+ * @param numMarkers Output number of markers, from 1 to SESSION_MAX_MARKERS.
+ * @return Status of the first failed exchange.
+ */
+ViStatus sessionCountMarkers(VisaSession* session, int* numMarkers) {
+    int low = 1, high = SESSION_MAX_MARKERS;
+    ViStatus status = VI_SUCCESS;
+    sessionBeginInternal(session);
+    while (low < high && status >= VI_SUCCESS) {
+        int middle = (low + high + 1) / 2, supported = 0;
+        status = markerSupported(session, middle, &supported);
+        if (supported)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    if (session->snapshot != NULL)
+        snapshotForget(session->snapshot);
+    sessionEndInternal(session);
+    if (status >= VI_SUCCESS)
+        *numMarkers = low;
+    return status < VI_SUCCESS ? status : VI_SUCCESS;
+}
+
+/* Brings the sweep and markers 1 to numMarkers to the marker capture setup, sending only the settings that differ
+   from the session's snapshot */
+static ViStatus applyMarkerSetup(VisaSession* session, int numMarkers) {
+    static const char* markerSettings[] = { ":CALCulate:MARKer#:FUNCtion", ":CALCulate:MARKer#:FCOunt[:STATe]",
+        ":CALCulate:MARKer#:MODE" };
+    char commands[1 + 3 * SESSION_MAX_MARKERS][SESSION_COMMAND_BYTES];
+    const char* setup[1 + 3 * SESSION_MAX_MARKERS];
+    int count = 0;
+
+    StateSnapshot* snapshot = sessionSnapshot(session);
+    if (snapshot == NULL)
+        return VI_ERROR_ALLOC;
+    snapshotTrack(snapshot, ":INITiate:CONTinuous", -1);
+    strcpy(commands[count++], ":INITiate:CONTinuous OFF");
+    for (int i = 1; i <= numMarkers; i++) {
+        for (int j = 0; j < 3; j++)
+            snapshotTrack(snapshot, markerSettings[j], i);
+        sprintf(commands[count++], ":CALCulate:MARKer%d:FUNCtion BPower", i);
+        sprintf(commands[count++], ":CALCulate:MARKer%d:FCOunt:STATe ON", i);
+        sprintf(commands[count++], ":CALCulate:MARKer%d:MODE POSition", i);
+    }
+    for (int i = 0; i < count; i++)
+        setup[i] = commands[i];
+    return snapshotApply(session, snapshot, setup, count, NULL);
+}
+
+/**
+ * @brief Sets the capability profile of the instrument's model, or clears it with NULL. The profile must outlive the
+ * session, e.g. by belonging to a CapabilityTable that is destroyed after it.
+ */
+void sessionSetProfile(VisaSession* session, const CapabilityProfile* profile) {
+    mutexLock(&session->mutex);
+    session->profile = profile;
+    mutexUnlock(&session->mutex);
+}
+
+/**
+ * @brief Returns the capability profile set with sessionSetProfile(), or NULL.
+ */
+const CapabilityProfile* sessionProfile(VisaSession* session) {
+    mutexLock(&session->mutex);
+    const CapabilityProfile* profile = session->profile;
+    mutexUnlock(&session->mutex);
+    return profile;
+}
+
+/**
+ * @brief Reads the frequency span and bandwidths from a spectrum analyzer, freezes the trace, finds out how many
+ * markers it has and sets them all up for readout. The markers are counted once per connection, or taken from the
+ * session's capability profile, and only settings that differ from the session's snapshot are sent, so repeated
+ * captures set up in one write or none. With a profile, the markers are limited to those whose readout fits in the
+ * model's batch length.
+ *
+ * @param setup Output span, bandwidths and number of markers.
+ * @return First error status, or VI_ERROR_INV_SETUP if the span read back is invalid.
+ */
+ViStatus sessionPrepareMarkerCapture(VisaSession* session, MarkerSetup* setup) {
+    ViStatus status;
+    sessionBeginInternal(session);
+
+    if ((status = sessionQueryDouble(session, ":SENSe:FREQuency:STARt?", &setup->startFreq)) < VI_SUCCESS
+        || (status = sessionQueryDouble(session, ":SENSe:FREQuency:STOP?", &setup->stopFreq)) < VI_SUCCESS)
+        goto done;
+    if (setup->startFreq < 0 || setup->stopFreq <= 0) {
+        status = VI_ERROR_INV_SETUP;
+        goto done;
+    }
+
+    if (session->numMarkers == 0 && session->profile != NULL) {
+        int markers = session->profile->numMarkers;
+        session->numMarkers = markers < 1 ? 1 : markers > SESSION_MAX_MARKERS ? SESSION_MAX_MARKERS : markers;
+    }
+    if (session->numMarkers == 0 && (status = sessionCountMarkers(session, &session->numMarkers)) < VI_SUCCESS) {
+        session->numMarkers = 0;
+        goto done;
+    }
+    setup->numMarkers = session->numMarkers;
+    if (session->profile != NULL && setup->numMarkers * SESSION_MARKER_MESSAGE_BYTES > session->profile->maxMessageBytes) {
+        setup->numMarkers = session->profile->maxMessageBytes / SESSION_MARKER_MESSAGE_BYTES;
+        if (setup->numMarkers < 1)
+            setup->numMarkers = 1;
+    }
+
+    if ((status = applyMarkerSetup(session, setup->numMarkers)) >= VI_SUCCESS
+        && (status = sessionQueryDouble(session, ":SENSe:BANDwidth:RESolution?", &setup->resBW)) >= VI_SUCCESS)
+        status = sessionQueryDouble(session, ":SENSe:BANDwidth:VIDeo?", &setup->vidBW);
+
+done:
+    sessionEndInternal(session);
+    return status;
+}
+
+/**
+ * @brief Moves marker 1 to a frequency and reads its y value. sessionPrepareMarkerCapture() must have been called first.
+ *
+ * @param amp Output amplitude at the marker.
+ * @return Status of the exchange.
+ */
+ViStatus sessionMeasureMarker(VisaSession* session, double freq, double* amp) {
+    char command[SESSION_COMMAND_BYTES];
+    sessionBeginInternal(session);
+    ViStatus status = templateRender(&markerXTemplate, command, sizeof(command), 1, freq) > 0
+        ? sessionWrite(session, command) : VI_ERROR_INV_PARAMETER;
+    if (status >= VI_SUCCESS)
+        status = sessionQueryDouble(session, ":CALC:MARK1:Y?", amp);
+    else
+        *amp = 0;
+    sessionEndInternal(session);
+    return status;
+}
+
+/**
+ * @brief Moves markers 1 to count to successive frequencies and reads all their y values, in one message and one
+ * response. sessionPrepareMarkerCapture() must have been called first.
+ *
+ * @param freq Frequencies for the markers.
+ * @param count Number of markers to use, from 1 to the number found by sessionPrepareMarkerCapture().
+ * @param amp Output amplitudes at the markers, 0 on error.
+ * @return Status of the exchange, or VI_ERROR_INV_SETUP if fewer values than markers came back.
+ */
+ViStatus sessionMeasureMarkers(VisaSession* session, const double* freq, int count, double* amp) {
+    char query[SESSION_MESSAGE_BYTES];
+    char response[SESSION_MAX_MARKERS * 32];
+    ViUInt32 length;
+    size_t used = 0;
+
+    if (count < 1 || count > SESSION_MAX_MARKERS)
+        return VI_ERROR_INV_PARAMETER;
+    for (int i = 0; i < 2 * count; i++) {
+        size_t written = i < count ? templateRender(&markerXTemplate, query + used, sizeof(query) - used - 1, i + 1, freq[i])
+            : templateRender(&markerYTemplate, query + used, sizeof(query) - used, i > count ? ";" : "", i - count + 1);
+        if (written == 0)
+            return VI_ERROR_INV_PARAMETER;
+        used += written;
+        if (i < count)
+            query[used++] = ';';
+    }
+
+    sessionBeginInternal(session);
+    ViStatus status = sessionQuery(session, query, response, sizeof(response), &length);
+    sessionEndInternal(session);
+    size_t unit = 0;
+    for (int i = 0; i < count; i++) {
+        amp[i] = 0;
+        if (status < VI_SUCCESS)
+            continue;
+        if (unit >= length) {
+            status = VI_ERROR_INV_SETUP;
+            continue;
+        }
+        size_t unitLength = scpiUnitLength(response + unit, length - unit);
+        amp[i] = atof(response + unit);
+        unit += unitLength + 1;
+    }
+    return status;
+}
+
+/**
+ * @brief sessionMeasureMarker() in the form of a MeasurePointFn, so a session can drive adaptiveCapture().
+ *
+ * @param session The VisaSession.
+ * @param freq Frequency to move the marker to.
+ * @return Amplitude at the marker, or 0 on error.
+ */
+double sessionMarkerPoint(void* session, double freq) {
+    double amp;
+    sessionMeasureMarker(session, freq, &amp);
+    return amp;
+}
+
+/**
+ * @brief Captures a trace of uniformly spaced points by walking the markers across the span, setup->numMarkers points
+ * per round trip.
+ *
+ * @param setup Span and number of markers read by sessionPrepareMarkerCapture().
+ * @param numPoints Number of points, at least 2.
+ * @param freq Output frequency array of numPoints values.
+ * @param amp Output amplitude array of numPoints values.
+ * @return VI_SUCCESS, or the status of the first failed point.
+ */
+ViStatus sessionCaptureMarkers(VisaSession* session, const MarkerSetup* setup, int numPoints, double* freq, double* amp) {
+    ViStatus status = VI_SUCCESS;
+    double freqSpacing = (setup->stopFreq - setup->startFreq) / (numPoints - 1);
+
+    sessionBeginInternal(session);
+    for (int i = 0; i < numPoints && status >= VI_SUCCESS; i += setup->numMarkers) {
+        int count = numPoints - i < setup->numMarkers ? numPoints - i : setup->numMarkers;
+        for (int j = i; j < i + count; j++)
+            freq[j] = round(setup->startFreq + j * freqSpacing);
+        status = sessionMeasureMarkers(session, freq + i, count, amp + i);
+    }
+    sessionEndInternal(session);
+    return status;
+}
+
+/**
+ * @brief Resumes continuous sweeps after a marker capture.
+ */
+ViStatus sessionFinishMarkerCapture(VisaSession* session) {
+    sessionBeginInternal(session);
+    ViStatus status = sessionWrite(session, ":INITiate:CONTinuous ON");
+    sessionEndInternal(session);
+    return status;
+}
+
+/* Reads a whole trace as one REAL,32 block, the caller holding the session mutex and having checked the profile */
+static ViStatus captureBinaryTrace(VisaSession* session, int numPoints, MarkerSetup* setup, double* freq, double* amp) {
+    char response[SESSION_RESPONSE_BYTES];
+    char byteOrder[SESSION_RESPONSE_BYTES];
+    double values[5];
+    size_t offset, length, received;
+    float* trace = NULL;
+
+    /* The span, bandwidths, sweep points and byte order to put back come back in one response */
+    ViStatus status = sessionQuery(session, ":SENS:FREQ:STAR?;:SENS:FREQ:STOP?;:SENS:BAND:RES?;:SENS:BAND:VID?;"
+        ":SENS:SWE:POIN?;:FORM:BORD?", response, sizeof(response), NULL);
+    if (status < VI_SUCCESS)
+        return status;
+    size_t unit = 0, responseLength = strlen(response);
+    for (int i = 0; i < 5; i++) {
+        if (unit >= responseLength)
+            return VI_ERROR_INV_SETUP;
+        values[i] = atof(response + unit);
+        unit += scpiUnitLength(response + unit, responseLength - unit) + 1;
+    }
+    if (unit >= responseLength)
+        return VI_ERROR_INV_SETUP;
+    snprintf(byteOrder, sizeof(byteOrder), "%s", response + unit);
+    byteOrder[strcspn(byteOrder, "\r\n")] = '\0';
+    setup->startFreq = values[0];
+    setup->stopFreq = values[1];
+    setup->resBW = values[2];
+    setup->vidBW = values[3];
+    setup->numMarkers = 0;
+    if (setup->startFreq < 0 || setup->stopFreq <= setup->startFreq)
+        return VI_ERROR_INV_SETUP;
+
+    /* A sweep with other points is taken once with the requested points; otherwise the frozen trace is read */
+    if ((int)values[4] != numPoints)
+        status = sessionWritef(session, ":INIT:CONT OFF;:SWE:POIN %d;:FORM:TRAC:DATA REAL,32;:FORM:BORD SWAP;:INIT:IMM",
+            numPoints);
+    else
+        status = sessionWrite(session, ":INIT:CONT OFF;:FORM:TRAC:DATA REAL,32;:FORM:BORD SWAP");
+    if (status >= VI_SUCCESS)
+        status = sessionQuery(session, "*OPC?", response, sizeof(response), NULL);
+
+    size_t size = (size_t)numPoints * 4 + 32;
+    unsigned char* block = status >= VI_SUCCESS ? malloc(size) : NULL;
+    if (status >= VI_SUCCESS && block == NULL)
+        status = VI_ERROR_ALLOC;
+    if (status >= VI_SUCCESS)
+        status = sessionQueryBlock(session, ":TRAC:DATA? TRACE1", block, size, &received);
+    if (status >= VI_SUCCESS && (status == VI_SUCCESS_MAX_CNT || scpiBlockHeader(block, received, &offset, &length) != 0
+        || length != (size_t)numPoints * 4 || (trace = malloc(sizeof(float) * numPoints)) == NULL))
+        status = VI_ERROR_INV_SETUP;
+    if (status >= VI_SUCCESS) {
+        double freqSpacing = (setup->stopFreq - setup->startFreq) / (numPoints - 1);
+        scpiDecodeReal32(block + offset, length, 0, trace, numPoints);
+        for (int j = 0; j < numPoints; j++) {
+            freq[j] = round(setup->startFreq + j * freqSpacing);
+            amp[j] = trace[j];
+        }
+        status = VI_SUCCESS;
+    }
+    free(trace);
+    free(block);
+
+    ViStatus restore = sessionWritef(session, ":FORM:TRAC:DATA ASC;:FORM:BORD %s;:INIT:CONT ON", byteOrder);
+    return status < VI_SUCCESS ? status : restore;
+}
+
+/**
+ * @brief Captures a trace of uniformly spaced points the fastest way the session's capability profile allows: as one
+ * REAL,32 block if the model supports binary traces of numPoints points, otherwise by walking the markers across the
+ * span with sessionPrepareMarkerCapture(), sessionCaptureMarkers() and sessionFinishMarkerCapture(). A binary capture
+ * leaves the sweep points at numPoints and setup->numMarkers at 0.
+ *
+ * @param numPoints Number of points, at least 2.
+ * @param setup Output span, bandwidths and number of markers used.
+ * @param freq Output frequency array of numPoints values.
+ * @param amp Output amplitude array of numPoints values.
+ * @return VI_SUCCESS, or the first error status.
+ */
+ViStatus sessionCaptureTrace(VisaSession* session, int numPoints, MarkerSetup* setup, double* freq, double* amp) {
+    ViStatus status;
+    sessionBeginInternal(session);
+    const CapabilityProfile* profile = session->profile;
+    if (profile != NULL && profile->binaryTrace && numPoints <= profile->maxPoints) {
+        status = captureBinaryTrace(session, numPoints, setup, freq, amp);
+    }
+    else {
+        status = sessionPrepareMarkerCapture(session, setup);
+        if (status >= VI_SUCCESS)
+            status = sessionCaptureMarkers(session, setup, numPoints, freq, amp);
+        ViStatus finish = sessionFinishMarkerCapture(session);
+        if (status >= VI_SUCCESS)
+            status = finish;
+    }
+    sessionEndInternal(session);
+    return status;
+}
+
+/**
+ * @brief Triggers the instrument with viAssertTrigger(), e.g. a Group Execute Trigger on GPIB or USBTMC, or by writing
+ * *TRG where the resource does not support it, as on raw sockets. While a journal is recorded or replayed *TRG is
+ * always written, since the journal only sees writes and reads.
+ *
+ * @param scpiTrigger Output 1 if *TRG was written, 0 if viAssertTrigger() triggered the instrument. May be NULL.
+ * @return Status of the trigger.
+ */
+ViStatus sessionAssertTrigger(VisaSession* session, int* scpiTrigger) {
+    ViStatus status = VI_ERROR_NSUP_OPER;
+    mutexLock(&session->mutex);
+    if (!session->healthy) {
+        mutexUnlock(&session->mutex);
+        return VI_ERROR_CONN_LOST;
+    }
+    if (!journalIsRecording() && !journalIsReplaying()) {
+        busAcquire(session);
+        status = noteStatus(session, viAssertTrigger(session->handle, VI_TRIG_PROT_DEFAULT));
+        busRelease(session);
+        LOG_TEXT(LOG_DEBUG, "visa.trigger", session->resource, NULL, 0);
+    }
+    int scpi = status == VI_ERROR_NSUP_OPER || status == VI_ERROR_INV_PROT || status == VI_ERROR_INV_SETUP;
+    if (scpi)
+        status = writeMessage(session, "*TRG");
+    mutexUnlock(&session->mutex);
+    if (scpiTrigger != NULL)
+        *scpiTrigger = scpi;
+    return status;
+}
+
+/**
+ * @brief Enables asynchronous I/O on the session by queuing I/O completion events. Not available while a journal is
+ * recorded or replayed, since the journal only sees synchronous calls, nor on a shared GPIB board or serial port: a
+ * job in flight would have to hold the bus until its completion event is collected, and an event loop submitting to
+ * another session on the bus would wait for itself.
+ *
+ * @return VI_SUCCESS, or an error status if asynchronous I/O cannot be used and the caller should fall back to the
+ * synchronous calls.
+ */
+ViStatus sessionEnableAsync(VisaSession* session) {
+    if (journalIsRecording() || journalIsReplaying() || session->bus != NULL)
+        return VI_ERROR_NSUP_OPER;
+    if (session->asyncEnabled)
+        return VI_SUCCESS;
+    ViStatus status = viEnableEvent(session->handle, VI_EVENT_IO_COMPLETION, VI_QUEUE, VI_NULL);
+    if (status >= VI_SUCCESS)
+        session->asyncEnabled = 1;
+    return status;
+}
+
+/**
+ * @brief Starts an asynchronous write. command must stay valid until the job completes.
+ *
+ * @param job Output job id, reported again by sessionWaitAsync() on completion.
+ * @return Status of the submission. VI_ERROR_NSUP_OPER means the resource only supports synchronous I/O.
+ * SESSION_ERROR_HEADER means the validator rejected the command.
+ */
+ViStatus sessionWriteAsync(VisaSession* session, const char* command, ViJobId* job) {
+    if (!session->asyncEnabled)
+        return VI_ERROR_NSUP_OPER;
+    mutexLock(&session->mutex);
+    ViStatus status = validateMessage(session, command);
+    if (status < VI_SUCCESS)
+        goto done;
+    if (!session->healthy) {
+        status = VI_ERROR_CONN_LOST;
+        goto done;
+    }
+    size_t length = strlen(command);
+    status = noteStatus(session, viWriteAsync(session->handle, (ViConstBuf)command, (ViUInt32)length, job));
+    if (session->snapshot != NULL)
+        snapshotNote(session->snapshot, command, length, status < VI_SUCCESS);
+    if (session->sweepTime > 0 && changesSweepTime(command, length))
+        session->sweepTime = 0;
+    LOG_TEXT(LOG_DEBUG, "visa.write", session->resource, command, length);
+    session->responsePending = status >= VI_SUCCESS && scpiIsQuery(command, length);
+    if (status >= VI_SUCCESS) {
+        session->asyncJobs++;
+        session->asyncWriteJob = *job;
+        session->asyncCommand = command;
+    }
+done:
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Starts an asynchronous read of up to size bytes. response must stay valid until the job completes and is not
+ * null-terminated.
+ *
+ * @param job Output job id, reported again by sessionWaitAsync() on completion.
+ * @return Status of the submission.
+ */
+ViStatus sessionReadAsync(VisaSession* session, char* response, ViUInt32 size, ViJobId* job) {
+    if (!session->asyncEnabled)
+        return VI_ERROR_NSUP_OPER;
+    mutexLock(&session->mutex);
+    ViStatus status = VI_ERROR_CONN_LOST;
+    if (session->healthy)
+        status = noteStatus(session, viReadAsync(session->handle, (ViPBuf)response, size, job));
+    if (status >= VI_SUCCESS)
+        session->asyncJobs++;
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Waits for the next asynchronous job on the session to complete. Like a synchronous exchange, its status
+ * updates the connection state, and a failed write marks the settings it carried unknown in the snapshot.
+ *
+ * @param timeoutMs How long to wait; 0 only polls.
+ * @param job Output id of the completed job.
+ * @param jobStatus Output status of the completed job.
+ * @param count Output number of bytes the job transferred.
+ * @return VI_SUCCESS if a job completed, VI_ERROR_TMO if none completed in time.
+ */
+ViStatus sessionWaitAsync(VisaSession* session, ViUInt32 timeoutMs, ViJobId* job, ViStatus* jobStatus, ViUInt32* count) {
+    ViEventType eventType;
+    ViEvent event;
+
+    ViStatus status = viWaitOnEvent(session->handle, VI_EVENT_IO_COMPLETION, timeoutMs, &eventType, &event);
+    if (status < VI_SUCCESS)
+        return status;
+    viGetAttribute(event, VI_ATTR_JOB_ID, job);
+    viGetAttribute(event, VI_ATTR_STATUS, jobStatus);
+    viGetAttribute(event, VI_ATTR_RET_COUNT_32, count);
+    viClose(event);
+
+    mutexLock(&session->mutex);
+    if (session->asyncJobs > 0)
+        session->asyncJobs--;
+    noteStatus(session, *jobStatus);
+    if (session->asyncCommand != NULL && *job == session->asyncWriteJob) {
+        if (*jobStatus < VI_SUCCESS) {
+            if (session->snapshot != NULL)
+                snapshotNote(session->snapshot, session->asyncCommand, strlen(session->asyncCommand), 1);
+            session->responsePending = 0;
+            if (LOG_ENABLED(LOG_WARN))
+                logPrintf(LOG_WARN, "visa.write.failed", session->resource, "status=%X", (unsigned int)*jobStatus);
+        }
+        session->asyncCommand = NULL;
+    }
+    else
+        session->responsePending = *jobStatus == VI_SUCCESS_MAX_CNT;
+    mutexUnlock(&session->mutex);
+    return VI_SUCCESS;
+}
+
+/**
+ * @brief Returns 1 if the connection is believed to be up, 0 after it was lost and until sessionReopen() succeeds.
+ */
+int sessionHealthy(VisaSession* session) {
+    return session->healthy;
+}
+
+/**
+ * @brief Returns how long the session has gone without a successful exchange, in microseconds.
+ */
+unsigned long long sessionIdleMicros(VisaSession* session) {
+    return monotonicMicros() - session->lastActivity;
+}
+
+/**
+ * @brief Enables VI_ATTR_TCPIP_KEEPALIVE, so the VISA library notices a LAN instrument that went away. Kept across
+ * sessionReopen().
+ * @return Status of viSetAttribute(); VI_ERROR_NSUP_ATTR if the resource or VISA library does not support it.
+ */
+ViStatus sessionEnableKeepAlive(VisaSession* session) {
+    if (journalIsReplaying())
+        return VI_ERROR_NSUP_ATTR;
+    mutexLock(&session->mutex);
+    ViStatus status = viSetAttribute(session->handle, VI_ATTR_TCPIP_KEEPALIVE, VI_TRUE);
+    session->keepAlive = status >= VI_SUCCESS;
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Checks that the instrument answers by reading its status byte with *STB?. The probe is not recorded in the
+ * journal, and is skipped while the response to an earlier query is still unread or an asynchronous job is in
+ * flight. A lost connection marks the session unhealthy. A timeout is inconclusive, since a busy instrument may not
+ * answer *STB? during a long sweep or *OPC?, so only SESSION_PROBE_TIMEOUTS timeouts in a row mark it unhealthy.
+ * After a timeout the instrument is cleared, so an answer to *STB? arriving late is not read as the response to the
+ * next query.
+ *
+ * @param timeoutMs How long to wait for the answer.
+ * @return Status of the probe.
+ */
+ViStatus sessionProbe(VisaSession* session, ViUInt32 timeoutMs) {
+    static const char probe[] = "*STB?";
+    char response[SESSION_RESPONSE_BYTES];
+    ViUInt32 count;
+
+    mutexLock(&session->mutex);
+    if (!session->healthy || session->responsePending || session->asyncJobs > 0 || journalIsReplaying()) {
+        mutexUnlock(&session->mutex);
+        return session->healthy ? VI_SUCCESS : VI_ERROR_CONN_LOST;
+    }
+    applyTimeout(session, timeoutMs);
+    busAcquire(session);
+    ViStatus status = viWrite(session->handle, (ViConstBuf)probe, sizeof(probe) - 1, &count);
+    if (status >= VI_SUCCESS)
+        status = viRead(session->handle, (ViPBuf)response, sizeof(response), &count);
+    busRelease(session);
+    applyTimeout(session, session->timeout);
+    if (status == VI_ERROR_TMO)
+        discardResponse(session);
+    if (status == VI_ERROR_TMO && ++session->probeTimeouts < SESSION_PROBE_TIMEOUTS) {
+        mutexUnlock(&session->mutex);
+        return status;
+    }
+    if (status < VI_SUCCESS)
+        session->healthy = 0;
+    noteStatus(session, status);
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Closes the VISA session and opens the resource again, restoring the timeout, asynchronous I/O and keep-alive
+ * settings. The session is healthy again if this succeeds.
+ * @return Status of the open.
+ */
+ViStatus sessionReopen(VisaSession* session) {
+    ViSession handle;
+    mutexLock(&session->mutex);
+    if (journalIsReplaying()) {
+        session->healthy = 1;
+        session->probeTimeouts = 0;
+        mutexUnlock(&session->mutex);
+        return VI_SUCCESS;
+    }
+    if (session->handle != VI_NULL)
+        viClose(session->handle);
+    session->handle = VI_NULL;
+    if (session->snapshot != NULL)
+        snapshotForget(session->snapshot);
+    session->numMarkers = 0;
+
+    ViStatus status = journalViOpen(session->resourceManager, session->resource, &handle);
+    if (status >= VI_SUCCESS) {
+        session->handle = handle;
+        viSetAttribute(handle, VI_ATTR_TMO_VALUE, session->timeout);
+        session->appliedTimeout = session->timeout;
+        if (session->asyncEnabled && viEnableEvent(handle, VI_EVENT_IO_COMPLETION, VI_QUEUE, VI_NULL) < VI_SUCCESS)
+            session->asyncEnabled = 0;
+        if (session->keepAlive)
+            viSetAttribute(handle, VI_ATTR_TCPIP_KEEPALIVE, VI_TRUE);
+        session->healthy = 1;
+        session->probeTimeouts = 0;
+        session->responsePending = 0;
+        session->asyncJobs = 0;
+        session->asyncCommand = NULL;
+        session->sweepTime = 0;
+        session->lastActivity = monotonicMicros();
+        LOG_TEXT(LOG_INFO, "session.reopen", session->resource, NULL, 0);
+    }
+    mutexUnlock(&session->mutex);
+    return status;
+}
+
+/**
+ * @brief Returns the session's cache of instrument settings, creating it with no settings tracked on first use. Every
+ * message written to the session updates it, and reopening the session forgets its values.
+ * @return The snapshot, or NULL if out of memory.
+ */
+StateSnapshot* sessionSnapshot(VisaSession* session) {
+    mutexLock(&session->mutex);
+    if (session->snapshot == NULL && (session->snapshot = malloc(sizeof(StateSnapshot))) != NULL)
+        snapshotInit(session->snapshot);
+    mutexUnlock(&session->mutex);
+    return session->snapshot;
+}
@@ -0,0 +1,778 @@
+/*********************************************************************/
+/*                                                                   */
+/* Implementation of the VISA C functions this program uses, backed  */
+/* by simulated analyzers from sim-instrument.c instead of hardware. */
+/* Link this file in place of visa32.lib/nivisa64.lib to run the     */
+/* benchmarks, or the CLI itself, without an instrument or NI-VISA.  */
+/*                                                                   */
+/* The simulated resources are named by the comma separated list in  */
+/* the VISA_SIM_RESOURCES environment variable (default SIM0::INSTR) */
+/* and every one behaves as a spectrum analyzer. VISA_SIM_RTT_US     */
+/* sets the simulated round trip time in microseconds.               */
+/*                                                                   */
+/* TCPIP[board]::host::port::SOCKET resources are not simulated but  */
+/* connected over the network (tcp-socket.c), whether listed or not, */
+/* so the program can drive real analyzers without a vendor VISA.    */
+/*                                                                   */
+/* viWriteAsync()/viReadAsync() are supported on simulated resources */
+/* with VI_EVENT_IO_COMPLETION queued events. Jobs on a session      */
+/* complete in order, half a round trip apart, without any threads:  */
+/* viWaitOnEvent() sleeps until the next job is due and finishes it. */
+/*                                                                   */
+/* Opening a simulated resource takes VISA_SIM_OPEN_ROUND_TRIPS      */
+/* round trips, like the connection handshake of a LAN instrument.   */
+/*                                                                   */
+/* visaSimRestart() takes a simulated analyzer offline for a while:  */
+/* open sessions to it report VI_ERROR_CONN_LOST and viOpen() fails  */
+/* until it is back, as when a LAN instrument reboots.               */
+/*                                                                   */
+/* viAssertTrigger() triggers a simulated analyzer as *TRG does; on  */
+/* SOCKET resources it is not supported, as with a vendor VISA.      */
+/*                                                                   */
+/* Resources on one GPIB board or serial port model a shared bus:    */
+/* overlapping transfers on it are counted as collisions, see        */
+/* visaSimBusCollisions().                                           */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "platform.h"
+#include "sim-instrument.h"
+#include "tcp-socket.h"
+#include "visa-sim.h"
+
+#define SIM_RM_HANDLE 1             // Handle of the default resource manager
+#define SIM_SESSION_BASE 2          // Handle of the first instrument session
+#define SIM_FIND_BASE 0x10000       // Handle of the first find list
+#define SIM_EVENT_BASE 0x20000      // Handle of the first I/O completion event
+#define SIM_MAX_BOARDS 32           // Board numbers tracked for bus collisions, per interface type
+
+typedef struct {
+    ViJobId id;
+    int isRead;
+    ViBuf buf;                      // Message to write or destination of a read; must stay valid until completion
+    ViUInt32 count;                 // Bytes to write or read
+    unsigned long long completeAt;  // monotonicMicros() when the job is due
+    unsigned long long expireAt;    // When a read with no response completes with VI_ERROR_TMO
+} SimJob;
+
+typedef struct {
+    int used;
+    ViJobId jobId;
+    ViStatus status;
+    ViUInt32 retCount;
+    ViBuf buf;
+} SimEvent;
+
+typedef struct {
+    char name[VI_FIND_BUFLEN];      // Resource descriptor
+    SimInstrument* instrument;      // Created on first open, shared by all sessions to the resource
+    unsigned int generation;        // Incremented on every restart, invalidating open sessions
+    unsigned long long downUntil;   // monotonicMicros() until which the resource cannot be opened
+} SimResource;
+
+typedef struct {
+    int used;
+    char name[VI_FIND_BUFLEN];      // Resource descriptor the session was opened with
+    SimInstrument* instrument;      // Simulated analyzer, or NULL for a socket session
+    SimResource* resource;          // Simulated resource, or NULL for a socket session
+    unsigned int generation;        // Generation of the resource when the session was opened
+    TcpSocket* socket;              // Network connection of a SOCKET resource
+    ViUInt32 timeout;               // VI_ATTR_TMO_VALUE in milliseconds
+    int termCharEnabled;            // VI_ATTR_TERMCHAR_EN
+    unsigned char termChar;         // VI_ATTR_TERMCHAR
+    int eventsEnabled;              // VI_EVENT_IO_COMPLETION queued with viEnableEvent()
+    SimJob jobs[VISA_SIM_MAX_JOBS]; // Pending asynchronous jobs, in submission order from jobHead
+    int jobHead, numJobs;
+    unsigned long long busyUntil;   // completeAt of the last submitted job
+    int* busActive;                 // Transfer count of the shared bus the resource is on, or NULL
+} SimSession;
+
+typedef struct {
+    char expression[VI_FIND_BUFLEN];
+    int next;                       // Index of the next resource to test
+} SimFindList;
+
+static PlatformMutex simMutex;
+static int configured;
+static unsigned int roundTrip;
+static SimResource resources[VISA_SIM_MAX_RESOURCES];
+static int numResources;
+static SimSession sessions[VISA_SIM_MAX_SESSIONS];
+static SimFindList findLists[VISA_SIM_MAX_SESSIONS];
+static SimEvent events[VISA_SIM_MAX_EVENTS];
+static ViJobId nextJobId = 1;
+static int busActive[VI_INTF_USB + 1][SIM_MAX_BOARDS];
+static unsigned long busCollisions;
+
+/**
+ * @brief Sets the simulated resources and round trip time. Must be called before viOpenDefaultRM() to take effect;
+ * otherwise the VISA_SIM_RESOURCES and VISA_SIM_RTT_US environment variables are used.
+ *
+ * @param resourceList Comma separated resource descriptors, or NULL for the default.
+ * @param rttMicros Simulated round trip time in microseconds.
+ */
+void visaSimConfigure(const char* resourceList, unsigned int rttMicros) {
+    if (!configured)
+        mutexInit(&simMutex);
+    configured = 1;
+    roundTrip = rttMicros;
+
+    for (int i = 0; i < numResources; i++) {
+        if (resources[i].instrument != NULL)
+            simSetRtt(resources[i].instrument, rttMicros);
+    }
+    if (resourceList == NULL)
+        resourceList = VISA_SIM_DEFAULT_RESOURCES;
+
+    numResources = 0;
+    const char* p = resourceList;
+    while (*p != '\0' && numResources < VISA_SIM_MAX_RESOURCES) {
+        const char* end = strchr(p, ',');
+        size_t length = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (length > 0 && length < VI_FIND_BUFLEN) {
+            memcpy(resources[numResources].name, p, length);
+            resources[numResources].name[length] = '\0';
+            resources[numResources].instrument = NULL;
+            resources[numResources].generation = 0;
+            resources[numResources].downUntil = 0;
+            numResources++;
+        }
+        p += length;
+        if (*p == ',')
+            p++;
+    }
+}
+
+static void ensureConfigured() {
+    if (!configured) {
+        const char* rtt = getenv("VISA_SIM_RTT_US");
+        visaSimConfigure(getenv("VISA_SIM_RESOURCES"), rtt != NULL ? (unsigned int)atoi(rtt) : 0);
+    }
+}
+
+/**
+ * @brief Matches a resource name against a VISA search expression: '?' matches any character, '*' repeats the
+ * previous element zero or more times and [...] is a character class. Matching is case-insensitive.
+ */
+static int matchExpression(const char* expr, const char* name) {
+    if (*expr == '\0')
+        return *name == '\0';
+
+    /* Find the extent of the current element */
+    const char* next = expr + 1;
+    if (*expr == '[') {
+        next = strchr(expr, ']');
+        if (next == NULL)
+            return 0;
+        next++;
+    }
+    int repeat = (*next == '*');
+
+    #define ELEMENT_MATCHES(c) ((c) != '\0' && (*expr == '?' \
+        || (*expr == '[' ? (memchr(expr + 1, (c), next - expr - 2) != NULL \
+            || (next - expr == 5 && expr[2] == '-' && (c) >= expr[1] && (c) <= expr[3])) \
+        : toupper((unsigned char)*expr) == toupper((unsigned char)(c)))))
+
+    if (repeat) {
+        const char* rest = next + 1;
+        do {
+            if (matchExpression(rest, name))
+                return 1;
+        } while (ELEMENT_MATCHES(*name) && *name++ != '\0');
+        return 0;
+    }
+    return ELEMENT_MATCHES(*name) && matchExpression(next, name + 1);
+    #undef ELEMENT_MATCHES
+}
+
+/* Matches a resource name against a search expression of alternatives separated by '|', e.g. "GPIB?*|TCPIP?*" */
+static int matchAlternatives(const char* expr, const char* name) {
+    char alternative[VI_FIND_BUFLEN];
+    while (*expr != '\0') {
+        size_t length = strcspn(expr, "|");
+        if (length < sizeof(alternative)) {
+            memcpy(alternative, expr, length);
+            alternative[length] = '\0';
+            if (matchExpression(alternative, name))
+                return 1;
+        }
+        expr += length;
+        if (*expr == '|')
+            expr++;
+    }
+    return 0;
+}
+
+static SimSession* getSession(ViObject vi) {
+    if (vi < SIM_SESSION_BASE || vi >= SIM_SESSION_BASE + VISA_SIM_MAX_SESSIONS)
+        return NULL;
+    SimSession* session = &sessions[vi - SIM_SESSION_BASE];
+    return session->used ? session : NULL;
+}
+
+ViStatus _VI_FUNC viOpenDefaultRM(ViPSession vi) {
+    ensureConfigured();
+    *vi = SIM_RM_HANDLE;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viFindNext(ViFindList vi, ViChar _VI_FAR desc[]) {
+    if (vi < SIM_FIND_BASE || vi >= SIM_FIND_BASE + VISA_SIM_MAX_SESSIONS)
+        return VI_ERROR_INV_OBJECT;
+    SimFindList* list = &findLists[vi - SIM_FIND_BASE];
+
+    mutexLock(&simMutex);
+    while (list->next < numResources) {
+        const char* name = resources[list->next++].name;
+        if (matchAlternatives(list->expression, name)) {
+            strcpy(desc, name);
+            mutexUnlock(&simMutex);
+            return VI_SUCCESS;
+        }
+    }
+    mutexUnlock(&simMutex);
+    return VI_ERROR_RSRC_NFOUND;
+}
+
+ViStatus _VI_FUNC viFindRsrc(ViSession sesn, ViConstString expr, ViPFindList vi, ViPUInt32 retCnt, ViChar _VI_FAR desc[]) {
+    if (sesn != SIM_RM_HANDLE)
+        return VI_ERROR_INV_OBJECT;
+
+    mutexLock(&simMutex);
+    int slot = 0;
+    while (slot < VISA_SIM_MAX_SESSIONS && findLists[slot].expression[0] != '\0')
+        slot++;
+    if (slot == VISA_SIM_MAX_SESSIONS) {
+        mutexUnlock(&simMutex);
+        return VI_ERROR_ALLOC;
+    }
+    SimFindList* list = &findLists[slot];
+    strncpy(list->expression, expr, VI_FIND_BUFLEN - 1);
+    list->next = 0;
+
+    ViUInt32 count = 0;
+    for (int i = 0; i < numResources; i++) {
+        if (matchAlternatives(expr, resources[i].name))
+            count++;
+    }
+    mutexUnlock(&simMutex);
+
+    if (vi != NULL)
+        *vi = SIM_FIND_BASE + slot;
+    if (retCnt != NULL)
+        *retCnt = count;
+    if (count == 0) {
+        list->expression[0] = '\0';
+        return VI_ERROR_RSRC_NFOUND;
+    }
+    return viFindNext(SIM_FIND_BASE + slot, desc);
+}
+
+/**
+ * @brief Parses the interface type and board number from a resource descriptor. Only the syntax is checked; the
+ * resource does not need to exist. Aliases are not supported.
+ */
+ViStatus _VI_FUNC viParseRsrcEx(ViSession rmSesn, ViConstRsrc rsrcName, ViPUInt16 intfType, ViPUInt16 intfNum,
+    ViChar _VI_FAR rsrcClass[], ViChar _VI_FAR expandedUnaliasedName[], ViChar _VI_FAR aliasIfExists[]) {
+    static const struct { const char* prefix; ViUInt16 type; } interfaces[] = {
+        { "GPIB-VXI", VI_INTF_GPIB_VXI }, { "GPIB", VI_INTF_GPIB }, { "VXI", VI_INTF_VXI }, { "ASRL", VI_INTF_ASRL },
+        { "PXI", VI_INTF_PXI }, { "TCPIP", VI_INTF_TCPIP }, { "USB", VI_INTF_USB }
+    };
+    if (rmSesn != SIM_RM_HANDLE)
+        return VI_ERROR_INV_OBJECT;
+    if (strlen(rsrcName) >= VI_FIND_BUFLEN)
+        return VI_ERROR_INV_RSRC_NAME;
+
+    for (size_t i = 0; i < sizeof(interfaces) / sizeof(interfaces[0]); i++) {
+        size_t length = strlen(interfaces[i].prefix);
+        size_t j = 0;
+        while (j < length && toupper((unsigned char)rsrcName[j]) == interfaces[i].prefix[j])
+            j++;
+        if (j < length)
+            continue;
+        const char* p = rsrcName + length;
+        const char* digits = p;
+        while (isdigit((unsigned char)*p))
+            p++;
+        if (strncmp(p, "::", 2) != 0)
+            continue;
+
+        if (intfType != NULL)
+            *intfType = interfaces[i].type;
+        if (intfNum != NULL)
+            *intfNum = p > digits ? (ViUInt16)atoi(digits) : 0;
+        if (rsrcClass != NULL) {
+            const char* last = strrchr(rsrcName, ':') + 1;
+            int isClass = *last != '\0';
+            for (const char* c = last; *c != '\0'; c++)
+                isClass &= isalpha((unsigned char)*c) != 0;
+            strcpy(rsrcClass, isClass ? last : "INSTR");
+            for (char* c = rsrcClass; *c != '\0'; c++)
+                *c = (char)toupper((unsigned char)*c);
+        }
+        if (expandedUnaliasedName != NULL)
+            strcpy(expandedUnaliasedName, rsrcName);
+        if (aliasIfExists != NULL)
+            aliasIfExists[0] = '\0';
+        return VI_SUCCESS;
+    }
+    return VI_ERROR_INV_RSRC_NAME;
+}
+
+ViStatus _VI_FUNC viParseRsrc(ViSession rmSesn, ViConstRsrc rsrcName, ViPUInt16 intfType, ViPUInt16 intfNum) {
+    return viParseRsrcEx(rmSesn, rsrcName, intfType, intfNum, NULL, NULL, NULL);
+}
+
+/**
+ * @brief Makes a simulated analyzer hang or recover, e.g. to test timeout handling. See simSetResponding().
+ * @return 0 on success, 1 if the resource is not simulated.
+ */
+int visaSimSetResponding(const char* resource, int responding) {
+    ensureConfigured();
+    mutexLock(&simMutex);
+    int i = 0;
+    while (i < numResources && strcmp(resources[i].name, resource) != 0)
+        i++;
+    if (i < numResources && resources[i].instrument == NULL)
+        resources[i].instrument = simCreate(roundTrip);
+    SimInstrument* instrument = i < numResources ? resources[i].instrument : NULL;
+    mutexUnlock(&simMutex);
+    if (instrument == NULL)
+        return 1;
+    simSetResponding(instrument, responding);
+    return 0;
+}
+
+/**
+ * @brief Restarts a simulated analyzer: open sessions to it fail with VI_ERROR_CONN_LOST from now on, and it cannot be
+ * opened again for downMs milliseconds. The analyzer keeps its settings.
+ * @return 0 on success, 1 if the resource is not simulated.
+ */
+int visaSimRestart(const char* resource, unsigned int downMs) {
+    ensureConfigured();
+    mutexLock(&simMutex);
+    int i = 0;
+    while (i < numResources && strcmp(resources[i].name, resource) != 0)
+        i++;
+    if (i < numResources) {
+        resources[i].generation++;
+        resources[i].downUntil = monotonicMicros() + (unsigned long long)downMs * 1000;
+    }
+    mutexUnlock(&simMutex);
+    return i == numResources;
+}
+
+/* Returns VI_ERROR_CONN_LOST if the session's analyzer restarted since the session was opened */
+static ViStatus checkConnection(SimSession* session) {
+    if (session->resource == NULL)
+        return VI_SUCCESS;
+    mutexLock(&simMutex);
+    int lost = session->generation != session->resource->generation;
+    mutexUnlock(&simMutex);
+    return lost ? VI_ERROR_CONN_LOST : VI_SUCCESS;
+}
+
+/**
+ * @brief Returns the transfers that overlapped with another transfer on the same GPIB board or serial port.
+ */
+unsigned long visaSimBusCollisions() {
+    mutexLock(&simMutex);
+    unsigned long collisions = busCollisions;
+    mutexUnlock(&simMutex);
+    return collisions;
+}
+
+/* Marks the start or end of a transfer on the session's shared bus */
+static void busTransfer(SimSession* session, int delta) {
+    if (session->busActive == NULL)
+        return;
+    mutexLock(&simMutex);
+    *session->busActive += delta;
+    if (delta > 0 && *session->busActive > 1)
+        busCollisions++;
+    mutexUnlock(&simMutex);
+}
+
+ViStatus _VI_FUNC viOpen(ViSession sesn, ViConstRsrc name, ViAccessMode mode, ViUInt32 timeout, ViPSession vi) {
+    char host[TCP_HOST_MAX];
+    int port;
+    TcpSocket* sock = NULL;
+    ViUInt16 intfType, intfNum;
+    (void)mode;
+    if (sesn != SIM_RM_HANDLE)
+        return VI_ERROR_INV_OBJECT;
+    if (strlen(name) >= VI_FIND_BUFLEN)
+        return VI_ERROR_INV_RSRC_NAME;
+
+    if (tcpParseResource(name, host, sizeof(host), &port) == 0) {
+        sock = tcpConnect(host, port, timeout > 0 ? timeout : VISA_SIM_DEFAULT_TIMEOUT);
+        if (sock == NULL)
+            return VI_ERROR_RSRC_NFOUND;
+    }
+
+    mutexLock(&simMutex);
+    int resource = 0;
+    while (resource < numResources && strcmp(resources[resource].name, name) != 0)
+        resource++;
+    int slot = 0;
+    while (slot < VISA_SIM_MAX_SESSIONS && sessions[slot].used)
+        slot++;
+    if (sock == NULL && resource < numResources && monotonicMicros() < resources[resource].downUntil)
+        resource = numResources;
+    if ((sock == NULL && resource == numResources) || slot == VISA_SIM_MAX_SESSIONS) {
+        mutexUnlock(&simMutex);
+        tcpClose(sock);
+        return slot == VISA_SIM_MAX_SESSIONS ? VI_ERROR_ALLOC : VI_ERROR_RSRC_NFOUND;
+    }
+    SimSession* session = &sessions[slot];
+    if (sock == NULL && resources[resource].instrument == NULL)
+        resources[resource].instrument = simCreate(roundTrip);
+    session->used = 1;
+    strcpy(session->name, name);
+    session->instrument = sock == NULL ? resources[resource].instrument : NULL;
+    session->resource = sock == NULL ? &resources[resource] : NULL;
+    session->generation = sock == NULL ? resources[resource].generation : 0;
+    session->socket = sock;
+    session->timeout = VISA_SIM_DEFAULT_TIMEOUT;
+    session->termCharEnabled = 1;
+    session->termChar = '\n';
+    session->eventsEnabled = 0;
+    session->jobHead = session->numJobs = 0;
+    session->busyUntil = 0;
+    session->busActive = NULL;
+    if (viParseRsrc(sesn, name, &intfType, &intfNum) == VI_SUCCESS && intfNum < SIM_MAX_BOARDS
+        && (intfType == VI_INTF_GPIB || intfType == VI_INTF_GPIB_VXI || intfType == VI_INTF_ASRL))
+        session->busActive = &busActive[intfType][intfNum];
+    unsigned int openMicros = sock == NULL ? roundTrip * VISA_SIM_OPEN_ROUND_TRIPS : 0;
+    mutexUnlock(&simMutex);
+
+    if (openMicros > 0)
+        sleepMicros(openMicros);
+    *vi = SIM_SESSION_BASE + slot;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viClose(ViObject vi) {
+    if (vi == SIM_RM_HANDLE)
+        return VI_SUCCESS;
+    if (vi >= SIM_FIND_BASE && vi < SIM_FIND_BASE + VISA_SIM_MAX_SESSIONS) {
+        findLists[vi - SIM_FIND_BASE].expression[0] = '\0';
+        return VI_SUCCESS;
+    }
+    if (vi >= SIM_EVENT_BASE && vi < SIM_EVENT_BASE + VISA_SIM_MAX_EVENTS) {
+        events[vi - SIM_EVENT_BASE].used = 0;
+        return VI_SUCCESS;
+    }
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    tcpClose(session->socket);
+    session->socket = NULL;
+    session->used = 0;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viSetAttribute(ViObject vi, ViAttr attrName, ViAttrState attrValue) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    switch (attrName) {
+    case VI_ATTR_TMO_VALUE:
+        session->timeout = (ViUInt32)attrValue;
+        break;
+    case VI_ATTR_TERMCHAR_EN:
+        session->termCharEnabled = attrValue != VI_FALSE;
+        break;
+    case VI_ATTR_TERMCHAR:
+        session->termChar = (unsigned char)attrValue;
+        break;
+    case VI_ATTR_TCPIP_KEEPALIVE:
+        if (session->socket == NULL || tcpSetKeepAlive(session->socket, attrValue != VI_FALSE) != 0)
+            return VI_ERROR_NSUP_ATTR;
+        break;
+    default:
+        return VI_ERROR_NSUP_ATTR;
+    }
+    if (session->socket != NULL)
+        tcpSetTermChar(session->socket, session->termCharEnabled, session->termChar);
+    return VI_SUCCESS;
+}
+
+/**
+ * @brief Reads the attributes of an I/O completion event.
+ */
+static ViStatus getEventAttribute(SimEvent* event, ViAttr attrName, void* attrValue) {
+    switch (attrName) {
+    case VI_ATTR_EVENT_TYPE:
+        *(ViEventType*)attrValue = VI_EVENT_IO_COMPLETION;
+        return VI_SUCCESS;
+    case VI_ATTR_STATUS:
+        *(ViStatus*)attrValue = event->status;
+        return VI_SUCCESS;
+    case VI_ATTR_JOB_ID:
+        *(ViJobId*)attrValue = event->jobId;
+        return VI_SUCCESS;
+    case VI_ATTR_RET_COUNT_32:
+        *(ViUInt32*)attrValue = event->retCount;
+        return VI_SUCCESS;
+#ifdef VI_ATTR_RET_COUNT_64
+    case VI_ATTR_RET_COUNT_64:
+        *(ViUInt64*)attrValue = event->retCount;
+        return VI_SUCCESS;
+#endif
+    case VI_ATTR_BUFFER:
+        *(ViBuf*)attrValue = event->buf;
+        return VI_SUCCESS;
+    default:
+        return VI_ERROR_NSUP_ATTR;
+    }
+}
+
+ViStatus _VI_FUNC viGetAttribute(ViObject vi, ViAttr attrName, void _VI_PTR attrValue) {
+    if (vi >= SIM_EVENT_BASE && vi < SIM_EVENT_BASE + VISA_SIM_MAX_EVENTS && events[vi - SIM_EVENT_BASE].used)
+        return getEventAttribute(&events[vi - SIM_EVENT_BASE], attrName, attrValue);
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    switch (attrName) {
+    case VI_ATTR_TMO_VALUE:
+        *(ViUInt32*)attrValue = session->timeout;
+        return VI_SUCCESS;
+    case VI_ATTR_TERMCHAR_EN:
+        *(ViBoolean*)attrValue = session->termCharEnabled ? VI_TRUE : VI_FALSE;
+        return VI_SUCCESS;
+    case VI_ATTR_TERMCHAR:
+        *(ViUInt8*)attrValue = session->termChar;
+        return VI_SUCCESS;
+    case VI_ATTR_RSRC_NAME:
+        strcpy((char*)attrValue, session->name);
+        return VI_SUCCESS;
+    default:
+        return VI_ERROR_NSUP_ATTR;
+    }
+}
+
+ViStatus _VI_FUNC viWrite(ViSession vi, ViConstBuf buf, ViUInt32 cnt, ViPUInt32 retCnt) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    if (session->socket != NULL)
+        return tcpWrite(session->socket, buf, cnt, retCnt);
+    if (checkConnection(session) != VI_SUCCESS)
+        return VI_ERROR_CONN_LOST;
+    busTransfer(session, 1);
+    ViStatus status = simWrite(session->instrument, buf, cnt, retCnt);
+    busTransfer(session, -1);
+    return status;
+}
+
+ViStatus _VI_FUNC viRead(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPUInt32 retCnt) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    if (session->socket != NULL)
+        return tcpRead(session->socket, buf, cnt, retCnt, session->timeout);
+    if (checkConnection(session) != VI_SUCCESS)
+        return VI_ERROR_CONN_LOST;
+    busTransfer(session, 1);
+    ViStatus status = simRead(session->instrument, buf, cnt, retCnt, session->timeout);
+    busTransfer(session, -1);
+    return status;
+}
+
+ViStatus _VI_FUNC viClear(ViSession vi) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    unsigned char discard[256];
+    ViUInt32 count;
+    if (session->socket != NULL) {
+        while (tcpRead(session->socket, discard, sizeof(discard), &count, 0) >= VI_SUCCESS)
+            ;
+        return VI_SUCCESS;
+    }
+    if (checkConnection(session) != VI_SUCCESS)
+        return VI_ERROR_CONN_LOST;
+    while (simRead(session->instrument, discard, sizeof(discard), &count, 0) == VI_SUCCESS_MAX_CNT)
+        ;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viReadSTB(ViSession vi, ViPUInt16 status) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    *status = 0;
+    if (session->socket != NULL)
+        return VI_SUCCESS;
+    if (checkConnection(session) != VI_SUCCESS)
+        return VI_ERROR_CONN_LOST;
+    busTransfer(session, 1);
+    ViStatus result = simReadStatusByte(session->instrument, status, session->timeout);
+    busTransfer(session, -1);
+    return result;
+}
+
+ViStatus _VI_FUNC viAssertTrigger(ViSession vi, ViUInt16 protocol) {
+    static const unsigned char trigger[] = "*TRG";
+    (void)protocol;
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    if (session->socket != NULL)
+        return VI_ERROR_NSUP_OPER;
+    if (checkConnection(session) != VI_SUCCESS)
+        return VI_ERROR_CONN_LOST;
+
+    /* The bus trigger reaches the analyzer like a *TRG message, in half a round trip */
+    ViUInt32 count;
+    busTransfer(session, 1);
+    ViStatus status = simWrite(session->instrument, trigger, sizeof(trigger) - 1, &count);
+    busTransfer(session, -1);
+    return status;
+}
+
+ViStatus _VI_FUNC viEnableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism, ViEventFilter context) {
+    (void)context;
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    if (eventType != VI_EVENT_IO_COMPLETION)
+        return VI_ERROR_INV_EVENT;
+    if (mechanism != VI_QUEUE)
+        return VI_ERROR_INV_MECH;
+    session->eventsEnabled = 1;
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viDisableEvent(ViSession vi, ViEventType eventType, ViUInt16 mechanism) {
+    (void)mechanism;
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    if (eventType != VI_EVENT_IO_COMPLETION && eventType != VI_ALL_ENABLED_EVENTS)
+        return VI_ERROR_INV_EVENT;
+    session->eventsEnabled = 0;
+    return VI_SUCCESS;
+}
+
+/**
+ * @brief Queues an asynchronous job on a simulated session. Jobs complete half a round trip after the previous one.
+ */
+static ViStatus submitJob(SimSession* session, int isRead, ViBuf buf, ViUInt32 count, ViPJobId jobId) {
+    if (session->socket != NULL)
+        return VI_ERROR_NSUP_OPER;
+    if (checkConnection(session) != VI_SUCCESS)
+        return VI_ERROR_CONN_LOST;
+
+    mutexLock(&simMutex);
+    if (session->numJobs == VISA_SIM_MAX_JOBS) {
+        mutexUnlock(&simMutex);
+        return VI_ERROR_ALLOC;
+    }
+    SimJob* job = &session->jobs[(session->jobHead + session->numJobs) % VISA_SIM_MAX_JOBS];
+    unsigned long long now = monotonicMicros();
+    job->id = nextJobId++;
+    job->isRead = isRead;
+    job->buf = buf;
+    job->count = count;
+    job->completeAt = (session->busyUntil > now ? session->busyUntil : now) + simRtt(session->instrument) / 2;
+    job->expireAt = job->completeAt + (unsigned long long)session->timeout * 1000;
+    session->busyUntil = job->completeAt;
+    session->numJobs++;
+    if (jobId != NULL)
+        *jobId = job->id;
+    mutexUnlock(&simMutex);
+    return VI_SUCCESS;
+}
+
+ViStatus _VI_FUNC viWriteAsync(ViSession vi, ViConstBuf buf, ViUInt32 cnt, ViPJobId jobId) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    return submitJob(session, 0, (ViBuf)buf, cnt, jobId);
+}
+
+ViStatus _VI_FUNC viReadAsync(ViSession vi, ViPBuf buf, ViUInt32 cnt, ViPJobId jobId) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    return submitJob(session, 1, buf, cnt, jobId);
+}
+
+ViStatus _VI_FUNC viWaitOnEvent(ViSession vi, ViEventType inEventType, ViUInt32 timeout, ViPEventType outEventType, ViPEvent outContext) {
+    SimSession* session = getSession(vi);
+    if (session == NULL)
+        return VI_ERROR_INV_OBJECT;
+    if (inEventType != VI_EVENT_IO_COMPLETION && inEventType != VI_ALL_ENABLED_EVENTS)
+        return VI_ERROR_INV_EVENT;
+    if (!session->eventsEnabled)
+        return VI_ERROR_NENABLED;
+
+    mutexLock(&simMutex);
+    if (session->numJobs == 0) {
+        mutexUnlock(&simMutex);
+        if (timeout != VI_TMO_INFINITE)
+            sleepMs(timeout);
+        return VI_ERROR_TMO;
+    }
+    SimJob job = session->jobs[session->jobHead];
+    mutexUnlock(&simMutex);
+
+    unsigned long long deadline = monotonicMicros() + (unsigned long long)timeout * 1000;
+    ViUInt32 retCount;
+    ViStatus status;
+    for (;;) {
+        unsigned long long now = monotonicMicros();
+        if (job.completeAt > now) {
+            if (timeout != VI_TMO_INFINITE && deadline < job.completeAt) {
+                if (deadline > now)
+                    sleepMicros(deadline - now);
+                return VI_ERROR_TMO;
+            }
+            sleepMicros(job.completeAt - now);
+        }
+
+        /* Jobs take effect in submission order as they complete */
+        status = job.isRead
+            ? simTake(session->instrument, job.buf, job.count, &retCount)
+            : simExecute(session->instrument, job.buf, job.count, &retCount);
+        if (status != VI_ERROR_TMO || job.completeAt >= job.expireAt)
+            break;
+
+        /* Nothing to read yet: the job stays queued until its VISA timeout expires */
+        job.completeAt = job.expireAt;
+        mutexLock(&simMutex);
+        session->jobs[session->jobHead].completeAt = job.expireAt;
+        mutexUnlock(&simMutex);
+    }
+
+    mutexLock(&simMutex);
+    session->jobHead = (session->jobHead + 1) % VISA_SIM_MAX_JOBS;
+    session->numJobs--;
+    int slot = 0;
+    while (slot < VISA_SIM_MAX_EVENTS && events[slot].used)
+        slot++;
+    if (slot == VISA_SIM_MAX_EVENTS) {
+        mutexUnlock(&simMutex);
+        return VI_ERROR_ALLOC;
+    }
+    events[slot].used = 1;
+    events[slot].jobId = job.id;
+    events[slot].status = status;
+    events[slot].retCount = retCount;
+    events[slot].buf = job.buf;
+    mutexUnlock(&simMutex);
+
+    if (outEventType != NULL)
+        *outEventType = VI_EVENT_IO_COMPLETION;
+    if (outContext != NULL)
+        *outContext = SIM_EVENT_BASE + slot;
+    else
+        events[slot].used = 0;
+    return VI_SUCCESS;
+}
@@ -0,0 +1,883 @@
+/*********************************************************************/
+/*                                                                   */
+/* Interactive commands for the options menu. Each one prompts the   */
+/* user, drives the instrument through a VisaSession and prints the  */
+/* outcome; the I/O itself lives in visa-session.c.                  */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "integer-input.h"
+#include "visacommands.h"
+#include "trace-analysis.h"
+#include "trace-decimate.h"
+#include "trace-adaptive.h"
+#include "split-span.h"
+#include "sync-trigger.h"
+#include "scpi-parse.h"
+#include "platform.h"
+
+static ViUInt32 readBytes = READ_BYTES;     // Byte count visaRead() requests, set by visaSetReadBytes()
+
+/**
+ * @brief Prompts user input for integer within range (0 to rangeMax) and tests for validity. Repeats on error.
+ *
+ * @param rangeMax Maximum integer value that user can input.
+ * @return User input integer provided it is in range.
+ */
+int getInput(int rangeMax) {
+    int input;
+    printf("\n");
+    fflush(stdin);
+    getIntegerFromStdin(&input);
+    if (0 <= input && input <= rangeMax) {
+        return input;
+    }
+    else {
+        printf("Invalid input: integer out of range.\n");
+        return getInput(rangeMax);
+    }
+}
+
+/**
+ * @brief Prompts user input for the index of a resource in a list of numResources. Unlike getInput(), a blank line or
+ * an index out of range does not prompt again but cancels.
+ *
+ * @return The index, or -1 to cancel.
+ */
+static int getResourceIndex(int numResources) {
+    char line[16] = "";
+    char* end;
+    printf("\n");
+    s_gets(line, sizeof(line));
+    long index = strtol(line, &end, 10);
+    if (end == line || index < 0 || index >= numResources)
+        return -1;
+    return (int)index;
+}
+
+/**
+ * @brief Gets a string from the standard input and appends it with a null terminator (as opposed to newline).
+ * @param str String that is received from standard input
+ * @param n Amount of characters allotted to the string array (Can read n-1 characters)
+ */
+void s_gets(char* str, int n) {
+    char* str_read = fgets(str, n, stdin);
+    if (!str_read)
+        return;
+
+    int i = 0;
+    while (str[i] != '\n' && str[i] != '\0')
+        i++;
+
+    if (str[i] == '\n')
+        str[i] = '\0';
+}
+
+/**
+ * @brief Prompts user to hit enter to continue.
+ */
+void enterToContinue() {
+    printf("Hit enter to continue.\n");
+    fflush(stdin);
+    getchar();
+}
+
+/**
+ * @brief Prints the SCPI error an instrument reported in checked mode.
+ */
+static void printScpiError(VisaSession* session) {
+    ScpiError error;
+    sessionLastError(session, &error);
+    printf("SCPI error %d: %s\n", error.code, error.message);
+}
+
+/**
+ * @brief Sends the *IDN? command to the instrument and prints its response.
+ */
+void visaIdentify(VisaSession* session) {
+    char response[READ_BYTES];
+
+    printf("Sending *IDN? to the device...\n");
+    ViStatus status = sessionQuery(session, "*IDN?", response, sizeof(response), NULL);
+    if (status < VI_SUCCESS)
+    {
+        printf("Error %X: Cannot query *IDN? from the device\n", status);
+    }
+    else
+    {
+        printf("%s\n", response);
+    }
+}
+
+/**
+ * @brief Sets timeout value to user input integer, or toggles adaptive timeouts.
+ */
+void visaSetTimeout(VisaSession* session) {
+    printf("Enter desired VISA timeout in milliseconds between %d and %d. Default: %d\n", TIMEOUT_MIN, TIMEOUT_MAX, TIMEOUT_MS);
+    printf("Enter %d to turn adaptive timeouts %s. Queries then wait according to their measured latency, up to the timeout.\n",
+        TIMEOUT_ADAPTIVE, sessionAdaptiveTimeout(session) ? "off" : "on");
+    int timeout;
+    int errorFlag = 1;
+    do {
+        timeout = getInput(TIMEOUT_MAX);
+        if (timeout == TIMEOUT_ADAPTIVE) {
+            sessionSetAdaptiveTimeout(session, !sessionAdaptiveTimeout(session));
+            printf("Adaptive timeouts %s\n", sessionAdaptiveTimeout(session) ? "on" : "off");
+            return;
+        }
+        if (TIMEOUT_MIN <= timeout && timeout <= TIMEOUT_MAX) {
+            errorFlag = 0;
+        }
+        else {
+            printf("Invalid input: integer out of range.\n");
+        }
+    } while (errorFlag);
+
+    ViStatus status = sessionSetTimeout(session, timeout);
+    if (status < VI_SUCCESS) {
+        printf("Error %X: Cannot set the timeout.\n", status);
+        return;
+    }
+    float timeoutFloat = timeout;
+    printf("New timeout value: %.3f seconds\n", timeoutFloat / 1000);
+}
+
+/**
+ * @brief Sends user input string to the instrument and prints its response.
+ */
+void visaQuery(VisaSession* session) {
+    printf("Enter SCPI command to send.\n");
+    char stringFromStdin[CHARACTER_MAX];
+    s_gets(stringFromStdin, CHARACTER_MAX);
+    printf("Sending %s to the device...\n", stringFromStdin);
+
+    char* response = malloc(readBytes + 1);
+    ViStatus status = sessionQuery(session, stringFromStdin, response, readBytes + 1, NULL);
+    if (status == SESSION_ERROR_SCPI || status == SESSION_ERROR_HEADER)
+    {
+        printScpiError(session);
+    }
+    else if (status < VI_SUCCESS)
+    {
+        printf("Error %X: Cannot query %s from the device.\n", status, stringFromStdin);
+    }
+    else if (!scpiIsQuery(stringFromStdin, strlen(stringFromStdin)))
+    {
+        printf("No response expected, %s was written as a command.\n", stringFromStdin);
+    }
+    else
+    {
+        printf("Response:\n");
+        printf("%s\n", response);
+    }
+    free(response);
+}
+
+/**
+ * @brief Sends user input string to the instrument.
+ */
+void visaWriteFromStdin(VisaSession* session) {
+    printf("Enter SCPI command to send.\n");
+    char stringFromStdin[CHARACTER_MAX];
+    s_gets(stringFromStdin, CHARACTER_MAX);
+    visaWrite(session, stringFromStdin);
+}
+
+/**
+ * @brief Sends function input string to the instrument.
+ * @param string Function input which will be send to the instrument
+ */
+void visaWrite(VisaSession* session, const char* string) {
+    printf("Sending %s to the device...\n", string);
+
+    ViStatus status = sessionWrite(session, string);
+    if (status == SESSION_ERROR_SCPI || status == SESSION_ERROR_HEADER)
+    {
+        printScpiError(session);
+    }
+    else if (status < VI_SUCCESS)
+    {
+        printf("Error %X: Cannot write %s to the device.\n", status, string);
+    }
+}
+
+/**
+ * @brief Reads a response of up to the configured read bytes from the instrument and prints it.
+ */
+void visaRead(VisaSession* session) {
+    ViUInt32 retCount;
+    char* response = malloc(readBytes + 1);
+
+    ViStatus status = sessionRead(session, response, readBytes + 1, &retCount);
+    if (status == VI_SUCCESS_MAX_CNT) {
+        printf("Warning %X: No termination character or END indicator received. Increase read bytes to fix.\n\n", status);
+    }
+    if (status == SESSION_ERROR_NO_QUERY)
+    {
+        printf("Error %X: No query is awaiting a response, nothing to read.\n", status);
+    }
+    else if (status < VI_SUCCESS)
+    {
+        printf("Error %X: Cannot read response from the device.\n", status);
+    }
+    else
+    {
+        printf("%d bytes returned:\n", retCount);
+        printf("%s\n", response);
+    }
+    free(response);
+}
+
+/**
+ * @brief Sets amount of return bytes to read on visaRead
+ */
+void visaSetReadBytes() {
+    printf("Enter a value of bytes to read. Default: %d bytes. Max: %d bytes.\n", READ_BYTES, MAX_READ_BYTES);
+    int ret = getInput(MAX_READ_BYTES);
+    if (ret == 0) {
+        printf("Invalid input: read count must be at least 1 byte.\n");
+        return;
+    }
+    readBytes = ret;
+    printf("Confirmed: Read count set to %d bytes.\n", ret);
+}
+
+/**
+ * @brief Sends a query to the instrument and converts the response to a double.
+ *
+ * @param query Query to send.
+ * @param print Nonzero to print the query and response.
+ * @return Value of the response, or 0 if nothing could be read.
+ */
+double visaQueryDouble(VisaSession* session, const char* query, int print) {
+    double value;
+    ViStatus status = sessionQueryDouble(session, query, &value);
+    if (status < VI_SUCCESS)
+        printf("Error %X: Cannot query %s from the device.\n", status, query);
+    else if (print)
+        printf("%s %g\n", query, value);
+    return value;
+}
+
+/**
+ * @brief Analyzes a captured trace, prints the results with a decimated view of the trace and saves the trace to a csv file.
+ * Traces are saved to trace000.csv in the location the program is run, incrementing the number until an unused name is found.
+ * Analysis results are written as comment lines in the file header.
+ *
+ * @param freq Frequency array of the trace, in ascending order.
+ * @param amp Amplitude array of the trace.
+ * @param numPoints Number of points in the trace.
+ * @param resBW Resolution bandwidth the trace was captured with.
+ * @param vidBW Video bandwidth the trace was captured with.
+ */
+void visaSaveTrace(double* freq, double* amp, int numPoints, double resBW, double vidBW) {
+    TraceAnalysis analysis;
+    int analyzed = (analyzeTrace(freq, amp, numPoints, resBW, &analysis) == 0);
+    fprintTraceSparkline(stdout, freq, amp, numPoints, SPARKLINE_WIDTH, SPARKLINE_ROWS, DECIMATE_MINMAX);
+    if (analyzed)
+        fprintTraceAnalysis(stdout, &analysis, "");
+
+    /* Check if a file exists with the name trace000.csv */
+    /* If yes, increment number until an unused name is found */
+    FILE* filePtr;
+    int i = 0;
+    char fileName[64];
+    do {
+        sprintf(fileName, "trace%.3d.csv", i);
+        i++;
+        filePtr = fopen(fileName, "r");
+        if (filePtr == NULL)
+            continue;
+        else
+            fclose(filePtr);
+    } while (filePtr != NULL);
+    /* Write header, analysis results and trace information to the file */
+    filePtr = fopen(fileName, "w");
+    if (filePtr == NULL) {
+        printf("Error: Could not open %s for writing.\n", fileName);
+        return;
+    }
+    fprintf(filePtr, "# %s\n# Start: %e\n# Stop: %e\n# Points: %d\n# RBW: %e\n# VBW: %e\n", fileName, freq[0], freq[numPoints - 1], numPoints, resBW, vidBW);
+    if (analyzed)
+        fprintTraceAnalysis(filePtr, &analysis, "# ");
+    fprintf(filePtr, "# Frequency, Amplitude\n");
+    for (int n = 0; n < numPoints; n++) {
+        fprintf(filePtr, "%f,%f\n", freq[n], amp[n]);
+    }
+    if (fclose(filePtr) == 0)
+        printf("Trace data saved to %s\n", fileName);
+    else
+        printf("Error: fclose() could not close the file stream.\n");
+}
+
+/**
+ * @brief Prompts the user to select the number of points to sweep a trace over.
+ *
+ * @return Number of points, or EXIT if the user chose to go back.
+ */
+int selectNumPoints() {
+    int numPoints = EXIT;
+
+    /* User menu to select sweep points */
+    printf("-------- SELECT NUMBER OF POINTS --------\n");
+    printf("%d: Back\n", EXIT);
+    printf("1: 101\n");
+    printf("2: 201\n");
+    printf("3: 401\n");
+    printf("4: 801\n");
+    printf("5: 1601\n");
+    printf("6: Set custom\n");
+
+    switch (getInput(6)) {
+    case EXIT:
+        return EXIT;
+    case 1:
+        numPoints = 101;
+        break;
+    case 2:
+        numPoints = 201;
+        break;
+    case 3:
+        numPoints = 401;
+        break;
+    case 4:
+        numPoints = 801;
+        break;
+    case 5:
+        numPoints = 1601;
+        break;
+    case 6:
+        printf("Enter number of points to sweep. Min: 21, Max: 24001\n");
+        do {
+            numPoints = getInput(24001);
+            if (numPoints < 21)
+                printf("Invalid input: integer out of range.\n");
+        } while (numPoints < 21);
+        break;
+    }
+    return numPoints;
+}
+
+/**
+ * @brief Reads the span and bandwidths and sets up the markers, printing the setup or the error.
+ * @return 0 on success, 1 on error.
+ */
+static int visaPrepareMarkerCapture(VisaSession* session, MarkerSetup* setup) {
+    ViStatus status = sessionPrepareMarkerCapture(session, setup);
+    if (status == VI_ERROR_INV_SETUP) {
+        printf("Error: Start or stop frequency could not be read from the device.\n");
+        return 1;
+    }
+    if (status < VI_SUCCESS) {
+        printf("Error %X: Cannot set up the marker capture.\n", status);
+        return 1;
+    }
+    printf("Start frequency: %e, Stop frequency: %e\n", setup->startFreq, setup->stopFreq);
+    printf("Resolution bandwidth: %e, Video bandwidth: %e\n", setup->resBW, setup->vidBW);
+    printf("Markers read per round trip: %d\n", setup->numMarkers);
+    return 0;
+}
+
+/**
+ * @brief Generates a csv of the current trace, as one binary transfer if the analyzer's capability profile allows it,
+ * otherwise with markers. The trace is analyzed and saved with visaSaveTrace().
+ */
+void visaGetTraceFromMarkers(VisaSession* session) {
+    int numPoints;                  // Number of points to sweep trace over
+    MarkerSetup setup;              // Frequency span and bandwidths read from the instrument
+
+    numPoints = selectNumPoints();
+    if (numPoints == EXIT)
+        return;
+
+    double* freq = malloc(sizeof(double) * numPoints);      // Array which stores frequency values of trace
+    double* amp = malloc(sizeof(double) * numPoints);       // Array which stores amplitude values of trace
+    ViStatus status = sessionCaptureTrace(session, numPoints, &setup, freq, amp);
+
+    if (status == VI_ERROR_INV_SETUP) {
+        printf("Error: Start or stop frequency could not be read from the device.\n");
+    }
+    else if (status < VI_SUCCESS) {
+        printf("Error %X: Trace capture failed, no trace saved.\n", status);
+    }
+    else {
+        printf("Start frequency: %e, Stop frequency: %e\n", setup.startFreq, setup.stopFreq);
+        printf("Resolution bandwidth: %e, Video bandwidth: %e\n", setup.resBW, setup.vidBW);
+        if (setup.numMarkers > 0)
+            printf("Markers read per round trip: %d\n", setup.numMarkers);
+        else
+            printf("Trace read as one binary transfer.\n");
+        printf("\nNumber of points: %d, Frequency spacing: %g\n", numPoints, (setup.stopFreq - setup.startFreq) / (numPoints - 1));
+        visaSaveTrace(freq, amp, numPoints, setup.resBW, setup.vidBW);
+    }
+    free(freq);
+    free(amp);
+}
+
+/**
+ * @brief Uses markers to capture the current trace adaptively: a coarse pass over the span, then refinement only where the
+ * trace is steep or above the noise floor, up to a point budget. Points are spaced non-uniformly in the saved csv.
+ * Should only be used for devices that don't support file transfer via SCPI.
+ */
+void visaGetTraceAdaptive(VisaSession* session) {
+    int numPoints;                  // Number of points on the full-resolution grid
+    MarkerSetup setup;              // Frequency span and bandwidths read from the instrument
+    AdaptivePlan plan;
+
+    numPoints = selectNumPoints();
+    if (numPoints == EXIT)
+        return;
+    if (visaPrepareMarkerCapture(session, &setup) != 0)
+        return;
+
+    adaptivePlanDefaults(&plan, setup.startFreq, setup.stopFreq, numPoints);
+    printf("Enter maximum number of points to measure. Min: %d, Max: %d, Suggested: %d\n", plan.coarsePoints, numPoints, plan.pointBudget);
+    do {
+        plan.pointBudget = getInput(numPoints);
+        if (plan.pointBudget < plan.coarsePoints)
+            printf("Invalid input: integer out of range.\n");
+    } while (plan.pointBudget < plan.coarsePoints);
+
+    double* freq = malloc(sizeof(double) * plan.pointBudget);  // Array which stores frequency values of trace
+    double* amp = malloc(sizeof(double) * plan.pointBudget);   // Array which stores amplitude values of trace
+    sessionLock(session);
+    int measured = adaptiveCapture(&plan, sessionMarkerPoint, session, freq, amp);
+    sessionUnlock(session);
+    sessionFinishMarkerCapture(session);
+
+    if (measured > 0) {
+        printf("\nGrid points: %d, Coarse points: %d, Measured points: %d\n", numPoints, plan.coarsePoints, measured);
+        visaSaveTrace(freq, amp, measured, setup.resBW, setup.vidBW);
+    }
+    else {
+        printf("Error: Adaptive capture could not be planned.\n");
+    }
+    free(freq);
+    free(amp);
+}
+
+
+/**
+ * @brief Splits the span of the current analyzer across several analyzers, captures the slices in parallel and saves
+ * the stitched trace. The analyzers should be identical models with matching settings.
+ *
+ * @param pool Pool the analyzers' sessions are taken from and handed back to.
+ * @param registry Resources found, to choose the analyzers from.
+ */
+void visaSplitSpanCapture(VisaSession* session, SessionPool* pool, const ResourceRegistry* registry) {
+    VisaSession* sessions[SPLIT_SPAN_MAX];
+    int numSessions;
+    int numPoints;
+    double startFreq, stopFreq;     // Full span, read from the current analyzer
+    double resBW, vidBW;            // Resolution and video bandwidth read from the current analyzer
+
+    printf("Enter number of analyzers to split the span across. Min: 2, Max: %d\n", SPLIT_SPAN_MAX);
+    do {
+        numSessions = getInput(SPLIT_SPAN_MAX);
+        if (numSessions < 2)
+            printf("Invalid input: integer out of range.\n");
+    } while (numSessions < 2);
+
+    numPoints = selectNumPoints();
+    if (numPoints == EXIT)
+        return;
+
+    startFreq = visaQueryDouble(session, ":SENSe:FREQuency:STARt?", 1);
+    stopFreq = visaQueryDouble(session, ":SENSe:FREQuency:STOP?", 1);
+    resBW = visaQueryDouble(session, ":SENSe:BANDwidth:RESolution?", 1);
+    vidBW = visaQueryDouble(session, ":SENSe:BANDwidth:VIDeo?", 1);
+    if (startFreq < 0 || stopFreq <= startFreq) {
+        printf("Error: Start or stop frequency could not be read from the device.\n");
+        return;
+    }
+
+    /* Open a session to each analyzer, in order from lowest to highest slice */
+    int numResources = registryCount(registry);
+    for (int i = 0; i < numResources; i++) {
+        printf("%3d --- %s\n", i, registryEntry(registry, i)->descriptor);
+    }
+    int opened = 0;
+    while (opened < numSessions) {
+        ViStatus status;
+        printf("Enter resource index of analyzer %d of %d.\n", opened + 1, numSessions);
+        const char* resource = registryEntry(registry, getInput(numResources - 1))->descriptor;
+        sessions[opened] = poolAcquire(pool, resource, &status);
+        if (sessions[opened] == NULL) {
+            printf("Error code 0x%X. An error occurred opening a session to %s\n", status, resource);
+            continue;
+        }
+        int duplicate = 0;
+        for (int i = 0; i < opened; i++)
+            duplicate |= sessions[i] == sessions[opened];
+        if (duplicate) {
+            printf("Invalid input: %s was already selected.\n", resource);
+            poolRelease(pool, sessions[opened]);
+            continue;
+        }
+        opened++;
+    }
+
+    double* freq = malloc(sizeof(double) * numPoints);      // Array which stores frequency values of the stitched trace
+    double* amp = malloc(sizeof(double) * numPoints);       // Array which stores amplitude values of the stitched trace
+    printf("Capturing %d points from %e to %e across %d analyzers...\n", numPoints, startFreq, stopFreq, numSessions);
+    if (splitSpanCapture(sessions, numSessions, startFreq, stopFreq, numPoints, freq, amp) == 0) {
+        visaSaveTrace(freq, amp, numPoints, resBW, vidBW);
+    }
+    else {
+        printf("Error: Split-span capture failed, no trace saved.\n");
+    }
+
+    for (int i = 0; i < numSessions; i++) {
+        poolRelease(pool, sessions[i]);
+    }
+    free(freq);
+    free(amp);
+}
+
+/**
+ * @brief Writes the traces of a campaign to campaign000.csv, or the first unused number, one row per point.
+ */
+static void visaSaveCampaign(const RemoteAddress* agents, const RemoteJob* jobs, const RemoteResult* results, int numJobs) {
+    FILE* filePtr;
+    int i = 0;
+    char fileName[64];
+    do {
+        sprintf(fileName, "campaign%.3d.csv", i);
+        i++;
+        filePtr = fopen(fileName, "r");
+        if (filePtr != NULL)
+            fclose(filePtr);
+    } while (filePtr != NULL);
+    filePtr = fopen(fileName, "w");
+    if (filePtr == NULL) {
+        printf("Error: Could not open %s for writing.\n", fileName);
+        return;
+    }
+    fprintf(filePtr, "# %s\n# Agent, Resource, Trace, RBW, VBW, Frequency, Amplitude\n", fileName);
+    for (int j = 0; j < numJobs; j++) {
+        const RemoteResult* result = &results[j];
+        double freqSpacing = result->numPoints > 1 ? (result->stopFreq - result->startFreq) / (result->numPoints - 1) : 0;
+        for (int n = 0; n < result->numPoints; n++) {
+            fprintf(filePtr, "%s:%d,%s,%d,%e,%e,%f,%f\n", agents[jobs[j].agent].host, agents[jobs[j].agent].port,
+                jobs[j].resource, j, result->resBW, result->vidBW, result->startFreq + n * freqSpacing, result->amp[n]);
+        }
+    }
+    if (fclose(filePtr) == 0)
+        printf("Campaign traces saved to %s\n", fileName);
+    else
+        printf("Error: fclose() could not close the file stream.\n");
+}
+
+/**
+ * @brief Runs a capture campaign on agents on other hosts (FindRsrc --agent): every analyzer the agents list captures
+ * the same number of traces, all analyzers at once. Prints the throughput of each agent and of the whole campaign and
+ * saves the traces with visaSaveCampaign().
+ *
+ * @param agents Addresses of the agents.
+ */
+void visaCoordinateCapture(const RemoteAddress* agents, int numAgents) {
+    char list[REMOTE_LINE_BYTES];
+    RemoteJob* analyzers = NULL;    // One job per analyzer, repeated for each trace
+    int numAnalyzers = 0;
+
+    for (int a = 0; a < numAgents; a++) {
+        ViStatus status = remoteListResources(&agents[a], list, sizeof(list));
+        if (status < VI_SUCCESS) {
+            printf("Error code 0x%X. Agent %s:%d could not be reached.\n", status, agents[a].host, agents[a].port);
+            continue;
+        }
+        int found = 0;
+        for (char* resource = strtok(list, ","); resource != NULL; resource = strtok(NULL, ",")) {
+            RemoteJob* grown = realloc(analyzers, sizeof(RemoteJob) * (numAnalyzers + 1));
+            if (grown == NULL)
+                break;
+            analyzers = grown;
+            analyzers[numAnalyzers].agent = a;
+            snprintf(analyzers[numAnalyzers].resource, VI_FIND_BUFLEN, "%s", resource);
+            numAnalyzers++;
+            found++;
+        }
+        printf("Agent %s:%d: %d analyzers\n", agents[a].host, agents[a].port, found);
+    }
+    if (numAnalyzers == 0) {
+        printf("Error: No analyzers to capture from.\n");
+        free(analyzers);
+        return;
+    }
+
+    int numPoints = selectNumPoints();
+    if (numPoints == EXIT) {
+        free(analyzers);
+        return;
+    }
+    printf("Enter number of traces per analyzer. Min: 1, Max: %d\n", CAMPAIGN_MAX_TRACES);
+    int numTraces;
+    do {
+        numTraces = getInput(CAMPAIGN_MAX_TRACES);
+        if (numTraces < 1)
+            printf("Invalid input: integer out of range.\n");
+    } while (numTraces < 1);
+
+    int numJobs = numAnalyzers * numTraces;
+    RemoteJob* jobs = malloc(sizeof(RemoteJob) * numJobs);
+    RemoteResult* results = malloc(sizeof(RemoteResult) * numJobs);
+    if (jobs == NULL || results == NULL) {
+        printf("Error: Not enough memory for %d traces.\n", numJobs);
+        free(analyzers);
+        free(jobs);
+        free(results);
+        return;
+    }
+    for (int j = 0; j < numJobs; j++) {
+        jobs[j] = analyzers[j % numAnalyzers];
+        jobs[j].numPoints = numPoints;
+    }
+
+    printf("Capturing %d traces of %d points on %d analyzers across %d agents...\n", numJobs, numPoints, numAnalyzers, numAgents);
+    unsigned long long start = monotonicMicros();
+    int captured = remoteDispatch(agents, numAgents, jobs, numJobs, results);
+    double seconds = (monotonicMicros() - start) / 1e6;
+    if (captured < 0) {
+        printf("Error: Not enough memory to dispatch the campaign.\n");
+        captured = 0;
+    }
+
+    /* Busy time adds up the capture times an agent reported, so busy time above the elapsed time is parallelism. An
+       agent's rate is over its own elapsed time, until its last trace arrived, not until the slowest agent finished */
+    double busySeconds = 0;
+    for (int a = 0; a < numAgents; a++) {
+        int traces = 0, failed = 0;
+        double agentSeconds = 0, elapsedSeconds = 0;
+        for (int j = 0; j < numJobs; j++) {
+            if (jobs[j].agent != a)
+                continue;
+            if (results[j].numPoints > 0)
+                traces++;
+            else
+                failed++;
+            agentSeconds += results[j].captureMicros / 1e6;
+            if (results[j].doneMicros / 1e6 > elapsedSeconds)
+                elapsedSeconds = results[j].doneMicros / 1e6;
+        }
+        busySeconds += agentSeconds;
+        printf("Agent %s:%d: %d traces, %d failed, %.2f s busy, %.2f s elapsed, %.1f traces/s\n", agents[a].host,
+            agents[a].port, traces, failed, agentSeconds, elapsedSeconds,
+            elapsedSeconds > 0 ? traces / elapsedSeconds : 0.0);
+    }
+    for (int j = 0; j < numJobs; j++) {
+        if (results[j].numPoints == 0) {
+            printf("Error code 0x%X. First failed trace: %s\n", results[j].status, jobs[j].resource);
+            break;
+        }
+    }
+    printf("Campaign: %d of %d traces in %.2f s, %.1f traces/s, %.0f points/s, %.1f analyzers busy on average\n",
+        captured, numJobs, seconds, captured / seconds, (double)captured * numPoints / seconds,
+        busySeconds / seconds);
+    if (captured > 0)
+        visaSaveCampaign(agents, jobs, results, numJobs);
+
+    remoteFreeResults(results, numJobs);
+    free(analyzers);
+    free(jobs);
+    free(results);
+}
+
+/**
+ * @brief Writes the readings of a synchronized capture to sync000.csv, or the first unused number, one row per reading.
+ * Times are host microseconds after the first release, so the readings of all rounds share one time axis.
+ */
+static void visaSaveSync(const SyncTarget* targets, int numTargets, const SyncReading* readings, const SyncReport* reports,
+    int numRounds) {
+    FILE* filePtr;
+    int i = 0;
+    char fileName[64];
+    do {
+        sprintf(fileName, "sync%.3d.csv", i);
+        i++;
+        filePtr = fopen(fileName, "r");
+        if (filePtr != NULL)
+            fclose(filePtr);
+    } while (filePtr != NULL);
+    filePtr = fopen(fileName, "w");
+    if (filePtr == NULL) {
+        printf("Error: Could not open %s for writing.\n", fileName);
+        return;
+    }
+    fprintf(filePtr, "# %s\n# Round, Resource, Trigger, Trigger time (us), Uncertainty (us), Reading time (us), Value\n",
+        fileName);
+    for (int r = 0; r < numRounds; r++) {
+        unsigned long long offset = reports[r].releaseMicros - reports[0].releaseMicros;
+        for (int t = 0; t < numTargets; t++) {
+            const SyncReading* reading = &readings[r * numTargets + t];
+            if (reading->status < VI_SUCCESS)
+                continue;
+            fprintf(filePtr, "%d,%s,%s,%llu,%llu,%llu,%f\n", r, sessionResource(targets[t].session),
+                reading->scpiTrigger ? "*TRG" : "viAssertTrigger", offset + reading->triggerMicros,
+                reading->triggerSpan / 2, offset + reading->readingMicros, reading->value);
+        }
+    }
+    if (fclose(filePtr) == 0)
+        printf("Synchronized readings saved to %s\n", fileName);
+    else
+        printf("Error: fclose() could not close the file stream.\n");
+}
+
+/**
+ * @brief Triggers the current instrument together with others, e.g. an analyzer and a power meter, and reads each
+ * one's reading with the host time of its trigger. Prints the readings and the trigger skew and saves them with
+ * visaSaveSync().
+ *
+ * @param pool Pool the other instruments' sessions are taken from and handed back to.
+ * @param registry Resources found, to choose the other instruments from.
+ */
+void visaSyncCapture(VisaSession* session, SessionPool* pool, const ResourceRegistry* registry) {
+    SyncTarget targets[SYNC_MAX_TARGETS];
+    SyncSettings settings[SYNC_MAX_TARGETS];
+    char fetch[SYNC_MAX_TARGETS][SYNC_QUERY_BYTES];
+    int numTargets, numRounds;
+
+    /* Every other instrument is one of the resources found, so there can be no more targets than resources */
+    int numResources = registryCount(registry);
+    int maxTargets = numResources < SYNC_MAX_TARGETS ? numResources : SYNC_MAX_TARGETS;
+    if (maxTargets < 2) {
+        printf("Error: No other instrument was found to trigger together with this one.\n");
+        return;
+    }
+    printf("Enter number of instruments to trigger together, including this one. Min: 2, Max: %d\n", maxTargets);
+    do {
+        numTargets = getInput(maxTargets);
+        if (numTargets < 2)
+            printf("Invalid input: integer out of range.\n");
+    } while (numTargets < 2);
+
+    for (int i = 0; i < numResources; i++) {
+        printf("%3d --- %s\n", i, registryEntry(registry, i)->descriptor);
+    }
+    targets[0].session = session;
+    int opened = 1;
+    while (opened < numTargets) {
+        ViStatus status;
+        printf("Enter resource index of instrument %d of %d, or nothing to cancel.\n", opened + 1, numTargets);
+        int index = getResourceIndex(numResources);
+        if (index < 0) {
+            printf("Synchronized capture cancelled.\n");
+            for (int t = 1; t < opened; t++)
+                poolRelease(pool, targets[t].session);
+            return;
+        }
+        const char* resource = registryEntry(registry, index)->descriptor;
+        targets[opened].session = poolAcquire(pool, resource, &status);
+        if (targets[opened].session == NULL) {
+            printf("Error code 0x%X. An error occurred opening a session to %s\n", status, resource);
+            continue;
+        }
+        int duplicate = 0;
+        for (int i = 0; i < opened; i++)
+            duplicate |= targets[i].session == targets[opened].session;
+        if (duplicate) {
+            printf("Invalid input: %s was already selected.\n", resource);
+            poolRelease(pool, targets[opened].session);
+            continue;
+        }
+        opened++;
+    }
+    for (int t = 0; t < numTargets; t++) {
+        printf("Enter the reading query of %s, or nothing for %s\n", sessionResource(targets[t].session),
+            SYNC_DEFAULT_FETCH);
+        s_gets(fetch[t], SYNC_QUERY_BYTES);
+        targets[t].arm = NULL;
+        targets[t].fetch = fetch[t][0] != '\0' ? fetch[t] : NULL;
+    }
+
+    printf("Enter number of readings per instrument. Min: 1, Max: %d\n", SYNC_MAX_ROUNDS);
+    do {
+        numRounds = getInput(SYNC_MAX_ROUNDS);
+        if (numRounds < 1)
+            printf("Invalid input: integer out of range.\n");
+    } while (numRounds < 1);
+
+    SyncReading* readings = malloc(sizeof(SyncReading) * numTargets * numRounds);
+    SyncReport* reports = malloc(sizeof(SyncReport) * numRounds);
+    if (readings == NULL || reports == NULL) {
+        printf("Error: Not enough memory for %d readings.\n", numTargets * numRounds);
+        goto done;
+    }
+
+    for (int t = 0; t < numTargets; t++) {
+        ViStatus status = syncSaveSettings(targets[t].session, &settings[t]);
+        if (status < VI_SUCCESS)
+            printf("Error code 0x%X. Could not read the trigger settings of %s; they will not be restored\n", status,
+                sessionResource(targets[t].session));
+    }
+    int taken = 0, complete = 0;
+    unsigned long long maxSkew = 0, totalSkew = 0, maxSpan = 0;
+    for (int r = 0; r < numRounds; r++) {
+        SyncReading* round = &readings[r * numTargets];
+        taken += syncTrigger(targets, numTargets, round, &reports[r]);
+        if (reports[r].triggered < numTargets)
+            continue;
+        complete++;
+        totalSkew += reports[r].skewMicros;
+        if (reports[r].skewMicros > maxSkew)
+            maxSkew = reports[r].skewMicros;
+        if (reports[r].maxSpanMicros > maxSpan)
+            maxSpan = reports[r].maxSpanMicros;
+    }
+    for (int t = 0; t < numTargets; t++) {
+        ViStatus status = syncRestoreSettings(targets[t].session, &settings[t]);
+        if (status < VI_SUCCESS)
+            printf("Error code 0x%X. Could not restore the trigger settings of %s\n", status,
+                sessionResource(targets[t].session));
+    }
+
+    for (int t = 0; t < numTargets; t++) {
+        const SyncReading* last = NULL;
+        int failed = 0;
+        for (int r = 0; r < numRounds; r++) {
+            const SyncReading* reading = &readings[r * numTargets + t];
+            if (reading->status >= VI_SUCCESS)
+                last = reading;
+            else if (failed++ == 0)
+                printf("Error code 0x%X. First failed reading of %s\n", reading->status, sessionResource(targets[t].session));
+        }
+        if (last != NULL)
+            printf("%s: %d readings, triggered by %s, last %s at +%llu us\n", sessionResource(targets[t].session),
+                numRounds - failed, last->scpiTrigger ? "*TRG" : "viAssertTrigger", last->reading, last->triggerMicros);
+    }
+    if (complete > 0)
+        printf("Trigger skew over %d rounds with every instrument triggered: max %llu us, mean %.1f us, "
+            "each trigger time within +/-%llu us\n", complete, maxSkew, (double)totalSkew / complete, maxSpan / 2);
+    if (taken > 0)
+        visaSaveSync(targets, numTargets, readings, reports, numRounds);
+
+done:
+    for (int t = 1; t < numTargets; t++) {
+        poolRelease(pool, targets[t].session);
+    }
+    free(readings);
+    free(reports);
+}
+
+/**
+ * @brief Detects if the trace is set to continuous or not, then toggles it.
+ */
+void visaToggleFreeze(VisaSession* session) {
+    double value;
+    if (sessionQueryDouble(session, ":INITiate:CONTinuous?", &value) < VI_SUCCESS) {
+        printf("Error: Cannot read the sweep mode from the device.\n");
+        return;
+    }
+    switch ((int)value) {
+    case 0:
+        visaWrite(session, ":INIT:CONT ON");
+        break;
+    case 1:
+        visaWrite(session, ":INIT:CONT OFF");
+        break;
+    default:
+        printf("Error\n");
+    }
+}
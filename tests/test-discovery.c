@@ -0,0 +1,61 @@
+/*********************************************************************/
+/*                                                                   */
+/* Tests of discovery.c: glob matching, filters and the search       */
+/* expression.                                                       */
+/*                                                                   */
+/*********************************************************************/
+
+#include <string.h>
+#include "discovery.h"
+#include "test.h"
+
+static void testGlob(void) {
+    CHECK(discoveryGlob("TCPIP*::INSTR", "TCPIP0::192.168.1.5::INSTR"));
+    CHECK(discoveryGlob("tcpip?::*", "TCPIP0::host::5025::SOCKET"));
+    CHECK(!discoveryGlob("TCPIP?::*", "TCPIP::host::INSTR"));
+    CHECK(discoveryGlob("*", ""));
+    CHECK(!discoveryGlob("?", ""));
+    CHECK(discoveryGlob("GPIB[0-1]::*", "gpib1::18::INSTR"));
+    CHECK(!discoveryGlob("GPIB[0-1]::*", "GPIB2::18::INSTR"));
+    CHECK(discoveryGlob("GPIB[!0]::*", "GPIB2::18::INSTR"));
+    CHECK(!discoveryGlob("GPIB[^0-2]::*", "GPIB2::18::INSTR"));
+    CHECK(discoveryGlob("ASRL[-a]*", "ASRL-1"));
+    CHECK(discoveryGlob("*[0-9]", "USB0::0x0957::0x0D0B::MY1"));
+
+    /* An unterminated class matches nothing rather than reading past the pattern */
+    CHECK(!discoveryGlob("GPIB[0", "GPIB0"));
+    CHECK(!discoveryGlob("GPIB[", "GPIB"));
+    CHECK(!discoveryGlob("GPIB[!", "GPIBx"));
+    CHECK(!discoveryGlob("[!", ""));
+}
+
+static void testFilter(void) {
+    DiscoveryFilter filter;
+    char expression[64];
+
+    discoveryInit(&filter);
+    CHECK(discoveryMatches(&filter, "ASRL1::INSTR"));
+    discoveryExpression(&filter, expression, sizeof(expression));
+    CHECK_STR(expression, DISCOVERY_ALL);
+
+    CHECK(discoveryInterfaces(&filter, "gpib,tcpip") == 0 && filter.numInterfaces == 2);
+    CHECK_STR(filter.interfaces[0], "GPIB");
+    CHECK(discoveryInterfaces(&filter, "usb,,asrl") == 1);
+    discoveryInit(&filter);
+    CHECK(discoveryInterfaces(&filter, "gpib,tcpip") == 0);
+    CHECK(discoveryInclude(&filter, "*::INSTR") == 0);
+    CHECK(discoveryExclude(&filter, "TCPIP0::10.*") == 0);
+    CHECK(discoveryMatches(&filter, "GPIB0::18::INSTR"));
+    CHECK(discoveryMatches(&filter, "TCPIP0::192.168.1.5::INSTR"));
+    CHECK(!discoveryMatches(&filter, "TCPIP0::10.0.0.1::INSTR"));
+    CHECK(!discoveryMatches(&filter, "TCPIP0::host::5025::SOCKET"));
+    CHECK(!discoveryMatches(&filter, "ASRL1::INSTR"));
+    discoveryExpression(&filter, expression, sizeof(expression));
+    CHECK(strstr(expression, "GPIB") != NULL && strstr(expression, "TCPIP") != NULL);
+}
+
+int main(void) {
+    testGlob();
+    testFilter();
+    return testResult("discovery");
+}
@@ -0,0 +1,70 @@
+/*********************************************************************/
+/*                                                                   */
+/* Tests of resource-registry.c: adding, finding by descriptor and   */
+/* alias, and growing past the initial capacity.                     */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "resource-registry.h"
+#include "test.h"
+
+static void testLookup(ResourceRegistry* registry) {
+    int gpib = registryAdd(registry, "GPIB0::18::INSTR");
+    int lan = registryAdd(registry, "TCPIP0::192.168.1.5::INSTR");
+    CHECK(gpib == 0 && lan == 1 && registryCount(registry) == 2);
+    CHECK(registryAdd(registry, "GPIB0::18::INSTR") == gpib && registryCount(registry) == 2);
+    CHECK(registryFind(registry, "gpib0::18::instr") == gpib);
+    CHECK(registryFind(registry, "GPIB0::19::INSTR") == -1);
+
+    CHECK(registrySetAlias(registry, lan, "Analyzer") == 0);
+    CHECK(registryFind(registry, "ANALYZER") == lan);
+    CHECK(registrySetAlias(registry, gpib, "analyzer") == 1);
+    CHECK(registrySetAlias(registry, gpib, "TCPIP0::192.168.1.5::INSTR") == 1);
+    CHECK(registrySetAlias(registry, lan, "SA1") == 0);
+    CHECK(registryFind(registry, "Analyzer") == -1 && registryFind(registry, "SA1") == lan);
+    CHECK(registrySetAlias(registry, lan, "") == 0);
+    CHECK(registryFind(registry, "SA1") == -1 && registryEntry(registry, lan)->alias == NULL);
+
+    CHECK(registrySetIdn(registry, gpib, "Keysight Technologies,N9020B,MY123,A.30\r\n") == 0);
+    CHECK_STR(registryEntry(registry, gpib)->idn, "Keysight Technologies,N9020B,MY123,A.30");
+    registrySetInterface(registry, lan, VI_INTF_TCPIP, 0);
+    CHECK(registryEntry(registry, lan)->intfType == VI_INTF_TCPIP);
+}
+
+static void testGrowth(ResourceRegistry* registry) {
+    char descriptor[64], alias[16];
+    int first = registryCount(registry);
+    const char* firstDescriptor = registryEntry(registry, 0)->descriptor;
+
+    for (int i = 0; i < 4 * REGISTRY_INITIAL_CAPACITY; i++) {
+        sprintf(descriptor, "TCPIP0::10.0.%d.%d::INSTR", i / 256, i % 256);
+        CHECK(registryAdd(registry, descriptor) == first + i);
+        if (i % 3 == 0) {
+            sprintf(alias, "DUT%d", i);
+            CHECK(registrySetAlias(registry, first + i, alias) == 0);
+        }
+    }
+    CHECK(registryCount(registry) == first + 4 * REGISTRY_INITIAL_CAPACITY);
+    for (int i = 0; i < 4 * REGISTRY_INITIAL_CAPACITY; i++) {
+        sprintf(descriptor, "tcpip0::10.0.%d.%d::instr", i / 256, i % 256);
+        CHECK(registryFind(registry, descriptor) == first + i);
+        sprintf(alias, "dut%d", i);
+        CHECK(registryFind(registry, alias) == (i % 3 == 0 ? first + i : -1));
+    }
+    /* Interned strings stay where they are as the entries grow */
+    CHECK(registryEntry(registry, 0)->descriptor == firstDescriptor);
+    CHECK(registryMemory(registry) > 0);
+}
+
+int main(void) {
+    ResourceRegistry* registry = registryCreate();
+    CHECK(registry != NULL);
+    if (registry == NULL)
+        return testResult("resource-registry");
+    testLookup(registry);
+    testGrowth(registry);
+    registryDestroy(registry);
+    return testResult("resource-registry");
+}
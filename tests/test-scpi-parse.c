@@ -0,0 +1,97 @@
+/*********************************************************************/
+/*                                                                   */
+/* Tests of scpi-parse.c: header matching, response units, error     */
+/* queue entries and definite length blocks.                         */
+/*                                                                   */
+/*********************************************************************/
+
+#include <string.h>
+#include "scpi-parse.h"
+#include "test.h"
+
+#define MATCH(header, pattern, suffix) scpiMatchHeader(header, strlen(header), pattern, suffix)
+
+static void testHeaders(void) {
+    int suffix;
+
+    CHECK(MATCH(":SENS:FREQ:STAR 1e9", "[:SENSe]:FREQuency:STARt", NULL));
+    CHECK(MATCH(":frequency:start 1e9", "[:SENSe]:FREQuency:STARt", NULL));
+    CHECK(MATCH("FREQ:STAR", "[:SENSe]:FREQuency:STARt", NULL));
+    CHECK(!MATCH(":FREQ:STO 1e9", "[:SENSe]:FREQuency:STARt", NULL));
+    CHECK(!MATCH(":FREQU:STAR", "[:SENSe]:FREQuency:STARt", NULL));
+    CHECK(!MATCH(":FREQ:STAR?", "[:SENSe]:FREQuency:STARt", NULL));
+    CHECK(MATCH(":FREQ:STAR?", "[:SENSe]:FREQuency:STARt?", NULL));
+
+    CHECK(MATCH(":CALC:MARK3:X 1e9", ":CALCulate:MARKer#:X", &suffix) && suffix == 3);
+    CHECK(MATCH(":CALC:MARK:X 1e9", ":CALCulate:MARKer#:X", &suffix) && suffix == 1);
+
+    const char* command = ":SWE:POIN   1001";
+    CHECK_STR(scpiSkipHeader(command, strlen(command)), "1001");
+    command = "*RST";
+    CHECK(scpiSkipHeader(command, strlen(command)) == command + 4);
+
+    size_t mnemonicLength;
+    int query;
+    command = ":CALC:MARK2:STAT?";
+    const char* mnemonic = scpiLastMnemonic(command, strlen(command), &mnemonicLength, &query);
+    CHECK(mnemonicLength == 4 && strncmp(mnemonic, "STAT", 4) == 0 && query);
+    CHECK(scpiMnemonicHash("stat", 4) == scpiMnemonicHash("STAT", 4));
+
+    CHECK(scpiIsQuery("*IDN?", 5));
+    CHECK(scpiIsQuery(":INIT;*OPC?", 11));
+    CHECK(!scpiIsQuery(":INIT:CONT OFF", 14));
+}
+
+static void testResponses(void) {
+    const char* response = "1.5;\"a;b\";OFF";
+    size_t length = strlen(response);
+    CHECK(scpiUnitLength(response, length) == 3);
+    CHECK(scpiUnitLength(response + 4, length - 4) == 5);
+    CHECK(scpiUnitLength(response + 10, length - 10) == 3);
+
+    /* A ';' inside the block payload does not end the unit */
+    const char* block = "#15ab;cd;1";
+    CHECK(scpiUnitLength(block, strlen(block)) == 8);
+
+    int code;
+    char message[16];
+    const char* error = " -113,\"Undefined header\"\n";
+    CHECK(scpiParseError(error, strlen(error), &code, message, sizeof(message)) == 0);
+    CHECK(code == -113);
+    CHECK_STR(message, "Undefined heade");
+    error = "+0,\"No error\"";
+    CHECK(scpiParseError(error, strlen(error), &code, message, sizeof(message)) == 0 && code == 0);
+    CHECK_STR(message, "No error");
+    error = "1.5e9";
+    CHECK(scpiParseError(error, strlen(error), &code, message, sizeof(message)) == 1);
+}
+
+static void testBlocks(void) {
+    size_t offset, length;
+    CHECK(scpiBlockHeader((const unsigned char*)"#3012abcdefghijkl", 17, &offset, &length) == 0);
+    CHECK(offset == 5 && length == 12);
+    CHECK(scpiBlockHeader((const unsigned char*)"#3012abc", 8, &offset, &length) == 1);
+    CHECK(scpiBlockHeader((const unsigned char*)"#0abc", 5, &offset, &length) == 1);
+    CHECK(scpiBlockHeader((const unsigned char*)"#2x4abcd", 8, &offset, &length) == 1);
+    CHECK(scpiBlockHeader((const unsigned char*)"1,2,3", 5, &offset, &length) == 1);
+
+    float values[3] = { 1.0f, -2.5f, 1e-3f }, decoded[3];
+    unsigned char block[32];
+    for (int bigEndian = 0; bigEndian < 2; bigEndian++) {
+        size_t written = scpiEncodeReal32(values, 3, bigEndian, block, sizeof(block));
+        CHECK(written == 4 + 12);
+        CHECK(scpiBlockHeader(block, written, &offset, &length) == 0 && offset == 4 && length == 12);
+        CHECK(scpiDecodeReal32(block + offset, length, bigEndian, decoded, 3) == 3);
+        CHECK(memcmp(values, decoded, sizeof(values)) == 0);
+    }
+    CHECK(memcmp(block, "#212", 4) == 0 && block[4] == 0x3F && block[5] == 0x80);  // 1.0f big-endian
+    CHECK(scpiDecodeReal32(block + 4, 12, 1, decoded, 2) == 2);
+    CHECK(scpiEncodeReal32(values, 3, 1, block, 10) == 0);
+}
+
+int main(void) {
+    testHeaders();
+    testResponses();
+    testBlocks();
+    return testResult("scpi-parse");
+}
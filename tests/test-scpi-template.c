@@ -0,0 +1,60 @@
+/*********************************************************************/
+/*                                                                   */
+/* Tests of scpi-template.c: compiling and rendering templates.      */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "scpi-template.h"
+#include "test.h"
+
+static void testRender(void) {
+    ScpiTemplate tmpl;
+    char out[64];
+
+    CHECK(templateCompile(&tmpl, ":CALC:MARK%d:X %f") == 0 && tmpl.numSlots == 2);
+    CHECK(templateRender(&tmpl, out, sizeof(out), 3, 1.5e9) == strlen(":CALC:MARK3:X 1500000000.000000"));
+    CHECK_STR(out, ":CALC:MARK3:X 1500000000.000000");
+    templateRender(&tmpl, out, sizeof(out), -12, -0.25);
+    CHECK_STR(out, ":CALC:MARK-12:X -0.250000");
+
+    CHECK(templateCompile(&tmpl, ":FREQ:CENT %.3f;:DISP:WIND:TRAC:Y:RLEV %.0f") == 0);
+    templateRender(&tmpl, out, sizeof(out), 2.4e9 + 0.0004, -10.5);
+    CHECK_STR(out, ":FREQ:CENT 2400000000.000;:DISP:WIND:TRAC:Y:RLEV -11");
+    templateRender(&tmpl, out, sizeof(out), 0.0005, 0.4);
+    CHECK_STR(out, ":FREQ:CENT 0.001;:DISP:WIND:TRAC:Y:RLEV 0");
+
+    CHECK(templateCompile(&tmpl, ":MMEM:STOR:TRAC TRACE1,\"%s\";:DISP:ENAB %d%%") == 0);
+    templateRender(&tmpl, out, sizeof(out), "C:\\a.csv", 1);
+    CHECK_STR(out, ":MMEM:STOR:TRAC TRACE1,\"C:\\a.csv\";:DISP:ENAB 1%");
+
+    /* Values beyond 64-bit integer arithmetic fall back to snprintf() */
+    char expected[64];
+    CHECK(templateCompile(&tmpl, "%.2f") == 0);
+    templateRender(&tmpl, out, sizeof(out), 1e30);
+    snprintf(expected, sizeof(expected), "%.2f", 1e30);
+    CHECK_STR(out, expected);
+}
+
+static void testErrors(void) {
+    ScpiTemplate tmpl;
+    char out[8];
+    char format[TEMPLATE_TEXT_BYTES + 1];
+
+    CHECK(templateCompile(&tmpl, ":FREQ %x") == 1);
+    CHECK(templateCompile(&tmpl, ":FREQ %") == 1);
+    CHECK(templateCompile(&tmpl, "%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d") == 1);
+    memset(format, 'A', TEMPLATE_TEXT_BYTES);
+    format[TEMPLATE_TEXT_BYTES] = '\0';
+    CHECK(templateCompile(&tmpl, format) == 1);
+
+    CHECK(templateCompile(&tmpl, ":SWE:POIN %d") == 0);
+    CHECK(templateRender(&tmpl, out, sizeof(out), 1001) == 0);
+}
+
+int main(void) {
+    testRender();
+    testErrors();
+    return testResult("scpi-template");
+}
@@ -0,0 +1,142 @@
+/*********************************************************************/
+/*                                                                   */
+/* Tests of scpi-validate.c: checking and learning headers, relative */
+/* headers, command lists and the per-model validator table.         */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "scpi-validate.h"
+#include "test.h"
+
+#define LIST_PATTERN "test-cmds-*.txt"          // Command lists of the table test, one per model
+#define LIST_N9020B "test-cmds-N9020B.txt"
+#define LIST_LEARNED "test-cmds-learned.txt"
+#define IDN_N9020B "Keysight Technologies,N9020B,MY12345678,A.30.05"
+#define IDN_FSV "Rohde&Schwarz,FSV-7,101234/007,3.40"
+
+#define CHECK_MESSAGE(validator, message, unknown) \
+    validatorCheck(validator, message, strlen(message), unknown, sizeof(unknown))
+
+static void testCheck(void) {
+    char unknown[64];
+    ScpiValidator* validator = validatorCreate(1);
+    CHECK(validator != NULL);
+    if (validator == NULL)
+        return;
+
+    CHECK(validatorStrict(validator) == 1);
+    CHECK(CHECK_MESSAGE(validator, "*IDN?", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, "*RST;*OPC?", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":SYST:ERR?", unknown) == 0);
+
+    int common = validatorCount(validator);
+    CHECK(validatorAdd(validator, "[:SENSe]:FREQuency:STARt") == 0);
+    CHECK(validatorAdd(validator, "[:SENSe]:FREQuency:STOP") == 0);
+    CHECK(validatorAdd(validator, "[:SENSe]:FREQuency:STARt") == 0);
+    CHECK(validatorAdd(validator, ":CALCulate:MARKer#:X?") == 0);
+    CHECK(validatorAdd(validator, ":") == 1);
+    CHECK(validatorAdd(validator, ":SENSe:FREQuency:STARt:AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA") == 1);
+    CHECK(validatorCount(validator) == common + 3);
+
+    CHECK(CHECK_MESSAGE(validator, ":SENS:FREQ:STAR 1e9", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":frequency:start 1e9;:FREQ:STOP 2e9", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":CALC:MARK4:X?", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":CALC:MARK4:X 1e9", unknown) == 1);
+    CHECK_STR(unknown, ":CALC:MARK4:X");
+    CHECK(CHECK_MESSAGE(validator, ":FREQ:STRT 1e9", unknown) == 1);
+    CHECK_STR(unknown, ":FREQ:STRT");
+
+    /* A relative header continues the path of the header before it */
+    CHECK(CHECK_MESSAGE(validator, ":FREQ:STAR 1e9;STOP 2e9", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":FREQ:STAR 1e9;CENT 2e9", unknown) == 1);
+    CHECK_STR(unknown, ":FREQ:CENT");
+    CHECK(CHECK_MESSAGE(validator, ":FREQ:STAR 1e9;*WAI;STOP 2e9", unknown) == 0);
+    validatorDestroy(validator);
+}
+
+static void testLearn(void) {
+    char unknown[64];
+    ScpiValidator* validator = validatorCreate(0);
+    CHECK(validator != NULL);
+    if (validator == NULL)
+        return;
+
+    const char* message = ":CALC:MARK2:X 1e9;Y?";
+    CHECK(validatorLearn(validator, message, strlen(message)) == 2);
+    CHECK(validatorLearn(validator, message, strlen(message)) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":calc:mark7:x 2e9", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":CALC:MARK:Y?", unknown) == 0);
+    CHECK(CHECK_MESSAGE(validator, ":CALC:MARK:Y 1", unknown) == 1);
+    CHECK(validatorLearn(validator, "*IDN?", 5) == 0);
+
+    CHECK(validatorSave(validator, LIST_LEARNED) == 0);
+    ScpiValidator* loaded = validatorCreate(1);
+    CHECK(loaded != NULL && validatorLoad(loaded, LIST_LEARNED) == 0);
+    if (loaded != NULL) {
+        CHECK(validatorCount(loaded) == validatorCount(validator));
+        CHECK(CHECK_MESSAGE(loaded, ":CALC:MARK3:Y?", unknown) == 0);
+        validatorDestroy(loaded);
+    }
+    remove(LIST_LEARNED);
+    validatorDestroy(validator);
+}
+
+static void testTable(void) {
+    char unknown[64];
+    FILE* file = fopen(LIST_N9020B, "w");
+    CHECK(file != NULL);
+    if (file == NULL)
+        return;
+    fprintf(file, "# N9020B\n\n  :INITiate:CONTinuous  \n:INITiate:CONTinuous?\n");
+    fclose(file);
+
+    ValidatorTable* strict = validatorTableCreate(LIST_PATTERN, 1);
+    CHECK(strict != NULL);
+    if (strict != NULL) {
+        ScpiValidator* analyzer = validatorTableSelect(strict, IDN_N9020B);
+        CHECK(analyzer != NULL && validatorTableSelect(strict, IDN_N9020B "\n") == analyzer);
+        if (analyzer != NULL) {
+            CHECK(CHECK_MESSAGE(analyzer, ":INIT:CONT OFF;:INIT:CONT?", unknown) == 0);
+            CHECK(CHECK_MESSAGE(analyzer, ":FREQ:STAR 1e9", unknown) == 1);
+        }
+        /* A strict table has no validator for a model without a command list */
+        CHECK(validatorTableSelect(strict, IDN_FSV) == NULL);
+        validatorTableDestroy(strict);
+    }
+
+    ValidatorTable* learning = validatorTableCreate(LIST_PATTERN, 0);
+    CHECK(learning != NULL);
+    if (learning != NULL) {
+        ScpiValidator* analyzer = validatorTableSelect(learning, IDN_N9020B);
+        ScpiValidator* other = validatorTableSelect(learning, IDN_FSV);
+        CHECK(analyzer != NULL && other != NULL && analyzer != other);
+        if (other != NULL) {
+            CHECK(CHECK_MESSAGE(other, ":INIT:CONT OFF", unknown) == 1);
+            CHECK(validatorLearn(other, ":DISP:ENAB OFF", 14) == 1);
+        }
+        CHECK(validatorTableSave(learning) == 0);
+        validatorTableDestroy(learning);
+    }
+    file = fopen("test-cmds-FSV-7.txt", "r");
+    CHECK(file != NULL);
+    if (file != NULL)
+        fclose(file);
+
+    ValidatorTable* shared = validatorTableCreate(LIST_N9020B, 1);
+    CHECK(shared != NULL);
+    if (shared != NULL) {
+        CHECK(validatorTableSelect(shared, IDN_FSV) == validatorTableSelect(shared, IDN_N9020B));
+        validatorTableDestroy(shared);
+    }
+    remove(LIST_N9020B);
+    remove("test-cmds-FSV-7.txt");
+}
+
+int main(void) {
+    testCheck();
+    testLearn();
+    testTable();
+    return testResult("scpi-validate");
+}
@@ -0,0 +1,127 @@
+/*********************************************************************/
+/*                                                                   */
+/* Tests of snapshot.c: noting the commands written, capturing the   */
+/* settings and applying setups, against the simulated analyzer of   */
+/* visa-sim.c.                                                       */
+/*                                                                   */
+/*********************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "visa.h"
+#include "visa-session.h"
+#include "snapshot.h"
+#include "visa-sim.h"
+#include "test.h"
+
+#define TEST_RESOURCE "SIM0::INSTR"
+
+#define NOTE(snapshot, message) snapshotNote(snapshot, message, strlen(message), 0)
+
+/* Index of a tracked setting, or -1 */
+static int settingIndex(const StateSnapshot* snapshot, const char* pattern, int suffix) {
+    for (int i = 0; i < snapshot->numSettings; i++) {
+        if (snapshot->settings[i].suffix == suffix && strcmp(snapshot->settings[i].pattern, pattern) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void testNote(void) {
+    StateSnapshot snapshot;
+    snapshotInit(&snapshot);
+    CHECK(snapshotTrack(&snapshot, "[:SENSe]:FREQuency:STARt", -1) == 0);
+    CHECK(snapshotTrack(&snapshot, "[:SENSe]:FREQuency:STOP", -1) == 0);
+    CHECK(snapshotTrack(&snapshot, ":CALCulate:MARKer#:X", 1) == 0);
+    CHECK(snapshotTrack(&snapshot, ":CALCulate:MARKer#:X", 2) == 0);
+    CHECK(snapshotTrack(&snapshot, ":CALCulate:MARKer#:X", 2) == 0 && snapshot.numSettings == 4);
+    SnapshotSetting* start = &snapshot.settings[0];
+    SnapshotSetting* stop = &snapshot.settings[1];
+    SnapshotSetting* marker1 = &snapshot.settings[2];
+    SnapshotSetting* marker2 = &snapshot.settings[3];
+
+    NOTE(&snapshot, ":SENS:FREQ:STAR 1e9 ;:frequency:stop 2E9;:CALC:MARK:X 1.5e9;:CALC:MARK2:X 1.6e9");
+    CHECK(start->known && stop->known && marker1->known && marker2->known);
+    CHECK_STR(start->value, "1e9");
+    CHECK_STR(stop->value, "2E9");
+    CHECK_STR(marker1->value, "1.5e9");
+
+    /* Queries change nothing; a failed write and a relative header leave the settings unknown */
+    NOTE(&snapshot, ":FREQ:STAR?;:CALC:MARK2:X?");
+    CHECK(start->known && marker2->known);
+    snapshotNote(&snapshot, ":FREQ:STAR 3e9", 14, 1);
+    CHECK(!start->known && stop->known);
+    NOTE(&snapshot, ":FREQ:STAR 3e9;STOP 4e9");
+    CHECK(start->known && !stop->known);
+
+    /* Turning one marker off forgets its settings, :CALCulate:MARKer:AOFF those of every marker */
+    NOTE(&snapshot, ":CALC:MARK2:STAT OFF");
+    CHECK(marker1->known && !marker2->known);
+    NOTE(&snapshot, ":CALC:MARK2:X 1.6e9;:CALC:MARK:AOFF");
+    CHECK(!marker1->known && !marker2->known && start->known);
+
+    NOTE(&snapshot, ":FREQ:STOP 4e9;*RST");
+    CHECK(!start->known && !stop->known);
+}
+
+static void testSession(ViSession resourceManager) {
+    ViStatus status;
+    int sent;
+    VisaSession* session = sessionOpen(resourceManager, TEST_RESOURCE, VISA_SIM_DEFAULT_TIMEOUT, &status);
+    CHECK(session != NULL);
+    if (session == NULL)
+        return;
+    StateSnapshot* snapshot = sessionSnapshot(session);
+    CHECK(snapshot != NULL && sessionSnapshot(session) == snapshot);
+    if (snapshot == NULL) {
+        sessionClose(session);
+        return;
+    }
+    CHECK(snapshotTrack(snapshot, "[:SENSe]:SWEep:POINts", -1) == 0);
+    CHECK(snapshotTrack(snapshot, ":CALCulate:MARKer#:X", 1) == 0);
+    int points = settingIndex(snapshot, "[:SENSe]:SWEep:POINts", -1);
+    int marker = settingIndex(snapshot, ":CALCulate:MARKer#:X", 1);
+
+    CHECK(sessionWrite(session, ":CALC:MARK1:X 1.5e9") >= VI_SUCCESS);
+    CHECK(snapshotCapture(session, snapshot) == VI_SUCCESS);
+    CHECK(snapshot->settings[points].known && snapshot->settings[marker].known);
+
+    /* The instrument already has the values captured, in another notation */
+    char pointsCommand[SNAPSHOT_VALUE_BYTES + 32];
+    snprintf(pointsCommand, sizeof(pointsCommand), ":SWE:POIN %s", snapshot->settings[points].value);
+    const char* same[] = { pointsCommand, "CALC:MARK:X 1.5E+09" };
+    CHECK(snapshotApply(session, snapshot, same, 2, &sent) == VI_SUCCESS && sent == 0);
+
+    const char* setup[] = { ":SWE:POIN 401", ":CALC:MARK1:X 1.5e9", ":FREQ:STOP 2e9" };
+    CHECK(snapshotApply(session, snapshot, setup, 3, &sent) == VI_SUCCESS && sent == 2);
+    CHECK(snapshotApply(session, snapshot, setup, 3, &sent) == VI_SUCCESS && sent == 1);
+    double value;
+    CHECK(sessionQueryDouble(session, ":SWE:POIN?", &value) >= VI_SUCCESS && value == 401);
+
+    CHECK(sessionWrite(session, ":CALC:MARK:AOFF") >= VI_SUCCESS);
+    CHECK(!snapshot->settings[marker].known && snapshot->settings[points].known);
+
+    /* In checked mode a value the instrument rejected is not cached */
+    int numErrors;
+    CHECK(sessionDrainErrors(session, NULL, 0, &numErrors) == VI_SUCCESS && numErrors == 0);
+    sessionSetChecked(session, 1);
+    CHECK(sessionWrite(session, ":SWE:POIN 1") == SESSION_ERROR_SCPI);
+    CHECK(!snapshot->settings[points].known);
+    const char* rejected[] = { ":SWE:POIN 1" };
+    CHECK(snapshotApply(session, snapshot, rejected, 1, &sent) == SESSION_ERROR_SCPI && sent == 1);
+    CHECK(!snapshot->settings[points].known);
+    CHECK(sessionQueryDouble(session, ":SWE:POIN?", &value) >= VI_SUCCESS && value == 401);
+    sessionSetChecked(session, 0);
+    sessionClose(session);
+}
+
+int main(void) {
+    ViSession resourceManager;
+
+    testNote();
+    visaSimConfigure(TEST_RESOURCE, 0);
+    CHECK(viOpenDefaultRM(&resourceManager) >= VI_SUCCESS);
+    testSession(resourceManager);
+    viClose(resourceManager);
+    return testResult("snapshot");
+}
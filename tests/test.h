@@ -0,0 +1,39 @@
+// file: test.h
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+/* Failed checks of the test program; main() returns testResult() so CTest sees the failure */
+static int testFailures;
+
+/* Reports a failed condition with its location and carries on, so one run lists every failure */
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_STR(actual, expected) \
+    do { \
+        const char* actualText = (actual); \
+        const char* expectedText = (expected); \
+        if (strcmp(actualText, expectedText) != 0) { \
+            fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #actual, actualText, \
+                expectedText); \
+            testFailures++; \
+        } \
+    } while (0)
+
+static int testResult(const char* name) {
+    if (testFailures > 0)
+        fprintf(stderr, "%s: %d check%s failed\n", name, testFailures, testFailures == 1 ? "" : "s");
+    else
+        printf("%s: passed\n", name);
+    return testFailures > 0;
+}
+
+#endif